@@ -0,0 +1,281 @@
+#include "AssetPack.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace initium {
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Maps the whole file read-only and asks for it to be read in ahead of
+// use. Returns null with size 0 for an empty file, and throws if the file
+// can't be opened or mapped.
+const uint8_t* mapFile(const std::filesystem::path& path, uint64_t& size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("cannot open asset pack " + path.string());
+	}
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		size = 0;
+		return nullptr;
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	// The view keeps both alive.
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	if (!view) {
+		throw std::runtime_error("cannot map asset pack " + path.string());
+	}
+	size = static_cast<uint64_t>(fileSize.QuadPart);
+	WIN32_MEMORY_RANGE_ENTRY range{ view, static_cast<SIZE_T>(size) };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	return static_cast<const uint8_t*>(view);
+#else
+	int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0) {
+		throw std::runtime_error("cannot open asset pack " + path.string());
+	}
+	struct stat status{};
+	if (::fstat(file, &status) != 0 || status.st_size == 0) {
+		::close(file);
+		size = 0;
+		return nullptr;
+	}
+	void* view = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping keeps the file open.
+	::close(file);
+	if (view == MAP_FAILED) {
+		throw std::runtime_error("cannot map asset pack " + path.string());
+	}
+	size = static_cast<uint64_t>(status.st_size);
+	::madvise(view, static_cast<size_t>(size), MADV_WILLNEED);
+	return static_cast<const uint8_t*>(view);
+#endif
+}
+
+void unmapFile(const uint8_t* data, uint64_t size) {
+	if (!data) {
+		return;
+	}
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(data);
+#else
+	::munmap(const_cast<uint8_t*>(data), static_cast<size_t>(size));
+#endif
+}
+
+}
+
+uint64_t hashAssetName(std::string_view name) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : name) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+AssetPack::AssetPack(const std::filesystem::path& path) : m_path(path) {
+	auto start = std::chrono::steady_clock::now();
+	m_data = mapFile(path, m_size);
+
+	// Sizes are checked against what is left rather than by adding to
+	// offsets, which a corrupt file could make overflow.
+	auto fits = [this](uint64_t offset, uint64_t size) { return offset <= m_size && size <= m_size - offset; };
+	auto corrupt = [&](const char* problem) {
+		unmapFile(m_data, m_size);
+		throw std::runtime_error("asset pack " + path.string() + " " + problem);
+	};
+
+	if (m_size < sizeof(AssetPackHeader)) {
+		corrupt("is too small");
+	}
+	m_header = reinterpret_cast<const AssetPackHeader*>(m_data);
+	if (m_header->magic != AssetPackHeader::kMagic || m_header->version != AssetPackHeader::kVersion) {
+		corrupt("has an unknown format");
+	}
+	uint32_t slotCount = m_header->slotCount;
+	if (m_header->fileSize != m_size || slotCount == 0 || (slotCount & (slotCount - 1)) != 0 || slotCount < m_header->entryCount
+		|| m_header->entriesOffset % alignof(AssetPackEntry) != 0 || m_header->slotsOffset % alignof(uint32_t) != 0
+		|| !fits(m_header->entriesOffset, static_cast<uint64_t>(m_header->entryCount) * sizeof(AssetPackEntry))
+		|| !fits(m_header->slotsOffset, static_cast<uint64_t>(slotCount) * sizeof(uint32_t)) || !fits(m_header->namesOffset, 0)) {
+		corrupt("has a bad table of contents");
+	}
+	m_entries = reinterpret_cast<const AssetPackEntry*>(m_data + m_header->entriesOffset);
+	m_slots = reinterpret_cast<const uint32_t*>(m_data + m_header->slotsOffset);
+	m_names = reinterpret_cast<const char*>(m_data + m_header->namesOffset);
+
+	uint64_t namesSize = m_size - m_header->namesOffset;
+	for (uint32_t i = 0; i < m_header->entryCount; i++) {
+		const AssetPackEntry& entry = m_entries[i];
+		if (entry.offset % kDataAlignment != 0 || !fits(entry.offset, entry.size) || entry.nameOffset > namesSize
+			|| entry.nameLength > namesSize - entry.nameOffset) {
+			corrupt("has an asset out of bounds");
+		}
+	}
+	m_openMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+AssetPack::~AssetPack() {
+	unmapFile(m_data, m_size);
+}
+
+Asset AssetPack::find(std::string_view name) const {
+	uint64_t hash = hashAssetName(name);
+	uint32_t mask = m_header->slotCount - 1;
+	for (uint32_t probe = 0; probe <= mask; probe++) {
+		uint32_t slot = m_slots[(hash + probe) & mask];
+		if (slot == 0) {
+			break;
+		}
+		if (slot <= m_header->entryCount) {
+			const AssetPackEntry& entry = m_entries[slot - 1];
+			if (entry.nameHash == hash && this->name(entry) == name) {
+				return asset(slot - 1);
+			}
+		}
+	}
+	return {};
+}
+
+Asset AssetPack::asset(uint32_t index) const {
+	const AssetPackEntry& entry = m_entries[index];
+	return { &entry, m_data + entry.offset };
+}
+
+std::string_view AssetPack::name(const AssetPackEntry& entry) const {
+	return { m_names + entry.nameOffset, entry.nameLength };
+}
+
+void AssetPack::reportStats() const {
+	std::printf("asset pack: %s, %u assets, %.1f MiB mapped, opened in %.2f ms\n", m_path.string().c_str(), assetCount(),
+		static_cast<double>(m_size) / (1 << 20), m_openMilliseconds);
+}
+
+void AssetPackWriter::addBuffer(std::string name, const void* data, uint64_t size) {
+	PendingAsset& asset = m_assets.emplace_back();
+	asset.name = std::move(name);
+	asset.entry.type = AssetType::Buffer;
+	asset.data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+}
+
+void AssetPackWriter::addTexture(std::string name, uint32_t format, uint32_t width, uint32_t height, uint32_t mipLevels, const void* data,
+	uint64_t size) {
+	PendingAsset& asset = m_assets.emplace_back();
+	asset.name = std::move(name);
+	asset.entry.type = AssetType::Texture;
+	asset.entry.format = format;
+	asset.entry.width = width;
+	asset.entry.height = height;
+	asset.entry.mipLevels = mipLevels;
+	asset.data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+}
+
+bool AssetPackWriter::write(const std::filesystem::path& path) const {
+	AssetPackHeader header;
+	header.entryCount = static_cast<uint32_t>(m_assets.size());
+	// At most half full, so probes stay short.
+	header.slotCount = 1;
+	while (header.slotCount < header.entryCount * 2) {
+		header.slotCount *= 2;
+	}
+	header.entriesOffset = alignUp(sizeof(AssetPackHeader), alignof(AssetPackEntry));
+	header.slotsOffset = header.entriesOffset + m_assets.size() * sizeof(AssetPackEntry);
+	header.namesOffset = header.slotsOffset + static_cast<uint64_t>(header.slotCount) * sizeof(uint32_t);
+
+	std::vector<AssetPackEntry> entries(m_assets.size());
+	std::vector<uint32_t> slots(header.slotCount, 0);
+	std::string names;
+	for (size_t i = 0; i < m_assets.size(); i++) {
+		const PendingAsset& asset = m_assets[i];
+		AssetPackEntry& entry = entries[i];
+		entry = asset.entry;
+		entry.nameHash = hashAssetName(asset.name);
+		entry.nameOffset = static_cast<uint32_t>(names.size());
+		entry.nameLength = static_cast<uint32_t>(asset.name.size());
+		entry.size = asset.data.size();
+		names += asset.name;
+
+		uint32_t mask = header.slotCount - 1;
+		uint32_t slot = static_cast<uint32_t>(entry.nameHash & mask);
+		for (; slots[slot] != 0; slot = (slot + 1) & mask) {
+			if (m_assets[slots[slot] - 1].name == asset.name) {
+				std::fprintf(stderr, "asset pack: %s is in the pack twice\n", asset.name.c_str());
+				return false;
+			}
+		}
+		slots[slot] = static_cast<uint32_t>(i + 1);
+	}
+	uint64_t offset = alignUp(header.namesOffset + names.size(), AssetPack::kDataAlignment);
+	for (size_t i = 0; i < entries.size(); i++) {
+		entries[i].offset = offset;
+		offset = alignUp(offset + entries[i].size, AssetPack::kDataAlignment);
+	}
+	header.fileSize = entries.empty() ? header.namesOffset + names.size() : entries.back().offset + entries.back().size;
+
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			return false;
+		}
+		static const char kPadding[AssetPack::kDataAlignment] = {};
+		auto padTo = [&file](uint64_t position) {
+			uint64_t current = static_cast<uint64_t>(file.tellp());
+			file.write(kPadding, static_cast<std::streamsize>(position - current));
+		};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		padTo(header.entriesOffset);
+		file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(AssetPackEntry)));
+		file.write(reinterpret_cast<const char*>(slots.data()), static_cast<std::streamsize>(slots.size() * sizeof(uint32_t)));
+		file.write(names.data(), static_cast<std::streamsize>(names.size()));
+		for (size_t i = 0; i < entries.size(); i++) {
+			padTo(entries[i].offset);
+			file.write(reinterpret_cast<const char*>(m_assets[i].data.data()), static_cast<std::streamsize>(m_assets[i].data.size()));
+		}
+		file.flush();
+		if (!file) {
+			file.close();
+			std::error_code ignored;
+			std::filesystem::remove(temporary, ignored);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error) {
+		std::error_code ignored;
+		std::filesystem::remove(temporary, ignored);
+		return false;
+	}
+	return true;
+}
+
+}
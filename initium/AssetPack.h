@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace initium {
+
+enum class AssetType : uint32_t {
+	// Raw bytes, such as a vertex or index buffer.
+	Buffer = 0,
+	// Texels of a 2D image, tightly packed, mip levels one after another.
+	Texture = 1,
+};
+
+// The pack starts with this header, then the entries, the hash table and
+// the names, then each asset's data at kDataAlignment. Everything is read in
+// place from the mapping, so the layout is fixed-size, naturally aligned and
+// little-endian.
+struct AssetPackHeader {
+	static constexpr uint32_t kMagic = 0x4B415049; // "IPAK"
+	// Also bump it when the layout of anything stored in packs changes,
+	// such as GpuMesh or GpuInstance.
+	static constexpr uint32_t kVersion = 1;
+
+	uint32_t magic = kMagic;
+	uint32_t version = kVersion;
+	uint32_t entryCount = 0;
+	// Open addressing with linear probing: a power of two, each slot an
+	// entry index plus one, or 0 when empty.
+	uint32_t slotCount = 0;
+	uint64_t entriesOffset = 0;
+	uint64_t slotsOffset = 0;
+	uint64_t namesOffset = 0;
+	uint64_t fileSize = 0;
+};
+
+struct AssetPackEntry {
+	uint64_t nameHash = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	// Into the names, which are not terminated.
+	uint32_t nameOffset = 0;
+	uint32_t nameLength = 0;
+	AssetType type = AssetType::Buffer;
+	// Textures only; format is a VkFormat.
+	uint32_t format = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t mipLevels = 0;
+	uint32_t reserved = 0;
+};
+
+// An asset where it sits in the mapped pack, valid as long as the pack.
+struct Asset {
+	const AssetPackEntry* entry = nullptr;
+	const uint8_t* data = nullptr;
+
+	explicit operator bool() const { return entry != nullptr; }
+	uint64_t size() const { return entry->size; }
+};
+
+// 64-bit FNV-1a of the name, as the pack's hash table uses.
+uint64_t hashAssetName(std::string_view name);
+
+// Read-only archive of GPU-ready assets: buffers and textures laid out as
+// the GPU wants them, so loading one is a copy from the mapping straight
+// into the staging ring, with no parsing and no intermediate buffers. The
+// whole file is memory-mapped on open and the OS is asked to start reading
+// it in, which overlaps with device creation. Opening reads only the table
+// of contents, and lookups hash the name into the pack's own hash table.
+//
+// The table of contents is bounds-checked on open but the data is not
+// checksummed: that would read every page up front, which is what mapping
+// avoids. Thread-safe, as it is never written.
+class AssetPack {
+public:
+	// Of every asset's data in the file: a cache line, more than any element
+	// type needs, so copies out of the mapping start on a line.
+	static constexpr uint64_t kDataAlignment = 64;
+
+	// Throws std::runtime_error if the file is missing, can't be mapped or
+	// isn't a pack of this version.
+	explicit AssetPack(const std::filesystem::path& path);
+	~AssetPack();
+
+	AssetPack(const AssetPack&) = delete;
+	AssetPack& operator=(const AssetPack&) = delete;
+
+	// An empty Asset when the pack has none of that name.
+	Asset find(std::string_view name) const;
+	uint32_t assetCount() const { return m_header->entryCount; }
+	Asset asset(uint32_t index) const;
+	std::string_view name(const AssetPackEntry& entry) const;
+
+	const std::filesystem::path& path() const { return m_path; }
+	uint64_t mappedBytes() const { return m_size; }
+	void reportStats() const;
+
+private:
+	std::filesystem::path m_path;
+	const uint8_t* m_data = nullptr;
+	uint64_t m_size = 0;
+	const AssetPackHeader* m_header = nullptr;
+	const AssetPackEntry* m_entries = nullptr;
+	const uint32_t* m_slots = nullptr;
+	const char* m_names = nullptr;
+	double m_openMilliseconds = 0.0;
+};
+
+// Builds a pack from assets in memory; the offline side of AssetPack.
+class AssetPackWriter {
+public:
+	void addBuffer(std::string name, const void* data, uint64_t size);
+	void addTexture(std::string name, uint32_t format, uint32_t width, uint32_t height, uint32_t mipLevels, const void* data, uint64_t size);
+
+	// Writes to a temporary file next to path and renames it over, so a
+	// failed write never leaves a truncated pack behind. Fails on duplicate
+	// names.
+	bool write(const std::filesystem::path& path) const;
+
+	size_t assetCount() const { return m_assets.size(); }
+
+private:
+	struct PendingAsset {
+		std::string name;
+		AssetPackEntry entry;
+		std::vector<uint8_t> data;
+	};
+
+	std::vector<PendingAsset> m_assets;
+};
+
+}
@@ -0,0 +1,122 @@
+#include "AsyncCompute.h"
+
+#include <algorithm>
+
+namespace initium {
+
+AsyncCompute::AsyncCompute(const VulkanContext& context) : m_context(context) {
+	if (!available()) {
+		return;
+	}
+	VkDevice device = context.device();
+
+	VkCommandPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = family();
+	vkCheck(vkCreateCommandPool(device, &poolInfo, m_context.allocationCallbacks(), &m_commandPool), "vkCreateCommandPool");
+
+	VkCommandBufferAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	allocateInfo.commandPool = m_commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+	for (Batch& batch : m_batches) {
+		vkCheck(vkAllocateCommandBuffers(device, &allocateInfo, &batch.commandBuffer), "vkAllocateCommandBuffers");
+	}
+
+	VkSemaphoreTypeCreateInfo typeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	semaphoreInfo.pNext = &typeInfo;
+	vkCheck(vkCreateSemaphore(device, &semaphoreInfo, m_context.allocationCallbacks(), &m_timeline), "vkCreateSemaphore");
+}
+
+AsyncCompute::~AsyncCompute() {
+	if (!available()) {
+		return;
+	}
+	waitIdle();
+	VkDevice device = m_context.device();
+	vkDestroySemaphore(device, m_timeline, m_context.allocationCallbacks());
+	vkDestroyCommandPool(device, m_commandPool, m_context.allocationCallbacks());
+}
+
+VkCommandBuffer AsyncCompute::begin() {
+	Batch& batch = m_batches[m_current];
+	if (!m_recording) {
+		// Batches are reused round-robin, so this one is the oldest in flight.
+		wait(batch.timelineValue);
+
+		VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkCheck(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+		m_recording = true;
+	}
+	return batch.commandBuffer;
+}
+
+uint64_t AsyncCompute::submit(const std::vector<VkSemaphoreSubmitInfo>& waits) {
+	Batch& batch = m_batches[m_current];
+	vkCheck(vkEndCommandBuffer(batch.commandBuffer), "vkEndCommandBuffer");
+	m_recording = false;
+
+	batch.timelineValue = ++m_submittedValue;
+
+	VkCommandBufferSubmitInfo commandBufferInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+	commandBufferInfo.commandBuffer = batch.commandBuffer;
+
+	VkSemaphoreSubmitInfo signalInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+	signalInfo.semaphore = m_timeline;
+	signalInfo.value = batch.timelineValue;
+	signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo2 submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+	submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size());
+	submitInfo.pWaitSemaphoreInfos = waits.data();
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandBufferInfo;
+	submitInfo.signalSemaphoreInfoCount = 1;
+	submitInfo.pSignalSemaphoreInfos = &signalInfo;
+	vkCheck(vkQueueSubmit2(m_context.computeQueue(), 1, &submitInfo, VK_NULL_HANDLE), "vkQueueSubmit2");
+
+	m_current = (m_current + 1) % kBatchCount;
+	return batch.timelineValue;
+}
+
+VkSemaphoreSubmitInfo AsyncCompute::waitInfo(uint64_t value, VkPipelineStageFlags2 stages) const {
+	VkSemaphoreSubmitInfo info{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+	info.semaphore = m_timeline;
+	info.value = value;
+	info.stageMask = stages;
+	return info;
+}
+
+uint64_t AsyncCompute::completedValue() {
+	if (!available()) {
+		return 0;
+	}
+	uint64_t value = 0;
+	vkCheck(vkGetSemaphoreCounterValue(m_context.device(), m_timeline, &value), "vkGetSemaphoreCounterValue");
+	m_completedValue = std::max(m_completedValue, value);
+	return m_completedValue;
+}
+
+void AsyncCompute::waitIdle() {
+	if (available()) {
+		wait(m_submittedValue);
+	}
+}
+
+void AsyncCompute::wait(uint64_t value) {
+	if (value <= m_completedValue) {
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_timeline;
+	waitInfo.pValues = &value;
+	vkCheck(vkWaitSemaphores(m_context.device(), &waitInfo, UINT64_MAX), "vkWaitSemaphores");
+	m_completedValue = value;
+}
+
+}
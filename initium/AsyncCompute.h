@@ -0,0 +1,66 @@
+#pragma once
+
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace initium {
+
+// Submissions to the compute queue, when the device has one separate from
+// graphics, paced by their own timeline semaphore. Command buffers are
+// recycled round-robin once the timeline has passed the submission that
+// used them. Consumers on the graphics queue wait on waitInfo(). Not
+// thread-safe: lives on the render thread with the Renderer.
+class AsyncCompute {
+public:
+	explicit AsyncCompute(const VulkanContext& context);
+	~AsyncCompute();
+
+	AsyncCompute(const AsyncCompute&) = delete;
+	AsyncCompute& operator=(const AsyncCompute&) = delete;
+
+	// False when compute shares the graphics queue; nothing else may be
+	// called then.
+	bool available() const { return m_context.hasDedicatedCompute(); }
+	uint32_t family() const { return m_context.queueFamilies().compute.family; }
+	uint32_t timestampValidBits() const { return m_context.queueFamilies().compute.timestampValidBits; }
+
+	// A command buffer, already begun, for the next submission. Blocks if
+	// every batch is still in flight.
+	VkCommandBuffer begin();
+	// Ends and submits the command buffer from begin(), after waits. Returns
+	// the timeline value that signals its completion.
+	uint64_t submit(const std::vector<VkSemaphoreSubmitInfo>& waits = {});
+
+	// Wait for value at stages; add it to the consuming submit.
+	VkSemaphoreSubmitInfo waitInfo(uint64_t value, VkPipelineStageFlags2 stages) const;
+
+	VkSemaphore timeline() const { return m_timeline; }
+	uint64_t submittedValue() const { return m_submittedValue; }
+	uint64_t completedValue();
+	void waitIdle();
+
+private:
+	static constexpr uint32_t kBatchCount = 8;
+
+	struct Batch {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint64_t timelineValue = 0;
+	};
+
+	void wait(uint64_t value);
+
+	const VulkanContext& m_context;
+
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	VkSemaphore m_timeline = VK_NULL_HANDLE;
+	uint64_t m_submittedValue = 0;
+	uint64_t m_completedValue = 0;
+
+	Batch m_batches[kBatchCount];
+	uint32_t m_current = 0;
+	bool m_recording = false;
+};
+
+}
@@ -0,0 +1,139 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace initium {
+
+namespace {
+
+void appendJsonString(std::string& out, const std::string& text) {
+	out += '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+		}
+		out += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+	}
+	out += '"';
+}
+
+void appendSummary(std::string& out, const char* name, const FrameTimeSummary& summary) {
+	char text[256];
+	std::snprintf(text, sizeof(text),
+		"  \"%s\": { \"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n", name, summary.min,
+		summary.average, summary.p50, summary.p95, summary.p99, summary.max);
+	out += text;
+}
+
+}
+
+FrameTimeSummary summarizeFrameTimes(std::vector<double> milliseconds) {
+	FrameTimeSummary summary;
+	if (milliseconds.empty()) {
+		return summary;
+	}
+	std::sort(milliseconds.begin(), milliseconds.end());
+	auto percentile = [&](double fraction) {
+		size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(milliseconds.size())));
+		return milliseconds[std::clamp<size_t>(rank, 1, milliseconds.size()) - 1];
+	};
+	double total = 0.0;
+	for (double value : milliseconds) {
+		total += value;
+	}
+	summary.min = milliseconds.front();
+	summary.average = total / static_cast<double>(milliseconds.size());
+	summary.p50 = percentile(0.50);
+	summary.p95 = percentile(0.95);
+	summary.p99 = percentile(0.99);
+	summary.max = milliseconds.back();
+	return summary;
+}
+
+Benchmark::Benchmark(uint32_t warmupFrames, std::filesystem::path output)
+	: m_warmupFrames(std::max(warmupFrames, 1u)), m_output(std::move(output)) {}
+
+void Benchmark::frameRendered(Renderer& renderer, const FrameSnapshot& snapshot, std::chrono::steady_clock::duration renderThreadTime) {
+	auto now = std::chrono::steady_clock::now();
+	m_frames++;
+	if (m_frames == m_warmupFrames) {
+		// Pass timings of frames still in flight land in the measured totals,
+		// a handful among hundreds.
+		renderer.graph().resetTimings();
+	} else if (m_frames > m_warmupFrames) {
+		m_frameTimes.push_back(std::chrono::duration<double, std::milli>(now - m_lastFrameEnd).count());
+		m_renderThreadTimes.push_back(std::chrono::duration<double, std::milli>(renderThreadTime).count());
+	}
+	m_lastFrameEnd = now;
+	m_width = snapshot.framebufferWidth;
+	m_height = snapshot.framebufferHeight;
+}
+
+bool Benchmark::finish(const VulkanContext& context, Renderer& renderer, const Swapchain* swapchain) const {
+	FrameTimeSummary frames = summarizeFrameTimes(m_frameTimes);
+	FrameTimeSummary renderThread = summarizeFrameTimes(m_renderThreadTimes);
+	GpuScene* scene = renderer.scene();
+
+	std::string json = "{\n  \"device\": ";
+	appendJsonString(json, context.properties().deviceName);
+	char text[512];
+	std::snprintf(text, sizeof(text),
+		",\n  \"headless\": %s,\n  \"presentMode\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"sprites\": %u,\n  \"instances\": %u,\n  \"sceneGeometry\": \"%s\",\n"
+		"  \"asyncCompute\": %s,\n  \"timestep\": %.6f,\n  \"warmupFrames\": %u,\n  \"frames\": %llu,\n",
+		swapchain ? "false" : "true", swapchain ? presentModeName(swapchain->presentMode()) : "none", m_width, m_height, renderer.spriteCount(), scene ? scene->instanceCount() : 0,
+		scene ? sceneGeometryName(scene->geometry()) : "none", renderer.asyncCompute() && renderer.asyncComputeAvailable() ? "true" : "false",
+		kTimestep, m_warmupFrames, static_cast<unsigned long long>(m_frameTimes.size()));
+	json += text;
+	appendSummary(json, "frameTimeMs", frames);
+	appendSummary(json, "renderThreadMs", renderThread);
+
+	// GPU time of each pass over the measured frames, from the render
+	// graph's timestamps; empty on devices that can't time them.
+	json += "  \"passes\": [";
+	bool first = true;
+	for (const RenderGraphPassTiming& timing : renderer.graph().passTimings()) {
+		if (timing.samples == 0) {
+			continue;
+		}
+		json += first ? "\n    { \"name\": " : ",\n    { \"name\": ";
+		first = false;
+		appendJsonString(json, timing.name);
+		std::snprintf(text, sizeof(text), ", \"queue\": \"%s\", \"avgMs\": %.4f, \"samples\": %llu", timing.asyncCompute ? "compute" : "graphics",
+			timing.averageMilliseconds(), static_cast<unsigned long long>(timing.samples));
+		json += text;
+		if (timing.statisticsSamples > 0) {
+			double samples = static_cast<double>(timing.statisticsSamples);
+			const RenderGraphPipelineStatistics& total = timing.totalStatistics;
+			std::snprintf(text, sizeof(text),
+				", \"inputPrimitives\": %.0f, \"clippingPrimitives\": %.0f, \"vertexInvocations\": %.0f, \"fragmentInvocations\": %.0f,"
+				" \"computeInvocations\": %.0f",
+				static_cast<double>(total.inputPrimitives) / samples, static_cast<double>(total.clippingPrimitives) / samples,
+				static_cast<double>(total.vertexInvocations) / samples, static_cast<double>(total.fragmentInvocations) / samples,
+				static_cast<double>(total.computeInvocations) / samples);
+			json += text;
+		}
+		json += " }";
+	}
+	json += first ? "]\n}\n" : "\n  ]\n}\n";
+
+	std::printf("benchmark: %llu frames after %u warm-up, frame time min %.3f / avg %.3f / p50 %.3f / p95 %.3f / p99 %.3f / max %.3f ms\n",
+		static_cast<unsigned long long>(m_frameTimes.size()), m_warmupFrames, frames.min, frames.average, frames.p50, frames.p95, frames.p99,
+		frames.max);
+	std::printf("benchmark: presenting with %s\n", swapchain ? presentModeName(swapchain->presentMode()) : "none (headless)");
+
+	std::ofstream file(m_output, std::ios::binary | std::ios::trunc);
+	file.write(json.data(), static_cast<std::streamsize>(json.size()));
+	file.close();
+	if (!file) {
+		std::fprintf(stderr, "benchmark: failed to write %s\n", m_output.string().c_str());
+		return false;
+	}
+	std::printf("benchmark: wrote %s\n", m_output.string().c_str());
+	return true;
+}
+
+}
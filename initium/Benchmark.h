@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Renderer.h"
+#include "RenderThread.h"
+#include "Swapchain.h"
+#include "VulkanContext.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace initium {
+
+// Nearest-rank percentiles of a set of frame times, in milliseconds.
+struct FrameTimeSummary {
+	double min = 0.0;
+	double average = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+FrameTimeSummary summarizeFrameTimes(std::vector<double> milliseconds);
+
+// Times a fixed run of frames for comparing builds. The application drives
+// it with a fixed timestep, so every run renders the same frames whatever
+// the machine; the first warmupFrames absorb pipeline creation and uploads
+// and are not measured. A frame's time is the interval between it and the
+// previous frame finishing on the render thread, which is what the slowest
+// of CPU, GPU and presentation allows.
+class Benchmark {
+public:
+	static constexpr double kTimestep = 1.0 / 60.0;
+
+	// At least one warm-up frame: the first measured interval starts at the
+	// end of the last one.
+	Benchmark(uint32_t warmupFrames, std::filesystem::path output);
+
+	Benchmark(const Benchmark&) = delete;
+	Benchmark& operator=(const Benchmark&) = delete;
+
+	// Render thread, after each frame, with how long the render thread
+	// spent on it.
+	void frameRendered(Renderer& renderer, const FrameSnapshot& snapshot, std::chrono::steady_clock::duration renderThreadTime);
+
+	// Once the render thread has stopped: writes the results as JSON to the
+	// output path and prints a summary. swapchain is null for a headless run.
+	bool finish(const VulkanContext& context, Renderer& renderer, const Swapchain* swapchain) const;
+
+private:
+	uint32_t m_warmupFrames;
+	std::filesystem::path m_output;
+	uint64_t m_frames = 0;
+	std::chrono::steady_clock::time_point m_lastFrameEnd;
+	int m_width = 0;
+	int m_height = 0;
+	std::vector<double> m_frameTimes;
+	std::vector<double> m_renderThreadTimes;
+};
+
+}
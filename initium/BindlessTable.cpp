@@ -0,0 +1,261 @@
+#include "BindlessTable.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+namespace initium {
+
+namespace {
+
+const char* typeName(BindlessType type) {
+	switch (type) {
+	case BindlessType::SampledImage: return "textures";
+	case BindlessType::Sampler: return "samplers";
+	case BindlessType::StorageBuffer: return "storage buffers";
+	case BindlessType::StorageImage: return "storage images";
+	default: return "?";
+	}
+}
+
+}
+
+BindlessTable::BindlessTable(const VulkanContext& context, const BindlessTableCreateInfo& createInfo)
+	: m_context(context), m_pushConstantBytes(std::min(createInfo.pushConstantBytes, context.properties().limits.maxPushConstantsSize)) {
+	VkDevice device = context.device();
+
+	VkPhysicalDeviceVulkan12Properties limits{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+	VkPhysicalDeviceProperties2 properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	properties.pNext = &limits;
+	vkGetPhysicalDeviceProperties2(context.physicalDevice(), &properties);
+
+	uint32_t sampledImages = std::min({ createInfo.sampledImages, limits.maxDescriptorSetUpdateAfterBindSampledImages,
+		limits.maxPerStageDescriptorUpdateAfterBindSampledImages });
+	uint32_t samplers = std::min({ createInfo.samplers, limits.maxDescriptorSetUpdateAfterBindSamplers,
+		limits.maxPerStageDescriptorUpdateAfterBindSamplers });
+	uint32_t storageBuffers = std::min({ createInfo.storageBuffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+		limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+	uint32_t storageImages = std::min({ createInfo.storageImages, limits.maxDescriptorSetUpdateAfterBindStorageImages,
+		limits.maxPerStageDescriptorUpdateAfterBindStorageImages });
+	// Every stage sees the whole table, so it also has to fit the per-stage
+	// total. Samplers and storage images are few; the two large arrays split
+	// what remains.
+	if (sampledImages + samplers + storageBuffers + storageImages > limits.maxPerStageUpdateAfterBindResources) {
+		uint32_t share = (limits.maxPerStageUpdateAfterBindResources
+			- std::min(samplers + storageImages, limits.maxPerStageUpdateAfterBindResources)) / 2;
+		sampledImages = std::min(sampledImages, share);
+		storageBuffers = std::min(storageBuffers, share);
+	}
+	m_arrays[static_cast<size_t>(BindlessType::SampledImage)].capacity = sampledImages;
+	m_arrays[static_cast<size_t>(BindlessType::Sampler)].capacity = samplers;
+	m_arrays[static_cast<size_t>(BindlessType::StorageBuffer)].capacity = storageBuffers;
+	m_arrays[static_cast<size_t>(BindlessType::StorageImage)].capacity = storageImages;
+
+	const VkDescriptorSetLayoutBinding bindings[] = {
+		{ kSampledImageBinding, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, sampledImages, VK_SHADER_STAGE_ALL, nullptr },
+		{ kSamplerBinding, VK_DESCRIPTOR_TYPE_SAMPLER, samplers, VK_SHADER_STAGE_ALL, nullptr },
+		{ kStorageBufferBinding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBuffers, VK_SHADER_STAGE_ALL, nullptr },
+		{ kStorageImageBinding, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, storageImages, VK_SHADER_STAGE_ALL, nullptr },
+	};
+	const VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT
+		| VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	const VkDescriptorBindingFlags bindingFlags[] = { flags, flags, flags, flags };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+	flagsInfo.bindingCount = static_cast<uint32_t>(std::size(bindingFlags));
+	flagsInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layoutInfo.pNext = &flagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(std::size(bindings));
+	layoutInfo.pBindings = bindings;
+	vkCheck(vkCreateDescriptorSetLayout(device, &layoutInfo, context.allocationCallbacks(), &m_setLayout), "vkCreateDescriptorSetLayout");
+
+	const VkDescriptorPoolSize poolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, sampledImages },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, samplers },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, storageBuffers },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, storageImages },
+	};
+	VkDescriptorPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(std::size(poolSizes));
+	poolInfo.pPoolSizes = poolSizes;
+
+	VkPushConstantRange pushConstants{ VK_SHADER_STAGE_ALL, 0, m_pushConstantBytes };
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+
+	try {
+		vkCheck(vkCreateDescriptorPool(device, &poolInfo, context.allocationCallbacks(), &m_pool), "vkCreateDescriptorPool");
+
+		VkDescriptorSetAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+		allocateInfo.descriptorPool = m_pool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &m_setLayout;
+		vkCheck(vkAllocateDescriptorSets(device, &allocateInfo, &m_set), "vkAllocateDescriptorSets");
+
+		vkCheck(vkCreatePipelineLayout(device, &pipelineLayoutInfo, context.allocationCallbacks(), &m_pipelineLayout), "vkCreatePipelineLayout");
+	} catch (...) {
+		vkDestroyDescriptorPool(device, m_pool, context.allocationCallbacks());
+		vkDestroyDescriptorSetLayout(device, m_setLayout, context.allocationCallbacks());
+		throw;
+	}
+}
+
+BindlessTable::~BindlessTable() {
+	VkDevice device = m_context.device();
+	vkDestroyPipelineLayout(device, m_pipelineLayout, m_context.allocationCallbacks());
+	vkDestroyDescriptorPool(device, m_pool, m_context.allocationCallbacks());
+	vkDestroyDescriptorSetLayout(device, m_setLayout, m_context.allocationCallbacks());
+}
+
+BindlessTexture BindlessTable::addTexture(VkImageView view, VkImageLayout layout) {
+	std::lock_guard lock(m_mutex);
+	BindlessTexture handle{ allocateSlot(BindlessType::SampledImage) };
+	m_pendingWrites.push_back({ BindlessType::SampledImage, handle.index, { VK_NULL_HANDLE, view, layout }, {} });
+	return handle;
+}
+
+BindlessSampler BindlessTable::addSampler(VkSampler sampler) {
+	std::lock_guard lock(m_mutex);
+	BindlessSampler handle{ allocateSlot(BindlessType::Sampler) };
+	m_pendingWrites.push_back({ BindlessType::Sampler, handle.index, { sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED }, {} });
+	return handle;
+}
+
+BindlessBuffer BindlessTable::addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	std::lock_guard lock(m_mutex);
+	BindlessBuffer handle{ allocateSlot(BindlessType::StorageBuffer) };
+	m_pendingWrites.push_back({ BindlessType::StorageBuffer, handle.index, {}, { buffer, offset, range } });
+	return handle;
+}
+
+BindlessStorageImage BindlessTable::addStorageImage(VkImageView view) {
+	std::lock_guard lock(m_mutex);
+	BindlessStorageImage handle{ allocateSlot(BindlessType::StorageImage) };
+	m_pendingWrites.push_back({ BindlessType::StorageImage, handle.index, { VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_GENERAL }, {} });
+	return handle;
+}
+
+uint32_t BindlessTable::allocateSlot(BindlessType type) {
+	Array& array = m_arrays[static_cast<size_t>(type)];
+	uint32_t index;
+	if (!array.free.empty()) {
+		index = array.free.back();
+		array.free.pop_back();
+	} else if (array.next < array.capacity) {
+		index = array.next++;
+	} else {
+		throw std::runtime_error(std::string("bindless table: out of ") + typeName(type));
+	}
+	array.live++;
+	array.peak = std::max(array.peak, array.live);
+	return index;
+}
+
+void BindlessTable::release(BindlessType type, uint32_t index, uint64_t lastSerial) {
+	std::lock_guard lock(m_mutex);
+	// A slot released before its write was flushed was never visible to the
+	// GPU; dropping the write keeps flush() from touching a recycled slot.
+	std::erase_if(m_pendingWrites, [type, index](const PendingWrite& write) { return write.type == type && write.index == index; });
+	m_retired.push_back({ type, index, lastSerial });
+}
+
+void BindlessTable::releaseCompleted(uint64_t completedSerial) {
+	std::lock_guard lock(m_mutex);
+	std::erase_if(m_retired, [this, completedSerial](const Retired& retired) {
+		if (retired.lastSerial > completedSerial) {
+			return false;
+		}
+		Array& array = m_arrays[static_cast<size_t>(retired.type)];
+		array.free.push_back(retired.index);
+		array.live--;
+		return true;
+	});
+}
+
+void BindlessTable::flush() {
+	std::vector<PendingWrite> pending;
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_pendingWrites.empty()) {
+			return;
+		}
+		pending.swap(m_pendingWrites);
+	}
+
+	// One write per slot: handles are scattered, so there are rarely runs
+	// worth merging, and a frame adds few of them.
+	std::vector<VkWriteDescriptorSet> writes(pending.size(), { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET });
+	for (size_t i = 0; i < pending.size(); i++) {
+		const PendingWrite& slot = pending[i];
+		VkWriteDescriptorSet& write = writes[i];
+		write.dstSet = m_set;
+		write.dstArrayElement = slot.index;
+		write.descriptorCount = 1;
+		switch (slot.type) {
+		case BindlessType::SampledImage:
+			write.dstBinding = kSampledImageBinding;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			write.pImageInfo = &slot.image;
+			break;
+		case BindlessType::Sampler:
+			write.dstBinding = kSamplerBinding;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+			write.pImageInfo = &slot.image;
+			break;
+		case BindlessType::StorageImage:
+			write.dstBinding = kStorageImageBinding;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			write.pImageInfo = &slot.image;
+			break;
+		default:
+			write.dstBinding = kStorageBufferBinding;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &slot.buffer;
+			break;
+		}
+	}
+	vkUpdateDescriptorSets(m_context.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+	std::lock_guard lock(m_mutex);
+	m_descriptorWrites += writes.size();
+	m_flushes++;
+}
+
+void BindlessTable::bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint) const {
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, m_pipelineLayout, 0, 1, &m_set, 0, nullptr);
+}
+
+BindlessStats BindlessTable::stats() const {
+	std::lock_guard lock(m_mutex);
+	BindlessStats stats;
+	for (size_t i = 0; i < std::size(m_arrays); i++) {
+		stats.capacity[i] = m_arrays[i].capacity;
+		stats.live[i] = m_arrays[i].live;
+		stats.peak[i] = m_arrays[i].peak;
+	}
+	stats.descriptorWrites = m_descriptorWrites;
+	stats.flushes = m_flushes;
+	return stats;
+}
+
+void BindlessTable::reportStats() const {
+	BindlessStats current = stats();
+	std::printf("bindless: %llu descriptor writes in %llu flushes, %u bytes of push constants\n",
+		static_cast<unsigned long long>(current.descriptorWrites), static_cast<unsigned long long>(current.flushes), m_pushConstantBytes);
+	for (size_t i = 0; i < std::size(current.capacity); i++) {
+		std::printf("  %-16s %6u live, %6u peak of %u\n", typeName(static_cast<BindlessType>(i)), current.live[i], current.peak[i],
+			current.capacity[i]);
+	}
+}
+
+}
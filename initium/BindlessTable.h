@@ -0,0 +1,165 @@
+#pragma once
+
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace initium {
+
+enum class BindlessType : uint32_t {
+	SampledImage,
+	Sampler,
+	StorageBuffer,
+	StorageImage,
+	Count,
+};
+
+// Index into one of the table's descriptor arrays: what shaders receive in
+// push constants or instance data in place of a descriptor set.
+template <BindlessType Type>
+struct BindlessHandle {
+	static constexpr uint32_t kInvalid = UINT32_MAX;
+
+	uint32_t index = kInvalid;
+
+	explicit operator bool() const { return index != kInvalid; }
+};
+
+using BindlessTexture = BindlessHandle<BindlessType::SampledImage>;
+using BindlessSampler = BindlessHandle<BindlessType::Sampler>;
+using BindlessBuffer = BindlessHandle<BindlessType::StorageBuffer>;
+using BindlessStorageImage = BindlessHandle<BindlessType::StorageImage>;
+
+struct BindlessTableCreateInfo {
+	// Array sizes; clamped to the device's update-after-bind limits.
+	uint32_t sampledImages = 16384;
+	uint32_t samplers = 64;
+	uint32_t storageBuffers = 16384;
+	uint32_t storageImages = 1024;
+	// Push constant bytes every bindless pipeline gets, visible to all stages.
+	uint32_t pushConstantBytes = 128;
+};
+
+struct BindlessStats {
+	uint32_t capacity[static_cast<size_t>(BindlessType::Count)] = {};
+	uint32_t live[static_cast<size_t>(BindlessType::Count)] = {};
+	uint32_t peak[static_cast<size_t>(BindlessType::Count)] = {};
+	uint64_t descriptorWrites = 0;
+	uint64_t flushes = 0;
+};
+
+// One descriptor set holding every texture, sampler, storage buffer and
+// storage image the renderer uses, in four runtime-sized arrays (set 0,
+// bindings 0-3):
+//
+//   layout(set = 0, binding = 0) uniform texture2D textures[];
+//   layout(set = 0, binding = 1) uniform sampler samplers[];
+//   layout(set = 0, binding = 2) buffer Buffers { uint data[]; } buffers[];
+//   layout(set = 0, binding = 3, r32f) uniform image2D images[];
+//
+// Shaders may declare a binding several times with different block or
+// image types, one per way they use it.
+// The set is bound once per command buffer with the shared pipelineLayout()
+// and never reallocated: a draw selects its resources by handle, so nothing
+// on the hot path allocates, writes or binds descriptors. The bindings are
+// update-after-bind and partially bound, so slots are written while frames
+// using other slots are in flight, and unused slots may hold anything.
+//
+// add*() and release() are thread-safe. A slot added becomes visible to
+// command buffers recorded after the next flush(); a released slot is
+// recycled only once the frame that last used it has completed.
+class BindlessTable {
+public:
+	static constexpr uint32_t kSampledImageBinding = 0;
+	static constexpr uint32_t kSamplerBinding = 1;
+	static constexpr uint32_t kStorageBufferBinding = 2;
+	static constexpr uint32_t kStorageImageBinding = 3;
+
+	BindlessTable(const VulkanContext& context, const BindlessTableCreateInfo& createInfo = {});
+	~BindlessTable();
+
+	BindlessTable(const BindlessTable&) = delete;
+	BindlessTable& operator=(const BindlessTable&) = delete;
+
+	// Throw std::runtime_error when the array is full.
+	BindlessTexture addTexture(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	BindlessSampler addSampler(VkSampler sampler);
+	BindlessBuffer addBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	// The image is accessed in VK_IMAGE_LAYOUT_GENERAL.
+	BindlessStorageImage addStorageImage(VkImageView view);
+
+	// lastSerial is the timeline value of the last frame that may use it.
+	template <BindlessType Type>
+	void release(BindlessHandle<Type> handle, uint64_t lastSerial) {
+		if (handle) {
+			release(Type, handle.index, lastSerial);
+		}
+	}
+
+	// Recycles slots released by frames up to completedSerial.
+	void releaseCompleted(uint64_t completedSerial);
+
+	// Writes the descriptors added since the last call. Call on the render
+	// thread before recording the frame, never while other threads record.
+	void flush();
+
+	// Binds the table as set 0. Needed once per command buffer, secondaries
+	// included: they don't inherit descriptor sets.
+	void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint) const;
+
+	VkDescriptorSetLayout setLayout() const { return m_setLayout; }
+	// The table as set 0 and pushConstantBytes() of push constants for
+	// VK_SHADER_STAGE_ALL. Every bindless pipeline uses it, so binding the
+	// set once survives pipeline switches.
+	VkPipelineLayout pipelineLayout() const { return m_pipelineLayout; }
+	uint32_t pushConstantBytes() const { return m_pushConstantBytes; }
+	uint32_t capacity(BindlessType type) const { return m_arrays[static_cast<size_t>(type)].capacity; }
+
+	BindlessStats stats() const;
+	void reportStats() const;
+
+private:
+	struct Array {
+		uint32_t capacity = 0;
+		// Slots never handed out start at next; recycled ones are in free.
+		uint32_t next = 0;
+		std::vector<uint32_t> free;
+		uint32_t live = 0;
+		uint32_t peak = 0;
+	};
+
+	struct Retired {
+		BindlessType type;
+		uint32_t index;
+		uint64_t lastSerial;
+	};
+
+	struct PendingWrite {
+		BindlessType type;
+		uint32_t index;
+		VkDescriptorImageInfo image;
+		VkDescriptorBufferInfo buffer;
+	};
+
+	uint32_t allocateSlot(BindlessType type);
+	void release(BindlessType type, uint32_t index, uint64_t lastSerial);
+
+	const VulkanContext& m_context;
+	uint32_t m_pushConstantBytes;
+
+	VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_pool = VK_NULL_HANDLE;
+	VkDescriptorSet m_set = VK_NULL_HANDLE;
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+
+	mutable std::mutex m_mutex;
+	Array m_arrays[static_cast<size_t>(BindlessType::Count)];
+	std::vector<Retired> m_retired;
+	std::vector<PendingWrite> m_pendingWrites;
+	uint64_t m_descriptorWrites = 0;
+	uint64_t m_flushes = 0;
+};
+
+}
@@ -0,0 +1,197 @@
+#include "FrameRing.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+namespace initium {
+
+FrameContext::FrameContext(const VulkanContext& context, GpuAllocator& allocator, VkDeviceSize transientBytes, uint32_t recordingSlots)
+	: m_context(context), m_allocator(allocator), m_commandPools(std::max(recordingSlots, 1u)) {
+	VkDevice device = context.device();
+
+	VkCommandPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = context.queueFamilies().graphics.family;
+	for (CommandPool& commandPool : m_commandPools) {
+		vkCheck(vkCreateCommandPool(device, &poolInfo, m_context.allocationCallbacks(), &commandPool.pool), "vkCreateCommandPool");
+	}
+
+	const VkDescriptorPoolSize poolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 256 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 256 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 256 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 64 },
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	descriptorPoolInfo.maxSets = 256;
+	descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(std::size(poolSizes));
+	descriptorPoolInfo.pPoolSizes = poolSizes;
+	vkCheck(vkCreateDescriptorPool(device, &descriptorPoolInfo, m_context.allocationCallbacks(), &m_descriptorPool), "vkCreateDescriptorPool");
+
+	VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	vkCheck(vkCreateSemaphore(device, &semaphoreInfo, m_context.allocationCallbacks(), &m_imageAvailable), "vkCreateSemaphore");
+
+	if (transientBytes > 0) {
+		VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+		bufferInfo.size = transientBytes;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+			| VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		m_transientBuffer = allocator.createBuffer(bufferInfo, { MemoryUsage::Upload });
+		m_transientMapped = static_cast<uint8_t*>(m_transientBuffer.allocation.mapped);
+		m_transientSize = transientBytes;
+	}
+}
+
+FrameContext::~FrameContext() {
+	VkDevice device = m_context.device();
+	m_allocator.destroyBuffer(m_transientBuffer);
+	vkDestroySemaphore(device, m_imageAvailable, m_context.allocationCallbacks());
+	vkDestroyDescriptorPool(device, m_descriptorPool, m_context.allocationCallbacks());
+	for (CommandPool& commandPool : m_commandPools) {
+		vkDestroyCommandPool(device, commandPool.pool, m_context.allocationCallbacks());
+	}
+}
+
+VkCommandBuffer FrameContext::allocateCommandBuffer(VkCommandBufferLevel level, uint32_t slot) {
+	CommandPool& commandPool = m_commandPools[slot];
+	std::vector<VkCommandBuffer>& buffers = commandPool.buffers[level];
+	uint32_t& used = commandPool.used[level];
+
+	if (used == buffers.size()) {
+		VkCommandBufferAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+		allocateInfo.commandPool = commandPool.pool;
+		allocateInfo.level = level;
+		allocateInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		vkCheck(vkAllocateCommandBuffers(m_context.device(), &allocateInfo, &commandBuffer), "vkAllocateCommandBuffers");
+		buffers.push_back(commandBuffer);
+	}
+	return buffers[used++];
+}
+
+TransientAllocation FrameContext::allocateTransient(VkDeviceSize size, VkDeviceSize alignment) {
+	alignment = std::max<VkDeviceSize>(alignment, 1);
+	VkDeviceSize offset = (m_transientOffset + alignment - 1) / alignment * alignment;
+	if (offset + size > m_transientSize) {
+		return {};
+	}
+	m_transientOffset = offset + size;
+	return { m_transientBuffer.buffer, offset, m_transientMapped + offset };
+}
+
+void FrameContext::reset() {
+	VkDevice device = m_context.device();
+	for (CommandPool& commandPool : m_commandPools) {
+		// One reset recycles every buffer in the pool; pools nobody recorded
+		// into last time have nothing to recycle.
+		if (commandPool.used[0] + commandPool.used[1] > 0) {
+			vkCheck(vkResetCommandPool(device, commandPool.pool, 0), "vkResetCommandPool");
+			commandPool.used[0] = 0;
+			commandPool.used[1] = 0;
+		}
+	}
+	vkCheck(vkResetDescriptorPool(device, m_descriptorPool, 0), "vkResetDescriptorPool");
+	m_transientOffset = 0;
+}
+
+FrameRing::FrameRing(const VulkanContext& context, GpuAllocator& allocator, uint32_t framesInFlight, VkDeviceSize transientBytesPerFrame,
+	uint32_t recordingSlots)
+	: m_context(context), m_allocator(allocator), m_transientBytes(transientBytesPerFrame), m_recordingSlots(recordingSlots) {
+	m_framesInFlight = std::clamp(framesInFlight, 1u, kMaxFramesInFlight);
+	m_requestedFramesInFlight = m_framesInFlight;
+
+	VkSemaphoreTypeCreateInfo typeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	semaphoreInfo.pNext = &typeInfo;
+	vkCheck(vkCreateSemaphore(context.device(), &semaphoreInfo, m_context.allocationCallbacks(), &m_timeline), "vkCreateSemaphore");
+}
+
+FrameRing::~FrameRing() {
+	waitIdle();
+	for (std::unique_ptr<FrameContext>& frame : m_frames) {
+		frame.reset();
+	}
+	vkDestroySemaphore(m_context.device(), m_timeline, m_context.allocationCallbacks());
+}
+
+FrameContext& FrameRing::beginFrame() {
+	INITIUM_PROFILE_ZONE("wait for frame slot");
+	auto start = std::chrono::steady_clock::now();
+
+	if (m_requestedFramesInFlight != m_framesInFlight) {
+		// Slots are reassigned, so everything in flight has to retire first.
+		// This is the only place the ring drains.
+		waitIdle();
+		m_framesInFlight = m_requestedFramesInFlight;
+		m_cursor = 0;
+	}
+
+	std::unique_ptr<FrameContext>& slot = m_frames[m_cursor];
+	if (!slot) {
+		slot = std::make_unique<FrameContext>(m_context, m_allocator, m_transientBytes, m_recordingSlots);
+	}
+
+	wait(slot->m_timelineValue);
+	slot->reset();
+
+	m_currentPreviousValue = slot->m_timelineValue;
+	slot->m_timelineValue = m_submittedValue + 1;
+	m_current = slot.get();
+
+	m_lastWaitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return *slot;
+}
+
+void FrameRing::endFrame() {
+	m_submittedValue = m_current->m_timelineValue;
+	m_current = nullptr;
+	m_cursor = (m_cursor + 1) % m_framesInFlight;
+}
+
+void FrameRing::cancelFrame() {
+	// Nothing will signal the value handed out, so put the old one back.
+	m_current->m_timelineValue = m_currentPreviousValue;
+	m_current = nullptr;
+}
+
+VkSemaphoreSubmitInfo FrameRing::signalInfo() const {
+	VkSemaphoreSubmitInfo info{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+	info.semaphore = m_timeline;
+	info.value = m_current->m_timelineValue;
+	info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	return info;
+}
+
+uint64_t FrameRing::completedValue() {
+	uint64_t value = 0;
+	vkCheck(vkGetSemaphoreCounterValue(m_context.device(), m_timeline, &value), "vkGetSemaphoreCounterValue");
+	m_completedValue = std::max(m_completedValue, value);
+	return m_completedValue;
+}
+
+void FrameRing::wait(uint64_t value) {
+	if (value <= m_completedValue) {
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_timeline;
+	waitInfo.pValues = &value;
+	vkCheck(vkWaitSemaphores(m_context.device(), &waitInfo, UINT64_MAX), "vkWaitSemaphores");
+	m_completedValue = value;
+}
+
+void FrameRing::setFramesInFlight(uint32_t count) {
+	m_requestedFramesInFlight = std::clamp(count, 1u, kMaxFramesInFlight);
+}
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "GpuAllocator.h"
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace initium {
+
+struct TransientAllocation {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	void* mapped = nullptr;
+
+	explicit operator bool() const { return mapped != nullptr; }
+};
+
+// Per-frame resources that are only touched by one frame at a time and get
+// reset wholesale once the GPU timeline has passed that frame, instead of
+// being freed object by object.
+class FrameContext {
+public:
+	FrameContext(const VulkanContext& context, GpuAllocator& allocator, VkDeviceSize transientBytes, uint32_t recordingSlots);
+	~FrameContext();
+
+	FrameContext(const FrameContext&) = delete;
+	FrameContext& operator=(const FrameContext&) = delete;
+
+	// Value the frame's last submission signals on FrameRing::timeline().
+	uint64_t timelineValue() const { return m_timelineValue; }
+
+	// Command buffers come from one of the frame's pools and are recycled,
+	// not freed, when the pools are reset. There is one pool per recording
+	// slot so threads can record in parallel; a slot must only be used by
+	// one thread at a time.
+	VkCommandBuffer allocateCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, uint32_t slot = 0);
+	uint32_t recordingSlots() const { return static_cast<uint32_t>(m_commandPools.size()); }
+
+	VkDescriptorPool descriptorPool() const { return m_descriptorPool; }
+
+	// Bump allocation from the frame's persistently mapped upload buffer.
+	// Returns an empty allocation when the frame has run out of space.
+	TransientAllocation allocateTransient(VkDeviceSize size, VkDeviceSize alignment);
+	VkDeviceSize transientUsed() const { return m_transientOffset; }
+
+	// Binary semaphore for vkAcquireNextImageKHR, which cannot signal a
+	// timeline semaphore.
+	VkSemaphore imageAvailable() const { return m_imageAvailable; }
+
+private:
+	friend class FrameRing;
+
+	void reset();
+
+	const VulkanContext& m_context;
+	GpuAllocator& m_allocator;
+	uint64_t m_timelineValue = 0;
+
+	// Padded so threads recording into neighbouring slots don't share a
+	// cache line.
+	struct alignas(64) CommandPool {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> buffers[2];
+		uint32_t used[2] = {};
+	};
+
+	std::vector<CommandPool> m_commandPools;
+
+	VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+	VkSemaphore m_imageAvailable = VK_NULL_HANDLE;
+
+	GpuBuffer m_transientBuffer;
+	uint8_t* m_transientMapped = nullptr;
+	VkDeviceSize m_transientSize = 0;
+	VkDeviceSize m_transientOffset = 0;
+};
+
+// Ring of frame contexts paced by a single timeline semaphore: frame N
+// signals value N, and reusing a slot waits for the value it last signalled.
+// The number of frames in flight can be changed at runtime to trade CPU/GPU
+// overlap against input latency.
+class FrameRing {
+public:
+	static constexpr uint32_t kMaxFramesInFlight = 4;
+
+	FrameRing(const VulkanContext& context, GpuAllocator& allocator, uint32_t framesInFlight, VkDeviceSize transientBytesPerFrame,
+		uint32_t recordingSlots = 1);
+	~FrameRing();
+
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+
+	// Waits until the next slot's previous use has retired on the GPU, then
+	// resets it. Every beginFrame() must be followed by endFrame() once the
+	// frame is submitted, or cancelFrame() if nothing was.
+	FrameContext& beginFrame();
+	void endFrame();
+	void cancelFrame();
+
+	// Add to the frame's final submit so the slot can be recycled.
+	VkSemaphoreSubmitInfo signalInfo() const;
+
+	VkSemaphore timeline() const { return m_timeline; }
+	uint64_t submittedValue() const { return m_submittedValue; }
+	uint64_t completedValue();
+	void wait(uint64_t value);
+	void waitIdle() { wait(m_submittedValue); }
+
+	// Takes effect at the next beginFrame(), after the frames already in
+	// flight have drained.
+	void setFramesInFlight(uint32_t count);
+	uint32_t framesInFlight() const { return m_framesInFlight; }
+
+	// CPU time the last beginFrame() spent blocked on the GPU.
+	double lastWaitMilliseconds() const { return m_lastWaitMilliseconds; }
+
+private:
+	const VulkanContext& m_context;
+	GpuAllocator& m_allocator;
+	VkDeviceSize m_transientBytes;
+	uint32_t m_recordingSlots;
+
+	VkSemaphore m_timeline = VK_NULL_HANDLE;
+	uint64_t m_submittedValue = 0;
+	uint64_t m_completedValue = 0;
+
+	std::unique_ptr<FrameContext> m_frames[kMaxFramesInFlight];
+	uint32_t m_framesInFlight;
+	uint32_t m_requestedFramesInFlight;
+	uint32_t m_cursor = 0;
+
+	FrameContext* m_current = nullptr;
+	uint64_t m_currentPreviousValue = 0;
+	double m_lastWaitMilliseconds = 0.0;
+};
+
+}
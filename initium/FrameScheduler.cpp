@@ -0,0 +1,93 @@
+#include "FrameScheduler.h"
+
+#include "Profiler.h"
+#include "glfw/include/GLFW/glfw3.h"
+
+namespace initium {
+
+FrameScheduler::FrameScheduler(GLFWwindow* window) : m_window(window) {
+	m_iconified = glfwGetWindowAttrib(window, GLFW_ICONIFIED) == GLFW_TRUE;
+
+	int width = 0;
+	int height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	m_zeroSized = width == 0 || height == 0;
+}
+
+bool FrameScheduler::pumpEvents() {
+	if (m_headless) {
+		{
+			INITIUM_PROFILE_ZONE("glfwPollEvents");
+			glfwPollEvents();
+		}
+		INITIUM_PROFILE_ZONE("wait for render thread");
+		m_awaitingRenderer.wait(true, std::memory_order_acquire);
+	} else if (isIdle()) {
+		INITIUM_PROFILE_ZONE("glfwWaitEventsTimeout");
+		glfwWaitEventsTimeout(m_idleTimeout);
+	} else {
+		INITIUM_PROFILE_ZONE("glfwPollEvents");
+		glfwPollEvents();
+	}
+
+	if (m_wakeRequested.exchange(false, std::memory_order_acquire)) {
+		requestFrames();
+	}
+
+	if (!isVisible() || m_awaitingRenderer.load(std::memory_order_acquire)) {
+		return false;
+	}
+	if (m_mode == Mode::Continuous) {
+		return true;
+	}
+	if (m_pendingFrames > 0) {
+		m_pendingFrames--;
+		return true;
+	}
+	return false;
+}
+
+void FrameScheduler::requestFrames(uint32_t count) {
+	if (count > m_pendingFrames) {
+		m_pendingFrames = count;
+	}
+}
+
+void FrameScheduler::wake() {
+	m_wakeRequested.store(true, std::memory_order_release);
+	glfwPostEmptyEvent();
+}
+
+void FrameScheduler::frameTaken() {
+	m_awaitingRenderer.store(false, std::memory_order_release);
+	m_awaitingRenderer.notify_one();
+	glfwPostEmptyEvent();
+}
+
+bool FrameScheduler::isVisible() const {
+	return !m_iconified && !m_zeroSized;
+}
+
+bool FrameScheduler::isIdle() const {
+	if (m_wakeRequested.load(std::memory_order_relaxed)) {
+		return false;
+	}
+	if (!isVisible() || m_awaitingRenderer.load(std::memory_order_acquire)) {
+		return true;
+	}
+	return m_mode == Mode::OnDemand && m_pendingFrames == 0;
+}
+
+void FrameScheduler::onIconify(bool iconified) {
+	m_iconified = iconified;
+	if (!iconified) {
+		requestFrames();
+	}
+}
+
+void FrameScheduler::onFramebufferSize(int width, int height) {
+	m_zeroSized = width == 0 || height == 0;
+	requestFrames();
+}
+
+}
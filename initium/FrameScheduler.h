@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+struct GLFWwindow;
+
+namespace initium {
+
+// Decides each main loop iteration whether to poll or block in GLFW, so an
+// idle or minimised window costs no CPU. Rendering is driven either
+// continuously (an animating scene) or on demand, one frame per request.
+class FrameScheduler {
+public:
+	enum class Mode {
+		OnDemand,
+		Continuous,
+	};
+
+	explicit FrameScheduler(GLFWwindow* window);
+
+	// Processes pending window events, blocking when there is nothing to
+	// draw. Returns true if a frame should be rendered this iteration.
+	bool pumpEvents();
+
+	void setMode(Mode mode) { m_mode = mode; }
+	Mode mode() const { return m_mode; }
+
+	// Without a display there are no events worth blocking on, and the null
+	// platform's wait returns at once. Headless loops only poll, and wait
+	// for the render thread on the handshake itself.
+	void setHeadless(bool headless) { m_headless = headless; }
+	bool isHeadless() const { return m_headless; }
+
+	// Upper bound on how long an idle loop sleeps before waking for
+	// housekeeping. Events and wake() always return immediately.
+	void setIdleTimeout(double seconds) { m_idleTimeout = seconds; }
+
+	// Schedules frames from the main thread, e.g. after input or a resize.
+	void requestFrames(uint32_t count = 1);
+
+	// Thread-safe: wakes a blocked main loop and schedules a frame. Used by
+	// background work (asset loads, hot reload) when its results are ready.
+	void wake();
+
+	// Render thread handshake. While a published frame has not been picked
+	// up, the loop waits for events instead of producing another one;
+	// frameTaken() is thread-safe and wakes the loop. Call framePublished()
+	// before handing the frame over, or the renderer may answer first.
+	void framePublished() { m_awaitingRenderer.store(true, std::memory_order_relaxed); }
+	void frameTaken();
+	bool isAwaitingRenderer() const { return m_awaitingRenderer.load(std::memory_order_acquire); }
+
+	bool isVisible() const;
+	bool isIdle() const;
+
+	// Window callback hooks, forwarded from the GLFW callbacks in main().
+	void onInput() { requestFrames(); }
+	void onRefresh() { requestFrames(); }
+	void onIconify(bool iconified);
+	void onFramebufferSize(int width, int height);
+
+private:
+	GLFWwindow* m_window;
+	Mode m_mode = Mode::OnDemand;
+	double m_idleTimeout = 0.5;
+	bool m_headless = false;
+
+	uint32_t m_pendingFrames = 1;
+	bool m_iconified = false;
+	bool m_zeroSized = false;
+
+	std::atomic<bool> m_wakeRequested{ false };
+	std::atomic<bool> m_awaitingRenderer{ false };
+};
+
+}
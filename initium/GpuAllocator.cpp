@@ -0,0 +1,497 @@
+#include "GpuAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace initium {
+
+namespace {
+
+constexpr VkDeviceSize kMiB = 1ull << 20;
+
+// New pools start with an eighth of the block size and double up to it, so
+// memory types that only ever see a few small resources stay small.
+constexpr uint32_t kBlockSizeSteps = 3;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+double mebibytes(VkDeviceSize bytes) {
+	return static_cast<double>(bytes) / static_cast<double>(kMiB);
+}
+
+}
+
+GpuAllocator::GpuAllocator(const VulkanContext& context, VkDeviceSize preferredBlockSize)
+	: m_context(context), m_memoryProperties(context.memoryProperties()), m_preferredBlockSize(preferredBlockSize) {
+	m_hasMemoryBudget = context.isDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	m_pools.resize(m_memoryProperties.memoryTypeCount * 2);
+	for (uint32_t type = 0; type < m_memoryProperties.memoryTypeCount; type++) {
+		// Small heaps (BAR windows, some integrated parts) would be eaten by
+		// a couple of full-sized blocks.
+		VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[heapOf(type)].size;
+		VkDeviceSize blockSize = heapSize <= 1024 * kMiB ? heapSize / 8 : m_preferredBlockSize;
+		blockSize = std::max(blockSize / Tlsf::kGranularity * Tlsf::kGranularity, Tlsf::kGranularity);
+
+		for (uint32_t linear = 0; linear < 2; linear++) {
+			Pool& pool = m_pools[type * 2 + linear];
+			pool.memoryType = type;
+			pool.blockSize = blockSize;
+		}
+	}
+
+	readBudget();
+}
+
+GpuAllocator::~GpuAllocator() {
+	VkDevice device = m_context.device();
+	uint32_t leaked = 0;
+	for (Pool& pool : m_pools) {
+		for (std::unique_ptr<Block>& block : pool.blocks) {
+			if (block) {
+				leaked += block->ranges.allocationCount();
+				vkFreeMemory(device, block->memory, m_context.allocationCallbacks());
+			}
+		}
+	}
+	for (const HeapCounters& heap : m_heaps) {
+		leaked += heap.dedicatedCount;
+	}
+	if (leaked > 0) {
+		std::fprintf(stderr, "initium: %u GPU allocations still live at shutdown\n", leaked);
+	}
+}
+
+GpuBuffer GpuAllocator::createBuffer(const VkBufferCreateInfo& bufferInfo, const AllocationCreateInfo& createInfo) {
+	VkDevice device = m_context.device();
+
+	GpuBuffer buffer;
+	vkCheck(vkCreateBuffer(device, &bufferInfo, m_context.allocationCallbacks(), &buffer.buffer), "vkCreateBuffer");
+
+	VkBufferMemoryRequirementsInfo2 requirementsInfo{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2 };
+	requirementsInfo.buffer = buffer.buffer;
+	VkMemoryDedicatedRequirements dedicatedRequirements{ VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 requirements{ VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+	requirements.pNext = &dedicatedRequirements;
+	vkGetBufferMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+	bool dedicated = createInfo.dedicated || dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+
+	try {
+		buffer.allocation = allocate(requirements.memoryRequirements, createInfo, true, dedicated, buffer.buffer, VK_NULL_HANDLE);
+		vkCheck(vkBindBufferMemory(device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset), "vkBindBufferMemory");
+	} catch (...) {
+		destroyBuffer(buffer);
+		throw;
+	}
+	return buffer;
+}
+
+GpuImage GpuAllocator::createImage(const VkImageCreateInfo& imageInfo, const AllocationCreateInfo& createInfo) {
+	VkDevice device = m_context.device();
+
+	GpuImage image;
+	vkCheck(vkCreateImage(device, &imageInfo, m_context.allocationCallbacks(), &image.image), "vkCreateImage");
+
+	VkImageMemoryRequirementsInfo2 requirementsInfo{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2 };
+	requirementsInfo.image = image.image;
+	VkMemoryDedicatedRequirements dedicatedRequirements{ VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 requirements{ VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+	requirements.pNext = &dedicatedRequirements;
+	vkGetImageMemoryRequirements2(device, &requirementsInfo, &requirements);
+
+	bool renderTarget = (imageInfo.usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+	bool dedicated = createInfo.dedicated || dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation
+		|| (renderTarget && requirements.memoryRequirements.size >= kDedicatedRenderTargetBytes);
+	bool linear = imageInfo.tiling == VK_IMAGE_TILING_LINEAR;
+
+	try {
+		image.allocation = allocate(requirements.memoryRequirements, createInfo, linear, dedicated, VK_NULL_HANDLE, image.image);
+		vkCheck(vkBindImageMemory(device, image.image, image.allocation.memory, image.allocation.offset), "vkBindImageMemory");
+	} catch (...) {
+		destroyImage(image);
+		throw;
+	}
+	return image;
+}
+
+void GpuAllocator::destroyBuffer(GpuBuffer& buffer) {
+	if (buffer.buffer) {
+		vkDestroyBuffer(m_context.device(), buffer.buffer, m_context.allocationCallbacks());
+	}
+	if (buffer.allocation) {
+		free(buffer.allocation);
+	}
+	buffer = {};
+}
+
+void GpuAllocator::destroyImage(GpuImage& image) {
+	if (image.image) {
+		vkDestroyImage(m_context.device(), image.image, m_context.allocationCallbacks());
+	}
+	if (image.allocation) {
+		free(image.allocation);
+	}
+	image = {};
+}
+
+Allocation GpuAllocator::allocateHeap(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo) {
+	return allocate(requirements, createInfo, false, true, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+void GpuAllocator::freeHeap(Allocation& allocation) {
+	if (allocation) {
+		free(allocation);
+	}
+}
+
+void GpuAllocator::invalidate(const Allocation& allocation) const {
+	if (m_memoryProperties.memoryTypes[allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+		return;
+	}
+
+	VkMappedMemoryRange range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
+	range.memory = allocation.memory;
+	if (allocation.m_pool == UINT32_MAX) {
+		range.size = VK_WHOLE_SIZE;
+	} else {
+		// Blocks are a multiple of the TLSF granularity, which is at least the
+		// atom size, so the rounded range stays inside the block.
+		VkDeviceSize atom = m_context.properties().limits.nonCoherentAtomSize;
+		range.offset = allocation.offset / atom * atom;
+		range.size = (allocation.offset + allocation.size + atom - 1) / atom * atom - range.offset;
+	}
+	vkCheck(vkInvalidateMappedMemoryRanges(m_context.device(), 1, &range), "vkInvalidateMappedMemoryRanges");
+}
+
+Allocation GpuAllocator::allocate(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo, bool linear,
+	bool dedicated, VkBuffer dedicatedBuffer, VkImage dedicatedImage) {
+	std::vector<uint32_t> candidates = memoryTypeCandidates(requirements.memoryTypeBits, createInfo.usage);
+	if (candidates.empty()) {
+		throw VulkanError("GpuAllocator: no compatible memory type", VK_ERROR_FEATURE_NOT_PRESENT);
+	}
+
+	std::lock_guard lock(m_mutex);
+
+	// Stay inside the budget on the best memory type if at all possible,
+	// then fall back to slower types, and only exceed the budget when
+	// nothing else is left; the OS will page, but that beats failing.
+	for (bool respectBudget : { true, false }) {
+		for (uint32_t type : candidates) {
+			bool ownMemory = dedicated || requirements.size > m_pools[type * 2].blockSize / 2;
+			Allocation allocation = ownMemory
+				? allocateDedicated(type, requirements.size, dedicatedBuffer, dedicatedImage, respectBudget)
+				: allocateFromPool(type, linear, requirements, respectBudget);
+			if (allocation) {
+				return allocation;
+			}
+		}
+	}
+	throw VulkanError("GpuAllocator::allocate", VK_ERROR_OUT_OF_DEVICE_MEMORY);
+}
+
+Allocation GpuAllocator::allocateFromPool(uint32_t memoryType, bool linear, const VkMemoryRequirements& requirements, bool respectBudget) {
+	uint32_t poolIndex = memoryType * 2 + (linear ? 0 : 1);
+	Pool& pool = m_pools[poolIndex];
+
+	auto suballocate = [&](uint32_t blockIndex) {
+		Block& block = *pool.blocks[blockIndex];
+		Tlsf::Allocation range = block.ranges.allocate(requirements.size, requirements.alignment);
+		Allocation allocation;
+		if (range) {
+			allocation.memory = block.memory;
+			allocation.offset = range.offset;
+			allocation.size = range.size;
+			allocation.mapped = block.mapped ? block.mapped + range.offset : nullptr;
+			allocation.memoryType = memoryType;
+			allocation.m_pool = poolIndex;
+			allocation.m_block = blockIndex;
+			allocation.m_handle = range.handle;
+		}
+		return allocation;
+	};
+
+	uint32_t freeSlot = UINT32_MAX;
+	uint32_t liveBlocks = 0;
+	for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+		if (!pool.blocks[i]) {
+			freeSlot = std::min(freeSlot, i);
+			continue;
+		}
+		liveBlocks++;
+		if (Allocation allocation = suballocate(i)) {
+			return allocation;
+		}
+	}
+
+	// Both are multiples of Tlsf::kGranularity, which the block's range is
+	// rounded down to.
+	VkDeviceSize needed = Tlsf::capacityFor(requirements.size, requirements.alignment);
+	VkDeviceSize blockSize = pool.blockSize >> (kBlockSizeSteps - std::min(liveBlocks, kBlockSizeSteps));
+	blockSize = std::max(alignUp(blockSize, Tlsf::kGranularity), needed);
+
+	// Under memory pressure a smaller block may still fit.
+	auto block = std::make_unique<Block>(blockSize);
+	VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+	while (true) {
+		result = allocateMemory(memoryType, blockSize, nullptr, respectBudget, block->memory, block->mapped);
+		if (result == VK_SUCCESS || result == VK_ERROR_TOO_MANY_OBJECTS || blockSize / 2 < needed) {
+			break;
+		}
+		blockSize = alignUp(blockSize / 2, Tlsf::kGranularity);
+		block = std::make_unique<Block>(blockSize);
+	}
+	if (result != VK_SUCCESS) {
+		return {};
+	}
+
+	if (freeSlot == UINT32_MAX) {
+		freeSlot = static_cast<uint32_t>(pool.blocks.size());
+		pool.blocks.push_back(std::move(block));
+	} else {
+		pool.blocks[freeSlot] = std::move(block);
+	}
+	return suballocate(freeSlot);
+}
+
+Allocation GpuAllocator::allocateDedicated(uint32_t memoryType, VkDeviceSize size, VkBuffer buffer, VkImage image, bool respectBudget) {
+	VkMemoryDedicatedAllocateInfo dedicatedInfo{ VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO };
+	dedicatedInfo.buffer = buffer;
+	dedicatedInfo.image = image;
+
+	Allocation allocation;
+	uint8_t* mapped = nullptr;
+	if (allocateMemory(memoryType, size, &dedicatedInfo, respectBudget, allocation.memory, mapped) != VK_SUCCESS) {
+		return {};
+	}
+	allocation.size = size;
+	allocation.mapped = mapped;
+	allocation.memoryType = memoryType;
+
+	HeapCounters& heap = m_heaps[heapOf(memoryType)];
+	heap.dedicatedCount++;
+	heap.dedicatedBytes += size;
+	return allocation;
+}
+
+void GpuAllocator::free(Allocation& allocation) {
+	std::lock_guard lock(m_mutex);
+
+	if (allocation.m_pool == UINT32_MAX) {
+		HeapCounters& heap = m_heaps[heapOf(allocation.memoryType)];
+		heap.dedicatedCount--;
+		heap.dedicatedBytes -= allocation.size;
+		freeMemory(allocation.memoryType, allocation.size, allocation.memory);
+		allocation = {};
+		return;
+	}
+
+	Pool& pool = m_pools[allocation.m_pool];
+	std::unique_ptr<Block>& block = pool.blocks[allocation.m_block];
+	block->ranges.free(allocation.m_handle);
+	allocation = {};
+
+	if (!block->ranges.empty()) {
+		return;
+	}
+
+	// Keep one empty block around so a resource that is created and
+	// destroyed every frame doesn't hit vkAllocateMemory each time.
+	bool otherEmpty = std::any_of(pool.blocks.begin(), pool.blocks.end(), [&](const std::unique_ptr<Block>& other) {
+		return other && other != block && other->ranges.empty();
+	});
+	if (otherEmpty) {
+		freeMemory(pool.memoryType, block->ranges.capacity(), block->memory);
+		block.reset();
+	}
+}
+
+std::vector<uint32_t> GpuAllocator::memoryTypeCandidates(uint32_t typeBits, MemoryUsage usage) const {
+	VkMemoryPropertyFlags required = 0;
+	VkMemoryPropertyFlags preferred = 0;
+	VkMemoryPropertyFlags avoided = 0;
+	switch (usage) {
+	case MemoryUsage::GpuOnly:
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		break;
+	case MemoryUsage::Upload:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		avoided = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		break;
+	case MemoryUsage::Readback:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		break;
+	}
+	constexpr VkMemoryPropertyFlags unusable = VK_MEMORY_PROPERTY_PROTECTED_BIT | VK_MEMORY_PROPERTY_DEVICE_COHERENT_BIT_AMD
+		| VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+	std::vector<std::pair<int, uint32_t>> scored;
+	for (uint32_t type = 0; type < m_memoryProperties.memoryTypeCount; type++) {
+		VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[type].propertyFlags;
+		if (!(typeBits & (1u << type)) || (flags & required) != required || (flags & unusable)) {
+			continue;
+		}
+		int cost = std::popcount(preferred & ~flags) + std::popcount(avoided & flags);
+		// Falling back to system memory for a GPU-only resource costs far
+		// more than a missing cache bit.
+		if ((preferred & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && !(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			cost += 8;
+		}
+		scored.emplace_back(cost, type);
+	}
+	std::stable_sort(scored.begin(), scored.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	std::vector<uint32_t> candidates;
+	for (const auto& [cost, type] : scored) {
+		candidates.push_back(type);
+	}
+	return candidates;
+}
+
+VkResult GpuAllocator::allocateMemory(uint32_t memoryType, VkDeviceSize size, const void* next, bool respectBudget,
+	VkDeviceMemory& memory, uint8_t*& mapped) {
+	if (m_deviceMemoryCount >= m_context.properties().limits.maxMemoryAllocationCount) {
+		return VK_ERROR_TOO_MANY_OBJECTS;
+	}
+	uint32_t heap = heapOf(memoryType);
+	if (respectBudget && !fitsBudget(heap, size)) {
+		return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+	}
+
+	VkMemoryAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	allocateInfo.pNext = next;
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = memoryType;
+	VkResult result = vkAllocateMemory(m_context.device(), &allocateInfo, m_context.allocationCallbacks(), &memory);
+	if (result != VK_SUCCESS) {
+		memory = VK_NULL_HANDLE;
+		return result;
+	}
+
+	if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		void* pointer = nullptr;
+		result = vkMapMemory(m_context.device(), memory, 0, VK_WHOLE_SIZE, 0, &pointer);
+		if (result != VK_SUCCESS) {
+			vkFreeMemory(m_context.device(), memory, m_context.allocationCallbacks());
+			memory = VK_NULL_HANDLE;
+			return result;
+		}
+		mapped = static_cast<uint8_t*>(pointer);
+	}
+
+	m_heaps[heap].committed += size;
+	m_deviceMemoryCount++;
+	return VK_SUCCESS;
+}
+
+void GpuAllocator::freeMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory memory) {
+	vkFreeMemory(m_context.device(), memory, m_context.allocationCallbacks());
+	m_heaps[heapOf(memoryType)].committed -= size;
+	m_deviceMemoryCount--;
+}
+
+bool GpuAllocator::fitsBudget(uint32_t heap, VkDeviceSize size) const {
+	const HeapCounters& counters = m_heaps[heap];
+	VkDeviceSize usage = counters.committed;
+	if (m_hasMemoryBudget) {
+		// The driver's figure includes other processes and implicit
+		// allocations; add what we committed since it was read.
+		usage = counters.driverUsage + (counters.committed > counters.committedAtUpdate ? counters.committed - counters.committedAtUpdate : 0);
+	}
+	return usage + size <= counters.driverBudget;
+}
+
+void GpuAllocator::updateBudget() {
+	std::lock_guard lock(m_mutex);
+	readBudget();
+}
+
+void GpuAllocator::readBudget() {
+	if (!m_hasMemoryBudget) {
+		for (uint32_t heap = 0; heap < m_memoryProperties.memoryHeapCount; heap++) {
+			m_heaps[heap].driverBudget = m_memoryProperties.memoryHeaps[heap].size * 8 / 10;
+		}
+		return;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+	VkPhysicalDeviceMemoryProperties2 properties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+	properties.pNext = &budget;
+	vkGetPhysicalDeviceMemoryProperties2(m_context.physicalDevice(), &properties);
+
+	for (uint32_t heap = 0; heap < m_memoryProperties.memoryHeapCount; heap++) {
+		HeapCounters& counters = m_heaps[heap];
+		counters.driverBudget = budget.heapBudget[heap];
+		counters.driverUsage = budget.heapUsage[heap];
+		counters.committedAtUpdate = counters.committed;
+	}
+}
+
+std::vector<HeapStats> GpuAllocator::heapStats() const {
+	std::lock_guard lock(m_mutex);
+
+	std::vector<HeapStats> stats(m_memoryProperties.memoryHeapCount);
+	std::vector<VkDeviceSize> freeBytes(stats.size(), 0);
+	std::vector<VkDeviceSize> contiguousFreeBytes(stats.size(), 0);
+
+	for (uint32_t heap = 0; heap < stats.size(); heap++) {
+		const HeapCounters& counters = m_heaps[heap];
+		HeapStats& heapStats = stats[heap];
+		heapStats.size = m_memoryProperties.memoryHeaps[heap].size;
+		heapStats.budget = counters.driverBudget;
+		heapStats.usage = m_hasMemoryBudget ? counters.driverUsage : counters.committed;
+		heapStats.committed = counters.committed;
+		heapStats.used = counters.dedicatedBytes;
+		heapStats.allocationCount = counters.dedicatedCount;
+		heapStats.dedicatedCount = counters.dedicatedCount;
+	}
+
+	for (const Pool& pool : m_pools) {
+		uint32_t heap = heapOf(pool.memoryType);
+		for (const std::unique_ptr<Block>& block : pool.blocks) {
+			if (!block) {
+				continue;
+			}
+			stats[heap].used += block->ranges.usedBytes();
+			stats[heap].blockCount++;
+			stats[heap].allocationCount += block->ranges.allocationCount();
+			freeBytes[heap] += block->ranges.freeBytes();
+			contiguousFreeBytes[heap] += block->ranges.largestFreeBlock();
+		}
+	}
+
+	for (uint32_t heap = 0; heap < stats.size(); heap++) {
+		if (freeBytes[heap] > 0) {
+			stats[heap].fragmentation = 1.0 - static_cast<double>(contiguousFreeBytes[heap]) / static_cast<double>(freeBytes[heap]);
+		}
+	}
+	return stats;
+}
+
+void GpuAllocator::reportStats() const {
+	std::vector<HeapStats> stats = heapStats();
+	uint32_t deviceMemoryCount = 0;
+	{
+		std::lock_guard lock(m_mutex);
+		deviceMemoryCount = m_deviceMemoryCount;
+	}
+
+	std::printf("gpu memory: %u VkDeviceMemory objects, budget %s\n", deviceMemoryCount,
+		m_hasMemoryBudget ? "from VK_EXT_memory_budget" : "estimated");
+	for (uint32_t heap = 0; heap < stats.size(); heap++) {
+		const HeapStats& heapStats = stats[heap];
+		bool deviceLocal = m_memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+		std::printf("  heap %u (%s, %.0f MiB): used %.1f / committed %.1f MiB in %u blocks, %u allocations (%u dedicated), "
+			"fragmentation %.1f%%, usage %.1f / budget %.1f MiB\n",
+			heap, deviceLocal ? "device" : "host", mebibytes(heapStats.size), mebibytes(heapStats.used), mebibytes(heapStats.committed),
+			heapStats.blockCount, heapStats.allocationCount, heapStats.dedicatedCount, heapStats.fragmentation * 100.0,
+			mebibytes(heapStats.usage), mebibytes(heapStats.budget));
+	}
+}
+
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "Tlsf.h"
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace initium {
+
+enum class MemoryUsage {
+	// Device-local, never touched by the CPU.
+	GpuOnly,
+	// Host-visible and coherent, written sequentially by the CPU and read
+	// once by the GPU. Prefers system memory over the small BAR window.
+	Upload,
+	// Host-visible, preferably cached, for reading results back. May be
+	// non-coherent, so reads need vkInvalidateMappedMemoryRanges.
+	Readback,
+};
+
+struct AllocationCreateInfo {
+	MemoryUsage usage = MemoryUsage::GpuOnly;
+	// Always give the resource its own VkDeviceMemory.
+	bool dedicated = false;
+};
+
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	// Set for host-visible memory, which stays mapped for its lifetime.
+	void* mapped = nullptr;
+	uint32_t memoryType = UINT32_MAX;
+
+	explicit operator bool() const { return memory != VK_NULL_HANDLE; }
+
+private:
+	friend class GpuAllocator;
+
+	// Pool and block the range came from, or UINT32_MAX for a dedicated
+	// allocation.
+	uint32_t m_pool = UINT32_MAX;
+	uint32_t m_block = UINT32_MAX;
+	uint32_t m_handle = Tlsf::kNull;
+};
+
+struct GpuBuffer {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	Allocation allocation;
+
+	explicit operator bool() const { return buffer != VK_NULL_HANDLE; }
+};
+
+struct GpuImage {
+	VkImage image = VK_NULL_HANDLE;
+	Allocation allocation;
+
+	explicit operator bool() const { return image != VK_NULL_HANDLE; }
+};
+
+struct HeapStats {
+	VkDeviceSize size = 0;
+	// From VK_EXT_memory_budget when the device has it, otherwise estimated
+	// as 80% of the heap and our own committed bytes.
+	VkDeviceSize budget = 0;
+	VkDeviceSize usage = 0;
+	// Bytes held in VkDeviceMemory objects, and the part of that handed out.
+	VkDeviceSize committed = 0;
+	VkDeviceSize used = 0;
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t dedicatedCount = 0;
+	// Share of free pool space outside the largest free range of its block:
+	// 0 when every block's free space is contiguous.
+	double fragmentation = 0.0;
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks, one set
+// of pools per memory type, so the application stays far below
+// maxMemoryAllocationCount and allocation never hits the driver on the hot
+// path. Each block is managed by a TLSF allocator. Linear (buffer) and
+// optimal (image) resources live in separate pools, which sidesteps
+// bufferImageGranularity. Large resources, render targets and anything the
+// driver asks for get a dedicated allocation instead. Thread-safe.
+class GpuAllocator {
+public:
+	explicit GpuAllocator(const VulkanContext& context, VkDeviceSize preferredBlockSize = 256ull << 20);
+	~GpuAllocator();
+
+	GpuAllocator(const GpuAllocator&) = delete;
+	GpuAllocator& operator=(const GpuAllocator&) = delete;
+
+	// Creates the resource, allocates memory for it and binds it. Throws
+	// VulkanError when no memory type can satisfy the request.
+	GpuBuffer createBuffer(const VkBufferCreateInfo& bufferInfo, const AllocationCreateInfo& createInfo);
+	GpuImage createImage(const VkImageCreateInfo& imageInfo, const AllocationCreateInfo& createInfo);
+
+	// The resource must no longer be in use by the GPU.
+	void destroyBuffer(GpuBuffer& buffer);
+	void destroyImage(GpuImage& image);
+
+	// Raw memory in its own VkDeviceMemory, for callers that place several
+	// resources in it themselves, e.g. aliased transients.
+	Allocation allocateHeap(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo);
+	void freeHeap(Allocation& allocation);
+
+	// Makes GPU writes to a mapped allocation visible to the CPU, after the
+	// work that wrote it has completed. Does nothing for coherent memory.
+	void invalidate(const Allocation& allocation) const;
+
+	// Re-reads heap budget and usage from the driver. Cheap enough to call
+	// once a frame; in between, usage is tracked from our own allocations.
+	void updateBudget();
+	bool hasMemoryBudget() const { return m_hasMemoryBudget; }
+
+	// Indexed by memory heap.
+	std::vector<HeapStats> heapStats() const;
+	void reportStats() const;
+
+private:
+	// Images from this size up always get a dedicated allocation when they
+	// are render targets; drivers can then apply compression and placement
+	// they can't use inside a shared block.
+	static constexpr VkDeviceSize kDedicatedRenderTargetBytes = 4ull << 20;
+
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		uint8_t* mapped = nullptr;
+		Tlsf ranges;
+
+		explicit Block(VkDeviceSize size) : ranges(size) {}
+	};
+
+	struct Pool {
+		uint32_t memoryType = 0;
+		VkDeviceSize blockSize = 0;
+		std::vector<std::unique_ptr<Block>> blocks;
+	};
+
+	struct HeapCounters {
+		VkDeviceSize committed = 0;
+		VkDeviceSize dedicatedBytes = 0;
+		uint32_t dedicatedCount = 0;
+		VkDeviceSize driverBudget = 0;
+		VkDeviceSize driverUsage = 0;
+		// committed at the last updateBudget(), to extrapolate driverUsage.
+		VkDeviceSize committedAtUpdate = 0;
+	};
+
+	Allocation allocate(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo, bool linear,
+		bool dedicated, VkBuffer dedicatedBuffer, VkImage dedicatedImage);
+	Allocation allocateFromPool(uint32_t memoryType, bool linear, const VkMemoryRequirements& requirements, bool respectBudget);
+	Allocation allocateDedicated(uint32_t memoryType, VkDeviceSize size, VkBuffer buffer, VkImage image, bool respectBudget);
+	void free(Allocation& allocation);
+
+	// Memory types allowed by typeBits that suit usage, best first.
+	std::vector<uint32_t> memoryTypeCandidates(uint32_t typeBits, MemoryUsage usage) const;
+	VkResult allocateMemory(uint32_t memoryType, VkDeviceSize size, const void* next, bool respectBudget,
+		VkDeviceMemory& memory, uint8_t*& mapped);
+	void freeMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory memory);
+	bool fitsBudget(uint32_t heap, VkDeviceSize size) const;
+	void readBudget();
+
+	uint32_t heapOf(uint32_t memoryType) const { return m_memoryProperties.memoryTypes[memoryType].heapIndex; }
+
+	const VulkanContext& m_context;
+	const VkPhysicalDeviceMemoryProperties& m_memoryProperties;
+	VkDeviceSize m_preferredBlockSize;
+	bool m_hasMemoryBudget = false;
+
+	mutable std::mutex m_mutex;
+	// Two per memory type: index 2 * type for linear, 2 * type + 1 for optimal.
+	std::vector<Pool> m_pools;
+	HeapCounters m_heaps[VK_MAX_MEMORY_HEAPS];
+	uint32_t m_deviceMemoryCount = 0;
+};
+
+}
@@ -0,0 +1,1348 @@
+#include "GpuScene.h"
+
+#include "SpritePipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace initium {
+
+namespace {
+
+// The per-frame view buffer, std430 as the scene shaders read it.
+struct ViewData {
+	float viewProjection[16];
+	float view[16];
+	float frustumPlanes[6][4];
+	// P[0][0], P[1][1], near and far.
+	float projection[4];
+	float pyramidSize[2];
+	uint32_t pyramidLevels;
+	float time;
+	float lightDirection[4];
+	float eye[4];
+};
+
+// Push constants of shaders/scene_cull.comp.
+struct CullConstants {
+	uint32_t instanceCount;
+	uint32_t phase;
+	uint32_t cullingEnabled;
+	uint32_t occlusionEnabled;
+	BindlessBuffer instances;
+	BindlessBuffer meshes;
+	BindlessBuffer draws;
+	BindlessBuffer visibility;
+	BindlessBuffer view;
+	BindlessTexture pyramid;
+	BindlessSampler sampler;
+	// Invalid to draw whole meshes.
+	BindlessBuffer clusters;
+	uint32_t groupCapacity;
+};
+
+// Push constants of shaders/scene_cluster_args.comp.
+struct ClusterArgsConstants {
+	BindlessBuffer clusters;
+	uint32_t phase;
+	uint32_t groupCapacity;
+};
+
+// Push constants of shaders/scene_cluster_cull.comp, and of scene.task and
+// scene.mesh, which also need the vertex data.
+struct ClusterCullConstants {
+	uint32_t phase;
+	uint32_t groupCapacity;
+	uint32_t drawCapacity;
+	BindlessBuffer clusters;
+	BindlessBuffer draws;
+	BindlessBuffer instances;
+	BindlessBuffer meshes;
+	BindlessBuffer meshlets;
+	BindlessBuffer view;
+	// Invalid to skip the occlusion test.
+	BindlessTexture pyramid;
+	BindlessSampler sampler;
+	BindlessBuffer vertices;
+	BindlessBuffer meshletVertices;
+	BindlessBuffer meshletTriangles;
+};
+
+// Push constants of shaders/scene_hiz.comp.
+struct PyramidConstants {
+	uint32_t sourceSize[2];
+	uint32_t destinationSize[2];
+	BindlessTexture depth;
+	BindlessSampler sampler;
+	BindlessStorageImage source;
+	BindlessStorageImage destination;
+	uint32_t fromDepth;
+};
+
+// Push constants of shaders/scene.vert.
+struct DrawConstants {
+	BindlessBuffer view;
+	BindlessBuffer instances;
+	BindlessBuffer vertices;
+};
+
+uint32_t previousPowerOfTwo(uint32_t value) {
+	uint32_t result = 1;
+	while (result <= value / 2) {
+		result *= 2;
+	}
+	return result;
+}
+
+struct Vec3 {
+	float x, y, z;
+};
+
+Vec3 operator-(Vec3 a, Vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+Vec3 cross(Vec3 a, Vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+Vec3 normalize(Vec3 v) {
+	float length = std::sqrt(dot(v, v));
+	return { v.x / length, v.y / length, v.z / length };
+}
+
+// Column-major, out = a * b.
+void multiply(const float a[16], const float b[16], float out[16]) {
+	for (int column = 0; column < 4; column++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++) {
+				sum += a[k * 4 + row] * b[column * 4 + k];
+			}
+			out[column * 4 + row] = sum;
+		}
+	}
+}
+
+// Interleaved position and normal, six floats a vertex.
+struct MeshBuilder {
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<GpuMesh> meshes;
+
+	uint32_t vertexCount() const { return static_cast<uint32_t>(vertices.size() / 6); }
+
+	void begin() {
+		GpuMesh mesh{};
+		mesh.firstIndex = static_cast<uint32_t>(indices.size());
+		mesh.vertexOffset = static_cast<int32_t>(vertexCount());
+		meshes.push_back(mesh);
+	}
+
+	uint32_t vertex(Vec3 position, Vec3 normal) {
+		GpuMesh& mesh = meshes.back();
+		mesh.radius = std::max(mesh.radius, std::sqrt(dot(position, position)));
+		vertices.insert(vertices.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z });
+		return vertexCount() - 1 - static_cast<uint32_t>(mesh.vertexOffset);
+	}
+
+	void triangle(uint32_t a, uint32_t b, uint32_t c) {
+		indices.insert(indices.end(), { a, b, c });
+		meshes.back().indexCount += 3;
+	}
+};
+
+// Unit cube, counter-clockwise seen from outside. Each face's tangents
+// satisfy u x v = n.
+void buildCube(MeshBuilder& builder) {
+	const Vec3 faces[6][3] = {
+		{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+		{ { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+		{ { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } },
+		{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+		{ { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+		{ { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } },
+	};
+	builder.begin();
+	for (const auto& face : faces) {
+		Vec3 n = face[0], u = face[1], v = face[2];
+		uint32_t corners[4];
+		const float signs[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+		for (int i = 0; i < 4; i++) {
+			Vec3 position{ (n.x + signs[i][0] * u.x + signs[i][1] * v.x) * 0.5f, (n.y + signs[i][0] * u.y + signs[i][1] * v.y) * 0.5f,
+				(n.z + signs[i][0] * u.z + signs[i][1] * v.z) * 0.5f };
+			corners[i] = builder.vertex(position, n);
+		}
+		builder.triangle(corners[0], corners[1], corners[2]);
+		builder.triangle(corners[0], corners[2], corners[3]);
+	}
+}
+
+// Flat-shaded octahedron, one triangle per octant.
+void buildOctahedron(MeshBuilder& builder) {
+	constexpr float kRadius = 0.6f;
+	builder.begin();
+	for (int octant = 0; octant < 8; octant++) {
+		float sx = (octant & 1) ? -1.0f : 1.0f;
+		float sy = (octant & 2) ? -1.0f : 1.0f;
+		float sz = (octant & 4) ? -1.0f : 1.0f;
+		Vec3 normal = normalize({ sx, sy, sz });
+		uint32_t a = builder.vertex({ sx * kRadius, 0, 0 }, normal);
+		uint32_t b = builder.vertex({ 0, sy * kRadius, 0 }, normal);
+		uint32_t c = builder.vertex({ 0, 0, sz * kRadius }, normal);
+		// Each mirrored axis flips the winding.
+		if (sx * sy * sz > 0.0f) {
+			builder.triangle(a, b, c);
+		} else {
+			builder.triangle(a, c, b);
+		}
+	}
+}
+
+// Smooth torus standing in the XY plane, the high-poly mesh. Quads are
+// emitted in 7x7 tiles, 64 vertices and 98 triangles each, so meshlets
+// built in index order come out as compact patches rather than strips.
+void buildTorus(MeshBuilder& builder) {
+	constexpr uint32_t kRings = 126;
+	constexpr uint32_t kSides = 42;
+	constexpr uint32_t kTile = 7;
+	constexpr float kMajorRadius = 0.42f;
+	constexpr float kMinorRadius = 0.16f;
+	constexpr float kTau = 6.2831853f;
+
+	builder.begin();
+	for (uint32_t ring = 0; ring < kRings; ring++) {
+		float u = kTau * static_cast<float>(ring) / kRings;
+		for (uint32_t side = 0; side < kSides; side++) {
+			float v = kTau * static_cast<float>(side) / kSides;
+			Vec3 normal{ std::cos(u) * std::cos(v), std::sin(u) * std::cos(v), std::sin(v) };
+			float distance = kMajorRadius + kMinorRadius * std::cos(v);
+			builder.vertex({ std::cos(u) * distance, std::sin(u) * distance, kMinorRadius * std::sin(v) }, normal);
+		}
+	}
+	// Counter-clockwise seen from outside: increasing u then v.
+	auto index = [](uint32_t ring, uint32_t side) { return (ring % kRings) * kSides + side % kSides; };
+	for (uint32_t tileRing = 0; tileRing < kRings; tileRing += kTile) {
+		for (uint32_t tileSide = 0; tileSide < kSides; tileSide += kTile) {
+			for (uint32_t ring = tileRing; ring < std::min(tileRing + kTile, kRings); ring++) {
+				for (uint32_t side = tileSide; side < std::min(tileSide + kTile, kSides); side++) {
+					uint32_t a = index(ring, side), b = index(ring + 1, side), c = index(ring + 1, side + 1), d = index(ring, side + 1);
+					builder.triangle(a, b, c);
+					builder.triangle(a, c, d);
+				}
+			}
+		}
+	}
+}
+
+// The meshes and their clusters, as the scene builds them when no asset
+// pack has them.
+void buildGeometry(MeshBuilder& builder, MeshletData& meshlets) {
+	buildCube(builder);
+	buildOctahedron(builder);
+	buildTorus(builder);
+	for (size_t i = 0; i < builder.meshes.size(); i++) {
+		GpuMesh& mesh = builder.meshes[i];
+		uint32_t vertexEnd = i + 1 < builder.meshes.size() ? static_cast<uint32_t>(builder.meshes[i + 1].vertexOffset) : builder.vertexCount();
+		uint32_t vertexOffset = static_cast<uint32_t>(mesh.vertexOffset);
+		mesh.meshletOffset = buildMeshlets(meshlets, builder.vertices.data() + static_cast<size_t>(vertexOffset) * 6, 6, vertexEnd - vertexOffset,
+			builder.indices.data() + mesh.firstIndex, mesh.indexCount, vertexOffset);
+		mesh.meshletCount = static_cast<uint32_t>(meshlets.meshlets.size()) - mesh.meshletOffset;
+	}
+}
+
+// Contents of a buffer to upload, wherever they live.
+struct BufferSource {
+	const void* data = nullptr;
+	VkDeviceSize size = 0;
+};
+
+template <typename T>
+BufferSource bufferSource(const std::vector<T>& data) {
+	return { data.data(), data.size() * sizeof(T) };
+}
+
+struct GeometrySources {
+	BufferSource vertices;
+	BufferSource indices;
+	BufferSource meshes;
+	BufferSource meshlets;
+	BufferSource meshletVertices;
+	BufferSource meshletTriangles;
+	BufferSource clusterIndices;
+};
+
+// Names of the scene's buffers in asset packs.
+const std::pair<const char*, BufferSource GeometrySources::*> kGeometryAssets[] = {
+	{ "scene/vertices", &GeometrySources::vertices },
+	{ "scene/indices", &GeometrySources::indices },
+	{ "scene/meshes", &GeometrySources::meshes },
+	{ "scene/meshlets", &GeometrySources::meshlets },
+	{ "scene/meshlet_vertices", &GeometrySources::meshletVertices },
+	{ "scene/meshlet_triangles", &GeometrySources::meshletTriangles },
+	{ "scene/cluster_indices", &GeometrySources::clusterIndices },
+};
+constexpr const char* kInstancesAsset = "scene/instances";
+
+GeometrySources geometrySources(const MeshBuilder& builder, const MeshletData& meshlets) {
+	GeometrySources sources;
+	sources.vertices = bufferSource(builder.vertices);
+	sources.indices = bufferSource(builder.indices);
+	sources.meshes = bufferSource(builder.meshes);
+	sources.meshlets = bufferSource(meshlets.meshlets);
+	sources.meshletVertices = bufferSource(meshlets.vertices);
+	sources.meshletTriangles = bufferSource(meshlets.triangles);
+	sources.clusterIndices = bufferSource(meshlets.indices);
+	return sources;
+}
+
+// Points sources at the pack's copy of every geometry buffer. False when
+// one is missing or not a whole number of its elements.
+bool findGeometry(const AssetPack& assets, GeometrySources& sources) {
+	for (const auto& [name, member] : kGeometryAssets) {
+		Asset asset = assets.find(name);
+		if (!asset || asset.entry->type != AssetType::Buffer || asset.size() == 0) {
+			return false;
+		}
+		sources.*member = { asset.data, asset.size() };
+	}
+	return sources.vertices.size % (6 * sizeof(float)) == 0 && sources.meshes.size % sizeof(GpuMesh) == 0
+		&& sources.meshlets.size % sizeof(GpuMeshlet) == 0;
+}
+
+constexpr float kInstanceSpacing = 2.5f;
+
+// Distance from the middle of a scene of instanceCount instances to its edge.
+float sceneExtent(uint32_t instanceCount) {
+	uint32_t side = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount)))));
+	return static_cast<float>(side) * kInstanceSpacing * 0.5f;
+}
+
+// A square field of objects on gentle hills, each a pure function of its
+// index so the scene is the same on every run.
+std::vector<GpuInstance> buildInstances(uint32_t instanceCount, uint32_t meshCount) {
+	uint32_t side = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount)))));
+	float extent = sceneExtent(instanceCount);
+
+	std::vector<GpuInstance> instances(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++) {
+		uint32_t hash = i * 2654435761u;
+		auto unit = [hash](int shift) { return static_cast<float>((hash >> shift) & 0xFF) / 255.0f; };
+
+		GpuInstance& instance = instances[i];
+		float x = (static_cast<float>(i % side) + 0.5f) * kInstanceSpacing - extent;
+		float z = (static_cast<float>(i / side) + 0.5f) * kInstanceSpacing - extent;
+		instance.position[0] = x + (unit(0) - 0.5f) * kInstanceSpacing * 0.4f;
+		instance.position[1] = 3.0f * std::sin(x * 0.03f) * std::cos(z * 0.04f) + unit(4);
+		instance.position[2] = z + (unit(12) - 0.5f) * kInstanceSpacing * 0.4f;
+		instance.scale = 0.6f + 0.8f * unit(20);
+		instance.color[0] = 0.3f + 0.7f * unit(8);
+		instance.color[1] = 0.3f + 0.7f * unit(16);
+		instance.color[2] = 0.3f + 0.7f * unit(24);
+		instance.color[3] = 1.0f;
+		instance.mesh = (hash >> 28) % meshCount;
+		instance.spinSpeed = 0.2f + 1.5f * unit(2);
+		instance.spinPhase = 6.2831853f * unit(10);
+		instance.padding = 0;
+	}
+	return instances;
+}
+
+// Looks from eye at target with the scene's projection and frustum planes.
+SceneView lookAtView(Vec3 eye, Vec3 target, VkExtent2D extent, float sceneExtent) {
+	constexpr float kFieldOfView = 1.0471976f;
+	constexpr float kNear = 0.5f;
+
+	Vec3 forward = normalize(target - eye);
+	Vec3 side = normalize(cross(forward, { 0.0f, 1.0f, 0.0f }));
+	Vec3 up = cross(side, forward);
+	const float view[16] = {
+		side.x, up.x, -forward.x, 0.0f,
+		side.y, up.y, -forward.y, 0.0f,
+		side.z, up.z, -forward.z, 0.0f,
+		-dot(side, eye), -dot(up, eye), dot(forward, eye), 1.0f,
+	};
+
+	// Reverse-Z: depth 1 at the near plane, 0 at the far one. Y is flipped
+	// for Vulkan's downward clip space.
+	float farPlane = sceneExtent * 4.0f;
+	float aspect = extent.height > 0 ? static_cast<float>(extent.width) / static_cast<float>(extent.height) : 1.0f;
+	float focal = 1.0f / std::tan(kFieldOfView * 0.5f);
+	const float projection[16] = {
+		focal / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, -focal, 0.0f, 0.0f,
+		0.0f, 0.0f, kNear / (farPlane - kNear), -1.0f,
+		0.0f, 0.0f, kNear * farPlane / (farPlane - kNear), 0.0f,
+	};
+
+	SceneView result;
+	multiply(projection, view, result.viewProjection);
+	std::memcpy(result.view, view, sizeof(result.view));
+	result.focal[0] = focal / aspect;
+	result.focal[1] = focal;
+	result.nearPlane = kNear;
+	result.farPlane = farPlane;
+	result.eye[0] = eye.x;
+	result.eye[1] = eye.y;
+	result.eye[2] = eye.z;
+
+	// Gribb-Hartmann: each plane is the w row plus or minus another, for
+	// -w <= x, y <= w and 0 <= z <= w.
+	const float* m = result.viewProjection;
+	auto row = [m](int index, float out[4]) {
+		for (int column = 0; column < 4; column++) {
+			out[column] = m[column * 4 + index];
+		}
+	};
+	float rows[4][4];
+	for (int i = 0; i < 4; i++) {
+		row(i, rows[i]);
+	}
+	const float signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 0.0f, -1.0f };
+	const int axes[6] = { 0, 0, 1, 1, 2, 2 };
+	for (int plane = 0; plane < 6; plane++) {
+		float* out = result.frustumPlanes[plane];
+		for (int i = 0; i < 4; i++) {
+			out[i] = plane == 4 ? rows[2][i] : rows[3][i] + signs[plane] * rows[axes[plane]][i];
+		}
+		float length = std::sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+		for (int i = 0; i < 4; i++) {
+			out[i] /= length;
+		}
+	}
+	return result;
+}
+
+}
+
+const char* sceneGeometryName(SceneGeometry geometry) {
+	switch (geometry) {
+	case SceneGeometry::Meshes:
+		return "meshes";
+	case SceneGeometry::ClustersCompute:
+		return "clusters culled by compute";
+	case SceneGeometry::ClustersMeshShader:
+		return "clusters culled by task shaders";
+	}
+	return "unknown";
+}
+
+SceneView orbitView(double time, VkExtent2D extent, float sceneExtent) {
+	float angle = static_cast<float>(std::fmod(time * 0.05, 6.283185307179586));
+	float radius = sceneExtent * 0.6f;
+	Vec3 eye{ radius * std::cos(angle), 8.0f + sceneExtent * 0.1f, radius * std::sin(angle) };
+	Vec3 target{ radius * 0.4f * std::cos(angle + 1.0f), 0.0f, radius * 0.4f * std::sin(angle + 1.0f) };
+	return lookAtView(eye, target, extent, sceneExtent);
+}
+
+SceneView flythroughView(double time, VkExtent2D extent, float sceneExtent) {
+	// Eye and target in fractions of the scene's extent, heights above the
+	// tallest instances: in wide and high, down between the instances,
+	// where most of the scene is occluded, along the ground, and back up
+	// over it.
+	struct Key {
+		Vec3 eye;
+		Vec3 target;
+	};
+	static const Key kKeys[] = {
+		{ { 0.9f, 0.35f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ { 0.45f, 0.08f, 0.5f }, { -0.2f, 0.0f, 0.1f } },
+		{ { -0.1f, 0.0f, 0.3f }, { -0.6f, 0.0f, 0.0f } },
+		{ { -0.5f, 0.0f, -0.2f }, { -0.2f, 0.0f, -0.7f } },
+		{ { -0.3f, 0.15f, -0.8f }, { 0.3f, 0.0f, -0.2f } },
+		{ { 0.5f, 0.6f, -0.5f }, { 0.0f, 0.0f, 0.0f } },
+	};
+	constexpr int kKeyCount = static_cast<int>(std::size(kKeys));
+	constexpr float kGroundClearance = 5.0f;
+
+	double position = std::fmod(time / kFlythroughSeconds, 1.0) * kKeyCount;
+	int segment = static_cast<int>(position);
+	float t = static_cast<float>(position - segment);
+	// Catmull-Rom through the keys, so the camera never stops or turns
+	// sharply at one.
+	auto spline = [&](Vec3 Key::*member) {
+		const Vec3& p0 = kKeys[(segment + kKeyCount - 1) % kKeyCount].*member;
+		const Vec3& p1 = kKeys[segment % kKeyCount].*member;
+		const Vec3& p2 = kKeys[(segment + 1) % kKeyCount].*member;
+		const Vec3& p3 = kKeys[(segment + 2) % kKeyCount].*member;
+		auto axis = [t](float a, float b, float c, float d) {
+			return 0.5f * (2.0f * b + (c - a) * t + (2.0f * a - 5.0f * b + 4.0f * c - d) * t * t + (3.0f * b - a - 3.0f * c + d) * t * t * t);
+		};
+		return Vec3{ axis(p0.x, p1.x, p2.x, p3.x) * sceneExtent, kGroundClearance + axis(p0.y, p1.y, p2.y, p3.y) * sceneExtent,
+			axis(p0.z, p1.z, p2.z, p3.z) * sceneExtent };
+	};
+	Vec3 eye = spline(&Key::eye);
+	Vec3 target = spline(&Key::target);
+	target.y -= kGroundClearance;
+	return lookAtView(eye, target, extent, sceneExtent);
+}
+
+GpuScene::GpuScene(const VulkanContext& context, GpuAllocator& allocator, StagingRing& staging, BindlessTable& bindless,
+	PipelineCache& pipelineCache, VkFormat colorFormat, uint32_t instanceCount, const AssetPack* assets,
+	const std::filesystem::path& shaderDirectory)
+	: m_context(context), m_allocator(allocator), m_staging(staging), m_bindless(bindless), m_colorFormat(colorFormat),
+	  m_shaderDirectory(shaderDirectory), m_instanceCount(std::min(instanceCount, context.properties().limits.maxDrawIndirectCount)) {
+	if (std::max({ sizeof(CullConstants), sizeof(ClusterArgsConstants), sizeof(ClusterCullConstants), sizeof(PyramidConstants),
+			sizeof(DrawConstants) })
+		> bindless.pushConstantBytes()) {
+		throw std::runtime_error("scene push constants exceed the bindless pipeline layout");
+	}
+	const QueueFamilies& families = context.queueFamilies();
+	m_queueFamilies = { families.graphics.family, families.compute.family, families.transfer.family };
+	std::sort(m_queueFamilies.begin(), m_queueFamilies.end());
+	m_queueFamilies.erase(std::unique(m_queueFamilies.begin(), m_queueFamilies.end()), m_queueFamilies.end());
+	try {
+		createGeometry(assets);
+		createInstances(assets);
+		// Nothing was visible before the first frame, so it draws everything
+		// in the second phase.
+		std::vector<uint32_t> visibility(m_instanceCount, 0);
+		m_visibility = uploadBuffer(visibility.data(), visibility.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false);
+		m_visibilityHandle = m_bindless.addBuffer(m_visibility.buffer);
+
+		for (FrameBuffers& frame : m_frames) {
+			VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+			bufferInfo.size = kDrawCommandsOffset + 2 * static_cast<VkDeviceSize>(m_instanceCount) * sizeof(VkDrawIndexedIndirectCommand);
+			bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+				| VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			// Used by the async compute passes too, and a different buffer
+			// every frame, so handing them over between frames won't do.
+			shareAcrossQueues(bufferInfo);
+			frame.draws = m_allocator.createBuffer(bufferInfo, { MemoryUsage::GpuOnly });
+			frame.drawsHandle = m_bindless.addBuffer(frame.draws.buffer);
+
+			bufferInfo.size = kClusterGroupsOffset + 2 * static_cast<VkDeviceSize>(m_groupCapacity) * 2 * sizeof(uint32_t);
+			frame.clusters = m_allocator.createBuffer(bufferInfo, { MemoryUsage::GpuOnly });
+			frame.clustersHandle = m_bindless.addBuffer(frame.clusters.buffer);
+
+			bufferInfo.size = sizeof(ViewData);
+			bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			frame.view = m_allocator.createBuffer(bufferInfo, { MemoryUsage::Upload });
+			frame.viewHandle = m_bindless.addBuffer(frame.view.buffer);
+
+			// Both counter blocks, the cluster list's after the instances'.
+			bufferInfo.size = kDrawCommandsOffset + kClusterCountersBytes;
+			bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			frame.readback = m_allocator.createBuffer(bufferInfo, { MemoryUsage::Readback });
+		}
+
+		// Texel fetches still need a sampler in GLSL; it never filters.
+		VkSamplerCreateInfo samplerInfo{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		vkCheck(vkCreateSampler(m_context.device(), &samplerInfo, m_context.allocationCallbacks(), &m_pointSampler), "vkCreateSampler");
+		m_pointSamplerHandle = m_bindless.addSampler(m_pointSampler);
+
+		for (const PipelineSource& source : pipelineSources()) {
+			*source.pipeline = createPipeline(pipelineCache, source);
+		}
+	} catch (...) {
+		m_staging.waitIdle();
+		destroy();
+		throw;
+	}
+	m_geometry = meshShadersAvailable() ? SceneGeometry::ClustersMeshShader : SceneGeometry::ClustersCompute;
+	m_stats.instances = m_instanceCount;
+	m_stats.meshes = m_meshCount;
+	m_stats.meshlets = m_meshletCount;
+}
+
+GpuScene::~GpuScene() {
+	destroy();
+}
+
+void GpuScene::destroy() {
+	// Only after the GPU is done with them: the bindless slots are not
+	// recycled.
+	VkDevice device = m_context.device();
+	vkDestroyPipeline(device, m_meshPipeline, m_context.allocationCallbacks());
+	vkDestroyPipeline(device, m_drawPipeline, m_context.allocationCallbacks());
+	vkDestroyPipeline(device, m_clusterCullPipeline, m_context.allocationCallbacks());
+	vkDestroyPipeline(device, m_clusterArgsPipeline, m_context.allocationCallbacks());
+	vkDestroyPipeline(device, m_pyramidPipeline, m_context.allocationCallbacks());
+	vkDestroyPipeline(device, m_cullPipeline, m_context.allocationCallbacks());
+	m_meshPipeline = VK_NULL_HANDLE;
+	m_drawPipeline = VK_NULL_HANDLE;
+	m_clusterCullPipeline = VK_NULL_HANDLE;
+	m_clusterArgsPipeline = VK_NULL_HANDLE;
+	m_pyramidPipeline = VK_NULL_HANDLE;
+	m_cullPipeline = VK_NULL_HANDLE;
+	for (Targets& targets : m_retiredTargets) {
+		destroyTargets(targets);
+	}
+	m_retiredTargets.clear();
+	destroyTargets(m_targets);
+	vkDestroySampler(device, m_pointSampler, m_context.allocationCallbacks());
+	m_pointSampler = VK_NULL_HANDLE;
+	for (FrameBuffers& frame : m_frames) {
+		m_allocator.destroyBuffer(frame.readback);
+		m_allocator.destroyBuffer(frame.view);
+		m_allocator.destroyBuffer(frame.clusters);
+		m_allocator.destroyBuffer(frame.draws);
+	}
+	m_allocator.destroyBuffer(m_visibility);
+	m_allocator.destroyBuffer(m_instances);
+	m_allocator.destroyBuffer(m_clusterIndices);
+	m_allocator.destroyBuffer(m_meshletTriangles);
+	m_allocator.destroyBuffer(m_meshletVertices);
+	m_allocator.destroyBuffer(m_meshlets);
+	m_allocator.destroyBuffer(m_meshes);
+	m_allocator.destroyBuffer(m_indices);
+	m_allocator.destroyBuffer(m_vertices);
+}
+
+GpuBuffer GpuScene::uploadBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, bool concurrent) {
+	VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = size;
+	bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (concurrent) {
+		shareAcrossQueues(bufferInfo);
+	}
+	GpuBuffer buffer = m_allocator.createBuffer(bufferInfo, { MemoryUsage::GpuOnly });
+
+	// In pieces well below the ring size, so a large scene never needs more
+	// staging space than there is. Acquired and waited on by the first
+	// frame, like any other upload.
+	VkDeviceSize chunk = m_staging.capacity() / 4;
+	uint32_t family = bufferInfo.sharingMode == VK_SHARING_MODE_CONCURRENT ? VK_QUEUE_FAMILY_IGNORED : m_context.queueFamilies().graphics.family;
+	for (VkDeviceSize offset = 0; offset < size; offset += chunk) {
+		m_staging.upload(buffer.buffer, offset, static_cast<const uint8_t*>(data) + offset, std::min(chunk, size - offset), family);
+	}
+	return buffer;
+}
+
+void GpuScene::shareAcrossQueues(VkBufferCreateInfo& bufferInfo) const {
+	if (m_queueFamilies.size() > 1) {
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_queueFamilies.size());
+		bufferInfo.pQueueFamilyIndices = m_queueFamilies.data();
+	}
+}
+
+void GpuScene::addAssets(AssetPackWriter& writer, uint32_t instanceCount) {
+	MeshBuilder builder;
+	MeshletData meshlets;
+	buildGeometry(builder, meshlets);
+	GeometrySources sources = geometrySources(builder, meshlets);
+	for (const auto& [name, member] : kGeometryAssets) {
+		writer.addBuffer(name, (sources.*member).data, (sources.*member).size);
+	}
+	if (instanceCount > 0) {
+		std::vector<GpuInstance> instances = buildInstances(instanceCount, static_cast<uint32_t>(builder.meshes.size()));
+		writer.addBuffer(kInstancesAsset, instances.data(), instances.size() * sizeof(GpuInstance));
+	}
+}
+
+void GpuScene::createGeometry(const AssetPack* assets) {
+	// From the pack's mapping straight into the staging ring when it has
+	// the geometry, otherwise built here.
+	MeshBuilder builder;
+	MeshletData meshlets;
+	GeometrySources sources;
+	if (!assets || !findGeometry(*assets, sources)) {
+		if (assets) {
+			std::printf("scene: %s has no usable scene geometry, building it\n", assets->path().string().c_str());
+		}
+		buildGeometry(builder, meshlets);
+		sources = geometrySources(builder, meshlets);
+	}
+	m_meshCount = static_cast<uint32_t>(sources.meshes.size / sizeof(GpuMesh));
+	m_meshletCount = static_cast<uint32_t>(sources.meshlets.size / sizeof(GpuMeshlet));
+	const GpuMesh* meshes = static_cast<const GpuMesh*>(sources.meshes.data);
+	uint32_t maxMeshlets = 0;
+	for (uint32_t i = 0; i < m_meshCount; i++) {
+		maxMeshlets = std::max(maxMeshlets, meshes[i].meshletCount);
+	}
+
+	// Room for every instance to be drawn with its largest mesh's clusters,
+	// within what a task shader launch can address. Cluster draws are
+	// capped lower: they are 20 bytes each, per frame in flight.
+	uint64_t groups = static_cast<uint64_t>(m_instanceCount) * ((maxMeshlets + kClusterGroupSize - 1) / kClusterGroupSize);
+	m_groupCapacity = static_cast<uint32_t>(std::clamp<uint64_t>(groups, 1, 1u << 22));
+	m_clusterDrawCapacity = static_cast<uint32_t>(std::clamp<uint64_t>(static_cast<uint64_t>(m_instanceCount) * maxMeshlets, 1, kMaxClusterDraws));
+
+	m_meshlets = uploadBuffer(sources.meshlets.data, sources.meshlets.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	m_meshletVertices = uploadBuffer(sources.meshletVertices.data, sources.meshletVertices.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	m_meshletTriangles = uploadBuffer(sources.meshletTriangles.data, sources.meshletTriangles.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	m_clusterIndices = uploadBuffer(sources.clusterIndices.data, sources.clusterIndices.size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	m_meshletsHandle = m_bindless.addBuffer(m_meshlets.buffer);
+	m_meshletVerticesHandle = m_bindless.addBuffer(m_meshletVertices.buffer);
+	m_meshletTrianglesHandle = m_bindless.addBuffer(m_meshletTriangles.buffer);
+
+	m_vertices = uploadBuffer(sources.vertices.data, sources.vertices.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	m_indices = uploadBuffer(sources.indices.data, sources.indices.size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	m_meshes = uploadBuffer(sources.meshes.data, sources.meshes.size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	m_verticesHandle = m_bindless.addBuffer(m_vertices.buffer);
+	m_meshesHandle = m_bindless.addBuffer(m_meshes.buffer);
+}
+
+void GpuScene::createInstances(const AssetPack* assets) {
+	m_extent = sceneExtent(m_instanceCount);
+
+	// Packs hold the instances for the count they were written with.
+	Asset packed = assets ? assets->find(kInstancesAsset) : Asset{};
+	if (packed && packed.entry->type == AssetType::Buffer && packed.size() == static_cast<uint64_t>(m_instanceCount) * sizeof(GpuInstance)) {
+		m_instances = uploadBuffer(packed.data, packed.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	} else {
+		std::vector<GpuInstance> instances = buildInstances(m_instanceCount, m_meshCount);
+		m_instances = uploadBuffer(instances.data(), instances.size() * sizeof(GpuInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	}
+	m_instancesHandle = m_bindless.addBuffer(m_instances.buffer);
+}
+
+VkPipeline GpuScene::createComputePipeline(PipelineCache& pipelineCache, const std::filesystem::path& shaderPath) const {
+	VkDevice device = m_context.device();
+	VkShaderModule shader = loadShaderModule(m_context, shaderPath);
+	VkComputePipelineCreateInfo computeInfo{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	computeInfo.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+	computeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeInfo.stage.module = shader;
+	computeInfo.stage.pName = "main";
+	computeInfo.layout = m_bindless.pipelineLayout();
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	auto start = std::chrono::steady_clock::now();
+	VkResult result = vkCreateComputePipelines(device, pipelineCache.threadCache(), 1, &computeInfo, m_context.allocationCallbacks(), &pipeline);
+	pipelineCache.recordCreation(std::chrono::steady_clock::now() - start);
+	vkDestroyShaderModule(device, shader, m_context.allocationCallbacks());
+	vkCheck(result, "vkCreateComputePipelines");
+	return pipeline;
+}
+
+std::vector<GpuScene::PipelineSource> GpuScene::pipelineSources() {
+	std::vector<PipelineSource> sources = {
+		{ &m_cullPipeline, { m_shaderDirectory / "scene_cull.comp.spv" }, {} },
+		{ &m_pyramidPipeline, { m_shaderDirectory / "scene_hiz.comp.spv" }, {} },
+		{ &m_clusterArgsPipeline, { m_shaderDirectory / "scene_cluster_args.comp.spv" }, {} },
+		{ &m_clusterCullPipeline, { m_shaderDirectory / "scene_cluster_cull.comp.spv" }, {} },
+		{ &m_drawPipeline, { m_shaderDirectory / "scene.vert.spv", m_shaderDirectory / "scene.frag.spv" },
+			{ VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT } },
+	};
+	if (m_context.features().meshShader) {
+		sources.push_back({ &m_meshPipeline,
+			{ m_shaderDirectory / "scene.task.spv", m_shaderDirectory / "scene.mesh.spv", m_shaderDirectory / "scene.frag.spv" },
+			{ VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT } });
+	}
+	return sources;
+}
+
+VkPipeline GpuScene::createPipeline(PipelineCache& pipelineCache, const PipelineSource& source) const {
+	if (source.stages.empty()) {
+		return createComputePipeline(pipelineCache, source.shaders[0]);
+	}
+	return createDrawPipeline(pipelineCache, source.shaders.data(), source.stages.data(), static_cast<uint32_t>(source.stages.size()));
+}
+
+void GpuScene::watchShaders(ShaderReloader& reloader, PipelineCache& pipelineCache) {
+	for (const PipelineSource& source : pipelineSources()) {
+		reloader.watch(*source.pipeline, source.shaders, [this, &pipelineCache, source] { return createPipeline(pipelineCache, source); });
+	}
+}
+
+VkPipeline GpuScene::createDrawPipeline(PipelineCache& pipelineCache, const std::filesystem::path* shaderPaths, const VkShaderStageFlagBits* stages,
+	uint32_t stageCount) const {
+	VkDevice device = m_context.device();
+	std::vector<VkShaderModule> shaders;
+	auto destroyShaders = [&] {
+		for (VkShaderModule shader : shaders) {
+			vkDestroyShaderModule(device, shader, m_context.allocationCallbacks());
+		}
+	};
+	std::vector<VkPipelineShaderStageCreateInfo> stageInfos;
+	try {
+		for (uint32_t i = 0; i < stageCount; i++) {
+			shaders.push_back(loadShaderModule(m_context, shaderPaths[i]));
+			VkPipelineShaderStageCreateInfo stageInfo{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+			stageInfo.stage = stages[i];
+			stageInfo.module = shaders.back();
+			stageInfo.pName = "main";
+			stageInfos.push_back(stageInfo);
+		}
+	} catch (...) {
+		destroyShaders();
+		throw;
+	}
+	// Mesh pipelines have no vertex input or input assembly.
+	bool meshPipeline = stages[0] == VK_SHADER_STAGE_TASK_BIT_EXT || stages[0] == VK_SHADER_STAGE_MESH_BIT_EXT;
+
+	// Vertices are pulled from a bindless storage buffer.
+	VkPipelineVertexInputStateCreateInfo vertexInput{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportState{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	// Meshes wind counter-clockwise; the projection's Y flip keeps them so
+	// in framebuffer space.
+	VkPipelineRasterizationStateCreateInfo rasterization{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+	rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterization.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample{ VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{ VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_GREATER;
+
+	VkPipelineColorBlendAttachmentState blendAttachment{};
+	blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlend{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+	colorBlend.attachmentCount = 1;
+	colorBlend.pAttachments = &blendAttachment;
+
+	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineRenderingCreateInfo renderingInfo{ VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &m_colorFormat;
+	renderingInfo.depthAttachmentFormat = kDepthFormat;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	pipelineInfo.pNext = &renderingInfo;
+	pipelineInfo.stageCount = stageCount;
+	pipelineInfo.pStages = stageInfos.data();
+	pipelineInfo.pVertexInputState = meshPipeline ? nullptr : &vertexInput;
+	pipelineInfo.pInputAssemblyState = meshPipeline ? nullptr : &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterization;
+	pipelineInfo.pMultisampleState = &multisample;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlend;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = m_bindless.pipelineLayout();
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	auto start = std::chrono::steady_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(device, pipelineCache.threadCache(), 1, &pipelineInfo, m_context.allocationCallbacks(), &pipeline);
+	pipelineCache.recordCreation(std::chrono::steady_clock::now() - start);
+
+	destroyShaders();
+	vkCheck(result, "vkCreateGraphicsPipelines");
+	return pipeline;
+}
+
+void GpuScene::createTargets(VkExtent2D extent) {
+	VkDevice device = m_context.device();
+	Targets targets;
+	targets.extent = extent;
+	// A power of two no larger than the depth buffer, so every level halves
+	// exactly and a level-0 texel covers at most a few depth texels.
+	targets.pyramidExtent = { previousPowerOfTwo(extent.width), previousPowerOfTwo(extent.height) };
+	while (targets.pyramidLevels < kMaxPyramidLevels
+		&& std::max(targets.pyramidExtent.width, targets.pyramidExtent.height) >> targets.pyramidLevels > 0) {
+		targets.pyramidLevels++;
+	}
+
+	try {
+		VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = kDepthFormat;
+		imageInfo.extent = { extent.width, extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		targets.depth = m_allocator.createImage(imageInfo, { MemoryUsage::GpuOnly });
+
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.extent = { targets.pyramidExtent.width, targets.pyramidExtent.height, 1 };
+		imageInfo.mipLevels = targets.pyramidLevels;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		targets.pyramid = m_allocator.createImage(imageInfo, { MemoryUsage::GpuOnly });
+
+		VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = targets.depth.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = kDepthFormat;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		vkCheck(vkCreateImageView(device, &viewInfo, m_context.allocationCallbacks(), &targets.depthView), "vkCreateImageView");
+
+		viewInfo.image = targets.pyramid.image;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, targets.pyramidLevels, 0, 1 };
+		vkCheck(vkCreateImageView(device, &viewInfo, m_context.allocationCallbacks(), &targets.pyramidView), "vkCreateImageView");
+
+		// The pyramid is built one level at a time through storage views of
+		// each, and sampled whole by the cull pass.
+		for (uint32_t level = 0; level < targets.pyramidLevels; level++) {
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+			VkImageView levelView = VK_NULL_HANDLE;
+			vkCheck(vkCreateImageView(device, &viewInfo, m_context.allocationCallbacks(), &levelView), "vkCreateImageView");
+			targets.levelViews.push_back(levelView);
+		}
+	} catch (...) {
+		destroyTargets(targets);
+		throw;
+	}
+
+	targets.depthHandle = m_bindless.addTexture(targets.depthView);
+	targets.pyramidHandle = m_bindless.addTexture(targets.pyramidView);
+	for (VkImageView levelView : targets.levelViews) {
+		targets.levelHandles.push_back(m_bindless.addStorageImage(levelView));
+	}
+
+	if (m_targets.depth) {
+		m_bindless.release(m_targets.depthHandle, m_targets.lastSerial);
+		m_bindless.release(m_targets.pyramidHandle, m_targets.lastSerial);
+		for (BindlessStorageImage handle : m_targets.levelHandles) {
+			m_bindless.release(handle, m_targets.lastSerial);
+		}
+		m_retiredTargets.push_back(std::move(m_targets));
+	}
+	m_targets = std::move(targets);
+}
+
+void GpuScene::destroyTargets(Targets& targets) {
+	VkDevice device = m_context.device();
+	for (VkImageView levelView : targets.levelViews) {
+		vkDestroyImageView(device, levelView, m_context.allocationCallbacks());
+	}
+	targets.levelViews.clear();
+	targets.levelHandles.clear();
+	vkDestroyImageView(device, targets.pyramidView, m_context.allocationCallbacks());
+	vkDestroyImageView(device, targets.depthView, m_context.allocationCallbacks());
+	targets.pyramidView = VK_NULL_HANDLE;
+	targets.depthView = VK_NULL_HANDLE;
+	m_allocator.destroyImage(targets.pyramid);
+	m_allocator.destroyImage(targets.depth);
+}
+
+void GpuScene::prepare(VkExtent2D extent) {
+	if (extent.width != m_targets.extent.width || extent.height != m_targets.extent.height || !m_targets.depth) {
+		createTargets(extent);
+	}
+}
+
+void GpuScene::addPasses(RenderGraph& graph, RenderGraphImage target, VkExtent2D extent, double time, uint64_t frameSerial) {
+	// FrameRing has waited for the frame that last used these buffers.
+	FrameBuffers& frame = m_frames[frameSerial % FrameRing::kMaxFramesInFlight];
+	frame.serial = frameSerial;
+	frame.pending = true;
+	SceneGeometry geometry = m_geometry;
+	bool clustered = geometry != SceneGeometry::Meshes;
+	frame.clustered = clustered;
+	VkBuffer drawBuffer = frame.draws.buffer;
+	VkBuffer clusterBuffer = frame.clusters.buffer;
+	VkBuffer readbackBuffer = frame.readback.buffer;
+
+	SceneView view = m_camera == SceneCamera::Flythrough ? flythroughView(time, extent, m_extent) : orbitView(time, extent, m_extent);
+	ViewData viewData{};
+	std::memcpy(viewData.viewProjection, view.viewProjection, sizeof(viewData.viewProjection));
+	std::memcpy(viewData.view, view.view, sizeof(viewData.view));
+	std::memcpy(viewData.frustumPlanes, view.frustumPlanes, sizeof(viewData.frustumPlanes));
+	viewData.projection[0] = view.focal[0];
+	viewData.projection[1] = view.focal[1];
+	viewData.projection[2] = view.nearPlane;
+	viewData.projection[3] = view.farPlane;
+	viewData.pyramidSize[0] = static_cast<float>(m_targets.pyramidExtent.width);
+	viewData.pyramidSize[1] = static_cast<float>(m_targets.pyramidExtent.height);
+	viewData.pyramidLevels = m_targets.pyramidLevels;
+	viewData.time = static_cast<float>(std::fmod(time, 3600.0));
+	const float light[3] = { 0.4f, -0.8f, 0.3f };
+	float lightLength = std::sqrt(light[0] * light[0] + light[1] * light[1] + light[2] * light[2]);
+	for (int i = 0; i < 3; i++) {
+		viewData.lightDirection[i] = light[i] / lightLength;
+		viewData.eye[i] = view.eye[i];
+	}
+	// Coherent, and the submission makes host writes visible to the GPU.
+	std::memcpy(frame.view.allocation.mapped, &viewData, sizeof(viewData));
+
+	// The persistent resources were last used by the previous frame on this
+	// queue: depth written by its second draw, the pyramid sampled by its
+	// second instance or cluster cull, the visible set written by it. Freshly created images
+	// have nothing to keep.
+	m_targets.lastSerial = frameSerial;
+	RenderGraphImageState depthInitial{ VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT };
+	RenderGraphImageState pyramidInitial{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | (meshShadersAvailable() ? VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT : VK_PIPELINE_STAGE_2_NONE),
+		VK_ACCESS_2_NONE };
+	if (m_targets.fresh) {
+		depthInitial = {};
+		pyramidInitial = {};
+		m_targets.fresh = false;
+	}
+	RenderGraphImage depth = graph.importImage("scene depth", { m_targets.depth.image, m_targets.depthView, kDepthFormat, m_targets.extent }, depthInitial,
+		{ VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL });
+	RenderGraphImage pyramid = graph.importImage("scene depth pyramid",
+		{ m_targets.pyramid.image, m_targets.pyramidView, VK_FORMAT_R32_SFLOAT, m_targets.pyramidExtent, m_targets.pyramidLevels }, pyramidInitial,
+		{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+	RenderGraphBuffer visibility = graph.importBuffer("scene visibility", m_visibility.buffer, 0, VK_WHOLE_SIZE,
+		{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT });
+	RenderGraphBufferState perFrame{ VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, true };
+	RenderGraphBuffer draws = graph.importBuffer("scene draws", drawBuffer, 0, VK_WHOLE_SIZE, perFrame);
+	RenderGraphBuffer clusters = graph.importBuffer("scene clusters", clusterBuffer, 0, VK_WHOLE_SIZE, perFrame);
+
+	// The reset and the first phase's culling only need last frame's
+	// results, so they can go to the compute queue ahead of the frame's
+	// graphics work. The rest waits on this frame's depth.
+	RenderGraphPass& reset = graph.addPass("scene reset").asyncCompute().use(draws, RenderGraphAccess::TransferWrite);
+	if (clustered) {
+		reset.use(clusters, RenderGraphAccess::TransferWrite);
+	}
+	reset.execute([drawBuffer, clusterBuffer, clustered](VkCommandBuffer commandBuffer) {
+		vkCmdFillBuffer(commandBuffer, drawBuffer, 0, kDrawCommandsOffset, 0);
+		if (clustered) {
+			vkCmdFillBuffer(commandBuffer, clusterBuffer, 0, kClusterGroupsOffset, 0);
+		}
+	});
+
+	CullConstants cull{};
+	cull.instanceCount = m_instanceCount;
+	cull.cullingEnabled = m_cullingEnabled ? 1 : 0;
+	cull.occlusionEnabled = m_occlusionCullingEnabled ? 1 : 0;
+	cull.instances = m_instancesHandle;
+	cull.meshes = m_meshesHandle;
+	cull.draws = frame.drawsHandle;
+	cull.visibility = m_visibilityHandle;
+	cull.view = frame.viewHandle;
+	cull.pyramid = m_targets.pyramidHandle;
+	cull.sampler = m_pointSamplerHandle;
+	cull.clusters = clustered ? frame.clustersHandle : BindlessBuffer{};
+	cull.groupCapacity = m_groupCapacity;
+	auto dispatchCull = [this](VkCommandBuffer commandBuffer, const CullConstants& constants) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+		m_bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+		vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (m_instanceCount + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+	};
+
+	ClusterCullConstants clusterCull{};
+	clusterCull.groupCapacity = m_groupCapacity;
+	clusterCull.drawCapacity = m_clusterDrawCapacity;
+	clusterCull.clusters = frame.clustersHandle;
+	clusterCull.instances = m_instancesHandle;
+	clusterCull.meshes = m_meshesHandle;
+	clusterCull.meshlets = m_meshletsHandle;
+	clusterCull.view = frame.viewHandle;
+	clusterCull.sampler = m_pointSamplerHandle;
+	clusterCull.vertices = m_verticesHandle;
+	clusterCull.meshletVertices = m_meshletVerticesHandle;
+	clusterCull.meshletTriangles = m_meshletTrianglesHandle;
+
+	DrawConstants draw{};
+	draw.view = frame.viewHandle;
+	draw.instances = m_instancesHandle;
+	draw.vertices = m_verticesHandle;
+	auto drawList = [this, draw, clusterCull, geometry, extent, drawBuffer, clusterBuffer](VkCommandBuffer commandBuffer, uint32_t list,
+						BindlessTexture pyramidHandle, VkBuffer clusterDrawBuffer) {
+		VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		vkCmdBindPipeline(commandBuffer, bindPoint, geometry == SceneGeometry::ClustersMeshShader ? m_meshPipeline : m_drawPipeline);
+		m_bindless.bind(commandBuffer, bindPoint);
+		VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+		VkRect2D scissor{ { 0, 0 }, extent };
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		if (geometry == SceneGeometry::ClustersMeshShader) {
+			ClusterCullConstants constants = clusterCull;
+			constants.phase = list;
+			constants.pyramid = pyramidHandle;
+			vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants), &constants);
+			m_context.cmdDrawMeshTasksIndirect()(commandBuffer, clusterBuffer, kClusterDispatchOffset + list * 4 * sizeof(uint32_t), 1,
+				4 * sizeof(uint32_t));
+			return;
+		}
+
+		vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(draw), &draw);
+		if (geometry == SceneGeometry::ClustersCompute) {
+			// Cluster draws index the meshlets' own copy of their triangles.
+			vkCmdBindIndexBuffer(commandBuffer, m_clusterIndices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexedIndirectCount(commandBuffer, clusterDrawBuffer, 0, clusterBuffer, (2 + list) * sizeof(uint32_t), m_clusterDrawCapacity,
+				sizeof(VkDrawIndexedIndirectCommand));
+			return;
+		}
+		vkCmdBindIndexBuffer(commandBuffer, m_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		VkDeviceSize commandsOffset = kDrawCommandsOffset + list * static_cast<VkDeviceSize>(m_instanceCount) * sizeof(VkDrawIndexedIndirectCommand);
+		vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, commandsOffset, drawBuffer, list * sizeof(uint32_t), m_instanceCount,
+			sizeof(VkDrawIndexedIndirectCommand));
+	};
+
+	// One phase: the instance cull, then with clusters the dispatch for their
+	// groups and, without mesh shaders, the cluster cull, then the draw. The
+	// pyramid is only tested against in phase 2, and only when it was built.
+	uint32_t dispatches = 0;
+	auto addPhase = [&](uint32_t phase, const char* name) {
+		bool occlusion = phase == 1 && m_occlusionCullingEnabled;
+		std::string prefix = name;
+		dispatches += 1 + (clustered ? 1 : 0) + (geometry == SceneGeometry::ClustersCompute ? 1 : 0);
+
+		CullConstants instanceCull = cull;
+		instanceCull.phase = phase;
+		RenderGraphPass& cullPass = graph.addPass(prefix + " cull");
+		if (phase == 0) {
+			cullPass.asyncCompute();
+		}
+		if (occlusion) {
+			cullPass.use(pyramid, RenderGraphAccess::ComputeSampled);
+		}
+		cullPass.use(visibility, phase == 0 ? RenderGraphAccess::ComputeStorageRead : RenderGraphAccess::ComputeStorageWrite)
+			.use(draws, RenderGraphAccess::ComputeStorageWrite);
+		if (clustered) {
+			cullPass.use(clusters, RenderGraphAccess::ComputeStorageWrite);
+		}
+		cullPass.execute([dispatchCull, instanceCull](VkCommandBuffer commandBuffer) {
+			dispatchCull(commandBuffer, instanceCull);
+		});
+
+		BindlessTexture pyramidHandle = occlusion ? m_targets.pyramidHandle : BindlessTexture{};
+		// Each phase's cluster draws are scratch from its cull to its draw.
+		// The early list is done before the late one is written, so the
+		// graph gives them the same memory.
+		RenderGraphBuffer clusterDraws{};
+		if (geometry == SceneGeometry::ClustersCompute) {
+			clusterDraws = graph.createBuffer(prefix + " cluster draws",
+				{ static_cast<VkDeviceSize>(m_clusterDrawCapacity) * sizeof(VkDrawIndexedIndirectCommand) });
+		}
+		if (clustered) {
+			ClusterArgsConstants args{ frame.clustersHandle, phase, m_groupCapacity };
+			RenderGraphPass& argsPass = graph.addPass(prefix + " cluster args");
+			if (phase == 0) {
+				argsPass.asyncCompute();
+			}
+			argsPass.use(clusters, RenderGraphAccess::ComputeStorageWrite)
+				.execute([this, args](VkCommandBuffer commandBuffer) {
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_clusterArgsPipeline);
+					m_bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+					vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(args), &args);
+					vkCmdDispatch(commandBuffer, 1, 1, 1);
+				});
+		}
+		if (geometry == SceneGeometry::ClustersCompute) {
+			ClusterCullConstants constants = clusterCull;
+			constants.phase = phase;
+			constants.pyramid = pyramidHandle;
+			RenderGraphPass& clusterPass = graph.addPass(prefix + " cluster cull");
+			if (phase == 0) {
+				clusterPass.asyncCompute();
+			}
+			if (occlusion) {
+				clusterPass.use(pyramid, RenderGraphAccess::ComputeSampled);
+			}
+			clusterPass.use(clusters, RenderGraphAccess::IndirectRead)
+				.use(clusters, RenderGraphAccess::ComputeStorageWrite)
+				.use(clusterDraws, RenderGraphAccess::ComputeStorageWrite)
+				.execute([this, &graph, constants, clusterDraws, clusterBuffer, phase](VkCommandBuffer commandBuffer) mutable {
+					constants.draws = graph.bindlessBuffer(clusterDraws);
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_clusterCullPipeline);
+					m_bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+					vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants), &constants);
+					vkCmdDispatchIndirect(commandBuffer, clusterBuffer, kClusterDispatchOffset + phase * 4 * sizeof(uint32_t));
+				});
+		}
+
+		RenderGraphPass& drawPass = graph.addPass(name);
+		if (phase == 0) {
+			drawPass.colorAttachment(target, VK_ATTACHMENT_LOAD_OP_CLEAR, { { 0.02f, 0.02f, 0.03f, 1.0f } })
+				.depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_CLEAR, 0.0f);
+		} else {
+			drawPass.colorAttachment(target, VK_ATTACHMENT_LOAD_OP_LOAD).depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_LOAD);
+		}
+		switch (geometry) {
+		case SceneGeometry::Meshes:
+			drawPass.use(draws, RenderGraphAccess::IndirectRead);
+			break;
+		case SceneGeometry::ClustersCompute:
+			drawPass.use(clusters, RenderGraphAccess::IndirectRead).use(clusterDraws, RenderGraphAccess::IndirectRead);
+			break;
+		case SceneGeometry::ClustersMeshShader:
+			if (occlusion) {
+				drawPass.use(pyramid, RenderGraphAccess::TaskSampled);
+			}
+			drawPass.use(clusters, RenderGraphAccess::IndirectRead).use(clusters, RenderGraphAccess::TaskStorageWrite);
+			break;
+		}
+		drawPass.execute([&graph, drawList, phase, pyramidHandle, clusterDraws, geometry](VkCommandBuffer commandBuffer) {
+			drawList(commandBuffer, phase, pyramidHandle, geometry == SceneGeometry::ClustersCompute ? graph.buffer(clusterDraws) : VK_NULL_HANDLE);
+		});
+	};
+
+	// Phase 1: what was visible last frame.
+	addPhase(0, "scene early");
+
+	// Phase 2: the pyramid from that depth, then everything else that
+	// survives it. Without occlusion culling only the frustum is left to
+	// test and the pyramid isn't built.
+	if (m_cullingEnabled) {
+		if (m_occlusionCullingEnabled) {
+			addPyramidPass(graph, depth, pyramid);
+			dispatches += m_targets.pyramidLevels;
+		}
+		addPhase(1, "scene late");
+	}
+	m_stats.lastDispatches = dispatches;
+
+	RenderGraphPass& readback = graph.addPass("scene readback").use(draws, RenderGraphAccess::TransferRead);
+	if (clustered) {
+		readback.use(clusters, RenderGraphAccess::TransferRead);
+	}
+	readback.sideEffects().execute([drawBuffer, clusterBuffer, readbackBuffer, clustered](VkCommandBuffer commandBuffer) {
+		VkBufferCopy region{ 0, 0, kDrawCommandsOffset };
+		vkCmdCopyBuffer(commandBuffer, drawBuffer, readbackBuffer, 1, &region);
+		if (clustered) {
+			VkBufferCopy clusterRegion{ 0, kDrawCommandsOffset, kClusterCountersBytes };
+			vkCmdCopyBuffer(commandBuffer, clusterBuffer, readbackBuffer, 1, &clusterRegion);
+		}
+
+		VkMemoryBarrier2 toHost{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+		toHost.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		toHost.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		toHost.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+		toHost.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+		VkDependencyInfo dependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		dependency.memoryBarrierCount = 1;
+		dependency.pMemoryBarriers = &toHost;
+		vkCmdPipelineBarrier2(commandBuffer, &dependency);
+	});
+}
+
+void GpuScene::addPyramidPass(RenderGraph& graph, RenderGraphImage depth, RenderGraphImage pyramid) {
+	graph.addPass("scene hiz")
+		.use(depth, RenderGraphAccess::ComputeSampled)
+		.use(pyramid, RenderGraphAccess::ComputeStorageWrite)
+		.execute([this](VkCommandBuffer commandBuffer) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pyramidPipeline);
+			m_bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+			PyramidConstants reduce{};
+			reduce.depth = m_targets.depthHandle;
+			reduce.sampler = m_pointSamplerHandle;
+			VkExtent2D source = m_targets.extent;
+			for (uint32_t level = 0; level < m_targets.pyramidLevels; level++) {
+				VkExtent2D destination{ std::max(m_targets.pyramidExtent.width >> level, 1u), std::max(m_targets.pyramidExtent.height >> level, 1u) };
+				reduce.sourceSize[0] = source.width;
+				reduce.sourceSize[1] = source.height;
+				reduce.destinationSize[0] = destination.width;
+				reduce.destinationSize[1] = destination.height;
+				reduce.source = level > 0 ? m_targets.levelHandles[level - 1] : BindlessStorageImage{};
+				reduce.destination = m_targets.levelHandles[level];
+				reduce.fromDepth = level == 0 ? 1 : 0;
+				vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(reduce), &reduce);
+				vkCmdDispatch(commandBuffer, (destination.width + kPyramidGroupSize - 1) / kPyramidGroupSize,
+					(destination.height + kPyramidGroupSize - 1) / kPyramidGroupSize, 1);
+				source = destination;
+
+				// The next level reads this one; the graph only orders the pass
+				// as a whole.
+				VkImageMemoryBarrier2 levelBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+				levelBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+				levelBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+				levelBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+				levelBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+				levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+				levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+				levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				levelBarrier.image = m_targets.pyramid.image;
+				levelBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+				VkDependencyInfo dependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+				dependency.imageMemoryBarrierCount = 1;
+				dependency.pImageMemoryBarriers = &levelBarrier;
+				vkCmdPipelineBarrier2(commandBuffer, &dependency);
+			}
+		});
+}
+
+void GpuScene::releaseCompleted(uint64_t completedSerial) {
+	for (FrameBuffers& frame : m_frames) {
+		if (!frame.pending || frame.serial > completedSerial) {
+			continue;
+		}
+		m_allocator.invalidate(frame.readback.allocation);
+		// The instance counters, then the cluster list's: group counts, draw
+		// counts and the cluster culling counters.
+		uint32_t counts[4 + kClusterCountersBytes / sizeof(uint32_t)];
+		std::memcpy(counts, frame.readback.allocation.mapped, sizeof(counts));
+		frame.pending = false;
+
+		m_stats.frames++;
+		m_stats.earlyDraws += counts[0];
+		m_stats.lateDraws += counts[1];
+		m_stats.frustumCulled += counts[2];
+		m_stats.occlusionCulled += counts[3];
+		m_stats.lastDrawn = counts[0] + counts[1];
+		m_stats.lastClustersDrawn = frame.clustered ? counts[6] + counts[7] : 0;
+		if (frame.clustered) {
+			m_stats.clusterFrames++;
+			m_stats.clustersDrawn += counts[6] + counts[7];
+			m_stats.clusterFrustumCulled += counts[8];
+			m_stats.clusterBackfaceCulled += counts[9];
+			m_stats.clusterOcclusionCulled += counts[10];
+		}
+	}
+
+	auto done = std::remove_if(m_retiredTargets.begin(), m_retiredTargets.end(), [&](Targets& targets) {
+		if (targets.lastSerial > completedSerial) {
+			return false;
+		}
+		destroyTargets(targets);
+		return true;
+	});
+	m_retiredTargets.erase(done, m_retiredTargets.end());
+}
+
+void GpuScene::reportStats() const {
+	double frames = static_cast<double>(std::max<uint64_t>(m_stats.frames, 1));
+	double instances = static_cast<double>(std::max(m_stats.instances, 1u));
+	double early = static_cast<double>(m_stats.earlyDraws) / frames;
+	double late = static_cast<double>(m_stats.lateDraws) / frames;
+	double frustumCulled = static_cast<double>(m_stats.frustumCulled) / frames;
+	double occlusionCulled = static_cast<double>(m_stats.occlusionCulled) / frames;
+	std::printf("gpu scene: %u instances of %u meshes, culling %s, occlusion culling %s, %u drawn in the last frame read back\n",
+		m_stats.instances, m_stats.meshes, m_cullingEnabled ? "on" : "off", m_occlusionCullingEnabled ? "on" : "off", m_stats.lastDrawn);
+	std::printf("  per frame: %.0f drawn early, %.0f late (%.1f%% of instances), %.0f outside the frustum (%.1f%%), %.0f occluded (%.1f%%)\n",
+		early, late, (early + late) * 100.0 / instances, frustumCulled, frustumCulled * 100.0 / instances, occlusionCulled,
+		occlusionCulled * 100.0 / instances);
+	std::printf("  depth pyramid %ux%u, %u levels\n", m_targets.pyramidExtent.width, m_targets.pyramidExtent.height, m_targets.pyramidLevels);
+
+	// Ratios are of the clusters tested, which is what survived instance
+	// culling.
+	double clusterFrames = static_cast<double>(std::max<uint64_t>(m_stats.clusterFrames, 1));
+	double drawn = static_cast<double>(m_stats.clustersDrawn) / clusterFrames;
+	double frustum = static_cast<double>(m_stats.clusterFrustumCulled) / clusterFrames;
+	double backface = static_cast<double>(m_stats.clusterBackfaceCulled) / clusterFrames;
+	double occluded = static_cast<double>(m_stats.clusterOcclusionCulled) / clusterFrames;
+	double tested = std::max(drawn + frustum + backface + occluded, 1.0);
+	std::printf("  geometry: %s, %u meshlets, mesh shaders %s\n", sceneGeometryName(m_geometry), m_stats.meshlets,
+		meshShadersAvailable() ? "available" : "unavailable");
+	if (m_stats.clusterFrames > 0) {
+		std::printf("  clusters per frame: %.0f drawn (%.1f%%), %.0f outside the frustum (%.1f%%), %.0f backfacing (%.1f%%), %.0f occluded (%.1f%%)\n",
+			drawn, drawn * 100.0 / tested, frustum, frustum * 100.0 / tested, backface, backface * 100.0 / tested, occluded,
+			occluded * 100.0 / tested);
+	}
+}
+
+void GpuScene::setGeometry(SceneGeometry geometry) {
+	if (geometry == SceneGeometry::ClustersMeshShader && !meshShadersAvailable()) {
+		geometry = SceneGeometry::ClustersCompute;
+	}
+	m_geometry = geometry;
+}
+
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "AssetPack.h"
+#include "BindlessTable.h"
+#include "FrameRing.h"
+#include "GpuAllocator.h"
+#include "Meshlets.h"
+#include "PipelineCache.h"
+#include "RenderGraph.h"
+#include "ShaderReloader.h"
+#include "StagingRing.h"
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace initium {
+
+// Per-object data, as shaders/scene_cull.comp and scene.vert read it from
+// the instance buffer. Objects spin about their Y axis in the vertex
+// shader, which leaves the bounding sphere unchanged.
+struct GpuInstance {
+	float position[3];
+	float scale;
+	float color[4];
+	uint32_t mesh;
+	float spinSpeed;
+	float spinPhase;
+	uint32_t padding;
+};
+
+// Where a mesh sits in the shared vertex and index buffers, the radius of
+// its bounding sphere about the origin, and its clusters in the meshlet
+// buffer.
+struct GpuMesh {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	float radius;
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+	uint32_t padding[2];
+};
+
+// How instances that pass culling are drawn.
+enum class SceneGeometry {
+	// One indexed draw of the whole mesh per instance.
+	Meshes,
+	// The instance's meshlets culled by a compute pass, one indexed draw per
+	// surviving cluster.
+	ClustersCompute,
+	// The instance's meshlets culled by task shaders and drawn by mesh
+	// shaders, when the device has them.
+	ClustersMeshShader,
+};
+
+const char* sceneGeometryName(SceneGeometry geometry);
+
+// Camera for one frame, column-major like GLSL. Frustum planes face inwards
+// and are normalised, so a sphere is outside when the signed distance of
+// its centre to any plane is below minus its radius. The projection is
+// reverse-Z and given by its focal lengths and clip distances, which is
+// what projecting bounding spheres for occlusion tests needs.
+struct SceneView {
+	float viewProjection[16];
+	float view[16];
+	float frustumPlanes[6][4];
+	float focal[2];
+	float nearPlane;
+	float farPlane;
+	float eye[3];
+};
+
+// Where the scene's camera goes over time.
+enum class SceneCamera {
+	Orbit,
+	Flythrough,
+};
+
+// Seconds flythroughView() takes to come round to its start.
+constexpr double kFlythroughSeconds = 20.0;
+
+// Flies around the scene at a height, looking at its middle. Pure function
+// of time and the aspect ratio.
+SceneView orbitView(double time, VkExtent2D extent, float sceneExtent);
+// A scripted path through the scene: wide views, a low pass between the
+// instances where most of them are occluded, and a climb out over them.
+// Loops every kFlythroughSeconds; pure function of time and the aspect
+// ratio, so benchmark runs see the same frames.
+SceneView flythroughView(double time, VkExtent2D extent, float sceneExtent);
+
+// Totals over the frames read back so far, a few frames late.
+struct GpuSceneStats {
+	uint32_t instances = 0;
+	uint32_t meshes = 0;
+	uint64_t frames = 0;
+	// Drawn in the first phase, from last frame's visible set, and in the
+	// second, newly visible after the occlusion test.
+	uint64_t earlyDraws = 0;
+	uint64_t lateDraws = 0;
+	uint64_t frustumCulled = 0;
+	uint64_t occlusionCulled = 0;
+	uint32_t lastDrawn = 0;
+	// Clusters, over the frames that drew them.
+	uint32_t meshlets = 0;
+	uint64_t clusterFrames = 0;
+	uint64_t clustersDrawn = 0;
+	uint64_t clusterFrustumCulled = 0;
+	uint64_t clusterBackfaceCulled = 0;
+	uint64_t clusterOcclusionCulled = 0;
+	uint32_t lastClustersDrawn = 0;
+	// Recorded for the last frame, pyramid levels included.
+	uint32_t lastDispatches = 0;
+};
+
+// GPU-driven rendering of a large static scene. Instances, meshes and
+// vertices live in device-local buffers, uploaded once and addressed
+// through the bindless table. Compute passes cull the instances and append
+// a VkDrawIndexedIndirectCommand for each survivor, with the instance index
+// as firstInstance, and vkCmdDrawIndexedIndirectCount draws whatever they
+// produced. The CPU records the same handful of commands however many
+// instances there are.
+//
+// Culling is two-phase, against a hierarchical depth pyramid:
+//   1. instances visible last frame that are in the frustum are drawn,
+//   2. the pyramid is built from the resulting depth, each level holding
+//      the farthest depth of the four texels below it,
+//   3. every instance in the frustum is tested against the pyramid; those
+//      that pass become the visible set for the next frame, and the ones
+//      not drawn in phase 1 are drawn now.
+// Occluders are whatever was visible last frame, so nothing is missing
+// from the final image when the view changes, only drawn a phase late.
+//
+// Geometry and instances are read from an asset pack when one has them,
+// otherwise built at load.
+//
+// Meshes are also split into meshlets at load. With cluster geometry, each
+// phase's instances are expanded into their meshlets, which are culled
+// again against the frustum, their normal cone and, in phase 2, the
+// pyramid: by task shaders feeding mesh shaders where the device has
+// them, otherwise by a compute pass feeding indexed indirect draws.
+//
+// Draw and view buffers exist once per frame that can be in flight, so
+// they are never overwritten while a previous frame still reads them. The
+// depth buffer, the pyramid and the visible set persist across frames and
+// are imported into the render graph with their last use, which orders
+// them against the previous frame. Lives on the render thread with the
+// Renderer.
+class GpuScene {
+public:
+	// assets, if any, only needs to live through the constructor.
+	GpuScene(const VulkanContext& context, GpuAllocator& allocator, StagingRing& staging, BindlessTable& bindless,
+		PipelineCache& pipelineCache, VkFormat colorFormat, uint32_t instanceCount, const AssetPack* assets = nullptr,
+		const std::filesystem::path& shaderDirectory = "shaders");
+	~GpuScene();
+
+	// Adds the scene's geometry, split into meshlets, and the instances of a
+	// scene of instanceCount to a pack, ready to upload as they are.
+	static void addAssets(AssetPackWriter& writer, uint32_t instanceCount);
+
+	GpuScene(const GpuScene&) = delete;
+	GpuScene& operator=(const GpuScene&) = delete;
+
+	static constexpr VkFormat kDepthFormat = VK_FORMAT_D32_SFLOAT;
+
+	// (Re)creates the depth buffer and pyramid for the target's size. Call
+	// before the bindless table is flushed for the frame, so the views it
+	// registers are visible to addPasses().
+	void prepare(VkExtent2D extent);
+
+	// Adds the cull, draw and pyramid passes for one frame. The scene is
+	// drawn into target, cleared first, with a reverse-Z depth buffer of the
+	// target's size.
+	void addPasses(RenderGraph& graph, RenderGraphImage target, VkExtent2D extent, double time, uint64_t frameSerial);
+
+	// Reads back culling counts of frames up to completedSerial and destroys
+	// depth buffers and pyramids replaced by a resize.
+	void releaseCompleted(uint64_t completedSerial);
+
+	// With culling off every instance is drawn in the first phase, through
+	// the same path. Cluster geometry still culls meshlets against the
+	// frustum and their normal cones.
+	void setCullingEnabled(bool enabled) { m_cullingEnabled = enabled; }
+	bool cullingEnabled() const { return m_cullingEnabled; }
+	// With occlusion culling off only the frustum test remains.
+	void setOcclusionCullingEnabled(bool enabled) { m_occlusionCullingEnabled = enabled; }
+	bool occlusionCullingEnabled() const { return m_occlusionCullingEnabled; }
+
+	// Mesh shader geometry falls back to compute culling on devices without
+	// them. Defaults to the best the device has.
+	void setGeometry(SceneGeometry geometry);
+	SceneGeometry geometry() const { return m_geometry; }
+
+	void setCamera(SceneCamera camera) { m_camera = camera; }
+	SceneCamera camera() const { return m_camera; }
+	bool meshShadersAvailable() const { return m_meshPipeline != VK_NULL_HANDLE; }
+
+	uint32_t instanceCount() const { return m_instanceCount; }
+	// Distance from the middle of the scene to its edge.
+	float extent() const { return m_extent; }
+
+	const GpuSceneStats& stats() const { return m_stats; }
+	void reportStats() const;
+
+	// Rebuilds the scene's pipelines when their shaders change.
+	void watchShaders(ShaderReloader& reloader, PipelineCache& pipelineCache);
+
+private:
+	static constexpr uint32_t kCullGroupSize = 64;
+	static constexpr uint32_t kPyramidGroupSize = 8;
+	static constexpr uint32_t kMaxPyramidLevels = 16;
+	// Draw counts of both phases and the culling counters, ahead of the
+	// commands: those of phase 1, then those of phase 2.
+	static constexpr VkDeviceSize kDrawCommandsOffset = 16;
+	// The cluster list's counters and the indirect dispatch of each phase,
+	// ahead of its groups (shaders/scene_common.glsl).
+	static constexpr VkDeviceSize kClusterCountersBytes = 32;
+	static constexpr VkDeviceSize kClusterDispatchOffset = 32;
+	static constexpr VkDeviceSize kClusterGroupsOffset = 64;
+	static constexpr uint32_t kClusterGroupSize = 32;
+	// Cluster draws per phase without mesh shaders; survivors past it are
+	// dropped.
+	static constexpr uint32_t kMaxClusterDraws = 1u << 18;
+
+	struct FrameBuffers {
+		GpuBuffer draws;
+		BindlessBuffer drawsHandle;
+		// Host-written camera for the frame.
+		GpuBuffer view;
+		BindlessBuffer viewHandle;
+		GpuBuffer clusters;
+		BindlessBuffer clustersHandle;
+		GpuBuffer readback;
+		uint64_t serial = 0;
+		bool pending = false;
+		bool clustered = false;
+	};
+
+	// Depth buffer and the pyramid built from it, recreated on resize.
+	struct Targets {
+		VkExtent2D extent{};
+		GpuImage depth;
+		VkImageView depthView = VK_NULL_HANDLE;
+		BindlessTexture depthHandle;
+		GpuImage pyramid;
+		VkExtent2D pyramidExtent{};
+		uint32_t pyramidLevels = 0;
+		VkImageView pyramidView = VK_NULL_HANDLE;
+		BindlessTexture pyramidHandle;
+		std::vector<VkImageView> levelViews;
+		std::vector<BindlessStorageImage> levelHandles;
+		// Unused so far: the images are still in UNDEFINED.
+		bool fresh = true;
+		uint64_t lastSerial = 0;
+	};
+
+	// A pipeline and the SPIR-V it is built from: one compute shader, or
+	// vertex and fragment, or task, mesh and fragment shaders.
+	struct PipelineSource {
+		VkPipeline* pipeline;
+		std::vector<std::filesystem::path> shaders;
+		// Empty for a compute pipeline.
+		std::vector<VkShaderStageFlagBits> stages;
+	};
+
+	void createGeometry(const AssetPack* assets);
+	void createInstances(const AssetPack* assets);
+	std::vector<PipelineSource> pipelineSources();
+	VkPipeline createPipeline(PipelineCache& pipelineCache, const PipelineSource& source) const;
+	VkPipeline createComputePipeline(PipelineCache& pipelineCache, const std::filesystem::path& shaderPath) const;
+	VkPipeline createDrawPipeline(PipelineCache& pipelineCache, const std::filesystem::path* shaderPaths, const VkShaderStageFlagBits* stages,
+		uint32_t stageCount) const;
+	void createTargets(VkExtent2D extent);
+	void destroyTargets(Targets& targets);
+	void addPyramidPass(RenderGraph& graph, RenderGraphImage depth, RenderGraphImage pyramid);
+	void destroy();
+	// Concurrent buffers are shared by every queue that touches the scene,
+	// so none of them needs an ownership transfer; others belong to the
+	// graphics queue.
+	GpuBuffer uploadBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, bool concurrent = true);
+	void shareAcrossQueues(VkBufferCreateInfo& bufferInfo) const;
+
+	const VulkanContext& m_context;
+	GpuAllocator& m_allocator;
+	StagingRing& m_staging;
+	BindlessTable& m_bindless;
+	VkFormat m_colorFormat;
+	std::filesystem::path m_shaderDirectory;
+	uint32_t m_instanceCount;
+	uint32_t m_meshCount = 0;
+	float m_extent = 0.0f;
+	bool m_cullingEnabled = true;
+	bool m_occlusionCullingEnabled = true;
+	SceneGeometry m_geometry = SceneGeometry::Meshes;
+	SceneCamera m_camera = SceneCamera::Orbit;
+	uint32_t m_meshletCount = 0;
+	// Cluster groups and cluster draws room is made for per phase.
+	uint32_t m_groupCapacity = 0;
+	uint32_t m_clusterDrawCapacity = 0;
+
+	GpuBuffer m_vertices;
+	GpuBuffer m_indices;
+	GpuBuffer m_meshes;
+	GpuBuffer m_instances;
+	BindlessBuffer m_verticesHandle;
+	BindlessBuffer m_meshesHandle;
+	BindlessBuffer m_instancesHandle;
+	GpuBuffer m_meshlets;
+	GpuBuffer m_meshletVertices;
+	GpuBuffer m_meshletTriangles;
+	GpuBuffer m_clusterIndices;
+	BindlessBuffer m_meshletsHandle;
+	BindlessBuffer m_meshletVerticesHandle;
+	BindlessBuffer m_meshletTrianglesHandle;
+	// The distinct graphics, compute and transfer families.
+	std::vector<uint32_t> m_queueFamilies;
+	// One word per instance: whether it passed the last occlusion test.
+	// Exclusive: the render graph hands it to the compute queue and back.
+	GpuBuffer m_visibility;
+	BindlessBuffer m_visibilityHandle;
+	FrameBuffers m_frames[FrameRing::kMaxFramesInFlight];
+
+	Targets m_targets;
+	std::vector<Targets> m_retiredTargets;
+	VkSampler m_pointSampler = VK_NULL_HANDLE;
+	BindlessSampler m_pointSamplerHandle;
+
+	VkPipeline m_cullPipeline = VK_NULL_HANDLE;
+	VkPipeline m_pyramidPipeline = VK_NULL_HANDLE;
+	VkPipeline m_clusterArgsPipeline = VK_NULL_HANDLE;
+	VkPipeline m_clusterCullPipeline = VK_NULL_HANDLE;
+	VkPipeline m_drawPipeline = VK_NULL_HANDLE;
+	// Null without mesh shaders.
+	VkPipeline m_meshPipeline = VK_NULL_HANDLE;
+
+	GpuSceneStats m_stats;
+};
+
+}
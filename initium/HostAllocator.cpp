@@ -0,0 +1,277 @@
+#include "HostAllocator.h"
+
+#define GLFW_INCLUDE_VULKAN
+#include "glfw/include/GLFW/glfw3.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace initium {
+
+namespace {
+
+// Sits directly in front of every block handed out.
+struct BlockHeader {
+	uint64_t size;
+	// Distance back from the block to the start of the underlying memory.
+	uint32_t offset;
+	uint8_t sizeClass;
+	uint8_t tag;
+	uint8_t reserved[2];
+};
+static_assert(sizeof(BlockHeader) == 16);
+
+constexpr uint8_t kLargeBlock = 0xff;
+constexpr size_t kHeaderBytes = sizeof(BlockHeader);
+
+BlockHeader* headerOf(void* block) {
+	return reinterpret_cast<BlockHeader*>(static_cast<uint8_t*>(block) - kHeaderBytes);
+}
+
+// Places the header and the aligned block inside raw memory: size +
+// alignment bytes are enough when it starts on a kHeaderBytes boundary,
+// kHeaderBytes more when it may not.
+void* placeBlock(void* raw, size_t size, size_t alignment, uint8_t sizeClass, MemoryTag tag) {
+	uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+	uintptr_t block = (start + kHeaderBytes + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+
+	BlockHeader* header = reinterpret_cast<BlockHeader*>(block - kHeaderBytes);
+	header->size = size;
+	header->offset = static_cast<uint32_t>(block - start);
+	header->sizeClass = sizeClass;
+	header->tag = static_cast<uint8_t>(tag);
+	return reinterpret_cast<void*>(block);
+}
+
+void* glfwAllocate(size_t size, void* user) {
+	return static_cast<HostAllocator*>(user)->allocate(size, alignof(std::max_align_t), MemoryTag::Glfw);
+}
+
+void* glfwReallocate(void* block, size_t size, void* user) {
+	return static_cast<HostAllocator*>(user)->reallocate(block, size, alignof(std::max_align_t), MemoryTag::Glfw);
+}
+
+void glfwDeallocate(void* block, void* user) {
+	static_cast<HostAllocator*>(user)->free(block);
+}
+
+MemoryTag vulkanTag(VkSystemAllocationScope scope) {
+	return static_cast<MemoryTag>(static_cast<uint8_t>(MemoryTag::VulkanCommand) + static_cast<uint8_t>(scope));
+}
+
+VKAPI_ATTR void* VKAPI_CALL vulkanAllocate(void* user, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	return static_cast<HostAllocator*>(user)->allocate(size, alignment, vulkanTag(scope));
+}
+
+VKAPI_ATTR void* VKAPI_CALL vulkanReallocate(void* user, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	return static_cast<HostAllocator*>(user)->reallocate(original, size, alignment, vulkanTag(scope));
+}
+
+VKAPI_ATTR void VKAPI_CALL vulkanFree(void* user, void* block) {
+	static_cast<HostAllocator*>(user)->free(block);
+}
+
+VKAPI_ATTR void VKAPI_CALL vulkanInternalAllocation(void* user, size_t size, VkInternalAllocationType, VkSystemAllocationScope) {
+	static_cast<HostAllocator*>(user)->trackExternal(MemoryTag::VulkanInternal, size, true);
+}
+
+VKAPI_ATTR void VKAPI_CALL vulkanInternalFree(void* user, size_t size, VkInternalAllocationType, VkSystemAllocationScope) {
+	static_cast<HostAllocator*>(user)->trackExternal(MemoryTag::VulkanInternal, size, false);
+}
+
+}
+
+const char* memoryTagName(MemoryTag tag) {
+	switch (tag) {
+	case MemoryTag::Glfw: return "glfw";
+	case MemoryTag::VulkanCommand: return "vk command";
+	case MemoryTag::VulkanObject: return "vk object";
+	case MemoryTag::VulkanCache: return "vk cache";
+	case MemoryTag::VulkanDevice: return "vk device";
+	case MemoryTag::VulkanInstance: return "vk instance";
+	case MemoryTag::VulkanInternal: return "vk internal";
+	default: return "?";
+	}
+}
+
+HostAllocator::HostAllocator() : m_glfwAllocator(std::make_unique<GLFWallocator>()) {
+	m_glfwAllocator->allocate = glfwAllocate;
+	m_glfwAllocator->reallocate = glfwReallocate;
+	m_glfwAllocator->deallocate = glfwDeallocate;
+	m_glfwAllocator->user = this;
+
+	m_vulkanCallbacks.pUserData = this;
+	m_vulkanCallbacks.pfnAllocation = vulkanAllocate;
+	m_vulkanCallbacks.pfnReallocation = vulkanReallocate;
+	m_vulkanCallbacks.pfnFree = vulkanFree;
+	m_vulkanCallbacks.pfnInternalAllocation = vulkanInternalAllocation;
+	m_vulkanCallbacks.pfnInternalFree = vulkanInternalFree;
+}
+
+HostAllocator::~HostAllocator() {
+	for (void* chunk : m_chunks) {
+		std::free(chunk);
+	}
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, MemoryTag tag) {
+	alignment = std::max(alignment, kHeaderBytes);
+	size_t needed = size + alignment;
+
+	void* raw = nullptr;
+	uint8_t sizeClass = kLargeBlock;
+	if (needed <= (size_t(1) << kMaxClassLog2)) {
+		size_t classIndex = 0;
+		while ((size_t(1) << (classIndex + kMinClassLog2)) < needed) {
+			classIndex++;
+		}
+		raw = allocateFromClass(classIndex);
+		sizeClass = static_cast<uint8_t>(classIndex);
+	} else {
+		// malloc only promises alignof(std::max_align_t), which can be 8:
+		// the extra header's worth leaves room to round the start up.
+		raw = std::malloc(needed + kHeaderBytes);
+	}
+	if (!raw) {
+		return nullptr;
+	}
+
+	track(tag, static_cast<int64_t>(size), 1);
+	return placeBlock(raw, size, alignment, sizeClass, tag);
+}
+
+void* HostAllocator::reallocate(void* block, size_t size, size_t alignment, MemoryTag tag) {
+	if (!block) {
+		return allocate(size, alignment, tag);
+	}
+	if (size == 0) {
+		free(block);
+		return nullptr;
+	}
+
+	BlockHeader* header = headerOf(block);
+	bool aligned = (reinterpret_cast<uintptr_t>(block) & (std::max(alignment, kHeaderBytes) - 1)) == 0;
+	if (header->sizeClass != kLargeBlock && aligned) {
+		// Grow or shrink in place while the size class still has room.
+		size_t capacity = (size_t(1) << (header->sizeClass + kMinClassLog2)) - header->offset;
+		if (size <= capacity) {
+			track(static_cast<MemoryTag>(header->tag), static_cast<int64_t>(size) - static_cast<int64_t>(header->size), 0);
+			header->size = size;
+			return block;
+		}
+	}
+
+	void* moved = allocate(size, alignment, tag);
+	if (!moved) {
+		return nullptr;
+	}
+	std::memcpy(moved, block, std::min<size_t>(size, header->size));
+	free(block);
+	return moved;
+}
+
+void HostAllocator::free(void* block) {
+	if (!block) {
+		return;
+	}
+
+	BlockHeader* header = headerOf(block);
+	track(static_cast<MemoryTag>(header->tag), -static_cast<int64_t>(header->size), -1);
+
+	uint8_t* raw = static_cast<uint8_t*>(block) - header->offset;
+	if (header->sizeClass == kLargeBlock) {
+		std::free(raw);
+		return;
+	}
+
+	SizeClass& sizeClass = m_classes[header->sizeClass];
+	std::lock_guard lock(sizeClass.mutex);
+	FreeBlock* freed = reinterpret_cast<FreeBlock*>(raw);
+	freed->next = sizeClass.freeList;
+	sizeClass.freeList = freed;
+}
+
+const GLFWallocator* HostAllocator::glfwAllocator() const {
+	return m_glfwAllocator.get();
+}
+
+void* HostAllocator::allocateFromClass(size_t classIndex) {
+	SizeClass& sizeClass = m_classes[classIndex];
+	size_t blockBytes = size_t(1) << (classIndex + kMinClassLog2);
+
+	std::lock_guard lock(sizeClass.mutex);
+	if (FreeBlock* block = sizeClass.freeList) {
+		sizeClass.freeList = block->next;
+		return block;
+	}
+
+	if (!sizeClass.carve || sizeClass.carve + blockBytes > sizeClass.carveEnd) {
+		// Chunks are never returned before shutdown; freed blocks go back on
+		// their class's free list instead.
+		void* chunk = std::malloc(kChunkBytes);
+		if (!chunk) {
+			return nullptr;
+		}
+		{
+			std::lock_guard chunkLock(m_chunkMutex);
+			m_chunks.push_back(chunk);
+		}
+		m_arenaBytes.fetch_add(kChunkBytes, std::memory_order_relaxed);
+		// Blocks are powers of two of at least kHeaderBytes, so aligning the
+		// first one aligns them all, whatever malloc returned.
+		uintptr_t start = reinterpret_cast<uintptr_t>(chunk);
+		uintptr_t aligned = (start + kHeaderBytes - 1) & ~static_cast<uintptr_t>(kHeaderBytes - 1);
+		sizeClass.carve = static_cast<uint8_t*>(chunk) + (aligned - start);
+		sizeClass.carveEnd = static_cast<uint8_t*>(chunk) + kChunkBytes;
+	}
+
+	void* block = sizeClass.carve;
+	sizeClass.carve += blockBytes;
+	return block;
+}
+
+void HostAllocator::trackExternal(MemoryTag tag, size_t size, bool allocated) {
+	track(tag, allocated ? static_cast<int64_t>(size) : -static_cast<int64_t>(size), allocated ? 1 : -1);
+}
+
+void HostAllocator::track(MemoryTag tag, int64_t bytes, int64_t allocations) {
+	TagCounters& counters = m_tags[static_cast<size_t>(tag)];
+	uint64_t current = counters.currentBytes.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed) + static_cast<uint64_t>(bytes);
+	if (bytes > 0) {
+		uint64_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+		while (current > peak && !counters.peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+		}
+	}
+	counters.currentAllocations.fetch_add(static_cast<uint64_t>(allocations), std::memory_order_relaxed);
+	if (allocations > 0) {
+		counters.totalAllocations.fetch_add(static_cast<uint64_t>(allocations), std::memory_order_relaxed);
+	}
+}
+
+MemoryTagStats HostAllocator::stats(MemoryTag tag) const {
+	const TagCounters& counters = m_tags[static_cast<size_t>(tag)];
+	MemoryTagStats stats;
+	stats.currentBytes = counters.currentBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	stats.currentAllocations = counters.currentAllocations.load(std::memory_order_relaxed);
+	stats.totalAllocations = counters.totalAllocations.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void HostAllocator::reportStats() const {
+	std::printf("host memory: %.1f MiB in arena chunks\n", static_cast<double>(arenaBytes()) / (1 << 20));
+	for (size_t i = 0; i < static_cast<size_t>(MemoryTag::Count); i++) {
+		MemoryTag tag = static_cast<MemoryTag>(i);
+		MemoryTagStats tagStats = stats(tag);
+		if (tagStats.totalAllocations == 0) {
+			continue;
+		}
+		std::printf("  %-12s live %9.1f KiB in %6llu blocks, peak %9.1f KiB, %8llu allocations\n", memoryTagName(tag),
+			static_cast<double>(tagStats.currentBytes) / 1024.0, static_cast<unsigned long long>(tagStats.currentAllocations),
+			static_cast<double>(tagStats.peakBytes) / 1024.0, static_cast<unsigned long long>(tagStats.totalAllocations));
+	}
+}
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct GLFWallocator;
+
+namespace initium {
+
+enum class MemoryTag : uint8_t {
+	Glfw,
+	// One per VkSystemAllocationScope, in its order.
+	VulkanCommand,
+	VulkanObject,
+	VulkanCache,
+	VulkanDevice,
+	VulkanInstance,
+	// Driver allocations we are only told about through
+	// pfnInternalAllocation; they don't come out of our pools.
+	VulkanInternal,
+	Count,
+};
+
+const char* memoryTagName(MemoryTag tag);
+
+struct MemoryTagStats {
+	uint64_t currentBytes = 0;
+	uint64_t peakBytes = 0;
+	uint64_t currentAllocations = 0;
+	uint64_t totalAllocations = 0;
+};
+
+// CPU allocator that GLFW and the Vulkan loader/driver route through.
+// Small blocks come from power-of-two size classes carved out of large
+// arena chunks, each class with its own free list and lock, so short-lived
+// driver allocations neither hit the CRT heap nor contend on one lock.
+// Larger blocks go straight to malloc. Every block carries a tag, giving
+// live bytes and high-water marks per subsystem.
+//
+// Must outlive everything that allocated from it: create it before
+// glfwInit and destroy it after glfwTerminate.
+class HostAllocator {
+public:
+	HostAllocator();
+	~HostAllocator();
+
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	// Returns nullptr on failure, like malloc. Thread-safe.
+	void* allocate(size_t size, size_t alignment, MemoryTag tag);
+	void* reallocate(void* block, size_t size, size_t alignment, MemoryTag tag);
+	void free(void* block);
+
+	// Pass to glfwInitAllocator before glfwInit.
+	const GLFWallocator* glfwAllocator() const;
+	// Pass as VulkanContextCreateInfo::allocationCallbacks.
+	const VkAllocationCallbacks* vulkanCallbacks() const { return &m_vulkanCallbacks; }
+
+	// Accounts for memory allocated elsewhere, such as the driver-internal
+	// allocations Vulkan reports through pfnInternalAllocation.
+	void trackExternal(MemoryTag tag, size_t size, bool allocated);
+
+	MemoryTagStats stats(MemoryTag tag) const;
+	uint64_t arenaBytes() const { return m_arenaBytes.load(std::memory_order_relaxed); }
+	void reportStats() const;
+
+private:
+	static constexpr size_t kMinClassLog2 = 4;
+	static constexpr size_t kMaxClassLog2 = 13;
+	static constexpr size_t kClassCount = kMaxClassLog2 - kMinClassLog2 + 1;
+	static constexpr size_t kChunkBytes = 256 * 1024;
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	struct SizeClass {
+		std::mutex mutex;
+		FreeBlock* freeList = nullptr;
+		// Unused tail of the chunk the class is carving from.
+		uint8_t* carve = nullptr;
+		uint8_t* carveEnd = nullptr;
+	};
+
+	struct TagCounters {
+		std::atomic<uint64_t> currentBytes{ 0 };
+		std::atomic<uint64_t> peakBytes{ 0 };
+		std::atomic<uint64_t> currentAllocations{ 0 };
+		std::atomic<uint64_t> totalAllocations{ 0 };
+	};
+
+	void* allocateFromClass(size_t classIndex);
+	void track(MemoryTag tag, int64_t bytes, int64_t allocations);
+
+	SizeClass m_classes[kClassCount];
+	TagCounters m_tags[static_cast<size_t>(MemoryTag::Count)];
+
+	std::mutex m_chunkMutex;
+	std::vector<void*> m_chunks;
+	std::atomic<uint64_t> m_arenaBytes{ 0 };
+
+	std::unique_ptr<GLFWallocator> m_glfwAllocator;
+	VkAllocationCallbacks m_vulkanCallbacks{};
+};
+
+}
@@ -0,0 +1,354 @@
+#include "JobSystem.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace initium {
+
+namespace {
+
+constexpr uint32_t kNoWorker = UINT32_MAX;
+// Yields before an idle worker goes to sleep: work tends to arrive in bursts,
+// and a futex wake costs more than a short spin.
+constexpr int kIdleSpins = 64;
+
+thread_local const JobSystem* t_system = nullptr;
+thread_local uint32_t t_worker = kNoWorker;
+thread_local const JobSystem* t_externalSystem = nullptr;
+thread_local uint32_t t_external = kNoWorker;
+thread_local uint64_t t_rng = 0x9e3779b97f4a7c15ull;
+
+uint64_t nextRandom(uint64_t& state) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+}
+
+JobSystem::JobSystem(uint32_t workerThreads, std::function<void()> wakeMainThread) : m_wakeMainThread(std::move(wakeMainThread)) {
+	if (workerThreads == 0) {
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		workerThreads = hardwareThreads > 3 ? hardwareThreads - 2 : 1;
+	}
+
+	m_workers.resize(workerThreads + 1);
+	for (uint32_t i = 0; i < m_workers.size(); i++) {
+		m_workers[i] = std::make_unique<Worker>();
+		m_workers[i]->jobs = std::make_unique<Job[]>(kJobPoolSize);
+		m_workers[i]->rng = 0x9e3779b97f4a7c15ull * (i + 1);
+	}
+
+	t_system = this;
+	t_worker = 0;
+	for (uint32_t i = 1; i < m_workers.size(); i++) {
+		m_workers[i]->thread = std::thread(&JobSystem::workerMain, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	// Run whatever is still queued so no submitter is left waiting.
+	runMainThreadJobs();
+	while (runOneJob(0)) {
+	}
+
+	m_running.store(false, std::memory_order_release);
+	m_signal.fetch_add(1, std::memory_order_seq_cst);
+	m_signal.notify_all();
+	for (uint32_t i = 1; i < m_workers.size(); i++) {
+		m_workers[i]->thread.join();
+	}
+	t_system = nullptr;
+	t_worker = kNoWorker;
+}
+
+void JobSystem::wait(JobCounter& counter) {
+	uint32_t worker = t_system == this ? t_worker : kNoWorker;
+	while (!counter.done()) {
+		if (worker == 0) {
+			runMainThreadJobs();
+		}
+		if (!runOneJob(worker)) {
+			std::this_thread::yield();
+		}
+	}
+	// The last job may still be inside finish(); don't let the caller destroy
+	// the counter under it.
+	std::lock_guard lock(counter.m_mutex);
+}
+
+void JobSystem::registerExternalThread() {
+	if (ownState()) {
+		return;
+	}
+	std::lock_guard lock(m_externalMutex);
+	uint32_t index = m_externalCount.load(std::memory_order_relaxed);
+	if (index == kMaxExternalThreads) {
+		return;
+	}
+	auto state = std::make_unique<Worker>();
+	state->jobs = std::make_unique<Job[]>(kJobPoolSize);
+	m_externals[index] = std::move(state);
+	m_externalCount.store(index + 1, std::memory_order_release);
+	t_externalSystem = this;
+	t_external = index;
+}
+
+void JobSystem::runMainThreadJobs() {
+	std::vector<Job*> jobs;
+	{
+		std::lock_guard lock(m_mainThreadMutex);
+		if (m_mainThreadJobs.empty()) {
+			return;
+		}
+		jobs.swap(m_mainThreadJobs);
+	}
+	for (Job* job : jobs) {
+		execute(job, 0, false);
+	}
+}
+
+bool JobSystem::isMainThread() const {
+	return t_system == this && t_worker == 0;
+}
+
+uint32_t JobSystem::currentWorker() const {
+	return t_system == this ? t_worker : workerCount();
+}
+
+JobWorkerStats JobSystem::workerStats(uint32_t worker) const {
+	const Worker& state = *m_workers[worker];
+	JobWorkerStats stats;
+	stats.executed = state.executed.load(std::memory_order_relaxed);
+	stats.stolen = state.stolen.load(std::memory_order_relaxed);
+	stats.busySeconds = static_cast<double>(state.busyNanoseconds.load(std::memory_order_relaxed)) / 1e9;
+	return stats;
+}
+
+void JobSystem::reportStats() const {
+	uint64_t executed = 0;
+	uint64_t stolen = 0;
+	for (uint32_t i = 0; i < workerCount(); i++) {
+		JobWorkerStats stats = workerStats(i);
+		executed += stats.executed;
+		stolen += stats.stolen;
+	}
+	std::printf("jobs: %u workers, %llu executed, %llu stolen\n", workerCount(), static_cast<unsigned long long>(executed),
+		static_cast<unsigned long long>(stolen));
+	for (uint32_t i = 0; i < workerCount(); i++) {
+		JobWorkerStats stats = workerStats(i);
+		if (stats.executed == 0) {
+			continue;
+		}
+		std::printf("  %-6s %2u %9llu jobs, %9llu stolen, %8.2f ms busy\n", i == 0 ? "main" : "worker", i,
+			static_cast<unsigned long long>(stats.executed), static_cast<unsigned long long>(stats.stolen), stats.busySeconds * 1000.0);
+	}
+}
+
+JobSystem::Worker* JobSystem::ownState() {
+	if (t_system == this && t_worker != kNoWorker) {
+		return m_workers[t_worker].get();
+	}
+	if (t_externalSystem == this) {
+		return m_externals[t_external].get();
+	}
+	return nullptr;
+}
+
+Job* JobSystem::allocateJob() {
+	if (Worker* state = ownState()) {
+		// Only the owner allocates from its pool; whoever runs a job frees the
+		// slot. A slot still in use after a full lap means a long-running or
+		// blocked job, so fall back to the heap rather than wait for it.
+		Job& job = state->jobs[state->nextJob++ & (kJobPoolSize - 1)];
+		if (!job.inUse.load(std::memory_order_acquire)) {
+			job.inUse.store(true, std::memory_order_relaxed);
+			job.heapAllocated = false;
+			return &job;
+		}
+	}
+	Job* job = new Job;
+	job->inUse.store(true, std::memory_order_relaxed);
+	job->heapAllocated = true;
+	return job;
+}
+
+void JobSystem::enqueue(Job* job, JobCounter* counter, JobCounter* dependency) {
+	job->counter = counter;
+	job->nextDependent = nullptr;
+	if (counter) {
+		counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (dependency) {
+		std::lock_guard lock(dependency->m_mutex);
+		if (!dependency->done()) {
+			job->nextDependent = dependency->m_dependents;
+			dependency->m_dependents = job;
+			return;
+		}
+	}
+	schedule(job);
+}
+
+void JobSystem::enqueueMainThread(Job* job, JobCounter* counter) {
+	job->counter = counter;
+	job->nextDependent = nullptr;
+	if (counter) {
+		counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+	}
+	{
+		std::lock_guard lock(m_mainThreadMutex);
+		m_mainThreadJobs.push_back(job);
+	}
+	if (m_wakeMainThread && !isMainThread()) {
+		m_wakeMainThread();
+	}
+}
+
+void JobSystem::schedule(Job* job) {
+	Worker* state = ownState();
+	if (!state || !state->deque.push(job)) {
+		std::lock_guard lock(m_injectionMutex);
+		m_injected.push_back(job);
+		m_injectedCount.fetch_add(1, std::memory_order_release);
+	}
+	notifyWorkers();
+}
+
+void JobSystem::execute(Job* job, uint32_t worker, bool stolen) {
+	INITIUM_PROFILE_ZONE("job");
+	auto start = std::chrono::steady_clock::now();
+	job->invoke(*job);
+	job->destroy(*job);
+
+	JobCounter* counter = job->counter;
+	if (job->heapAllocated) {
+		delete job;
+	} else {
+		job->inUse.store(false, std::memory_order_release);
+	}
+	if (counter) {
+		finish(*counter);
+	}
+
+	if (worker != kNoWorker) {
+		Worker& state = *m_workers[worker];
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+		state.executed.fetch_add(1, std::memory_order_relaxed);
+		state.busyNanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+		if (stolen) {
+			state.stolen.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+void JobSystem::finish(JobCounter& counter) {
+	// Decrement under the lock so a waiter that sees zero can't destroy the
+	// counter before this has let go of it (wait() takes the lock last).
+	Job* dependents = nullptr;
+	{
+		std::lock_guard lock(counter.m_mutex);
+		if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+			return;
+		}
+		dependents = counter.m_dependents;
+		counter.m_dependents = nullptr;
+	}
+	while (dependents) {
+		Job* next = dependents->nextDependent;
+		schedule(dependents);
+		dependents = next;
+	}
+}
+
+Job* JobSystem::findJob(uint32_t worker, bool& stolen) {
+	stolen = false;
+	Worker* own = worker != kNoWorker ? m_workers[worker].get() : ownState();
+	if (own) {
+		if (Job* job = own->deque.pop()) {
+			return job;
+		}
+	}
+
+	if (m_injectedCount.load(std::memory_order_acquire) > 0) {
+		std::lock_guard lock(m_injectionMutex);
+		if (!m_injected.empty()) {
+			Job* job = m_injected.back();
+			m_injected.pop_back();
+			m_injectedCount.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	// Start at a random victim so thieves spread out instead of all hitting
+	// the first busy deque.
+	uint32_t count = victimCount();
+	uint64_t& rng = worker != kNoWorker ? m_workers[worker]->rng : t_rng;
+	uint32_t first = static_cast<uint32_t>(nextRandom(rng) % count);
+	for (uint32_t i = 0; i < count; i++) {
+		Worker& state = victim((first + i) % count);
+		if (&state == own) {
+			continue;
+		}
+		if (Job* job = state.deque.steal()) {
+			stolen = true;
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+bool JobSystem::runOneJob(uint32_t worker) {
+	bool stolen = false;
+	Job* job = findJob(worker, stolen);
+	if (!job) {
+		return false;
+	}
+	execute(job, worker, stolen);
+	return true;
+}
+
+void JobSystem::workerMain(uint32_t worker) {
+	t_system = this;
+	t_worker = worker;
+	std::string name = "job worker " + std::to_string(worker);
+	INITIUM_PROFILE_THREAD(name.c_str());
+
+	while (m_running.load(std::memory_order_acquire)) {
+		if (runOneJob(worker)) {
+			continue;
+		}
+
+		bool found = false;
+		for (int spin = 0; spin < kIdleSpins && !found; spin++) {
+			std::this_thread::yield();
+			found = runOneJob(worker);
+		}
+		if (found) {
+			continue;
+		}
+
+		// Register as sleeping before the final check, so a submit that
+		// lands after it either sees us sleeping or changes the signal.
+		m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+		uint32_t signal = m_signal.load(std::memory_order_seq_cst);
+		if (!runOneJob(worker) && m_running.load(std::memory_order_acquire)) {
+			m_signal.wait(signal, std::memory_order_seq_cst);
+		}
+		m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+void JobSystem::notifyWorkers() {
+	m_signal.fetch_add(1, std::memory_order_seq_cst);
+	if (m_sleeping.load(std::memory_order_seq_cst) > 0) {
+		m_signal.notify_one();
+	}
+}
+
+}
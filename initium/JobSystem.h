@@ -0,0 +1,224 @@
+#pragma once
+
+#include "WorkStealingDeque.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace initium {
+
+class JobCounter;
+
+// A unit of work plus its callable, stored inline so that submitting from a
+// worker or a registered external thread doesn't allocate. Owned by the
+// JobSystem; only ever seen through pointers.
+struct Job {
+	static constexpr size_t kStorageBytes = 64;
+
+	void (*invoke)(Job& job) = nullptr;
+	void (*destroy)(Job& job) = nullptr;
+	JobCounter* counter = nullptr;
+	// Next job waiting on the same dependency counter.
+	Job* nextDependent = nullptr;
+	// Cleared when the job has run; its pool slot is free again.
+	std::atomic<bool> inUse{ false };
+	// Came from the heap because its submitter had no pool, or no free slot.
+	bool heapAllocated = false;
+	alignas(std::max_align_t) unsigned char storage[kStorageBytes];
+};
+
+// Counts outstanding jobs. Jobs submitted with a counter increment it and
+// decrement it when they finish; other jobs can be made to start only once
+// it reaches zero, and any thread can wait on it while running other work.
+// Must outlive every job that references it.
+class JobCounter {
+public:
+	JobCounter() = default;
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+	uint32_t pending() const { return m_pending.load(std::memory_order_relaxed); }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> m_pending{ 0 };
+	std::mutex m_mutex;
+	Job* m_dependents = nullptr;
+};
+
+struct JobWorkerStats {
+	uint64_t executed = 0;
+	// Of those, taken from another thread's deque.
+	uint64_t stolen = 0;
+	double busySeconds = 0.0;
+};
+
+// Work-stealing job scheduler. Each worker owns a Chase-Lev deque: jobs it
+// submits go to its own bottom and are popped LIFO, idle workers steal FIFO
+// from the others. Threads that are not workers submit through a shared,
+// locked injection queue and allocate their jobs, unless registered with
+// registerExternalThread(): the render thread gets a pool and a deque of
+// its own that the workers steal from. Waiting on a counter runs other jobs
+// instead of blocking, so nested parallelism does not idle a core.
+//
+// The constructing thread becomes worker 0, the main thread: it takes part
+// in waits, and is the only thread that runs main-thread jobs, which is
+// where anything touching GLFW has to go.
+class JobSystem {
+public:
+	// workerThreads = 0 picks hardware threads minus the main and render
+	// threads. wakeMainThread is called (from any thread) after a main-thread
+	// job is queued, to get the main loop out of its event wait.
+	JobSystem(uint32_t workerThreads, std::function<void()> wakeMainThread);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Runs function on some worker. Increments counter, if any, until it has
+	// finished. With a dependency the job does not start before that counter
+	// has reached zero.
+	template <typename F>
+	void submit(F&& function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr) {
+		Job* job = allocateJob();
+		emplace(*job, std::forward<F>(function));
+		enqueue(job, counter, dependency);
+	}
+
+	// Runs function on the main thread, from runMainThreadJobs() or a wait.
+	template <typename F>
+	void submitMainThread(F&& function, JobCounter* counter = nullptr) {
+		Job* job = allocateJob();
+		emplace(*job, std::forward<F>(function));
+		enqueueMainThread(job, counter);
+	}
+
+	// Splits [0, count) into ranges of at most grain items, runs
+	// function(begin, end) on them in parallel and returns when all are done.
+	template <typename F>
+	void parallelFor(uint32_t count, uint32_t grain, F&& function) {
+		if (grain == 0) {
+			grain = 1;
+		}
+		JobCounter counter;
+		uint32_t begin = 0;
+		for (; count - begin > grain; begin += grain) {
+			uint32_t end = begin + grain;
+			submit([&function, begin, end] { function(begin, end); }, &counter);
+		}
+		// The last range runs here rather than idling until a worker takes it.
+		if (begin < count) {
+			function(begin, count);
+		}
+		wait(counter);
+	}
+
+	// Runs jobs, main-thread jobs included when called on the main thread,
+	// until counter reaches zero.
+	void wait(JobCounter& counter);
+
+	// Counts work that finishes outside a job, such as a coroutine or an I/O
+	// request, against counter until the matching complete().
+	void addPending(JobCounter& counter) { counter.m_pending.fetch_add(1, std::memory_order_relaxed); }
+	void complete(JobCounter& counter) { finish(counter); }
+
+	// Gives the calling thread, which must not be a worker, a job pool and a
+	// deque for as long as the JobSystem lives. Does nothing past
+	// kMaxExternalThreads, or when the thread is already registered.
+	void registerExternalThread();
+
+	// Main thread: runs the main-thread jobs queued so far. Call once per
+	// loop iteration.
+	void runMainThreadJobs();
+
+	bool isMainThread() const;
+	// Main thread plus worker threads.
+	uint32_t workerCount() const { return static_cast<uint32_t>(m_workers.size()); }
+	// Index of the calling worker, or workerCount() on any other thread.
+	uint32_t currentWorker() const;
+
+	JobWorkerStats workerStats(uint32_t worker) const;
+	void reportStats() const;
+
+private:
+	static constexpr size_t kDequeCapacity = 4096;
+	static constexpr size_t kJobPoolSize = 4096;
+	static constexpr uint32_t kMaxExternalThreads = 4;
+
+	struct alignas(64) Worker {
+		WorkStealingDeque<Job, kDequeCapacity> deque;
+		std::unique_ptr<Job[]> jobs;
+		uint32_t nextJob = 0;
+		uint64_t rng = 0;
+		std::atomic<uint64_t> executed{ 0 };
+		std::atomic<uint64_t> stolen{ 0 };
+		std::atomic<uint64_t> busyNanoseconds{ 0 };
+		std::thread thread;
+	};
+
+	template <typename F>
+	static void emplace(Job& job, F&& function) {
+		using Function = std::decay_t<F>;
+		static_assert(sizeof(Function) <= Job::kStorageBytes, "job captures too large; capture a pointer instead");
+		static_assert(alignof(Function) <= alignof(std::max_align_t), "over-aligned job callable");
+		new (job.storage) Function(std::forward<F>(function));
+		job.invoke = [](Job& job) { (*std::launder(reinterpret_cast<Function*>(job.storage)))(); };
+		job.destroy = [](Job& job) { std::launder(reinterpret_cast<Function*>(job.storage))->~Function(); };
+	}
+
+	// The calling thread's pool and deque: its worker's, its external slot's,
+	// or none.
+	Worker* ownState();
+	// Deques other threads steal from: workers first, then external threads.
+	uint32_t victimCount() const { return workerCount() + m_externalCount.load(std::memory_order_acquire); }
+	Worker& victim(uint32_t index) { return index < workerCount() ? *m_workers[index] : *m_externals[index - workerCount()]; }
+
+	Job* allocateJob();
+	void enqueue(Job* job, JobCounter* counter, JobCounter* dependency);
+	void enqueueMainThread(Job* job, JobCounter* counter);
+	// Makes a job runnable now, on the calling thread's deque if it has one.
+	void schedule(Job* job);
+	void execute(Job* job, uint32_t worker, bool stolen);
+	void finish(JobCounter& counter);
+
+	// Finds a job for worker (UINT32_MAX for a non-worker thread): its own
+	// deque, then the injection queue, then the other deques.
+	Job* findJob(uint32_t worker, bool& stolen);
+	bool runOneJob(uint32_t worker);
+	void workerMain(uint32_t worker);
+	void notifyWorkers();
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::function<void()> m_wakeMainThread;
+
+	// Filled in order under the mutex; m_externalCount is published last.
+	std::mutex m_externalMutex;
+	std::unique_ptr<Worker> m_externals[kMaxExternalThreads];
+	std::atomic<uint32_t> m_externalCount{ 0 };
+
+	std::mutex m_injectionMutex;
+	std::vector<Job*> m_injected;
+	std::atomic<size_t> m_injectedCount{ 0 };
+
+	std::mutex m_mainThreadMutex;
+	std::vector<Job*> m_mainThreadJobs;
+
+	// Bumped whenever work is added; idle workers sleep on it.
+	std::atomic<uint32_t> m_signal{ 0 };
+	std::atomic<uint32_t> m_sleeping{ 0 };
+	std::atomic<bool> m_running{ true };
+};
+
+}
@@ -0,0 +1,136 @@
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace initium {
+
+namespace {
+
+constexpr uint32_t kUnused = UINT32_MAX;
+
+// Sphere around the vertices' bounding box, and the cone of the triangles'
+// normals: its axis is their normalised average and mindp the cosine of
+// the widest angle to it. The backface test needs the cone turned inside
+// out, sin(acos(mindp)); cones wider than ~84 degrees never cull.
+void computeBounds(MeshletData& data, GpuMeshlet& meshlet, const float* positions, size_t stride, uint32_t baseVertex) {
+	auto position = [&](uint32_t vertex) { return positions + static_cast<size_t>(vertex - baseVertex) * stride; };
+
+	float lower[3] = { INFINITY, INFINITY, INFINITY };
+	float upper[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+		const float* p = position(data.vertices[meshlet.vertexOffset + i]);
+		for (int axis = 0; axis < 3; axis++) {
+			lower[axis] = std::min(lower[axis], p[axis]);
+			upper[axis] = std::max(upper[axis], p[axis]);
+		}
+	}
+	float radiusSquared = 0.0f;
+	for (int axis = 0; axis < 3; axis++) {
+		meshlet.center[axis] = (lower[axis] + upper[axis]) * 0.5f;
+	}
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+		const float* p = position(data.vertices[meshlet.vertexOffset + i]);
+		float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet.radius = std::sqrt(radiusSquared);
+
+	std::vector<float> normals;
+	normals.reserve(meshlet.triangleCount * 3);
+	float axis[3] = {};
+	for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+		const uint32_t* corner = &data.indices[(meshlet.triangleOffset + t) * 3];
+		const float* a = position(corner[0]);
+		const float* b = position(corner[1]);
+		const float* c = position(corner[2]);
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0f) {
+			continue;
+		}
+		for (int i = 0; i < 3; i++) {
+			normals.push_back(n[i] / length);
+			axis[i] += n[i] / length;
+		}
+	}
+
+	meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+	meshlet.coneCutoff = 1.0f;
+	float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (axisLength == 0.0f) {
+		return;
+	}
+	float minDot = 1.0f;
+	for (size_t i = 0; i < normals.size(); i += 3) {
+		minDot = std::min(minDot, (normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]) / axisLength);
+	}
+	if (minDot <= 0.1f) {
+		return;
+	}
+	for (int i = 0; i < 3; i++) {
+		meshlet.coneAxis[i] = axis[i] / axisLength;
+	}
+	meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+}
+
+uint32_t buildMeshlets(MeshletData& data, const float* positions, size_t stride, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+	uint32_t baseVertex, const MeshletLimits& limits) {
+	// Triangle corners are packed in 8 bits.
+	if (limits.maxVertices < 3 || limits.maxVertices > 256 || limits.maxTriangles == 0) {
+		throw std::runtime_error("meshlet limits out of range");
+	}
+
+	uint32_t first = static_cast<uint32_t>(data.meshlets.size());
+	// Mesh vertex to its slot in the meshlet being built.
+	std::vector<uint32_t> slots(vertexCount, kUnused);
+	GpuMeshlet meshlet{};
+	meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+	meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+
+	auto finish = [&] {
+		if (meshlet.triangleCount == 0) {
+			return;
+		}
+		for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+			slots[data.vertices[meshlet.vertexOffset + i] - baseVertex] = kUnused;
+		}
+		computeBounds(data, meshlet, positions, stride, baseVertex);
+		data.meshlets.push_back(meshlet);
+		meshlet = {};
+		meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+	};
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		const uint32_t* corner = indices + i;
+		uint32_t added = 0;
+		for (int k = 0; k < 3; k++) {
+			added += slots[corner[k]] == kUnused ? 1 : 0;
+		}
+		if (meshlet.vertexCount + added > limits.maxVertices || meshlet.triangleCount == limits.maxTriangles) {
+			finish();
+		}
+
+		uint32_t packed = 0;
+		for (int k = 0; k < 3; k++) {
+			if (slots[corner[k]] == kUnused) {
+				slots[corner[k]] = meshlet.vertexCount++;
+				data.vertices.push_back(baseVertex + corner[k]);
+			}
+			packed |= slots[corner[k]] << (8 * k);
+			data.indices.push_back(baseVertex + corner[k]);
+		}
+		data.triangles.push_back(packed);
+		meshlet.triangleCount++;
+	}
+	finish();
+	return first;
+}
+
+}
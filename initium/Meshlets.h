@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace initium {
+
+// A cluster of a mesh's triangles, as the scene shaders read it from the
+// meshlet buffer. Bounds are in the mesh's object space.
+struct GpuMeshlet {
+	// Bounding sphere.
+	float center[3];
+	float radius;
+	// Normal cone: every triangle faces away from an eye for which
+	// dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius.
+	// A cutoff of 1 never culls.
+	float coneAxis[3];
+	float coneCutoff;
+	// Into MeshletData::vertices and MeshletData::triangles.
+	uint32_t vertexOffset;
+	uint32_t triangleOffset;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+// What one mesh shader workgroup outputs. 64 vertices and 124 triangles
+// fit every implementation's limits and keep the outputs small enough for
+// the fast path on current hardware.
+struct MeshletLimits {
+	uint32_t maxVertices = 64;
+	uint32_t maxTriangles = 124;
+};
+
+// Clusters of any number of meshes, in shared arrays.
+struct MeshletData {
+	std::vector<GpuMeshlet> meshlets;
+	// Per meshlet vertex: its index in the vertex buffer.
+	std::vector<uint32_t> vertices;
+	// Per meshlet triangle: three indices into the meshlet's vertices, 8 bits
+	// each, for mesh shaders.
+	std::vector<uint32_t> triangles;
+	// The same triangles as three vertex buffer indices each, for drawing
+	// clusters with indexed draws. Triangle t starts at index 3 * t.
+	std::vector<uint32_t> indices;
+};
+
+// Splits an indexed triangle list into clusters appended to data and
+// returns the index of the first. Triangles are taken greedily in index
+// order, so meshes whose triangles are already spatially coherent make
+// tight clusters without reordering. Indices are relative to baseVertex;
+// positions holds vertexCount positions, stride floats apart, and the
+// clusters refer to vertex baseVertex + i.
+uint32_t buildMeshlets(MeshletData& data, const float* positions, size_t stride, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+	uint32_t baseVertex, const MeshletLimits& limits = {});
+
+}
@@ -0,0 +1,213 @@
+#include "OffscreenTarget.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace initium {
+
+OffscreenTarget::OffscreenTarget(const VulkanContext& context, GpuAllocator& allocator, VkFormat format)
+	: m_context(context), m_allocator(allocator), m_format(format) {}
+
+OffscreenTarget::~OffscreenTarget() {
+	// The owner has waited for the device by now.
+	releaseCompleted(UINT64_MAX);
+	for (Target& target : m_images) {
+		destroyTarget(target);
+	}
+	if (!m_dumpDirectory.empty()) {
+		std::printf("offscreen: wrote %llu frames to %s\n", static_cast<unsigned long long>(m_dumpedFrames), m_dumpDirectory.string().c_str());
+	}
+}
+
+void OffscreenTarget::setDumpDirectory(const std::filesystem::path& directory, uint32_t interval) {
+	m_dumpDirectory = directory;
+	m_dumpInterval = interval > 0 ? interval : 1;
+	if (!directory.empty()) {
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		if (error) {
+			throw std::runtime_error("cannot create " + directory.string() + ": " + error.message());
+		}
+	}
+}
+
+bool OffscreenTarget::acquire(VkExtent2D framebufferSize, uint64_t frameSerial, uint64_t frameNumber, uint32_t& imageIndex) {
+	if (framebufferSize.width == 0 || framebufferSize.height == 0) {
+		return false;
+	}
+	if (m_images.empty() || framebufferSize.width != m_extent.width || framebufferSize.height != m_extent.height) {
+		recreate(framebufferSize, frameSerial);
+	}
+
+	imageIndex = m_next;
+	m_next = (m_next + 1) % kImageCount;
+	m_lastSerial = frameSerial;
+
+	m_dumpCurrent = !m_dumpDirectory.empty() && frameNumber % m_dumpInterval == 0;
+	m_currentSerial = frameSerial;
+	m_currentFrameNumber = frameNumber;
+	return true;
+}
+
+void OffscreenTarget::recordFinish(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	// Without a dump the image stays in COLOR_ATTACHMENT_OPTIMAL; the next
+	// frame to use it discards the contents anyway.
+	if (!m_dumpCurrent) {
+		return;
+	}
+	m_dumpCurrent = false;
+
+	PendingDump dump;
+	dump.extent = m_extent;
+	dump.serial = m_currentSerial;
+	dump.frameNumber = m_currentFrameNumber;
+
+	VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = static_cast<VkDeviceSize>(m_extent.width) * m_extent.height * 4;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	dump.buffer = m_allocator.createBuffer(bufferInfo, { MemoryUsage::Readback });
+
+	VkImageMemoryBarrier2 toTransfer{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	toTransfer.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	toTransfer.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	toTransfer.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	toTransfer.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+	toTransfer.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.image = image(imageIndex);
+	toTransfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	VkDependencyInfo dependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependency.imageMemoryBarrierCount = 1;
+	dependency.pImageMemoryBarriers = &toTransfer;
+	vkCmdPipelineBarrier2(commandBuffer, &dependency);
+
+	VkBufferImageCopy2 region{ VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2 };
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { m_extent.width, m_extent.height, 1 };
+
+	VkCopyImageToBufferInfo2 copyInfo{ VK_STRUCTURE_TYPE_COPY_IMAGE_TO_BUFFER_INFO_2 };
+	copyInfo.srcImage = image(imageIndex);
+	copyInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	copyInfo.dstBuffer = dump.buffer.buffer;
+	copyInfo.regionCount = 1;
+	copyInfo.pRegions = &region;
+	vkCmdCopyImageToBuffer2(commandBuffer, &copyInfo);
+
+	VkMemoryBarrier2 toHost{ VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	toHost.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	toHost.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	toHost.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	toHost.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+	VkDependencyInfo hostDependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	hostDependency.memoryBarrierCount = 1;
+	hostDependency.pMemoryBarriers = &toHost;
+	vkCmdPipelineBarrier2(commandBuffer, &hostDependency);
+
+	m_pendingDumps.push_back(std::move(dump));
+}
+
+void OffscreenTarget::releaseCompleted(uint64_t completedSerial) {
+	size_t kept = 0;
+	for (PendingDump& dump : m_pendingDumps) {
+		if (dump.serial > completedSerial) {
+			m_pendingDumps[kept++] = std::move(dump);
+			continue;
+		}
+		if (writeDump(dump)) {
+			m_dumpedFrames++;
+		}
+		m_allocator.destroyBuffer(dump.buffer);
+	}
+	m_pendingDumps.resize(kept);
+
+	kept = 0;
+	for (Retired& retired : m_retired) {
+		if (retired.lastSerial > completedSerial) {
+			m_retired[kept++] = std::move(retired);
+			continue;
+		}
+		for (Target& target : retired.images) {
+			destroyTarget(target);
+		}
+	}
+	m_retired.resize(kept);
+}
+
+void OffscreenTarget::recreate(VkExtent2D extent, uint64_t frameSerial) {
+	if (!m_images.empty()) {
+		// Frames up to m_lastSerial may still be rendering into the old images.
+		m_retired.push_back({ std::move(m_images), m_lastSerial });
+		m_images.clear();
+	}
+	m_extent = extent;
+	m_next = 0;
+	m_lastSerial = frameSerial;
+
+	VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = m_format;
+	imageInfo.extent = { extent.width, extent.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	m_images.resize(kImageCount);
+	for (Target& target : m_images) {
+		target.image = m_allocator.createImage(imageInfo, { MemoryUsage::GpuOnly });
+
+		VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = target.image.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = m_format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCheck(vkCreateImageView(m_context.device(), &viewInfo, m_context.allocationCallbacks(), &target.view), "vkCreateImageView");
+	}
+}
+
+void OffscreenTarget::destroyTarget(Target& target) {
+	if (target.view) {
+		vkDestroyImageView(m_context.device(), target.view, m_context.allocationCallbacks());
+		target.view = VK_NULL_HANDLE;
+	}
+	m_allocator.destroyImage(target.image);
+}
+
+bool OffscreenTarget::writeDump(const PendingDump& dump) const {
+	m_allocator.invalidate(dump.buffer.allocation);
+	const uint8_t* pixels = static_cast<const uint8_t*>(dump.buffer.allocation.mapped);
+	bool swapRedBlue = m_format == VK_FORMAT_B8G8R8A8_UNORM || m_format == VK_FORMAT_B8G8R8A8_SRGB;
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "frame_%06llu.ppm", static_cast<unsigned long long>(dump.frameNumber));
+	std::filesystem::path path = m_dumpDirectory / name;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file << "P6\n" << dump.extent.width << ' ' << dump.extent.height << "\n255\n";
+	std::vector<uint8_t> row(static_cast<size_t>(dump.extent.width) * 3);
+	for (uint32_t y = 0; y < dump.extent.height; y++) {
+		const uint8_t* source = pixels + static_cast<size_t>(y) * dump.extent.width * 4;
+		for (uint32_t x = 0; x < dump.extent.width; x++) {
+			row[x * 3 + 0] = source[x * 4 + (swapRedBlue ? 2 : 0)];
+			row[x * 3 + 1] = source[x * 4 + 1];
+			row[x * 3 + 2] = source[x * 4 + (swapRedBlue ? 0 : 2)];
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+	}
+	if (!file) {
+		std::fprintf(stderr, "initium: failed to write %s\n", path.string().c_str());
+		return false;
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "FrameRing.h"
+#include "GpuAllocator.h"
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace initium {
+
+// Stands in for the swapchain in headless runs: a ring of color images the
+// renderer draws into and nothing presents. Any frame can be copied into a
+// readback buffer and, once the GPU has finished with it, written to disk as
+// a binary PPM for image comparison on machines without a display.
+class OffscreenTarget {
+public:
+	// One image per frame that can be in flight, so reusing an image never
+	// has to wait beyond what FrameRing::beginFrame already waited for.
+	static constexpr uint32_t kImageCount = FrameRing::kMaxFramesInFlight;
+
+	OffscreenTarget(const VulkanContext& context, GpuAllocator& allocator, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+	~OffscreenTarget();
+
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+	// Writes every interval-th frame to directory, which is created if
+	// needed. An empty path turns dumping off.
+	void setDumpDirectory(const std::filesystem::path& directory, uint32_t interval = 1);
+
+	// Picks the image for the next frame, recreating the images at a new size
+	// first. Returns false for a 0x0 framebuffer. frameSerial is the frame's
+	// timeline value, frameNumber names the dump file.
+	bool acquire(VkExtent2D framebufferSize, uint64_t frameSerial, uint64_t frameNumber, uint32_t& imageIndex);
+
+	// Records the end of the frame after rendering to image(imageIndex) in
+	// COLOR_ATTACHMENT_OPTIMAL, including the copy out if it gets dumped.
+	void recordFinish(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	// Writes dumps and destroys images replaced by a resize once the frames
+	// using them have completed. Pass UINT64_MAX after a device wait idle.
+	void releaseCompleted(uint64_t completedSerial);
+
+	VkFormat format() const { return m_format; }
+	VkExtent2D extent() const { return m_extent; }
+	VkImage image(uint32_t index) const { return m_images[index].image.image; }
+	VkImageView imageView(uint32_t index) const { return m_images[index].view; }
+
+	uint64_t dumpedFrames() const { return m_dumpedFrames; }
+
+private:
+	struct Target {
+		GpuImage image;
+		VkImageView view = VK_NULL_HANDLE;
+	};
+
+	struct Retired {
+		std::vector<Target> images;
+		uint64_t lastSerial = 0;
+	};
+
+	struct PendingDump {
+		GpuBuffer buffer;
+		VkExtent2D extent{};
+		uint64_t serial = 0;
+		uint64_t frameNumber = 0;
+	};
+
+	void recreate(VkExtent2D extent, uint64_t frameSerial);
+	void destroyTarget(Target& target);
+	bool writeDump(const PendingDump& dump) const;
+
+	const VulkanContext& m_context;
+	GpuAllocator& m_allocator;
+	VkFormat m_format;
+	VkExtent2D m_extent{};
+
+	std::vector<Target> m_images;
+	uint32_t m_next = 0;
+	uint64_t m_lastSerial = 0;
+	std::vector<Retired> m_retired;
+
+	std::filesystem::path m_dumpDirectory;
+	uint32_t m_dumpInterval = 1;
+	// Set by acquire() when the current frame is to be dumped.
+	bool m_dumpCurrent = false;
+	uint64_t m_currentSerial = 0;
+	uint64_t m_currentFrameNumber = 0;
+	std::vector<PendingDump> m_pendingDumps;
+	uint64_t m_dumpedFrames = 0;
+};
+
+}
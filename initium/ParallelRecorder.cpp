@@ -0,0 +1,88 @@
+#include "ParallelRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace initium {
+
+ParallelRecorder::ParallelRecorder(JobSystem& jobs) : m_jobs(jobs), m_threads(std::make_unique<ThreadCounters[]>(jobs.workerCount() + 1)) {}
+
+std::vector<VkCommandBuffer> ParallelRecorder::record(FrameContext& frame, const VkCommandBufferInheritanceRenderingInfo& renderingInfo,
+	uint32_t drawCount, uint32_t maxThreads, const RecordFunction& recordRange) {
+	uint32_t chunkCount = std::min(frame.recordingSlots(), (drawCount + m_minDrawsPerChunk - 1) / m_minDrawsPerChunk);
+	if (maxThreads > 0) {
+		chunkCount = std::min(chunkCount, maxThreads);
+	}
+	std::vector<VkCommandBuffer> secondaries(chunkCount);
+	if (chunkCount == 0) {
+		return secondaries;
+	}
+
+	VkCommandBufferInheritanceInfo inheritance{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+	inheritance.pNext = &renderingInfo;
+
+	m_jobs.parallelFor(chunkCount, 1, [&](uint32_t firstChunk, uint32_t lastChunk) {
+		for (uint32_t chunk = firstChunk; chunk < lastChunk; chunk++) {
+			auto start = std::chrono::steady_clock::now();
+			uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * chunk / chunkCount);
+			uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * (chunk + 1) / chunkCount);
+
+			VkCommandBuffer commandBuffer = frame.allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY, chunk);
+			VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = &inheritance;
+			vkCheck(vkBeginCommandBuffer(commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+			recordRange(commandBuffer, begin, end);
+			vkCheck(vkEndCommandBuffer(commandBuffer), "vkEndCommandBuffer");
+			secondaries[chunk] = commandBuffer;
+
+			auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+			ThreadCounters& counters = m_threads[m_jobs.currentWorker()];
+			counters.draws.fetch_add(end - begin, std::memory_order_relaxed);
+			counters.commandBuffers.fetch_add(1, std::memory_order_relaxed);
+			counters.nanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+		}
+	});
+	return secondaries;
+}
+
+RecordingThreadStats ParallelRecorder::threadStats(uint32_t thread) const {
+	const ThreadCounters& counters = m_threads[thread];
+	RecordingThreadStats stats;
+	stats.draws = counters.draws.load(std::memory_order_relaxed);
+	stats.commandBuffers = counters.commandBuffers.load(std::memory_order_relaxed);
+	stats.seconds = static_cast<double>(counters.nanoseconds.load(std::memory_order_relaxed)) / 1e9;
+	return stats;
+}
+
+void ParallelRecorder::resetStats() {
+	for (uint32_t i = 0; i <= m_jobs.workerCount(); i++) {
+		m_threads[i].draws.store(0, std::memory_order_relaxed);
+		m_threads[i].commandBuffers.store(0, std::memory_order_relaxed);
+		m_threads[i].nanoseconds.store(0, std::memory_order_relaxed);
+	}
+}
+
+void ParallelRecorder::reportStats() const {
+	RecordingThreadStats total;
+	for (uint32_t i = 0; i <= m_jobs.workerCount(); i++) {
+		RecordingThreadStats stats = threadStats(i);
+		total.draws += stats.draws;
+		total.commandBuffers += stats.commandBuffers;
+		total.seconds += stats.seconds;
+	}
+	std::printf("recording: %llu draws in %llu secondaries, %.1f draws/ms per thread\n", static_cast<unsigned long long>(total.draws),
+		static_cast<unsigned long long>(total.commandBuffers), total.drawsPerMillisecond());
+	for (uint32_t i = 0; i <= m_jobs.workerCount(); i++) {
+		RecordingThreadStats stats = threadStats(i);
+		if (stats.draws == 0) {
+			continue;
+		}
+		const char* name = i == 0 ? "main" : i == m_jobs.workerCount() ? "other" : "worker";
+		std::printf("  %-6s %2u %10llu draws, %8.2f ms, %8.1f draws/ms\n", name, i, static_cast<unsigned long long>(stats.draws),
+			stats.seconds * 1000.0, stats.drawsPerMillisecond());
+	}
+}
+
+}
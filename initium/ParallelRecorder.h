@@ -0,0 +1,76 @@
+#pragma once
+
+#include "FrameRing.h"
+#include "JobSystem.h"
+#include "VulkanContext.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace initium {
+
+struct RecordingThreadStats {
+	uint64_t draws = 0;
+	uint64_t commandBuffers = 0;
+	double seconds = 0.0;
+
+	double drawsPerMillisecond() const { return seconds > 0.0 ? static_cast<double>(draws) / (seconds * 1000.0) : 0.0; }
+};
+
+// Records the draws of one dynamic rendering pass into secondary command
+// buffers on the job system.
+//
+// The draws are split into contiguous chunks and chunk i is always recorded
+// into a buffer from the frame's recording slot i, so every pool has exactly
+// one thread recording into it and pools are reset wholesale with the frame.
+// The chunks depend only on the draw count and thread limit, never on which
+// worker happened to pick a chunk up, and the secondaries come back in draw
+// order: what the GPU executes is the same as recording on one thread.
+class ParallelRecorder {
+public:
+	// Records draws [begin, end) into a secondary that has already begun
+	// inside the pass. Called concurrently for disjoint ranges.
+	using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end)>;
+
+	explicit ParallelRecorder(JobSystem& jobs);
+
+	ParallelRecorder(const ParallelRecorder&) = delete;
+	ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+	// Recording slots a FrameContext needs for this recorder: one per
+	// thread that can run a chunk, which is every worker plus the caller.
+	uint32_t slotCount() const { return m_jobs.workerCount() + 1; }
+
+	// Below this many draws a chunk is not worth a job of its own.
+	void setMinDrawsPerChunk(uint32_t draws) { m_minDrawsPerChunk = draws > 0 ? draws : 1; }
+
+	// Records drawCount draws split over at most maxThreads chunks (0 means
+	// as many as the frame has slots) and returns the secondaries in draw
+	// order, ready for vkCmdExecuteCommands. renderingInfo describes the
+	// pass they will execute in. Blocks, helping with the jobs, until all
+	// chunks are recorded.
+	std::vector<VkCommandBuffer> record(FrameContext& frame, const VkCommandBufferInheritanceRenderingInfo& renderingInfo,
+		uint32_t drawCount, uint32_t maxThreads, const RecordFunction& recordRange);
+
+	// Totals per worker index, with non-worker threads (the render thread)
+	// in the last entry.
+	RecordingThreadStats threadStats(uint32_t thread) const;
+	void resetStats();
+	void reportStats() const;
+
+private:
+	struct alignas(64) ThreadCounters {
+		std::atomic<uint64_t> draws{ 0 };
+		std::atomic<uint64_t> commandBuffers{ 0 };
+		std::atomic<uint64_t> nanoseconds{ 0 };
+	};
+
+	JobSystem& m_jobs;
+	uint32_t m_minDrawsPerChunk = 256;
+	std::unique_ptr<ThreadCounters[]> m_threads;
+};
+
+}
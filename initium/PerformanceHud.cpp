@@ -0,0 +1,370 @@
+#include "PerformanceHud.h"
+
+#include "SpritePipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace initium {
+
+namespace {
+
+// Push constants of shaders/hud.vert.
+struct HudConstants {
+	float pixelToClip[2];
+};
+
+constexpr uint32_t rgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+	return r | g << 8 | b << 16 | a << 24;
+}
+
+constexpr uint32_t kPanelColor = rgba(0, 0, 0, 170);
+constexpr uint32_t kGraphColor = rgba(24, 24, 32, 200);
+constexpr uint32_t kTextColor = rgba(230, 230, 230, 255);
+constexpr uint32_t kDimColor = rgba(110, 110, 120, 255);
+constexpr uint32_t kGoodColor = rgba(70, 190, 90, 255);
+constexpr uint32_t kSlowColor = rgba(220, 180, 50, 255);
+constexpr uint32_t kBadColor = rgba(220, 60, 50, 255);
+constexpr uint32_t kCpuColor = rgba(80, 200, 255, 255);
+constexpr uint32_t kGpuColor = rgba(255, 90, 220, 255);
+
+// Font pixels are kPixel screen pixels square; glyphs are 3x5 with a pixel
+// between characters and two between lines.
+constexpr float kPixel = 2.0f;
+constexpr float kAdvance = 4.0f * kPixel;
+constexpr float kLineHeight = 7.0f * kPixel;
+constexpr float kMargin = 8.0f;
+constexpr float kPadding = 6.0f;
+constexpr float kColumnWidth = 2.0f;
+constexpr float kGraphHeight = 64.0f;
+constexpr float kPanelWidth = 280.0f;
+// Frame times over 60 Hz show as slow, over 30 Hz as bad.
+constexpr double kSlowMilliseconds = 1000.0 / 60.0 + 0.5;
+constexpr double kBadMilliseconds = 1000.0 / 30.0 + 0.5;
+
+// Rows top to bottom, the left column in bit 2. Letters are upper case
+// only; anything without a glyph is drawn as a space.
+const uint8_t* glyph(char c) {
+	static const uint8_t kDigits[10][5] = {
+		{ 7, 5, 5, 5, 7 }, { 2, 6, 2, 2, 7 }, { 7, 1, 7, 4, 7 }, { 7, 1, 3, 1, 7 }, { 5, 5, 7, 1, 1 },
+		{ 7, 4, 7, 1, 7 }, { 7, 4, 7, 5, 7 }, { 7, 1, 1, 1, 1 }, { 7, 5, 7, 5, 7 }, { 7, 5, 7, 1, 7 },
+	};
+	static const uint8_t kLetters[26][5] = {
+		{ 2, 5, 7, 5, 5 }, { 6, 5, 6, 5, 6 }, { 3, 4, 4, 4, 3 }, { 6, 5, 5, 5, 6 }, { 7, 4, 6, 4, 7 }, { 7, 4, 6, 4, 4 },
+		{ 3, 4, 5, 5, 3 }, { 5, 5, 7, 5, 5 }, { 7, 2, 2, 2, 7 }, { 1, 1, 1, 5, 2 }, { 5, 5, 6, 5, 5 }, { 4, 4, 4, 4, 7 },
+		{ 5, 7, 7, 5, 5 }, { 6, 5, 5, 5, 5 }, { 2, 5, 5, 5, 2 }, { 6, 5, 6, 4, 4 }, { 2, 5, 5, 6, 3 }, { 6, 5, 6, 5, 5 },
+		{ 3, 4, 2, 1, 6 }, { 7, 2, 2, 2, 2 }, { 5, 5, 5, 5, 7 }, { 5, 5, 5, 5, 2 }, { 5, 5, 7, 7, 5 }, { 5, 5, 2, 5, 5 },
+		{ 5, 5, 2, 2, 2 }, { 7, 1, 2, 4, 7 },
+	};
+	static const uint8_t kPeriod[5] = { 0, 0, 0, 0, 2 };
+	static const uint8_t kSlash[5] = { 1, 1, 2, 4, 4 };
+	static const uint8_t kColon[5] = { 0, 2, 0, 2, 0 };
+	static const uint8_t kPercent[5] = { 5, 1, 2, 4, 5 };
+	static const uint8_t kMinus[5] = { 0, 0, 7, 0, 0 };
+
+	if (c >= '0' && c <= '9') {
+		return kDigits[c - '0'];
+	}
+	if (c >= 'a' && c <= 'z') {
+		return kLetters[c - 'a'];
+	}
+	if (c >= 'A' && c <= 'Z') {
+		return kLetters[c - 'A'];
+	}
+	switch (c) {
+	case '.': return kPeriod;
+	case '/': return kSlash;
+	case ':': return kColon;
+	case '%': return kPercent;
+	case '-': return kMinus;
+	default: return nullptr;
+	}
+}
+
+uint32_t frameColor(double milliseconds) {
+	return milliseconds > kBadMilliseconds ? kBadColor : milliseconds > kSlowMilliseconds ? kSlowColor : kGoodColor;
+}
+
+}
+
+PerformanceHud::PerformanceHud(const VulkanContext& context, PipelineCache& pipelineCache, const BindlessTable& bindless, VkFormat colorFormat,
+	const std::filesystem::path& shaderDirectory)
+	: m_context(context), m_bindless(bindless), m_colorFormat(colorFormat), m_shaderDirectory(shaderDirectory) {
+	if (sizeof(HudConstants) > bindless.pushConstantBytes()) {
+		throw std::runtime_error("HUD push constants exceed the bindless pipeline layout");
+	}
+	m_rects.reserve(kMaxRects);
+	m_pipeline = createPipeline(pipelineCache);
+}
+
+PerformanceHud::~PerformanceHud() {
+	vkDestroyPipeline(m_context.device(), m_pipeline, m_context.allocationCallbacks());
+}
+
+void PerformanceHud::watchShaders(ShaderReloader& reloader, PipelineCache& pipelineCache) {
+	reloader.watch(m_pipeline, { m_shaderDirectory / "hud.vert.spv", m_shaderDirectory / "hud.frag.spv" },
+		[this, &pipelineCache] { return createPipeline(pipelineCache); });
+}
+
+void PerformanceHud::update(FrameContext& frame, const PerformanceHudFrame& data) {
+	m_history[m_historyNext] = { static_cast<float>(data.frameMilliseconds), static_cast<float>(data.cpuMilliseconds),
+		static_cast<float>(data.gpuMilliseconds) };
+	m_historyNext = (m_historyNext + 1) % kHistory;
+	m_rects.clear();
+	m_rectCount = 0;
+
+	float graphWidth = kHistory * kColumnWidth;
+	// Five lines of counters, the graph and its legend.
+	float panelHeight = kPadding * 3.0f + kLineHeight * 5.0f + kGraphHeight + 5.0f * kPixel;
+	addRect(kMargin, kMargin, kPanelWidth, panelHeight, kPanelColor);
+
+	float x = kMargin + kPadding;
+	float y = kMargin + kPadding;
+	char line[96];
+	std::snprintf(line, sizeof(line), "frame %6.2f ms %5.0f fps", data.frameMilliseconds,
+		data.frameMilliseconds > 0.0 ? 1000.0 / data.frameMilliseconds : 0.0);
+	addText(x, y, line, frameColor(data.frameMilliseconds));
+	y += kLineHeight;
+
+	std::snprintf(line, sizeof(line), "cpu %5.2f", data.cpuMilliseconds);
+	float next = addText(x, y, line, kCpuColor);
+	std::snprintf(line, sizeof(line), " gpu %5.2f", data.gpuMilliseconds);
+	next = addText(next, y, line, kGpuColor);
+	if (data.computeMilliseconds > 0.0) {
+		std::snprintf(line, sizeof(line), " async %.2f", data.computeMilliseconds);
+		next = addText(next, y, line, kTextColor);
+	}
+	addText(next, y, " ms", kTextColor);
+	y += kLineHeight;
+
+	std::snprintf(line, sizeof(line), "draws %llu dispatches %llu", static_cast<unsigned long long>(data.draws),
+		static_cast<unsigned long long>(data.dispatches));
+	addText(x, y, line, kTextColor);
+	y += kLineHeight;
+
+	double mib = 1024.0 * 1024.0;
+	std::snprintf(line, sizeof(line), "vram %.0f / %.0f mib", static_cast<double>(data.vramUsage) / mib,
+		static_cast<double>(data.vramBudget) / mib);
+	addText(x, y, line, data.vramBudget > 0 && data.vramUsage * 10 > data.vramBudget * 9 ? kBadColor : kTextColor);
+	y += kLineHeight;
+
+	// Overall use, then a bar per worker filling from the bottom.
+	float busy = 0.0f;
+	for (float utilization : data.jobUtilization) {
+		busy += utilization;
+	}
+	busy = data.jobUtilization.empty() ? 0.0f : busy / static_cast<float>(data.jobUtilization.size());
+	std::snprintf(line, sizeof(line), "jobs %3.0f%% ", busy * 100.0f);
+	float barX = addText(x, y, line, kTextColor);
+	float barHeight = 5.0f * kPixel;
+	for (float utilization : data.jobUtilization) {
+		if (barX + 4.0f > kMargin + kPanelWidth - kPadding) {
+			break;
+		}
+		float filled = barHeight * std::clamp(utilization, 0.0f, 1.0f);
+		addRect(barX, y, 4.0f, barHeight - filled, kGraphColor);
+		addRect(barX, y + barHeight - filled, 4.0f, filled, kCpuColor);
+		barX += 6.0f;
+	}
+	y += kLineHeight;
+
+	// The graph's scale doubles until the slowest frame in it fits, with a
+	// line where a 60 Hz frame would reach.
+	float slowest = 0.0f;
+	for (const Sample& sample : m_history) {
+		slowest = std::max(slowest, sample.frame);
+	}
+	float scale = static_cast<float>(kBadMilliseconds);
+	for (int i = 0; i < 4 && slowest > scale; i++) {
+		scale *= 2.0f;
+	}
+	float graphTop = y;
+	float graphBottom = graphTop + kGraphHeight;
+	addRect(x, graphTop, graphWidth, kGraphHeight, kGraphColor);
+	addRect(x, graphBottom - kGraphHeight * static_cast<float>(1000.0 / 60.0) / scale, graphWidth, 1.0f, kDimColor);
+	auto height = [scale](float milliseconds) { return kGraphHeight * std::min(milliseconds / scale, 1.0f); };
+	for (uint32_t i = 0; i < kHistory; i++) {
+		const Sample& sample = m_history[(m_historyNext + i) % kHistory];
+		float columnX = x + static_cast<float>(i) * kColumnWidth;
+		if (sample.frame > 0.0f) {
+			addRect(columnX, graphBottom - height(sample.frame), kColumnWidth, height(sample.frame), frameColor(sample.frame));
+		}
+		// CPU and GPU overlap, so they are lines over the bars rather than
+		// parts of them.
+		if (sample.cpu > 0.0f) {
+			addRect(columnX, graphBottom - height(sample.cpu) - 1.0f, kColumnWidth, 2.0f, kCpuColor);
+		}
+		if (sample.gpu > 0.0f) {
+			addRect(columnX, graphBottom - height(sample.gpu) - 1.0f, kColumnWidth, 2.0f, kGpuColor);
+		}
+	}
+	y = graphBottom + kPadding;
+
+	std::snprintf(line, sizeof(line), "0-%.0f ms", scale);
+	next = addText(x, y, line, kDimColor);
+	next = addText(next, y, " frame", kGoodColor);
+	next = addText(next, y, " cpu", kCpuColor);
+	addText(next, y, " gpu", kGpuColor);
+
+	TransientAllocation allocation = frame.allocateTransient(m_rects.size() * sizeof(HudRect), alignof(HudRect));
+	if (!allocation) {
+		return;
+	}
+	std::memcpy(allocation.mapped, m_rects.data(), m_rects.size() * sizeof(HudRect));
+	m_buffer = allocation.buffer;
+	m_offset = allocation.offset;
+	m_rectCount = static_cast<uint32_t>(m_rects.size());
+}
+
+void PerformanceHud::record(VkCommandBuffer commandBuffer, VkExtent2D extent) const {
+	if (m_rectCount == 0) {
+		return;
+	}
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+	VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+	VkRect2D scissor{ { 0, 0 }, extent };
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	HudConstants constants{ { 2.0f / static_cast<float>(extent.width), 2.0f / static_cast<float>(extent.height) } };
+	vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants), &constants);
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_buffer, &m_offset);
+	vkCmdDraw(commandBuffer, 4, m_rectCount, 0, 0);
+}
+
+void PerformanceHud::addRect(float x, float y, float width, float height, uint32_t color) {
+	if (m_rects.size() < kMaxRects && width > 0.0f && height > 0.0f) {
+		m_rects.push_back({ { x, y }, { width, height }, color });
+	}
+}
+
+float PerformanceHud::addText(float x, float y, const char* text, uint32_t color) {
+	for (; *text; text++, x += kAdvance) {
+		const uint8_t* rows = glyph(*text);
+		if (!rows) {
+			continue;
+		}
+		// A rectangle per horizontal run of lit pixels.
+		for (uint32_t row = 0; row < 5; row++) {
+			uint32_t column = 0;
+			while (column < 3) {
+				if ((rows[row] & (4u >> column)) == 0) {
+					column++;
+					continue;
+				}
+				uint32_t end = column;
+				while (end < 3 && (rows[row] & (4u >> end)) != 0) {
+					end++;
+				}
+				addRect(x + static_cast<float>(column) * kPixel, y + static_cast<float>(row) * kPixel,
+					static_cast<float>(end - column) * kPixel, kPixel, color);
+				column = end;
+			}
+		}
+	}
+	return x;
+}
+
+VkPipeline PerformanceHud::createPipeline(PipelineCache& pipelineCache) const {
+	VkDevice device = m_context.device();
+	VkShaderModule vertexShader = VK_NULL_HANDLE;
+	VkShaderModule fragmentShader = VK_NULL_HANDLE;
+	try {
+		vertexShader = loadShaderModule(m_context, m_shaderDirectory / "hud.vert.spv");
+		fragmentShader = loadShaderModule(m_context, m_shaderDirectory / "hud.frag.spv");
+	} catch (...) {
+		vkDestroyShaderModule(device, vertexShader, m_context.allocationCallbacks());
+		throw;
+	}
+
+	VkPipelineShaderStageCreateInfo stages[2] = { { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
+		{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO } };
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vertexShader;
+	stages[0].pName = "main";
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = fragmentShader;
+	stages[1].pName = "main";
+
+	// Every vertex of an instance reads the same rectangle.
+	VkVertexInputBindingDescription binding{ 0, sizeof(HudRect), VK_VERTEX_INPUT_RATE_INSTANCE };
+	const VkVertexInputAttributeDescription attributes[] = {
+		{ 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(HudRect, position) },
+		{ 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(HudRect, size) },
+		{ 2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(HudRect, color) },
+	};
+	VkPipelineVertexInputStateCreateInfo vertexInput{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+	vertexInput.vertexBindingDescriptionCount = 1;
+	vertexInput.pVertexBindingDescriptions = &binding;
+	vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(std::size(attributes));
+	vertexInput.pVertexAttributeDescriptions = attributes;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+	VkPipelineViewportStateCreateInfo viewportState{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterization{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+	rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization.cullMode = VK_CULL_MODE_NONE;
+	rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterization.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample{ VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState blendAttachment{};
+	blendAttachment.blendEnable = VK_TRUE;
+	blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlend{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+	colorBlend.attachmentCount = 1;
+	colorBlend.pAttachments = &blendAttachment;
+
+	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineRenderingCreateInfo renderingInfo{ VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &m_colorFormat;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	pipelineInfo.pNext = &renderingInfo;
+	pipelineInfo.stageCount = static_cast<uint32_t>(std::size(stages));
+	pipelineInfo.pStages = stages;
+	pipelineInfo.pVertexInputState = &vertexInput;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterization;
+	pipelineInfo.pMultisampleState = &multisample;
+	pipelineInfo.pColorBlendState = &colorBlend;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = m_bindless.pipelineLayout();
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	auto start = std::chrono::steady_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(device, pipelineCache.threadCache(), 1, &pipelineInfo, m_context.allocationCallbacks(), &pipeline);
+	pipelineCache.recordCreation(std::chrono::steady_clock::now() - start);
+
+	vkDestroyShaderModule(device, fragmentShader, m_context.allocationCallbacks());
+	vkDestroyShaderModule(device, vertexShader, m_context.allocationCallbacks());
+	vkCheck(result, "vkCreateGraphicsPipelines");
+	return pipeline;
+}
+
+}
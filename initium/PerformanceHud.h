@@ -0,0 +1,101 @@
+#pragma once
+
+#include "BindlessTable.h"
+#include "FrameRing.h"
+#include "PipelineCache.h"
+#include "ShaderReloader.h"
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace initium {
+
+// What the overlay shows for one frame, gathered by the renderer.
+struct PerformanceHudFrame {
+	// Interval since the previous frame, and how long the render thread
+	// spent on the previous one.
+	double frameMilliseconds = 0.0;
+	double cpuMilliseconds = 0.0;
+	// The last timed frame's passes on each queue, summed; 0 on devices that
+	// can't time them.
+	double gpuMilliseconds = 0.0;
+	double computeMilliseconds = 0.0;
+	// Draws the GPU ran, indirect ones included, and dispatches recorded.
+	uint64_t draws = 0;
+	uint64_t dispatches = 0;
+	// Device-local heaps.
+	VkDeviceSize vramUsage = 0;
+	VkDeviceSize vramBudget = 0;
+	// Busy share of each job worker since the previous frame, main thread
+	// first.
+	std::vector<float> jobUtilization;
+};
+
+// Per-instance input of shaders/hud.vert: a solid rectangle in pixels from
+// the top left, colour as RGBA8 with red in the low byte.
+struct HudRect {
+	float position[2];
+	float size[2];
+	uint32_t color;
+};
+
+// Frame-time graph and counters drawn over the frame. The layout is built
+// on the CPU as a list of rectangles, text included, rasterised from a
+// built-in 3x5 font, and written to the frame's transient buffer; recording
+// it is one instanced draw whatever it shows.
+class PerformanceHud {
+public:
+	// Frames the graph goes back.
+	static constexpr uint32_t kHistory = 120;
+	// Rectangles per frame; anything past it is dropped.
+	static constexpr uint32_t kMaxRects = 8192;
+
+	PerformanceHud(const VulkanContext& context, PipelineCache& pipelineCache, const BindlessTable& bindless, VkFormat colorFormat,
+		const std::filesystem::path& shaderDirectory = "shaders");
+	~PerformanceHud();
+
+	PerformanceHud(const PerformanceHud&) = delete;
+	PerformanceHud& operator=(const PerformanceHud&) = delete;
+
+	// Adds the frame to the graph, lays the overlay out and copies it into
+	// the frame's transient buffer. Draws nothing this frame when the buffer
+	// is out of space.
+	void update(FrameContext& frame, const PerformanceHudFrame& data);
+	// Inside a rendering pass on a colour attachment of colorFormat.
+	void record(VkCommandBuffer commandBuffer, VkExtent2D extent) const;
+	uint32_t rectCount() const { return m_rectCount; }
+
+	// Rebuilds the pipeline when the HUD shaders change.
+	void watchShaders(ShaderReloader& reloader, PipelineCache& pipelineCache);
+
+private:
+	struct Sample {
+		float frame = 0.0f;
+		float cpu = 0.0f;
+		float gpu = 0.0f;
+	};
+
+	VkPipeline createPipeline(PipelineCache& pipelineCache) const;
+
+	void addRect(float x, float y, float width, float height, uint32_t color);
+	// Returns the x the next character would go at.
+	float addText(float x, float y, const char* text, uint32_t color);
+
+	const VulkanContext& m_context;
+	const BindlessTable& m_bindless;
+	VkFormat m_colorFormat;
+	std::filesystem::path m_shaderDirectory;
+	VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+	Sample m_history[kHistory];
+	uint32_t m_historyNext = 0;
+
+	std::vector<HudRect> m_rects;
+	VkBuffer m_buffer = VK_NULL_HANDLE;
+	VkDeviceSize m_offset = 0;
+	uint32_t m_rectCount = 0;
+};
+
+}
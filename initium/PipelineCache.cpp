@@ -0,0 +1,219 @@
+#include "PipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace initium {
+
+namespace {
+
+uint64_t fnv1a(const uint8_t* data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+double toMilliseconds(std::chrono::steady_clock::duration duration) {
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}
+
+bool PipelineCacheBlob::write() const {
+	if (data.empty()) {
+		return false;
+	}
+
+	std::filesystem::path temporary = path;
+	temporary += ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		file.flush();
+		if (!file) {
+			file.close();
+			std::error_code ignored;
+			std::filesystem::remove(temporary, ignored);
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error) {
+		std::error_code ignored;
+		std::filesystem::remove(temporary, ignored);
+		return false;
+	}
+	return true;
+}
+
+PipelineCache::PipelineCache(const VulkanContext& context, std::filesystem::path path)
+	: m_context(context), m_path(std::move(path)) {
+	const VkPhysicalDeviceProperties& properties = context.properties();
+	m_expected.vendorID = properties.vendorID;
+	m_expected.deviceID = properties.deviceID;
+	m_expected.driverVersion = properties.driverVersion;
+	std::memcpy(m_expected.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	VkPhysicalDeviceIDProperties idProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES };
+	VkPhysicalDeviceProperties2 properties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+	properties2.pNext = &idProperties;
+	vkGetPhysicalDeviceProperties2(context.physicalDevice(), &properties2);
+	std::memcpy(m_expected.driverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+
+	auto start = std::chrono::steady_clock::now();
+	m_warm = load();
+
+	VkPipelineCacheCreateInfo cacheInfo{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+	cacheInfo.initialDataSize = m_warm ? m_initialData.size() : 0;
+	cacheInfo.pInitialData = m_warm ? m_initialData.data() : nullptr;
+	vkCheck(vkCreatePipelineCache(context.device(), &cacheInfo, m_context.allocationCallbacks(), &m_cache), "vkCreatePipelineCache");
+
+	m_loadMilliseconds = toMilliseconds(std::chrono::steady_clock::now() - start);
+}
+
+PipelineCache::~PipelineCache() {
+	for (const ThreadCache& threadCache : m_threadCaches) {
+		vkDestroyPipelineCache(m_context.device(), threadCache.cache, m_context.allocationCallbacks());
+	}
+	vkDestroyPipelineCache(m_context.device(), m_cache, m_context.allocationCallbacks());
+}
+
+bool PipelineCache::load() {
+	std::ifstream file(m_path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	PipelineCacheFileHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+		std::fprintf(stderr, "pipeline cache: %s is truncated, ignoring\n", m_path.string().c_str());
+		return false;
+	}
+
+	if (header.magic != PipelineCacheFileHeader::kMagic || header.version != PipelineCacheFileHeader::kVersion) {
+		std::fprintf(stderr, "pipeline cache: %s has an unknown format, ignoring\n", m_path.string().c_str());
+		return false;
+	}
+	if (header.vendorID != m_expected.vendorID || header.deviceID != m_expected.deviceID
+		|| header.driverVersion != m_expected.driverVersion
+		|| std::memcmp(header.pipelineCacheUUID, m_expected.pipelineCacheUUID, VK_UUID_SIZE) != 0
+		|| std::memcmp(header.driverUUID, m_expected.driverUUID, VK_UUID_SIZE) != 0) {
+		std::printf("pipeline cache: %s was written by a different device or driver, rebuilding\n", m_path.string().c_str());
+		return false;
+	}
+
+	std::error_code error;
+	uintmax_t fileSize = std::filesystem::file_size(m_path, error);
+	if (error || header.dataSize != fileSize - sizeof(header)) {
+		std::fprintf(stderr, "pipeline cache: %s has a bad size, ignoring\n", m_path.string().c_str());
+		return false;
+	}
+
+	std::vector<uint8_t> data(static_cast<size_t>(header.dataSize));
+	if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))
+		|| fnv1a(data.data(), data.size()) != header.checksum) {
+		std::fprintf(stderr, "pipeline cache: %s is corrupt, ignoring\n", m_path.string().c_str());
+		return false;
+	}
+
+	// The driver checks its own header as well, but some drivers have been
+	// known to crash on foreign blobs instead of rejecting them.
+	VkPipelineCacheHeaderVersionOne driverHeader;
+	if (data.size() < sizeof(driverHeader)) {
+		return false;
+	}
+	std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+	if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		|| driverHeader.vendorID != m_expected.vendorID || driverHeader.deviceID != m_expected.deviceID
+		|| std::memcmp(driverHeader.pipelineCacheUUID, m_expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		std::fprintf(stderr, "pipeline cache: %s has a mismatched driver header, ignoring\n", m_path.string().c_str());
+		return false;
+	}
+
+	m_initialData = std::move(data);
+	return true;
+}
+
+VkPipelineCache PipelineCache::threadCache() {
+	std::thread::id thread = std::this_thread::get_id();
+	std::lock_guard lock(m_threadCachesMutex);
+	for (const ThreadCache& threadCache : m_threadCaches) {
+		if (threadCache.thread == thread) {
+			return threadCache.cache;
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+	cacheInfo.initialDataSize = m_warm ? m_initialData.size() : 0;
+	cacheInfo.pInitialData = m_warm ? m_initialData.data() : nullptr;
+
+	VkPipelineCache cache;
+	vkCheck(vkCreatePipelineCache(m_context.device(), &cacheInfo, m_context.allocationCallbacks(), &cache), "vkCreatePipelineCache");
+	m_threadCaches.push_back({ thread, cache });
+	return cache;
+}
+
+void PipelineCache::recordCreation(std::chrono::steady_clock::duration elapsed) {
+	m_pipelinesCreated.fetch_add(1, std::memory_order_relaxed);
+	m_creationNanoseconds.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+		std::memory_order_relaxed);
+}
+
+PipelineCacheBlob PipelineCache::serialize() {
+	VkDevice device = m_context.device();
+
+	{
+		std::lock_guard lock(m_threadCachesMutex);
+		std::vector<VkPipelineCache> caches;
+		for (const ThreadCache& threadCache : m_threadCaches) {
+			caches.push_back(threadCache.cache);
+		}
+		if (!caches.empty()) {
+			vkCheck(vkMergePipelineCaches(device, m_cache, static_cast<uint32_t>(caches.size()), caches.data()), "vkMergePipelineCaches");
+		}
+	}
+
+	PipelineCacheBlob blob;
+	blob.path = m_path;
+	blob.header = m_expected;
+
+	size_t size = 0;
+	vkCheck(vkGetPipelineCacheData(device, m_cache, &size, nullptr), "vkGetPipelineCacheData");
+	blob.data.resize(size);
+	vkCheck(vkGetPipelineCacheData(device, m_cache, &size, blob.data.data()), "vkGetPipelineCacheData");
+	blob.data.resize(size);
+
+	blob.header.dataSize = size;
+	blob.header.checksum = fnv1a(blob.data.data(), blob.data.size());
+	return blob;
+}
+
+void PipelineCache::reportStats() const {
+	uint64_t created = m_pipelinesCreated.load(std::memory_order_relaxed);
+	double creationMilliseconds = static_cast<double>(m_creationNanoseconds.load(std::memory_order_relaxed)) / 1e6;
+	size_t threads = 0;
+	{
+		std::lock_guard lock(m_threadCachesMutex);
+		threads = m_threadCaches.size();
+	}
+
+	std::printf("pipeline cache: %s start, %zu bytes loaded in %.2f ms\n", m_warm ? "warm" : "cold",
+		m_warm ? m_initialData.size() : size_t(0), m_loadMilliseconds);
+	if (created > 0) {
+		std::printf("pipeline cache: %llu pipelines created in %.2f ms (%.3f ms each) on %zu threads\n",
+			static_cast<unsigned long long>(created), creationMilliseconds, creationMilliseconds / static_cast<double>(created),
+			threads);
+	}
+}
+
+}
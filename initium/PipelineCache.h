@@ -0,0 +1,96 @@
+#pragma once
+
+#include "VulkanContext.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace initium {
+
+// Header written in front of the driver's cache blob. The driver blob has its
+// own header too, but it does not carry the driver version or UUID, and a
+// cache from an older driver is at best ignored and at worst crashes it.
+struct PipelineCacheFileHeader {
+	static constexpr uint32_t kMagic = 0x48435049; // "IPCH"
+	static constexpr uint32_t kVersion = 1;
+
+	uint32_t magic = kMagic;
+	uint32_t version = kVersion;
+	uint32_t vendorID = 0;
+	uint32_t deviceID = 0;
+	uint32_t driverVersion = 0;
+	uint32_t reserved = 0;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE] = {};
+	uint8_t driverUUID[VK_UUID_SIZE] = {};
+	uint64_t dataSize = 0;
+	uint64_t checksum = 0;
+};
+
+// Cache contents read back from the device. It no longer references the
+// device, so it can be written out after the device and GLFW are gone.
+struct PipelineCacheBlob {
+	std::filesystem::path path;
+	PipelineCacheFileHeader header;
+	std::vector<uint8_t> data;
+
+	// Writes to a temporary file next to path and renames it over the old
+	// cache, so a crash mid-write never leaves a truncated cache behind.
+	bool write() const;
+};
+
+class PipelineCache {
+public:
+	PipelineCache(const VulkanContext& context, std::filesystem::path path);
+	~PipelineCache();
+
+	PipelineCache(const PipelineCache&) = delete;
+	PipelineCache& operator=(const PipelineCache&) = delete;
+
+	// True when a valid cache for this exact device and driver was loaded.
+	bool isWarm() const { return m_warm; }
+
+	// The calling thread's cache, created on first use and seeded with the
+	// loaded data. Pipelines are created against it so that parallel builds,
+	// such as shader reload's, never contend on the driver's internal cache
+	// lock; serialize() merges them all back into the main cache.
+	VkPipelineCache threadCache();
+
+	// Pipeline creation time, reported at shutdown so warm and cold starts
+	// can be compared. Safe to call from any thread.
+	void recordCreation(std::chrono::steady_clock::duration elapsed);
+
+	// Merges the thread caches and reads the result back. Must run before
+	// the device is destroyed.
+	PipelineCacheBlob serialize();
+
+	void reportStats() const;
+
+private:
+	bool load();
+
+	const VulkanContext& m_context;
+	std::filesystem::path m_path;
+	PipelineCacheFileHeader m_expected;
+
+	VkPipelineCache m_cache = VK_NULL_HANDLE;
+	std::vector<uint8_t> m_initialData;
+	bool m_warm = false;
+
+	struct ThreadCache {
+		std::thread::id thread;
+		VkPipelineCache cache = VK_NULL_HANDLE;
+	};
+
+	mutable std::mutex m_threadCachesMutex;
+	std::vector<ThreadCache> m_threadCaches;
+
+	std::atomic<uint64_t> m_pipelinesCreated{ 0 };
+	std::atomic<uint64_t> m_creationNanoseconds{ 0 };
+	double m_loadMilliseconds = 0.0;
+};
+
+}
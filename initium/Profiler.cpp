@@ -0,0 +1,342 @@
+#include "Profiler.h"
+
+#include "glfw/include/GLFW/glfw3.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace initium {
+
+// Atomic only so an export may read a slot while its writer overwrites it;
+// every access is relaxed and compiles to a plain load or store.
+struct ProfileSlot {
+	std::atomic<const char*> name{ nullptr };
+	std::atomic<uint64_t> begin{ 0 };
+	std::atomic<uint64_t> end{ 0 };
+};
+
+// A thread's ring, or a track's.
+struct ProfileTrack {
+	uint32_t id = 0;
+	// Guarded by the registry mutex.
+	std::string name;
+	std::unique_ptr<ProfileSlot[]> slots{ new ProfileSlot[Profiler::kEventsPerThread] };
+	// Zones ever recorded; the next goes to slot written % kEventsPerThread.
+	std::atomic<uint64_t> written{ 0 };
+};
+
+namespace {
+
+struct ProfileEvent {
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+// Rings outlive their threads, so an export at exit still sees workers that
+// have been joined.
+struct Registry {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ProfileTrack>> rings;
+	std::set<std::string> names;
+};
+
+Registry& registry() {
+	static Registry registry;
+	return registry;
+}
+
+ProfileTrack* addRing(const char* name) {
+	Registry& rings = registry();
+	std::lock_guard<std::mutex> lock(rings.mutex);
+	auto ring = std::make_unique<ProfileTrack>();
+	ring->id = static_cast<uint32_t>(rings.rings.size()) + 1;
+	ring->name = name ? name : "thread " + std::to_string(ring->id);
+	rings.rings.push_back(std::move(ring));
+	return rings.rings.back().get();
+}
+
+thread_local ProfileTrack* t_ring = nullptr;
+
+ProfileTrack& threadRing() {
+	if (!t_ring) {
+		t_ring = addRing(nullptr);
+	}
+	return *t_ring;
+}
+
+// The zones of ring still intact once copied, oldest first.
+std::vector<ProfileEvent> copyRing(const ProfileTrack& ring) {
+	constexpr uint64_t kCapacity = Profiler::kEventsPerThread;
+	uint64_t end = ring.written.load(std::memory_order_acquire);
+	uint64_t first = end > kCapacity ? end - kCapacity : 0;
+
+	std::vector<ProfileEvent> events;
+	events.reserve(static_cast<size_t>(end - first));
+	for (uint64_t i = first; i < end; i++) {
+		const ProfileSlot& slot = ring.slots[i % kCapacity];
+		events.push_back({ slot.name.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed),
+			slot.end.load(std::memory_order_relaxed) });
+	}
+
+	// Pairs with the release fence in record(): a slot read above that saw
+	// any of a newer zone means written now counts the zone before it, so
+	// the slot falls below valid. The one slot that may be mid-write is
+	// dropped too.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t after = ring.written.load(std::memory_order_relaxed);
+	uint64_t valid = after + 1 > kCapacity ? after + 1 - kCapacity : 0;
+	if (valid > first) {
+		events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(valid, end) - first));
+	}
+	return events;
+}
+
+struct ThreadEvents {
+	uint32_t id;
+	std::string name;
+	std::vector<ProfileEvent> events;
+};
+
+void writeJsonString(std::string& out, const char* text) {
+	out += '"';
+	for (const char* c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			out += '\\';
+			out += *c;
+		} else if (static_cast<unsigned char>(*c) < 0x20) {
+			char escape[8];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(*c));
+			out += escape;
+		} else {
+			out += *c;
+		}
+	}
+	out += '"';
+}
+
+// Chrome trace event format: one complete ("X") event a zone, in
+// microseconds, and a metadata event naming each thread.
+std::string chromeTrace(const std::vector<ThreadEvents>& threads, uint64_t origin, double ticksPerSecond) {
+	double microsecondsPerTick = 1e6 / ticksPerSecond;
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	char number[96];
+	bool first = true;
+	for (const ThreadEvents& thread : threads) {
+		std::snprintf(number, sizeof(number), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+			first ? "" : ",", thread.id);
+		out += number;
+		writeJsonString(out, thread.name.c_str());
+		out += "}}";
+		first = false;
+		for (const ProfileEvent& event : thread.events) {
+			out += ",\n{\"name\":";
+			writeJsonString(out, event.name);
+			std::snprintf(number, sizeof(number), ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", thread.id,
+				static_cast<double>(event.begin - origin) * microsecondsPerTick, static_cast<double>(event.end - event.begin) * microsecondsPerTick);
+			out += number;
+		}
+	}
+	out += "\n]}\n";
+	return out;
+}
+
+// Just enough protobuf encoding for perfetto.protos.Trace.
+void putVarint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+void putVarintField(std::string& out, uint32_t field, uint64_t value) {
+	putVarint(out, uint64_t(field) << 3);
+	putVarint(out, value);
+}
+
+void putBytesField(std::string& out, uint32_t field, const std::string& bytes) {
+	putVarint(out, (uint64_t(field) << 3) | 2);
+	putVarint(out, bytes.size());
+	out += bytes;
+}
+
+// Perfetto's native format: a track per thread, and begin and end track
+// events in nanoseconds on one packet sequence per thread.
+std::string perfettoTrace(std::vector<ThreadEvents>& threads, uint64_t origin, double ticksPerSecond) {
+	// Field numbers from perfetto/protos/perfetto/trace/.
+	enum : uint32_t {
+		kTracePacket = 1,
+		kPacketTimestamp = 8,
+		kPacketSequenceId = 10,
+		kPacketTrackEvent = 11,
+		kPacketSequenceFlags = 13,
+		kPacketTrackDescriptor = 60,
+		kEventType = 9,
+		kEventTrackUuid = 11,
+		kEventName = 23,
+		kTrackUuid = 1,
+		kTrackThread = 4,
+		kThreadPid = 1,
+		kThreadTid = 2,
+		kThreadName = 5,
+	};
+	constexpr uint64_t kSliceBegin = 1;
+	constexpr uint64_t kSliceEnd = 2;
+	constexpr uint64_t kIncrementalStateCleared = 1;
+	double nanosecondsPerTick = 1e9 / ticksPerSecond;
+
+	std::string out;
+	std::string packet;
+	std::string message;
+	auto putEvent = [&](const ThreadEvents& thread, uint64_t type, uint64_t time, const char* name) {
+		message.clear();
+		putVarintField(message, kEventType, type);
+		putVarintField(message, kEventTrackUuid, thread.id);
+		if (name) {
+			putBytesField(message, kEventName, name);
+		}
+		packet.clear();
+		putVarintField(packet, kPacketTimestamp, static_cast<uint64_t>(static_cast<double>(time - origin) * nanosecondsPerTick));
+		putVarintField(packet, kPacketSequenceId, thread.id);
+		putBytesField(packet, kPacketTrackEvent, message);
+		putBytesField(out, kTracePacket, packet);
+	};
+
+	for (ThreadEvents& thread : threads) {
+		std::string descriptor;
+		putVarintField(descriptor, kThreadPid, 1);
+		putVarintField(descriptor, kThreadTid, thread.id);
+		putBytesField(descriptor, kThreadName, thread.name);
+		message.clear();
+		putVarintField(message, kTrackUuid, thread.id);
+		putBytesField(message, kTrackThread, descriptor);
+		packet.clear();
+		putVarintField(packet, kPacketSequenceId, thread.id);
+		putVarintField(packet, kPacketSequenceFlags, kIncrementalStateCleared);
+		putBytesField(packet, kPacketTrackDescriptor, message);
+		putBytesField(out, kTracePacket, packet);
+
+		// Zones are recorded as they end, so inner ones come first; slices
+		// have to open outermost first. Zones on one thread nest, so a stack
+		// of open ones recovers the order.
+		std::sort(thread.events.begin(), thread.events.end(), [](const ProfileEvent& a, const ProfileEvent& b) {
+			return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+		});
+		std::vector<uint64_t> open;
+		for (const ProfileEvent& event : thread.events) {
+			while (!open.empty() && open.back() <= event.begin) {
+				putEvent(thread, kSliceEnd, open.back(), nullptr);
+				open.pop_back();
+			}
+			putEvent(thread, kSliceBegin, event.begin, event.name);
+			open.push_back(event.end);
+		}
+		while (!open.empty()) {
+			putEvent(thread, kSliceEnd, open.back(), nullptr);
+			open.pop_back();
+		}
+	}
+	return out;
+}
+
+bool isPerfettoPath(const std::filesystem::path& path) {
+	return path.extension() == ".pftrace" || path.extension() == ".perfetto-trace";
+}
+
+}
+
+void Profiler::setThreadName(const char* name) {
+	ProfileTrack& ring = threadRing();
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	ring.name = name;
+}
+
+uint64_t Profiler::now() {
+	return glfwGetTimerValue();
+}
+
+void Profiler::record(const char* name, uint64_t begin, uint64_t end) {
+	record(threadRing(), name, begin, end);
+}
+
+uint64_t Profiler::frequency() {
+	return glfwGetTimerFrequency();
+}
+
+ProfileTrack* Profiler::createTrack(const char* name) {
+	return addRing(name);
+}
+
+const char* Profiler::intern(const std::string& name) {
+	Registry& rings = registry();
+	std::lock_guard<std::mutex> lock(rings.mutex);
+	return rings.names.insert(name).first->c_str();
+}
+
+void Profiler::record(ProfileTrack& ring, const char* name, uint64_t begin, uint64_t end) {
+	uint64_t index = ring.written.load(std::memory_order_relaxed);
+	// Orders the overwrite after publishing the zone it replaces; see copyRing.
+	std::atomic_thread_fence(std::memory_order_release);
+	ProfileSlot& slot = ring.slots[index % kEventsPerThread];
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.begin.store(begin, std::memory_order_relaxed);
+	slot.end.store(end, std::memory_order_relaxed);
+	ring.written.store(index + 1, std::memory_order_release);
+}
+
+bool Profiler::writeTrace(const std::filesystem::path& path) {
+	std::vector<ThreadEvents> threads;
+	{
+		Registry& rings = registry();
+		std::lock_guard<std::mutex> lock(rings.mutex);
+		for (const std::unique_ptr<ProfileTrack>& ring : rings.rings) {
+			threads.push_back({ ring->id, ring->name, copyRing(*ring) });
+		}
+	}
+
+	uint64_t origin = UINT64_MAX;
+	size_t zoneCount = 0;
+	for (const ThreadEvents& thread : threads) {
+		for (const ProfileEvent& event : thread.events) {
+			origin = std::min(origin, event.begin);
+		}
+		zoneCount += thread.events.size();
+	}
+	double ticksPerSecond = static_cast<double>(frequency());
+	std::string trace = isPerfettoPath(path) ? perfettoTrace(threads, origin, ticksPerSecond) : chromeTrace(threads, origin, ticksPerSecond);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+	file.close();
+	if (!file) {
+		std::fprintf(stderr, "profiler: failed to write %s\n", path.string().c_str());
+		return false;
+	}
+	std::printf("profiler: wrote %zu zones from %zu threads to %s\n", zoneCount, threads.size(), path.string().c_str());
+	return true;
+}
+
+void Profiler::reportStats() {
+	Registry& rings = registry();
+	std::lock_guard<std::mutex> lock(rings.mutex);
+	uint64_t recorded = 0;
+	uint64_t overwritten = 0;
+	for (const std::unique_ptr<ProfileTrack>& ring : rings.rings) {
+		uint64_t written = ring->written.load(std::memory_order_acquire);
+		recorded += written;
+		overwritten += written > kEventsPerThread ? written - kEventsPerThread : 0;
+	}
+	std::printf("profiler: %llu zones on %zu threads, %llu overwritten by newer ones\n", static_cast<unsigned long long>(recorded),
+		rings.rings.size(), static_cast<unsigned long long>(overwritten));
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Scoped CPU zones. INITIUM_PROFILE_ZONE("name") times the rest of the
+// enclosing scope; the name is kept by pointer, so it must be a string
+// literal or otherwise outlive the last trace export.
+// INITIUM_PROFILE_THREAD(name) labels the calling thread in traces, copying
+// the name. Define INITIUM_DISABLE_PROFILER to compile both away.
+#ifndef INITIUM_DISABLE_PROFILER
+#define INITIUM_PROFILE_CONCAT_INNER(a, b) a##b
+#define INITIUM_PROFILE_CONCAT(a, b) INITIUM_PROFILE_CONCAT_INNER(a, b)
+#define INITIUM_PROFILE_ZONE(name) ::initium::ProfileZone INITIUM_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define INITIUM_PROFILE_THREAD(name) ::initium::Profiler::setThreadName(name)
+#else
+#define INITIUM_PROFILE_ZONE(name) ((void)0)
+#define INITIUM_PROFILE_THREAD(name) ((void)0)
+#endif
+
+namespace initium {
+
+// A timeline other than a thread's, such as a GPU queue's.
+struct ProfileTrack;
+
+// Records zones into a fixed ring per thread, timestamped with GLFW's
+// timer. Only the owning thread writes a ring, with no locks or atomic
+// read-modify-writes; an export copies the rings while they are being
+// written and drops whatever was overwritten during the copy. Each ring
+// keeps the last kEventsPerThread zones, so an export covers the last few
+// seconds of a busy thread and more of a quiet one.
+//
+// Timestamps come from glfwGetTimerValue(), so zones only record between
+// glfwInit() and glfwTerminate(). Tracks hold zones timed elsewhere and
+// converted to that clock, such as the render graph's GPU passes.
+class Profiler {
+public:
+	static constexpr uint32_t kEventsPerThread = 1u << 16;
+
+	Profiler() = delete;
+
+	static void setThreadName(const char* name);
+	static uint64_t now();
+	static void record(const char* name, uint64_t begin, uint64_t end);
+	// Timer ticks per second.
+	static uint64_t frequency();
+
+	// Tracks are written like a thread's ring, so only one thread may
+	// record to a track at a time. They live as long as the process.
+	static ProfileTrack* createTrack(const char* name);
+	static void record(ProfileTrack& track, const char* name, uint64_t begin, uint64_t end);
+	// A copy of name that lives as long as the process, for zones named at
+	// run time.
+	static const char* intern(const std::string& name);
+
+	// Writes every ring to path: as Perfetto protobuf when it ends in
+	// .pftrace or .perfetto-trace, otherwise as Chrome trace event JSON.
+	// ui.perfetto.dev opens both, chrome://tracing the JSON. Safe from any
+	// thread while others record.
+	static bool writeTrace(const std::filesystem::path& path);
+
+	static void reportStats();
+};
+
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name) : m_name(name), m_begin(Profiler::now()) {}
+	~ProfileZone() { Profiler::record(m_name, m_begin, Profiler::now()); }
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* m_name;
+	uint64_t m_begin;
+};
+
+}
@@ -0,0 +1,1525 @@
+#include "RenderGraph.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace initium {
+
+namespace {
+
+constexpr VkAccessFlags2 kWriteAccess = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+	| VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT
+	| VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+// In the order vkGetQueryPoolResults writes them, lowest bit first.
+constexpr VkQueryPipelineStatisticFlags kPipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+constexpr uint32_t kPipelineStatisticCount = 5;
+
+void addStatistics(RenderGraphPipelineStatistics& total, const RenderGraphPipelineStatistics& add) {
+	total.inputPrimitives += add.inputPrimitives;
+	total.vertexInvocations += add.vertexInvocations;
+	total.clippingPrimitives += add.clippingPrimitives;
+	total.fragmentInvocations += add.fragmentInvocations;
+	total.computeInvocations += add.computeInvocations;
+}
+
+bool isDepthFormat(VkFormat format) {
+	return format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
+VkImageAspectFlags aspectOf(VkFormat format) {
+	return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+VkImageUsageFlags usageOf(RenderGraphAccess access) {
+	switch (access) {
+	case RenderGraphAccess::ColorAttachmentWrite:
+	case RenderGraphAccess::ColorAttachmentReadWrite:
+		return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	case RenderGraphAccess::DepthAttachmentWrite:
+	case RenderGraphAccess::DepthAttachmentRead:
+		return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	case RenderGraphAccess::FragmentSampled:
+	case RenderGraphAccess::ComputeSampled:
+	case RenderGraphAccess::TaskSampled:
+		return VK_IMAGE_USAGE_SAMPLED_BIT;
+	case RenderGraphAccess::ComputeStorageRead:
+	case RenderGraphAccess::ComputeStorageWrite:
+	case RenderGraphAccess::VertexStorageRead:
+	case RenderGraphAccess::TaskStorageWrite:
+		return VK_IMAGE_USAGE_STORAGE_BIT;
+	case RenderGraphAccess::TransferRead:
+		return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	case RenderGraphAccess::TransferWrite:
+		return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	default:
+		return 0;
+	}
+}
+
+VkBufferUsageFlags bufferUsageOf(RenderGraphAccess access) {
+	switch (access) {
+	case RenderGraphAccess::ComputeStorageRead:
+	case RenderGraphAccess::ComputeStorageWrite:
+	case RenderGraphAccess::VertexStorageRead:
+	case RenderGraphAccess::TaskStorageWrite:
+		return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	case RenderGraphAccess::IndirectRead:
+		return VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+	case RenderGraphAccess::TransferRead:
+		return VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	case RenderGraphAccess::TransferWrite:
+		return VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	default:
+		return 0;
+	}
+}
+
+// Whether the access depends on what was there before, for culling.
+// Storage writes may be partial, so they count as reads too.
+bool readsPrevious(RenderGraphAccess access) {
+	return !renderGraphAccessInfo(access).write || access == RenderGraphAccess::ColorAttachmentReadWrite
+		|| access == RenderGraphAccess::ComputeStorageWrite || access == RenderGraphAccess::TaskStorageWrite;
+}
+
+bool lifetimesOverlap(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+	return firstA <= lastB && firstB <= lastA;
+}
+
+uint64_t hashCombine(uint64_t hash, uint64_t value) {
+	// FNV-1a over the value's bytes.
+	for (int i = 0; i < 8; i++) {
+		hash ^= (value >> (i * 8)) & 0xFF;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+}
+
+RenderGraphAccessInfo renderGraphAccessInfo(RenderGraphAccess access) {
+	switch (access) {
+	case RenderGraphAccess::ColorAttachmentWrite:
+		return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+	case RenderGraphAccess::ColorAttachmentReadWrite:
+		return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+	case RenderGraphAccess::DepthAttachmentWrite:
+		return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, true };
+	case RenderGraphAccess::DepthAttachmentRead:
+		return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false };
+	case RenderGraphAccess::FragmentSampled:
+		return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case RenderGraphAccess::ComputeSampled:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case RenderGraphAccess::ComputeStorageRead:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+	case RenderGraphAccess::ComputeStorageWrite:
+		return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, true };
+	case RenderGraphAccess::VertexStorageRead:
+		return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+	case RenderGraphAccess::TaskStorageWrite:
+		return { VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, true };
+	case RenderGraphAccess::TaskSampled:
+		return { VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+	case RenderGraphAccess::IndirectRead:
+		return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+	case RenderGraphAccess::TransferRead:
+		return { VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+	case RenderGraphAccess::TransferWrite:
+		return { VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+	case RenderGraphAccess::HostRead:
+		return { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+	}
+	return {};
+}
+
+RenderGraphPass& RenderGraphPass::use(RenderGraphImage image, RenderGraphAccess access) {
+	m_uses.push_back({ image.index, true, access });
+	return *this;
+}
+
+RenderGraphPass& RenderGraphPass::use(RenderGraphBuffer buffer, RenderGraphAccess access) {
+	m_uses.push_back({ buffer.index, false, access });
+	return *this;
+}
+
+RenderGraphPass& RenderGraphPass::colorAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, VkClearColorValue clear) {
+	VkClearValue clearValue{};
+	clearValue.color = clear;
+	m_colorAttachments.push_back({ image.index, loadOp, clearValue });
+	return use(image, loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? RenderGraphAccess::ColorAttachmentReadWrite : RenderGraphAccess::ColorAttachmentWrite);
+}
+
+RenderGraphPass& RenderGraphPass::depthAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, float clearDepth) {
+	VkClearValue clearValue{};
+	clearValue.depthStencil.depth = clearDepth;
+	m_depthAttachment.assign(1, { image.index, loadOp, clearValue });
+	return use(image, RenderGraphAccess::DepthAttachmentWrite);
+}
+
+RenderGraphPass& RenderGraphPass::secondaryCommandBuffers() {
+	m_secondaries = true;
+	return *this;
+}
+
+RenderGraphPass& RenderGraphPass::sideEffects() {
+	m_sideEffects = true;
+	return *this;
+}
+
+RenderGraphPass& RenderGraphPass::asyncCompute() {
+	m_asyncCompute = true;
+	return *this;
+}
+
+RenderGraphPass& RenderGraphPass::execute(ExecuteFunction function) {
+	m_execute = std::move(function);
+	return *this;
+}
+
+RenderGraph::RenderGraph(const VulkanContext& context, GpuAllocator& allocator, AsyncCompute* asyncCompute, VkSemaphore graphicsTimeline,
+	BindlessTable* bindless)
+	: m_context(context), m_allocator(allocator), m_asyncCompute(asyncCompute), m_graphicsTimeline(graphicsTimeline), m_bindless(bindless) {
+	// Queries are reset from the host so the compute queue needn't reset
+	// the graphics queue's, and vice versa.
+	if (!context.features().hostQueryReset || context.queueFamilies().graphics.timestampValidBits == 0) {
+		return;
+	}
+	bool computeTimestamps = asyncComputeAvailable() && m_asyncCompute->timestampValidBits() > 0;
+	VkQueryPoolCreateInfo queryInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryInfo.queryCount = kMaxTimedPasses * 2;
+	for (TimingFrame& frame : m_timingFrames) {
+		vkCheck(vkCreateQueryPool(context.device(), &queryInfo, context.allocationCallbacks(), &frame.graphicsQueries), "vkCreateQueryPool");
+		if (computeTimestamps) {
+			vkCheck(vkCreateQueryPool(context.device(), &queryInfo, context.allocationCallbacks(), &frame.computeQueries), "vkCreateQueryPool");
+		}
+	}
+	if (context.features().pipelineStatisticsQuery) {
+		VkQueryPoolCreateInfo statisticsInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		statisticsInfo.queryCount = kMaxTimedPasses;
+		statisticsInfo.pipelineStatistics = kPipelineStatistics;
+		for (TimingFrame& frame : m_timingFrames) {
+			vkCheck(vkCreateQueryPool(context.device(), &statisticsInfo, context.allocationCallbacks(), &frame.statisticsQueries),
+				"vkCreateQueryPool");
+		}
+	}
+	m_timestampPeriod = context.properties().limits.timestampPeriod;
+
+	if (context.features().calibratedTimestamps) {
+		m_graphicsTrack = Profiler::createTrack("GPU graphics queue");
+		if (computeTimestamps) {
+			m_computeTrack = Profiler::createTrack("GPU compute queue");
+		}
+	}
+}
+
+RenderGraph::~RenderGraph() {
+	// The owner has waited for both queues by now.
+	for (std::unique_ptr<TransientSet>& set : m_transientSets) {
+		destroyTransients(*set);
+	}
+	for (TimingFrame& frame : m_timingFrames) {
+		if (frame.graphicsQueries) {
+			vkDestroyQueryPool(m_context.device(), frame.graphicsQueries, m_context.allocationCallbacks());
+		}
+		if (frame.computeQueries) {
+			vkDestroyQueryPool(m_context.device(), frame.computeQueries, m_context.allocationCallbacks());
+		}
+		if (frame.statisticsQueries) {
+			vkDestroyQueryPool(m_context.device(), frame.statisticsQueries, m_context.allocationCallbacks());
+		}
+	}
+}
+
+RenderGraphImage RenderGraph::importImage(std::string name, const RenderGraphImportedImage& image, const RenderGraphImageState& initial,
+	const RenderGraphImageState& final) {
+	ImageResource resource;
+	resource.name = std::move(name);
+	resource.image = image.image;
+	resource.view = image.view;
+	resource.format = image.format;
+	resource.extent = image.extent;
+	resource.mipLevels = image.mipLevels;
+	resource.imported = true;
+	resource.final = final;
+	resource.state.layout = initial.layout;
+	resource.state.writeStages = initial.stages;
+	resource.state.writeAccess = initial.access & kWriteAccess;
+	m_images.push_back(std::move(resource));
+	return { static_cast<uint32_t>(m_images.size() - 1) };
+}
+
+RenderGraphBuffer RenderGraph::importBuffer(std::string name, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+	const RenderGraphBufferState& initial) {
+	BufferResource resource;
+	resource.name = std::move(name);
+	resource.buffer = buffer;
+	resource.offset = offset;
+	resource.size = size;
+	resource.imported = true;
+	resource.concurrent = initial.concurrent;
+	resource.state.writeStages = initial.stages;
+	resource.state.writeAccess = initial.access & kWriteAccess;
+	m_buffers.push_back(std::move(resource));
+	return { static_cast<uint32_t>(m_buffers.size() - 1) };
+}
+
+RenderGraphImage RenderGraph::createImage(std::string name, const RenderGraphTransientImage& image) {
+	ImageResource resource;
+	resource.name = std::move(name);
+	resource.format = image.format;
+	resource.extent = image.extent;
+	resource.mipLevels = std::max(image.mipLevels, 1u);
+	m_images.push_back(std::move(resource));
+	return { static_cast<uint32_t>(m_images.size() - 1) };
+}
+
+RenderGraphBuffer RenderGraph::createBuffer(std::string name, const RenderGraphTransientBuffer& buffer) {
+	BufferResource resource;
+	resource.name = std::move(name);
+	resource.size = buffer.size;
+	m_buffers.push_back(std::move(resource));
+	return { static_cast<uint32_t>(m_buffers.size() - 1) };
+}
+
+RenderGraphPass& RenderGraph::addPass(std::string name) {
+	m_passes.push_back(std::unique_ptr<RenderGraphPass>(new RenderGraphPass(std::move(name))));
+	return *m_passes.back();
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint64_t frameSerial) {
+	cull();
+	adoptReleases();
+	schedule();
+
+	// Lifetimes in graphics pass order. The compute queue runs ahead of the
+	// graphics work, so a resource it uses is alive from the start of the
+	// frame; one it hands to graphics is done after its last graphics use,
+	// since graphics waits for the whole compute submission first, and one
+	// it uses last is kept to the end of the frame.
+	for (uint32_t i = 0; i < m_passes.size(); i++) {
+		const RenderGraphPass& pass = *m_passes[i];
+		if (pass.m_culled) {
+			continue;
+		}
+		uint32_t first = pass.m_onCompute ? 0 : i;
+		uint32_t last = pass.m_onCompute ? UINT32_MAX - 1 : i;
+		for (const RenderGraphPass::Use& use : pass.m_uses) {
+			if (!use.image) {
+				BufferResource& buffer = m_buffers[use.resource];
+				if (!buffer.used) {
+					buffer.firstOnCompute = pass.m_onCompute;
+				}
+				buffer.used = true;
+				buffer.firstPass = std::min(buffer.firstPass, first);
+				buffer.lastPass = last;
+				buffer.usage |= bufferUsageOf(use.access);
+				continue;
+			}
+			ImageResource& image = m_images[use.resource];
+			if (image.firstPass == UINT32_MAX) {
+				image.firstOnCompute = pass.m_onCompute;
+			}
+			image.firstPass = std::min(image.firstPass, first);
+			image.lastPass = last;
+			image.usage |= usageOf(use.access);
+		}
+	}
+
+	bool anyTransient = std::any_of(m_images.begin(), m_images.end(), [](const ImageResource& image) {
+		return !image.imported && image.firstPass != UINT32_MAX;
+	}) || std::any_of(m_buffers.begin(), m_buffers.end(), [](const BufferResource& buffer) { return !buffer.imported && buffer.used; });
+	TransientSet* set = nullptr;
+	if (anyTransient) {
+		set = &acquireTransients(frameSerial);
+		auto sharesMemory = [](const Placement& a, const Placement& b) {
+			return a.heap == b.heap && a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+		};
+		// Resources done before one starts whose memory it may take over:
+		// its first barrier has to wait for their last use.
+		for (uint32_t i = 0; i < m_images.size(); i++) {
+			ImageResource& image = m_images[i];
+			if (image.transient == UINT32_MAX) {
+				continue;
+			}
+			image.image = set->images[image.transient];
+			image.view = set->views[image.transient];
+			for (uint32_t j = 0; j < m_images.size(); j++) {
+				const ImageResource& other = m_images[j];
+				if (j != i && other.transient != UINT32_MAX && other.lastPass < image.firstPass
+					&& sharesMemory(set->imagePlacements[image.transient], set->imagePlacements[other.transient])) {
+					image.aliases.push_back(j);
+				}
+			}
+		}
+		for (uint32_t i = 0; i < m_buffers.size(); i++) {
+			BufferResource& buffer = m_buffers[i];
+			if (buffer.transient == UINT32_MAX) {
+				continue;
+			}
+			buffer.buffer = set->buffers[buffer.transient];
+			buffer.handle = set->bufferHandles[buffer.transient];
+			for (uint32_t j = 0; j < m_buffers.size(); j++) {
+				const BufferResource& other = m_buffers[j];
+				if (j != i && other.transient != UINT32_MAX && other.lastPass < buffer.firstPass
+					&& sharesMemory(set->bufferPlacements[buffer.transient], set->bufferPlacements[other.transient])) {
+					buffer.aliases.push_back(j);
+				}
+			}
+		}
+		m_stats.transientBytes = set->requestedBytes;
+		m_stats.aliasedBytes = set->allocatedBytes;
+	}
+
+	m_waitInfos.clear();
+	m_computeWaitStages = VK_PIPELINE_STAGE_2_NONE;
+	m_graphicsWaitStages = VK_PIPELINE_STAGE_2_NONE;
+	bool returning = std::any_of(m_images.begin(), m_images.end(), [](const ImageResource& image) {
+		return image.released && !image.firstOnCompute;
+	}) || std::any_of(m_buffers.begin(), m_buffers.end(), [](const BufferResource& buffer) { return buffer.released && !buffer.firstOnCompute; });
+	bool anyCompute = returning || std::any_of(m_passes.begin(), m_passes.end(), [](const std::unique_ptr<RenderGraphPass>& pass) {
+		return !pass->m_culled && pass->m_onCompute;
+	});
+	VkCommandBuffer computeCommandBuffer = anyCompute ? m_asyncCompute->begin() : VK_NULL_HANDLE;
+	if (returning) {
+		returnUnused(commandBuffer, computeCommandBuffer);
+	}
+	TimingFrame* timing = beginTiming(frameSerial);
+
+	for (uint32_t i = 0; i < m_passes.size(); i++) {
+		RenderGraphPass& pass = *m_passes[i];
+		if (pass.m_culled) {
+			continue;
+		}
+		VkCommandBuffer passCommandBuffer = pass.m_onCompute ? computeCommandBuffer : commandBuffer;
+		uint32_t query = timing ? beginTimestamp(passCommandBuffer, *timing, pass) : UINT32_MAX;
+		recordPass(passCommandBuffer, pass, i);
+		if (query != UINT32_MAX) {
+			endTimestamp(passCommandBuffer, *timing, query);
+		}
+	}
+
+	// Leave imported resources on the graphics queue, and images where the
+	// caller expects them.
+	for (uint32_t i = 0; i < m_images.size(); i++) {
+		ImageResource& image = m_images[i];
+		if (!image.imported) {
+			continue;
+		}
+		if (image.onCompute) {
+			VkImageLayout layout = image.final.layout != VK_IMAGE_LAYOUT_UNDEFINED ? image.final.layout : image.state.layout;
+			VkPipelineStageFlags2 stages = image.final.stages != VK_PIPELINE_STAGE_2_NONE ? image.final.stages : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			handoff(image.state, { stages, image.final.access, layout, false }, true, i);
+			image.onCompute = false;
+			continue;
+		}
+		if (image.final.layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+			continue;
+		}
+		if (image.state.layout != image.final.layout || image.final.access != VK_ACCESS_2_NONE) {
+			RenderGraphAccessInfo info{ image.final.stages, image.final.access, image.final.layout, false };
+			SyncState& state = image.state;
+			VkImageMemoryBarrier2 barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+			barrier.srcStageMask = state.writeStages | state.readStages;
+			barrier.srcAccessMask = state.writeAccess;
+			barrier.dstStageMask = info.stages;
+			barrier.dstAccessMask = info.access;
+			barrier.oldLayout = state.layout;
+			barrier.newLayout = info.layout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image.image;
+			barrier.subresourceRange = { aspectOf(image.format), 0, image.mipLevels, 0, 1 };
+			m_imageBarriers.push_back(barrier);
+			image.state.layout = info.layout;
+		}
+	}
+	for (uint32_t i = 0; i < m_buffers.size(); i++) {
+		BufferResource& buffer = m_buffers[i];
+		if (buffer.imported && buffer.onCompute) {
+			handoff(buffer.state, { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, false }, false, i);
+			buffer.onCompute = false;
+		}
+	}
+	flushBarriers(commandBuffer);
+	releaseToCompute(commandBuffer);
+
+	if (computeCommandBuffer) {
+		// Ownership releases go last: nothing on the compute queue touches a
+		// resource again after handing it to graphics.
+		m_imageBarriers.swap(m_releaseImageBarriers);
+		m_bufferBarriers.swap(m_releaseBufferBarriers);
+		flushBarriers(computeCommandBuffer);
+
+		// Compute work that uses imported resources goes after the last
+		// frame's graphics work, the only other queue that can have used them.
+		if (m_graphicsWaitStages != VK_PIPELINE_STAGE_2_NONE && m_previousSerial != 0) {
+			VkSemaphoreSubmitInfo wait{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+			wait.semaphore = m_graphicsTimeline;
+			wait.value = m_previousSerial;
+			wait.stageMask = m_graphicsWaitStages;
+			m_computeWaits.push_back(wait);
+		}
+		uint64_t computeValue = m_asyncCompute->submit(m_computeWaits);
+		m_stats.computeSubmissions++;
+		if (m_computeWaitStages != VK_PIPELINE_STAGE_2_NONE) {
+			m_waitInfos.push_back(m_asyncCompute->waitInfo(computeValue, m_computeWaitStages));
+		}
+		if (set) {
+			set->lastComputeValue = computeValue;
+		}
+		if (timing) {
+			timing->computeValue = computeValue;
+		}
+	}
+
+	m_computeWaits.clear();
+	m_previousSerial = frameSerial;
+	m_stats.frames++;
+	clear();
+}
+
+void RenderGraph::releaseCompleted(uint64_t completedSerial) {
+	m_completedSerial = std::max(m_completedSerial, completedSerial);
+	if (asyncComputeAvailable()) {
+		m_completedComputeValue = m_asyncCompute->completedValue();
+	}
+	readTimings();
+
+	std::erase_if(m_transientSets, [this](std::unique_ptr<TransientSet>& set) {
+		if (set->lastSerial > m_completedSerial || set->lastComputeValue > m_completedComputeValue || set->signature == m_lastSignature) {
+			return false;
+		}
+		destroyTransients(*set);
+		return true;
+	});
+}
+
+void RenderGraph::reportStats() const {
+	if (m_stats.frames == 0) {
+		return;
+	}
+	double frames = static_cast<double>(m_stats.frames);
+	std::printf("render graph: %llu frames, %.1f passes/frame (%.1f culled), %.1f barriers/frame\n",
+		static_cast<unsigned long long>(m_stats.frames), static_cast<double>(m_stats.passes) / frames,
+		static_cast<double>(m_stats.culledPasses) / frames, static_cast<double>(m_stats.barriers) / frames);
+	if (m_stats.transientBytes > 0) {
+		std::printf("  transients: %.2f MiB requested, %.2f MiB after aliasing\n", static_cast<double>(m_stats.transientBytes) / (1 << 20),
+			static_cast<double>(m_stats.aliasedBytes) / (1 << 20));
+	}
+	std::printf("  async compute: %s, %llu passes on the compute queue, %llu ran on graphics instead, %llu submissions, "
+				"%llu ownership transfer barriers\n",
+		!asyncComputeAvailable() ? "unavailable" : m_asyncComputeEnabled ? "on" : "off",
+		static_cast<unsigned long long>(m_stats.asyncPasses), static_cast<unsigned long long>(m_stats.demotedPasses),
+		static_cast<unsigned long long>(m_stats.computeSubmissions), static_cast<unsigned long long>(m_stats.ownershipTransfers));
+	for (const RenderGraphPassTiming& timing : m_passTimings) {
+		std::printf("  %-24s %-8s %.3f ms avg, %.3f ms last (%llu samples)\n", timing.name.c_str(), timing.asyncCompute ? "compute" : "graphics",
+			timing.averageMilliseconds(), timing.lastMilliseconds, static_cast<unsigned long long>(timing.samples));
+		if (timing.statisticsSamples > 0) {
+			double samples = static_cast<double>(timing.statisticsSamples);
+			const RenderGraphPipelineStatistics& total = timing.totalStatistics;
+			std::printf("  %-24s per frame: %.0f primitives in, %.0f after clipping, %.0f vertex, %.0f fragment, %.0f compute invocations\n",
+				"", static_cast<double>(total.inputPrimitives) / samples, static_cast<double>(total.clippingPrimitives) / samples,
+				static_cast<double>(total.vertexInvocations) / samples, static_cast<double>(total.fragmentInvocations) / samples,
+				static_cast<double>(total.computeInvocations) / samples);
+		}
+	}
+	if (!m_passTimings.empty()) {
+		std::printf("  GPU zones in CPU traces: %s\n", gpuZonesAvailable() ? "yes, calibrated" : "no, the device has no calibrated timestamps");
+	}
+}
+
+void RenderGraph::cull() {
+	// Walk backwards from what leaves the graph: imported resources and
+	// passes with side effects. A pass survives if a later surviving pass
+	// (or the outside world) reads something it writes.
+	std::vector<bool> imageNeeded(m_images.size());
+	std::vector<bool> bufferNeeded(m_buffers.size());
+	for (uint32_t i = 0; i < m_images.size(); i++) {
+		imageNeeded[i] = m_images[i].imported;
+	}
+	for (uint32_t i = 0; i < m_buffers.size(); i++) {
+		bufferNeeded[i] = m_buffers[i].imported;
+	}
+
+	for (uint32_t i = static_cast<uint32_t>(m_passes.size()); i-- > 0;) {
+		RenderGraphPass& pass = *m_passes[i];
+		bool alive = pass.m_sideEffects;
+		for (const RenderGraphPass::Use& use : pass.m_uses) {
+			if (renderGraphAccessInfo(use.access).write) {
+				alive = alive || (use.image ? imageNeeded[use.resource] : bufferNeeded[use.resource]);
+			}
+		}
+		pass.m_culled = !alive;
+		m_stats.passes++;
+		if (!alive) {
+			m_stats.culledPasses++;
+			continue;
+		}
+
+		// Writes satisfy the need; reads (including read-modify-writes)
+		// create one for whoever wrote before.
+		for (const RenderGraphPass::Use& use : pass.m_uses) {
+			if (renderGraphAccessInfo(use.access).write) {
+				if (use.image) {
+					imageNeeded[use.resource] = m_images[use.resource].imported;
+				} else {
+					bufferNeeded[use.resource] = m_buffers[use.resource].imported;
+				}
+			}
+		}
+		for (const RenderGraphPass::Use& use : pass.m_uses) {
+			if (readsPrevious(use.access)) {
+				(use.image ? imageNeeded[use.resource] : bufferNeeded[use.resource]) = true;
+			}
+		}
+		for (const RenderGraphPass::Attachment& depth : pass.m_depthAttachment) {
+			if (depth.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+				imageNeeded[depth.image] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::adoptReleases() {
+	for (const ComputeRelease& release : m_computeReleases) {
+		if (release.image) {
+			auto image = std::find_if(m_images.begin(), m_images.end(), [&](const ImageResource& image) {
+				return image.imported && image.image == release.image;
+			});
+			if (image != m_images.end()) {
+				image->released = true;
+				image->state.layout = release.layout;
+			}
+			continue;
+		}
+		auto buffer = std::find_if(m_buffers.begin(), m_buffers.end(), [&](const BufferResource& buffer) {
+			return buffer.imported && buffer.buffer == release.buffer && buffer.offset == release.offset;
+		});
+		if (buffer != m_buffers.end()) {
+			buffer->released = true;
+		}
+	}
+	m_computeReleases.clear();
+}
+
+void RenderGraph::schedule() {
+	// Compute work is submitted ahead of the frame's graphics work, so a pass
+	// can only move there if nothing it touches has been used by a graphics
+	// pass before it. An imported resource whose contents it reads has to
+	// be released to the compute queue by the previous frame as well, unless
+	// both queues are in one family or the buffer is concurrent; the pass
+	// asks for that and runs on graphics until then.
+	bool enabled = m_asyncComputeEnabled && asyncComputeAvailable();
+	bool transfer = enabled && m_asyncCompute->family() != m_context.queueFamilies().graphics.family;
+	std::vector<bool> imageOnGraphics(m_images.size());
+	std::vector<bool> bufferOnGraphics(m_buffers.size());
+	constexpr VkPipelineStageFlags2 kComputeStages =
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+
+	for (std::unique_ptr<RenderGraphPass>& passPointer : m_passes) {
+		RenderGraphPass& pass = *passPointer;
+		pass.m_onCompute = false;
+		if (pass.m_culled) {
+			continue;
+		}
+		if (pass.m_asyncCompute && enabled) {
+			bool eligible = pass.m_colorAttachments.empty() && pass.m_depthAttachment.empty()
+				&& std::all_of(pass.m_uses.begin(), pass.m_uses.end(), [&](const RenderGraphPass::Use& use) {
+				if ((renderGraphAccessInfo(use.access).stages & ~kComputeStages) != 0) {
+					return false;
+				}
+				bool imported = use.image ? m_images[use.resource].imported : m_buffers[use.resource].imported;
+				return (!imported || m_graphicsTimeline != VK_NULL_HANDLE)
+					&& !(use.image ? imageOnGraphics[use.resource] : bufferOnGraphics[use.resource]);
+			});
+			bool owned = true;
+			for (const RenderGraphPass::Use& use : pass.m_uses) {
+				if (!eligible || !transfer || !readsPrevious(use.access)) {
+					continue;
+				}
+				if (use.image && m_images[use.resource].imported) {
+					m_images[use.resource].wantsCompute = true;
+					owned = owned && m_images[use.resource].released;
+				} else if (!use.image && m_buffers[use.resource].imported && !m_buffers[use.resource].concurrent) {
+					m_buffers[use.resource].wantsCompute = true;
+					owned = owned && m_buffers[use.resource].released;
+				}
+			}
+			pass.m_onCompute = eligible && owned;
+			if (pass.m_onCompute) {
+				m_stats.asyncPasses++;
+			} else {
+				m_stats.demotedPasses++;
+			}
+		}
+		if (!pass.m_onCompute) {
+			for (const RenderGraphPass::Use& use : pass.m_uses) {
+				(use.image ? imageOnGraphics[use.resource] : bufferOnGraphics[use.resource]) = true;
+			}
+		}
+	}
+}
+
+uint64_t RenderGraph::transientSignature() const {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const ImageResource& image : m_images) {
+		if (image.imported) {
+			continue;
+		}
+		hash = hashCombine(hash, image.firstPass == UINT32_MAX ? 0 : 1);
+		if (image.firstPass == UINT32_MAX) {
+			continue;
+		}
+		hash = hashCombine(hash, static_cast<uint64_t>(image.format));
+		hash = hashCombine(hash, (static_cast<uint64_t>(image.extent.width) << 32) | image.extent.height);
+		hash = hashCombine(hash, (static_cast<uint64_t>(image.mipLevels) << 32) | image.usage);
+		hash = hashCombine(hash, (static_cast<uint64_t>(image.firstPass) << 32) | image.lastPass);
+	}
+	for (const BufferResource& buffer : m_buffers) {
+		if (buffer.imported) {
+			continue;
+		}
+		hash = hashCombine(hash, buffer.used ? 2 : 0);
+		if (buffer.used) {
+			hash = hashCombine(hash, buffer.size);
+			hash = hashCombine(hash, buffer.usage);
+			hash = hashCombine(hash, (static_cast<uint64_t>(buffer.firstPass) << 32) | buffer.lastPass);
+		}
+	}
+	return hash;
+}
+
+RenderGraph::TransientSet& RenderGraph::acquireTransients(uint64_t frameSerial) {
+	uint64_t signature = transientSignature();
+	m_lastSignature = signature;
+
+	// Transient indices follow resource order, skipping resources no
+	// surviving pass uses; the signature pins that order down.
+	uint32_t transient = 0;
+	for (ImageResource& image : m_images) {
+		if (!image.imported && image.firstPass != UINT32_MAX) {
+			image.transient = transient++;
+		}
+	}
+	transient = 0;
+	for (BufferResource& buffer : m_buffers) {
+		if (!buffer.imported && buffer.used) {
+			buffer.transient = transient++;
+		}
+	}
+
+	TransientSet* set = nullptr;
+	for (std::unique_ptr<TransientSet>& candidate : m_transientSets) {
+		if (candidate->signature == signature && candidate->lastSerial <= m_completedSerial
+			&& candidate->lastComputeValue <= m_completedComputeValue) {
+			set = candidate.get();
+			break;
+		}
+	}
+	if (!set) {
+		m_transientSets.push_back(createTransients(signature));
+		set = m_transientSets.back().get();
+		// Safe here: execute() runs on the render thread once the frame's
+		// secondaries are recorded, and the table is update-after-bind.
+		if (m_bindless) {
+			m_bindless->flush();
+		}
+	}
+	set->lastSerial = frameSerial;
+	set->lastComputeValue = 0;
+	return *set;
+}
+
+std::unique_ptr<RenderGraph::TransientSet> RenderGraph::createTransients(uint64_t signature) {
+	VkDevice device = m_context.device();
+	auto set = std::make_unique<TransientSet>();
+	set->signature = signature;
+
+	// One entry per transient, images first, with the lifetime that decides
+	// what it may share memory with.
+	struct Request {
+		bool image;
+		uint32_t firstPass;
+		uint32_t lastPass;
+		VkMemoryRequirements memory;
+	};
+	std::vector<Request> requests;
+	std::vector<const ImageResource*> images;
+	for (const ImageResource& image : m_images) {
+		if (image.transient != UINT32_MAX) {
+			images.push_back(&image);
+		}
+	}
+	std::vector<const BufferResource*> buffers;
+	for (const BufferResource& buffer : m_buffers) {
+		if (buffer.transient != UINT32_MAX) {
+			buffers.push_back(&buffer);
+		}
+	}
+
+	try {
+		for (const ImageResource* image : images) {
+			VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = image->format;
+			imageInfo.extent = { image->extent.width, image->extent.height, 1 };
+			imageInfo.mipLevels = image->mipLevels;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = image->usage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+			VkImage handle;
+			vkCheck(vkCreateImage(device, &imageInfo, m_context.allocationCallbacks(), &handle), "vkCreateImage");
+			set->images.push_back(handle);
+
+			VkImageMemoryRequirementsInfo2 requirementsInfo{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2 };
+			requirementsInfo.image = handle;
+			VkMemoryRequirements2 imageRequirements{ VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+			vkGetImageMemoryRequirements2(device, &requirementsInfo, &imageRequirements);
+			requests.push_back({ true, image->firstPass, image->lastPass, imageRequirements.memoryRequirements });
+		}
+		for (const BufferResource* buffer : buffers) {
+			// Always fillable, e.g. to zero counters before a pass appends.
+			VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+			bufferInfo.size = buffer->size;
+			bufferInfo.usage = buffer->usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			VkBuffer handle;
+			vkCheck(vkCreateBuffer(device, &bufferInfo, m_context.allocationCallbacks(), &handle), "vkCreateBuffer");
+			set->buffers.push_back(handle);
+
+			VkMemoryRequirements bufferRequirements;
+			vkGetBufferMemoryRequirements(device, handle, &bufferRequirements);
+			requests.push_back({ false, buffer->firstPass, buffer->lastPass, bufferRequirements });
+		}
+
+		// Largest first, each at the lowest offset that doesn't collide with
+		// a resource already placed in the same heap whose lifetime overlaps.
+		struct Heap {
+			bool image;
+			uint32_t typeBits;
+			VkDeviceSize size = 0;
+			VkDeviceSize alignment = 1;
+			std::vector<uint32_t> members;
+		};
+		std::vector<Heap> heaps;
+		std::vector<Placement> placements(requests.size());
+		std::vector<uint32_t> order(requests.size());
+		for (uint32_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+			set->requestedBytes += requests[i].memory.size;
+		}
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return requests[a].memory.size > requests[b].memory.size; });
+
+		for (uint32_t i : order) {
+			const Request& request = requests[i];
+			uint32_t heapIndex = 0;
+			while (heapIndex < heaps.size()
+				&& (heaps[heapIndex].image != request.image || (heaps[heapIndex].typeBits & request.memory.memoryTypeBits) == 0)) {
+				heapIndex++;
+			}
+			if (heapIndex == heaps.size()) {
+				heaps.push_back({ request.image, request.memory.memoryTypeBits });
+			}
+			Heap& heap = heaps[heapIndex];
+
+			auto collides = [&](VkDeviceSize offset) {
+				for (uint32_t other : heap.members) {
+					if (!lifetimesOverlap(request.firstPass, request.lastPass, requests[other].firstPass, requests[other].lastPass)) {
+						continue;
+					}
+					VkDeviceSize otherStart = placements[other].offset;
+					if (offset < otherStart + placements[other].size && otherStart < offset + request.memory.size) {
+						return true;
+					}
+				}
+				return false;
+			};
+			auto align = [&](VkDeviceSize offset) {
+				return (offset + request.memory.alignment - 1) / request.memory.alignment * request.memory.alignment;
+			};
+
+			VkDeviceSize best = collides(0) ? VK_WHOLE_SIZE : 0;
+			for (uint32_t other : heap.members) {
+				VkDeviceSize candidate = align(placements[other].offset + placements[other].size);
+				if (candidate < best && !collides(candidate)) {
+					best = candidate;
+				}
+			}
+
+			placements[i] = { heapIndex, best, request.memory.size };
+			heap.typeBits &= request.memory.memoryTypeBits;
+			heap.size = std::max(heap.size, best + request.memory.size);
+			heap.alignment = std::max(heap.alignment, request.memory.alignment);
+			heap.members.push_back(i);
+		}
+
+		for (const Heap& heap : heaps) {
+			VkMemoryRequirements heapRequirements{ heap.size, heap.alignment, heap.typeBits };
+			set->heaps.push_back(m_allocator.allocateHeap(heapRequirements, { MemoryUsage::GpuOnly }));
+			set->allocatedBytes += heap.size;
+		}
+		set->imagePlacements.assign(placements.begin(), placements.begin() + images.size());
+		set->bufferPlacements.assign(placements.begin() + images.size(), placements.end());
+
+		for (size_t i = 0; i < images.size(); i++) {
+			const Placement& placement = set->imagePlacements[i];
+			const Allocation& heap = set->heaps[placement.heap];
+			vkCheck(vkBindImageMemory(device, set->images[i], heap.memory, heap.offset + placement.offset), "vkBindImageMemory");
+
+			VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+			viewInfo.image = set->images[i];
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = images[i]->format;
+			viewInfo.subresourceRange = { aspectOf(images[i]->format), 0, images[i]->mipLevels, 0, 1 };
+			VkImageView view;
+			vkCheck(vkCreateImageView(device, &viewInfo, m_context.allocationCallbacks(), &view), "vkCreateImageView");
+			set->views.push_back(view);
+		}
+		for (size_t i = 0; i < buffers.size(); i++) {
+			const Placement& placement = set->bufferPlacements[i];
+			const Allocation& heap = set->heaps[placement.heap];
+			vkCheck(vkBindBufferMemory(device, set->buffers[i], heap.memory, heap.offset + placement.offset), "vkBindBufferMemory");
+			BindlessBuffer handle;
+			if (m_bindless && (buffers[i]->usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+				handle = m_bindless->addBuffer(set->buffers[i]);
+			}
+			set->bufferHandles.push_back(handle);
+		}
+	} catch (...) {
+		destroyTransients(*set);
+		throw;
+	}
+	return set;
+}
+
+void RenderGraph::destroyTransients(TransientSet& set) {
+	VkDevice device = m_context.device();
+	for (VkImageView view : set.views) {
+		vkDestroyImageView(device, view, m_context.allocationCallbacks());
+	}
+	for (VkImage image : set.images) {
+		vkDestroyImage(device, image, m_context.allocationCallbacks());
+	}
+	for (VkBuffer buffer : set.buffers) {
+		vkDestroyBuffer(device, buffer, m_context.allocationCallbacks());
+	}
+	if (m_bindless) {
+		for (BindlessBuffer handle : set.bufferHandles) {
+			m_bindless->release(handle, set.lastSerial);
+		}
+	}
+	for (Allocation& heap : set.heaps) {
+		m_allocator.freeHeap(heap);
+	}
+	set.views.clear();
+	set.images.clear();
+	set.buffers.clear();
+	set.bufferHandles.clear();
+	set.heaps.clear();
+}
+
+void RenderGraph::transition(SyncState& state, const RenderGraphAccessInfo& info, bool image, uint32_t index) {
+	bool layoutChange = image && state.layout != info.layout;
+	VkPipelineStageFlags2 srcStages = VK_PIPELINE_STAGE_2_NONE;
+	VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+	bool barrier = false;
+
+	if (info.write || layoutChange) {
+		// Writes and layout transitions wait for the last write and every
+		// read since (write-after-read needs no flush, only ordering).
+		srcStages = state.writeStages | state.readStages;
+		srcAccess = state.writeAccess;
+		barrier = layoutChange || srcStages != VK_PIPELINE_STAGE_2_NONE;
+		if (info.write) {
+			state.writeStages = info.stages;
+			state.writeAccess = info.access & kWriteAccess;
+			state.readStages = VK_PIPELINE_STAGE_2_NONE;
+			state.visibleStages = VK_PIPELINE_STAGE_2_NONE;
+			state.visibleAccess = VK_ACCESS_2_NONE;
+		} else {
+			// A transition for a read: it completes before info.stages, and
+			// made the last write visible to this access.
+			state.writeStages |= info.stages;
+			state.readStages = info.stages;
+			state.visibleStages = info.stages;
+			state.visibleAccess = info.access;
+		}
+	} else if (state.writeStages != VK_PIPELINE_STAGE_2_NONE
+		&& ((info.stages & ~state.visibleStages) != 0 || (info.access & ~state.visibleAccess) != 0)) {
+		// Read after write in the same layout, by a stage or access the
+		// write hasn't been made visible to yet.
+		srcStages = state.writeStages;
+		srcAccess = state.writeAccess;
+		barrier = true;
+		state.visibleStages |= info.stages;
+		state.visibleAccess |= info.access;
+		state.readStages |= info.stages;
+	} else {
+		state.readStages |= info.stages;
+	}
+
+	if (!barrier) {
+		if (image) {
+			state.layout = info.layout;
+		}
+		return;
+	}
+
+	if (image) {
+		const ImageResource& resource = m_images[index];
+		VkImageMemoryBarrier2 imageBarrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		imageBarrier.srcStageMask = srcStages;
+		imageBarrier.srcAccessMask = srcAccess;
+		imageBarrier.dstStageMask = info.stages;
+		imageBarrier.dstAccessMask = info.access;
+		imageBarrier.oldLayout = state.layout;
+		imageBarrier.newLayout = info.layout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = resource.image;
+		imageBarrier.subresourceRange = { aspectOf(resource.format), 0, resource.mipLevels, 0, 1 };
+		m_imageBarriers.push_back(imageBarrier);
+		state.layout = info.layout;
+	} else {
+		const BufferResource& resource = m_buffers[index];
+		VkBufferMemoryBarrier2 bufferBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+		bufferBarrier.srcStageMask = srcStages;
+		bufferBarrier.srcAccessMask = srcAccess;
+		bufferBarrier.dstStageMask = info.stages;
+		bufferBarrier.dstAccessMask = info.access;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = resource.buffer;
+		bufferBarrier.offset = resource.offset;
+		bufferBarrier.size = resource.size;
+		m_bufferBarriers.push_back(bufferBarrier);
+	}
+}
+
+void RenderGraph::handoff(SyncState& state, const RenderGraphAccessInfo& info, bool image, uint32_t index) {
+	// The graphics submission waits on the compute timeline at these stages,
+	// which covers execution and memory; barriers on this side only need to
+	// chain from there.
+	m_computeWaitStages |= info.stages;
+	uint32_t computeFamily = m_asyncCompute->family();
+	uint32_t graphicsFamily = m_context.queueFamilies().graphics.family;
+	bool transfer = computeFamily != graphicsFamily && (image || !m_buffers[index].concurrent);
+	if (transfer) {
+		m_stats.ownershipTransfers += 2;
+	}
+
+	if (image) {
+		const ImageResource& resource = m_images[index];
+		VkImageMemoryBarrier2 acquire{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		acquire.srcStageMask = info.stages;
+		acquire.srcAccessMask = VK_ACCESS_2_NONE;
+		acquire.dstStageMask = info.stages;
+		acquire.dstAccessMask = info.access;
+		acquire.oldLayout = state.layout;
+		acquire.newLayout = info.layout;
+		acquire.srcQueueFamilyIndex = transfer ? computeFamily : VK_QUEUE_FAMILY_IGNORED;
+		acquire.dstQueueFamilyIndex = transfer ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		acquire.image = resource.image;
+		acquire.subresourceRange = { aspectOf(resource.format), 0, resource.mipLevels, 0, 1 };
+		if (transfer) {
+			// The release is the same transfer and layout transition, ordered
+			// after the last compute use instead.
+			VkImageMemoryBarrier2 release = acquire;
+			release.srcStageMask = state.writeStages | state.readStages;
+			release.srcAccessMask = state.writeAccess;
+			release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+			release.dstAccessMask = VK_ACCESS_2_NONE;
+			m_releaseImageBarriers.push_back(release);
+		}
+		if (transfer || state.layout != info.layout) {
+			m_imageBarriers.push_back(acquire);
+		}
+		state.layout = info.layout;
+	} else if (transfer) {
+		const BufferResource& resource = m_buffers[index];
+		VkBufferMemoryBarrier2 acquire{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+		acquire.srcStageMask = info.stages;
+		acquire.srcAccessMask = VK_ACCESS_2_NONE;
+		acquire.dstStageMask = info.stages;
+		acquire.dstAccessMask = info.access;
+		acquire.srcQueueFamilyIndex = computeFamily;
+		acquire.dstQueueFamilyIndex = graphicsFamily;
+		acquire.buffer = resource.buffer;
+		acquire.offset = resource.offset;
+		acquire.size = resource.size;
+		VkBufferMemoryBarrier2 release = acquire;
+		release.srcStageMask = state.writeStages | state.readStages;
+		release.srcAccessMask = state.writeAccess;
+		release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		release.dstAccessMask = VK_ACCESS_2_NONE;
+		m_releaseBufferBarriers.push_back(release);
+		m_bufferBarriers.push_back(acquire);
+	}
+
+	// From here on the compute work counts as done at info.stages: later
+	// graphics uses at other stages chain from there.
+	state.writeStages = info.stages;
+	state.writeAccess = info.write ? info.access & kWriteAccess : VK_ACCESS_2_NONE;
+	state.readStages = info.write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+	state.visibleStages = info.write ? VK_PIPELINE_STAGE_2_NONE : info.stages;
+	state.visibleAccess = info.write ? VK_ACCESS_2_NONE : info.access;
+}
+
+void RenderGraph::enterCompute(VkCommandBuffer commandBuffer, SyncState& state, const RenderGraphAccessInfo& info, bool image,
+	uint32_t index) {
+	m_graphicsWaitStages |= info.stages;
+	uint32_t computeFamily = m_asyncCompute->family();
+	uint32_t graphicsFamily = m_context.queueFamilies().graphics.family;
+	bool& released = image ? m_images[index].released : m_buffers[index].released;
+	if (released) {
+		// The other half of the release at the end of the last frame, in the
+		// same layout, ordered after the semaphore wait. A layout change or
+		// write the pass needs on top has to chain from it, in a later call.
+		pushOwnershipBarrier(image, index, state.layout, graphicsFamily, computeFamily, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+			info.stages, info.access);
+		flushBarriers(commandBuffer);
+		released = false;
+		state.writeStages = info.stages;
+		state.writeAccess = VK_ACCESS_2_NONE;
+		state.readStages = VK_PIPELINE_STAGE_2_NONE;
+		state.visibleStages = info.stages;
+		state.visibleAccess = info.access;
+		return;
+	}
+
+	// The stages it was imported with belong to the graphics queue. Earlier
+	// compute submissions may still be using it too: wait for the whole
+	// queue. Still owned by graphics, an image's contents are discarded;
+	// schedule() made sure nothing here reads them.
+	if (image && computeFamily != graphicsFamily) {
+		state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+	state.writeStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	state.writeAccess = VK_ACCESS_2_MEMORY_WRITE_BIT;
+	state.readStages = VK_PIPELINE_STAGE_2_NONE;
+	state.visibleStages = VK_PIPELINE_STAGE_2_NONE;
+	state.visibleAccess = VK_ACCESS_2_NONE;
+}
+
+void RenderGraph::returnUnused(VkCommandBuffer commandBuffer, VkCommandBuffer computeCommandBuffer) {
+	// Released to compute for a pass that isn't there this frame, or that
+	// couldn't move: acquired and handed straight back, and the graphics
+	// work waits for that before anything else.
+	uint32_t computeFamily = m_asyncCompute->family();
+	uint32_t graphicsFamily = m_context.queueFamilies().graphics.family;
+	constexpr VkAccessFlags2 kAnyAccess = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+	auto forEachReturned = [&](auto&& function) {
+		for (uint32_t i = 0; i < m_images.size(); i++) {
+			if (m_images[i].released && !m_images[i].firstOnCompute) {
+				function(true, i, m_images[i].state.layout);
+			}
+		}
+		for (uint32_t i = 0; i < m_buffers.size(); i++) {
+			if (m_buffers[i].released && !m_buffers[i].firstOnCompute) {
+				function(false, i, VK_IMAGE_LAYOUT_UNDEFINED);
+			}
+		}
+	};
+	forEachReturned([&](bool image, uint32_t index, VkImageLayout layout) {
+		pushOwnershipBarrier(image, index, layout, graphicsFamily, computeFamily, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+			VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, kAnyAccess);
+	});
+	flushBarriers(computeCommandBuffer);
+	forEachReturned([&](bool image, uint32_t index, VkImageLayout layout) {
+		pushOwnershipBarrier(image, index, layout, computeFamily, graphicsFamily, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			VK_ACCESS_2_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+	});
+	flushBarriers(computeCommandBuffer);
+	forEachReturned([&](bool image, uint32_t index, VkImageLayout layout) {
+		pushOwnershipBarrier(image, index, layout, computeFamily, graphicsFamily, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE,
+			VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, kAnyAccess);
+		(image ? m_images[index].released : m_buffers[index].released) = false;
+	});
+	flushBarriers(commandBuffer);
+	m_graphicsWaitStages |= VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	m_computeWaitStages |= VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+}
+
+void RenderGraph::releaseToCompute(VkCommandBuffer commandBuffer) {
+	// Same family: nothing to hand over, the compute submission's wait for
+	// this frame orders it.
+	uint32_t graphicsFamily = m_context.queueFamilies().graphics.family;
+	if (!asyncComputeAvailable() || m_asyncCompute->family() == graphicsFamily) {
+		return;
+	}
+	uint32_t computeFamily = m_asyncCompute->family();
+	for (uint32_t i = 0; i < m_images.size(); i++) {
+		const ImageResource& image = m_images[i];
+		if (image.imported && image.wantsCompute) {
+			pushOwnershipBarrier(true, i, image.state.layout, graphicsFamily, computeFamily, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+				VK_ACCESS_2_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+			m_computeReleases.push_back({ image.image, VK_NULL_HANDLE, 0, image.state.layout });
+		}
+	}
+	for (uint32_t i = 0; i < m_buffers.size(); i++) {
+		const BufferResource& buffer = m_buffers[i];
+		if (buffer.imported && buffer.wantsCompute) {
+			pushOwnershipBarrier(false, i, VK_IMAGE_LAYOUT_UNDEFINED, graphicsFamily, computeFamily, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+				VK_ACCESS_2_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+			m_computeReleases.push_back({ VK_NULL_HANDLE, buffer.buffer, buffer.offset, VK_IMAGE_LAYOUT_UNDEFINED });
+		}
+	}
+	flushBarriers(commandBuffer);
+}
+
+void RenderGraph::pushOwnershipBarrier(bool image, uint32_t index, VkImageLayout layout, uint32_t srcFamily, uint32_t dstFamily,
+	VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess) {
+	m_stats.ownershipTransfers++;
+	if (image) {
+		const ImageResource& resource = m_images[index];
+		VkImageMemoryBarrier2 barrier{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		barrier.srcStageMask = srcStages;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstStageMask = dstStages;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = layout;
+		barrier.newLayout = layout;
+		barrier.srcQueueFamilyIndex = srcFamily;
+		barrier.dstQueueFamilyIndex = dstFamily;
+		barrier.image = resource.image;
+		barrier.subresourceRange = { aspectOf(resource.format), 0, resource.mipLevels, 0, 1 };
+		m_imageBarriers.push_back(barrier);
+		return;
+	}
+	const BufferResource& resource = m_buffers[index];
+	VkBufferMemoryBarrier2 barrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = srcStages;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstStageMask = dstStages;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.buffer = resource.buffer;
+	barrier.offset = resource.offset;
+	barrier.size = resource.size;
+	m_bufferBarriers.push_back(barrier);
+}
+
+void RenderGraph::recordPass(VkCommandBuffer commandBuffer, RenderGraphPass& pass, uint32_t passIndex) {
+	// One state change per resource: uses of the same resource in a pass are
+	// merged, falling back to GENERAL when they want different layouts.
+	struct Merged {
+		uint32_t resource;
+		bool image;
+		RenderGraphAccessInfo info;
+	};
+	std::vector<Merged> merged;
+	for (const RenderGraphPass::Use& use : pass.m_uses) {
+		RenderGraphAccessInfo info = renderGraphAccessInfo(use.access);
+		auto existing = std::find_if(merged.begin(), merged.end(), [&](const Merged& m) { return m.resource == use.resource && m.image == use.image; });
+		if (existing == merged.end()) {
+			merged.push_back({ use.resource, use.image, info });
+			continue;
+		}
+		existing->info.stages |= info.stages;
+		existing->info.access |= info.access;
+		existing->info.write = existing->info.write || info.write;
+		if (existing->info.layout != info.layout) {
+			existing->info.layout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+	}
+
+	for (const Merged& use : merged) {
+		bool& onCompute = use.image ? m_images[use.resource].onCompute : m_buffers[use.resource].onCompute;
+		SyncState& state = use.image ? m_images[use.resource].state : m_buffers[use.resource].state;
+		bool& recorded = use.image ? m_images[use.resource].recorded : m_buffers[use.resource].recorded;
+		bool first = !recorded;
+		recorded = true;
+		if (onCompute && !pass.m_onCompute) {
+			handoff(state, use.info, use.image, use.resource);
+			onCompute = false;
+			continue;
+		}
+		onCompute = pass.m_onCompute;
+		bool imported = use.image ? m_images[use.resource].imported : m_buffers[use.resource].imported;
+		if (first && imported && pass.m_onCompute) {
+			enterCompute(commandBuffer, state, use.info, use.image, use.resource);
+		}
+		if (!use.image) {
+			// Memory shared with buffers that are done by now: the first
+			// access waits for their last one.
+			if (first) {
+				for (uint32_t alias : m_buffers[use.resource].aliases) {
+					const SyncState& previous = m_buffers[alias].state;
+					state.writeStages |= previous.writeStages | previous.readStages;
+					state.writeAccess |= previous.writeAccess;
+				}
+			}
+			transition(state, use.info, false, use.resource);
+			continue;
+		}
+		ImageResource& image = m_images[use.resource];
+		if (!image.imported && passIndex == image.firstPass) {
+			// Memory shared with images that are done by now: the UNDEFINED
+			// transition discards their contents once their last use is over.
+			for (uint32_t alias : image.aliases) {
+				const SyncState& previous = m_images[alias].state;
+				image.state.writeStages |= previous.writeStages | previous.readStages;
+				image.state.writeAccess |= previous.writeAccess;
+			}
+		}
+		transition(image.state, use.info, true, use.resource);
+	}
+	flushBarriers(commandBuffer);
+
+	if (pass.m_colorAttachments.empty() && pass.m_depthAttachment.empty()) {
+		if (pass.m_execute) {
+			pass.m_execute(commandBuffer);
+		}
+		return;
+	}
+
+	// A transient nothing reads after this pass needn't be written back.
+	auto storeOp = [&](uint32_t index) {
+		const ImageResource& image = m_images[index];
+		return !image.imported && image.lastPass == passIndex ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+	};
+
+	std::vector<VkRenderingAttachmentInfo> colorAttachments;
+	for (const RenderGraphPass::Attachment& attachment : pass.m_colorAttachments) {
+		VkRenderingAttachmentInfo info{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+		info.imageView = m_images[attachment.image].view;
+		info.imageLayout = m_images[attachment.image].state.layout;
+		info.loadOp = attachment.loadOp;
+		info.storeOp = storeOp(attachment.image);
+		info.clearValue = attachment.clear;
+		colorAttachments.push_back(info);
+	}
+	VkRenderingAttachmentInfo depthAttachment{ VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+	if (!pass.m_depthAttachment.empty()) {
+		const RenderGraphPass::Attachment& attachment = pass.m_depthAttachment[0];
+		depthAttachment.imageView = m_images[attachment.image].view;
+		depthAttachment.imageLayout = m_images[attachment.image].state.layout;
+		depthAttachment.loadOp = attachment.loadOp;
+		depthAttachment.storeOp = storeOp(attachment.image);
+		depthAttachment.clearValue = attachment.clear;
+	}
+
+	uint32_t first = !pass.m_colorAttachments.empty() ? pass.m_colorAttachments[0].image : pass.m_depthAttachment[0].image;
+	VkRenderingInfo renderingInfo{ VK_STRUCTURE_TYPE_RENDERING_INFO };
+	renderingInfo.flags = pass.m_secondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+	renderingInfo.renderArea = { { 0, 0 }, m_images[first].extent };
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+	renderingInfo.pColorAttachments = colorAttachments.data();
+	renderingInfo.pDepthAttachment = pass.m_depthAttachment.empty() ? nullptr : &depthAttachment;
+
+	vkCmdBeginRendering(commandBuffer, &renderingInfo);
+	if (pass.m_execute) {
+		pass.m_execute(commandBuffer);
+	}
+	vkCmdEndRendering(commandBuffer);
+}
+
+void RenderGraph::flushBarriers(VkCommandBuffer commandBuffer) {
+	if (m_imageBarriers.empty() && m_bufferBarriers.empty()) {
+		return;
+	}
+	VkDependencyInfo dependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependency.imageMemoryBarrierCount = static_cast<uint32_t>(m_imageBarriers.size());
+	dependency.pImageMemoryBarriers = m_imageBarriers.data();
+	dependency.bufferMemoryBarrierCount = static_cast<uint32_t>(m_bufferBarriers.size());
+	dependency.pBufferMemoryBarriers = m_bufferBarriers.data();
+	vkCmdPipelineBarrier2(commandBuffer, &dependency);
+
+	m_stats.barriers += m_imageBarriers.size() + m_bufferBarriers.size();
+	m_imageBarriers.clear();
+	m_bufferBarriers.clear();
+}
+
+RenderGraph::TimingFrame* RenderGraph::beginTiming(uint64_t frameSerial) {
+	TimingFrame& frame = m_timingFrames[m_timingCursor];
+	if (!frame.graphicsQueries || frame.pending) {
+		// No timestamps, or results still outstanding: this frame goes untimed.
+		return nullptr;
+	}
+	m_timingCursor = (m_timingCursor + 1) % kTimingFrames;
+
+	vkResetQueryPool(m_context.device(), frame.graphicsQueries, 0, kMaxTimedPasses * 2);
+	if (frame.computeQueries) {
+		vkResetQueryPool(m_context.device(), frame.computeQueries, 0, kMaxTimedPasses * 2);
+	}
+	if (frame.statisticsQueries) {
+		vkResetQueryPool(m_context.device(), frame.statisticsQueries, 0, kMaxTimedPasses);
+	}
+	frame.serial = frameSerial;
+	frame.computeValue = 0;
+	frame.pending = true;
+	frame.queries.clear();
+	frame.graphicsCount = 0;
+	frame.computeCount = 0;
+	frame.statisticsCount = 0;
+	return &frame;
+}
+
+uint32_t RenderGraph::beginTimestamp(VkCommandBuffer commandBuffer, TimingFrame& frame, const RenderGraphPass& pass) {
+	VkQueryPool pool = pass.m_onCompute ? frame.computeQueries : frame.graphicsQueries;
+	uint32_t& count = pass.m_onCompute ? frame.computeCount : frame.graphicsCount;
+	if (!pool || count == kMaxTimedPasses) {
+		return UINT32_MAX;
+	}
+
+	auto timing = std::find_if(m_passTimings.begin(), m_passTimings.end(), [&](const RenderGraphPassTiming& timing) {
+		return timing.name == pass.m_name && timing.asyncCompute == pass.m_onCompute;
+	});
+	if (timing == m_passTimings.end()) {
+		RenderGraphPassTiming newTiming;
+		newTiming.name = pass.m_name;
+		newTiming.profileName = Profiler::intern(pass.m_name);
+		newTiming.asyncCompute = pass.m_onCompute;
+		m_passTimings.push_back(newTiming);
+		timing = m_passTimings.end() - 1;
+	}
+
+	// Secondary command buffers would need inheritedQueries to run inside
+	// a statistics query, and the compute queue can't count graphics stages.
+	uint32_t statistics = UINT32_MAX;
+	if (m_pipelineStatisticsEnabled && frame.statisticsQueries && !pass.m_onCompute && !pass.m_secondaries) {
+		statistics = frame.statisticsCount++;
+	}
+
+	frame.queries.push_back({ static_cast<uint32_t>(timing - m_passTimings.begin()), pass.m_onCompute, count * 2, statistics });
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, pool, count * 2);
+	if (statistics != UINT32_MAX) {
+		vkCmdBeginQuery(commandBuffer, frame.statisticsQueries, statistics, 0);
+	}
+	count++;
+	return static_cast<uint32_t>(frame.queries.size() - 1);
+}
+
+void RenderGraph::endTimestamp(VkCommandBuffer commandBuffer, TimingFrame& frame, uint32_t query) {
+	const TimingFrame::Query& timed = frame.queries[query];
+	if (timed.statistics != UINT32_MAX) {
+		vkCmdEndQuery(commandBuffer, frame.statisticsQueries, timed.statistics);
+	}
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, timed.compute ? frame.computeQueries : frame.graphicsQueries,
+		timed.first + 1);
+}
+
+void RenderGraph::readTimings() {
+	// Oldest first, so zones go onto the GPU tracks in the order they ran.
+	TimingFrame* ready[kTimingFrames];
+	uint32_t readyCount = 0;
+	for (TimingFrame& frame : m_timingFrames) {
+		if (frame.pending && frame.serial <= m_completedSerial && frame.computeValue <= m_completedComputeValue) {
+			ready[readyCount++] = &frame;
+		}
+	}
+	if (readyCount == 0) {
+		return;
+	}
+	std::sort(ready, ready + readyCount, [](const TimingFrame* a, const TimingFrame* b) { return a->serial < b->serial; });
+	calibrate();
+
+	for (uint32_t i = 0; i < readyCount; i++) {
+		TimingFrame* frame = ready[i];
+		for (const TimingFrame::Query& timed : frame->queries) {
+			uint64_t ticks[2] = {};
+			VkResult result = vkGetQueryPoolResults(m_context.device(), timed.compute ? frame->computeQueries : frame->graphicsQueries,
+				timed.first, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+			if (result != VK_SUCCESS) {
+				continue;
+			}
+			uint32_t validBits = timed.compute ? m_asyncCompute->timestampValidBits() : m_context.queueFamilies().graphics.timestampValidBits;
+			uint64_t mask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+			double milliseconds = static_cast<double>((ticks[1] - ticks[0]) & mask) * m_timestampPeriod * 1e-6;
+
+			RenderGraphPassTiming& timing = m_passTimings[timed.timing];
+			timing.samples++;
+			timing.totalMilliseconds += milliseconds;
+			timing.lastMilliseconds = milliseconds;
+			timing.lastFrame = frame->serial;
+
+			ProfileTrack* track = timed.compute ? m_computeTrack : m_graphicsTrack;
+			if (track && m_calibration.valid) {
+				uint64_t& trackEnd = timed.compute ? m_computeTrackEnd : m_graphicsTrackEnd;
+				// Passes overlap on the GPU; the tracks show them one after
+				// another, each from where the last one ended.
+				uint64_t begin = std::max(hostTicks(ticks[0], validBits), trackEnd);
+				uint64_t end = std::max(hostTicks(ticks[1], validBits), begin);
+				Profiler::record(*track, timing.profileName, begin, end);
+				trackEnd = end;
+			}
+
+			if (timed.statistics != UINT32_MAX) {
+				uint64_t values[kPipelineStatisticCount] = {};
+				result = vkGetQueryPoolResults(m_context.device(), frame->statisticsQueries, timed.statistics, 1, sizeof(values), values,
+					sizeof(values), VK_QUERY_RESULT_64_BIT);
+				if (result == VK_SUCCESS) {
+					timing.lastStatistics = { values[0], values[1], values[2], values[3], values[4] };
+					addStatistics(timing.totalStatistics, timing.lastStatistics);
+					timing.statisticsSamples++;
+				}
+			}
+		}
+		frame->pending = false;
+	}
+}
+
+void RenderGraph::resetTimings() {
+	for (RenderGraphPassTiming& timing : m_passTimings) {
+		timing.samples = 0;
+		timing.totalMilliseconds = 0.0;
+		timing.statisticsSamples = 0;
+		timing.totalStatistics = {};
+	}
+}
+
+void RenderGraph::calibrate() {
+	if (!m_graphicsTrack) {
+		return;
+	}
+	// Twice a second is plenty to keep drift well under a microsecond.
+	uint64_t now = Profiler::now();
+	if (m_calibration.valid && now - m_calibration.hostTicks < Profiler::frequency() / 2) {
+		return;
+	}
+	VkCalibratedTimestampInfoEXT infos[2] = { { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT }, { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT } };
+	infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+	infos[1].timeDomain = kHostTimeDomain;
+	uint64_t timestamps[2] = {};
+	uint64_t maxDeviation = 0;
+	if (m_context.getCalibratedTimestamps()(m_context.device(), 2, infos, timestamps, &maxDeviation) == VK_SUCCESS) {
+		m_calibration = { timestamps[0], timestamps[1], true };
+	}
+}
+
+uint64_t RenderGraph::hostTicks(uint64_t deviceTicks, uint32_t validBits) const {
+	// Signed, since the timestamp may come before the calibration or after.
+	uint64_t mask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+	uint64_t difference = (deviceTicks - m_calibration.deviceTicks) & mask;
+	int64_t signedDifference = difference > mask / 2 ? -static_cast<int64_t>((mask - difference) + 1) : static_cast<int64_t>(difference);
+	double hostTicksPerDeviceTick = m_timestampPeriod * 1e-9 * static_cast<double>(Profiler::frequency());
+	return m_calibration.hostTicks + static_cast<uint64_t>(static_cast<int64_t>(static_cast<double>(signedDifference) * hostTicksPerDeviceTick));
+}
+
+void RenderGraph::clear() {
+	m_images.clear();
+	m_buffers.clear();
+	m_passes.clear();
+}
+
+}
@@ -0,0 +1,531 @@
+#pragma once
+
+#include "AsyncCompute.h"
+#include "BindlessTable.h"
+#include "GpuAllocator.h"
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace initium {
+
+struct ProfileTrack;
+
+// How a pass touches a resource. Each maps to the synchronization2 stages,
+// access flags and, for images, the layout the graph will put it in.
+enum class RenderGraphAccess {
+	ColorAttachmentWrite,
+	// Load op LOAD: the previous contents are read before being written.
+	ColorAttachmentReadWrite,
+	DepthAttachmentWrite,
+	DepthAttachmentRead,
+	FragmentSampled,
+	ComputeSampled,
+	ComputeStorageRead,
+	ComputeStorageWrite,
+	VertexStorageRead,
+	// Task shaders (VK_EXT_mesh_shader), which read what they write.
+	TaskStorageWrite,
+	TaskSampled,
+	IndirectRead,
+	TransferRead,
+	TransferWrite,
+	HostRead,
+};
+
+struct RenderGraphAccessInfo {
+	VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+	VkAccessFlags2 access = VK_ACCESS_2_NONE;
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	bool write = false;
+};
+
+RenderGraphAccessInfo renderGraphAccessInfo(RenderGraphAccess access);
+
+// Layout and last use of an imported image outside the graph: where it is
+// on entry, and where the graph leaves it.
+struct RenderGraphImageState {
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+	VkAccessFlags2 access = VK_ACCESS_2_NONE;
+};
+
+// Last use of an imported buffer before the graph, typically by the
+// previous frame on the same queue; its first use in the graph waits for it.
+struct RenderGraphBufferState {
+	VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+	VkAccessFlags2 access = VK_ACCESS_2_NONE;
+	// Created VK_SHARING_MODE_CONCURRENT over the graphics and compute
+	// families: it moves between queues without ownership transfers.
+	bool concurrent = false;
+};
+
+struct RenderGraphImportedImage {
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent{};
+	uint32_t mipLevels = 1;
+};
+
+// A transient image lives for one frame of the graph. Its usage flags come
+// from the accesses declared on it, and its memory is shared with other
+// transients whose lifetimes don't overlap.
+struct RenderGraphTransientImage {
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent{};
+	uint32_t mipLevels = 1;
+};
+
+// A transient buffer, like a transient image, lives for one frame, takes
+// its usage flags from the declared accesses and shares memory with other
+// transient buffers it is never alive alongside. Storage buffers also get a
+// bindless slot when the graph has a table.
+struct RenderGraphTransientBuffer {
+	VkDeviceSize size = 0;
+};
+
+struct RenderGraphImage {
+	uint32_t index = UINT32_MAX;
+	explicit operator bool() const { return index != UINT32_MAX; }
+};
+
+struct RenderGraphBuffer {
+	uint32_t index = UINT32_MAX;
+	explicit operator bool() const { return index != UINT32_MAX; }
+};
+
+struct RenderGraphStats {
+	uint64_t frames = 0;
+	uint64_t passes = 0;
+	uint64_t culledPasses = 0;
+	uint64_t barriers = 0;
+	// Passes run on the compute queue, and passes that asked to but had to
+	// run on graphics (see RenderGraphPass::asyncCompute()).
+	uint64_t asyncPasses = 0;
+	uint64_t demotedPasses = 0;
+	uint64_t computeSubmissions = 0;
+	// Queue family ownership transfer barriers recorded, release and acquire
+	// halves counted separately.
+	uint64_t ownershipTransfers = 0;
+	// Last compiled frame: transient memory asked for, and what aliasing
+	// actually needed.
+	VkDeviceSize transientBytes = 0;
+	VkDeviceSize aliasedBytes = 0;
+};
+
+// What a pass's draws and dispatches did, from a pipeline statistics query.
+struct RenderGraphPipelineStatistics {
+	uint64_t inputPrimitives = 0;
+	uint64_t vertexInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	uint64_t fragmentInvocations = 0;
+	uint64_t computeInvocations = 0;
+};
+
+// GPU time of a pass, from timestamps around it on the queue it ran on.
+struct RenderGraphPassTiming {
+	std::string name;
+	// The same, interned for the profiler's GPU tracks.
+	const char* profileName = nullptr;
+	bool asyncCompute = false;
+	uint64_t samples = 0;
+	double totalMilliseconds = 0.0;
+	double lastMilliseconds = 0.0;
+	// Serial of the frame the last sample came from.
+	uint64_t lastFrame = 0;
+	// Only graphics queue passes that don't execute secondary command
+	// buffers are counted, and only while statistics are on.
+	uint64_t statisticsSamples = 0;
+	RenderGraphPipelineStatistics lastStatistics;
+	RenderGraphPipelineStatistics totalStatistics;
+
+	double averageMilliseconds() const { return samples > 0 ? totalMilliseconds / static_cast<double>(samples) : 0.0; }
+};
+
+class RenderGraph;
+
+// Declares what a pass reads and writes, and records it. Returned by
+// RenderGraph::addPass() and valid until the graph executes.
+class RenderGraphPass {
+public:
+	using ExecuteFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+	RenderGraphPass& use(RenderGraphImage image, RenderGraphAccess access);
+	RenderGraphPass& use(RenderGraphBuffer buffer, RenderGraphAccess access);
+
+	// Attachments make the pass a dynamic rendering pass: the graph begins
+	// and ends rendering around execute, over the first attachment's extent.
+	RenderGraphPass& colorAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, VkClearColorValue clear = {});
+	RenderGraphPass& depthAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, float clearDepth = 0.0f);
+	// The pass's rendering is done by vkCmdExecuteCommands only.
+	RenderGraphPass& secondaryCommandBuffers();
+
+	// Keeps the pass even if nothing reads what it writes, e.g. readbacks.
+	RenderGraphPass& sideEffects();
+
+	// Run on the async compute queue when the device has one and it is
+	// enabled. Only honoured for passes without attachments whose resources
+	// no graphics pass has used earlier in the frame; other passes run on
+	// graphics as usual. An imported resource whose contents the pass reads,
+	// other than a concurrent buffer, has to be released by the graphics
+	// queue at the end of the previous frame when the queues are in
+	// different families, so such a pass runs on graphics the first frame it
+	// asks and moves over from the next.
+	RenderGraphPass& asyncCompute();
+
+	RenderGraphPass& execute(ExecuteFunction function);
+
+private:
+	friend class RenderGraph;
+
+	struct Use {
+		uint32_t resource;
+		bool image;
+		RenderGraphAccess access;
+	};
+
+	struct Attachment {
+		uint32_t image;
+		VkAttachmentLoadOp loadOp;
+		VkClearValue clear;
+	};
+
+	explicit RenderGraphPass(std::string name) : m_name(std::move(name)) {}
+
+	std::string m_name;
+	std::vector<Use> m_uses;
+	std::vector<Attachment> m_colorAttachments;
+	std::vector<Attachment> m_depthAttachment;
+	bool m_secondaries = false;
+	bool m_sideEffects = false;
+	bool m_asyncCompute = false;
+	bool m_culled = false;
+	bool m_onCompute = false;
+	ExecuteFunction m_execute;
+};
+
+// Frame graph. Each frame the renderer imports the images it renders to,
+// creates transient images, and adds passes declaring every resource they
+// touch; execute() then
+//   - culls passes whose results nothing reads,
+//   - places transients in shared memory, reusing the same range for
+//     resources that are never alive at the same time,
+//   - records each pass behind exactly the synchronization2 barriers its
+//     declared accesses need, batched into one vkCmdPipelineBarrier2,
+//   - moves async compute passes to the compute queue, submitted ahead of
+//     the graphics work, with queue family ownership transfers and a
+//     timeline wait for whatever graphics consumes. Compute work that uses
+//     imported resources waits for the previous frame's graphics work.
+// Passes run in the order they were added on their queue. Transient memory
+// is recycled across frames once the frame that used it has retired on
+// both timelines. Between frames, imported resources belong to the graphics
+// queue, apart from those it released to the compute queue for the next
+// frame; one of those that isn't imported again that frame loses its
+// contents. Render thread only.
+class RenderGraph {
+public:
+	// Without asyncCompute, or when it isn't available, every pass runs on
+	// the graphics queue. graphicsTimeline is the semaphore the frame serials
+	// given to execute() are signalled on. Transient storage buffers are
+	// added to bindless, which must outlive the graph.
+	RenderGraph(const VulkanContext& context, GpuAllocator& allocator, AsyncCompute* asyncCompute = nullptr,
+		VkSemaphore graphicsTimeline = VK_NULL_HANDLE, BindlessTable* bindless = nullptr);
+	~RenderGraph();
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+	RenderGraphImage importImage(std::string name, const RenderGraphImportedImage& image, const RenderGraphImageState& initial,
+		const RenderGraphImageState& final);
+	// The graph only synchronises imported buffers.
+	RenderGraphBuffer importBuffer(std::string name, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE,
+		const RenderGraphBufferState& initial = {});
+	RenderGraphImage createImage(std::string name, const RenderGraphTransientImage& image);
+	RenderGraphBuffer createBuffer(std::string name, const RenderGraphTransientBuffer& buffer);
+
+	RenderGraphPass& addPass(std::string name);
+
+	// Valid inside a pass's execute function; transient resources only
+	// exist while the graph executes.
+	VkImage image(RenderGraphImage image) const { return m_images[image.index].image; }
+	VkImageView imageView(RenderGraphImage image) const { return m_images[image.index].view; }
+	VkExtent2D imageExtent(RenderGraphImage image) const { return m_images[image.index].extent; }
+	VkBuffer buffer(RenderGraphBuffer buffer) const { return m_buffers[buffer.index].buffer; }
+	// Transient storage buffers only, with a bindless table.
+	BindlessBuffer bindlessBuffer(RenderGraphBuffer buffer) const { return m_buffers[buffer.index].handle; }
+
+	// Compiles and records the frame's graphics work into commandBuffer,
+	// submits its async compute work, then clears the graph for the next
+	// one. frameSerial is the timeline value the graphics submission
+	// signals; transient memory isn't reused before it retires.
+	void execute(VkCommandBuffer commandBuffer, uint64_t frameSerial);
+
+	// After execute(): waits the graphics submission has to add, for
+	// results of this frame's async compute work.
+	const std::vector<VkSemaphoreSubmitInfo>& waitInfos() const { return m_waitInfos; }
+	// Before execute(): a wait for this frame's compute submission, such as
+	// uploads the compute passes read. Cleared by execute().
+	void addComputeWait(const VkSemaphoreSubmitInfo& wait) { m_computeWaits.push_back(wait); }
+
+	// Runtime toggle; passes fall back to the graphics queue when off.
+	void setAsyncComputeEnabled(bool enabled) { m_asyncComputeEnabled = enabled; }
+	bool asyncComputeEnabled() const { return m_asyncComputeEnabled; }
+	bool asyncComputeAvailable() const { return m_asyncCompute && m_asyncCompute->available(); }
+
+	// Frees transient memory that retired frames used and the current graph
+	// no longer needs.
+	void releaseCompleted(uint64_t completedSerial);
+
+	// Pipeline statistics around graphics queue passes, where the device
+	// has them. Off by default: the queries can keep some drivers from
+	// overlapping passes, which skews the timings they sit beside.
+	void setPipelineStatisticsEnabled(bool enabled) { m_pipelineStatisticsEnabled = enabled; }
+	bool pipelineStatisticsEnabled() const { return m_pipelineStatisticsEnabled; }
+	bool pipelineStatisticsAvailable() const { return m_timingFrames[0].statisticsQueries != VK_NULL_HANDLE; }
+	// Whether pass timings are also recorded as profiler zones on GPU queue
+	// tracks, placed on the CPU timeline with calibrated timestamps.
+	bool gpuZonesAvailable() const { return m_graphicsTrack != nullptr; }
+
+	const RenderGraphStats& stats() const { return m_stats; }
+	// Empty when the queues can't write timestamps or reset queries from
+	// the host.
+	const std::vector<RenderGraphPassTiming>& passTimings() const { return m_passTimings; }
+	// Starts the pass timings and statistics over, as after a warm-up.
+	// Frames still in flight land in the new totals.
+	void resetTimings();
+	void reportStats() const;
+
+private:
+	// Where a resource stands between passes.
+	struct SyncState {
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Last write (or layout transition) and the stages it happened in.
+		VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+		// Reads since that write: a later write must wait for them.
+		VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+		// Stages and accesses the last write has already been made visible to.
+		VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+	};
+
+	struct ImageResource {
+		std::string name;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent{};
+		uint32_t mipLevels = 1;
+		bool imported = false;
+		RenderGraphImageState final;
+		// Transient only: accumulated from the declared accesses.
+		VkImageUsageFlags usage = 0;
+		// First and last surviving pass that uses the image, see execute().
+		uint32_t firstPass = UINT32_MAX;
+		uint32_t lastPass = 0;
+		// Transient only: index into the transient set, and the images whose
+		// memory this one takes over.
+		uint32_t transient = UINT32_MAX;
+		std::vector<uint32_t> aliases;
+		// Last used by a pass on the compute queue.
+		bool onCompute = false;
+		// Whether the first surviving pass that uses it runs on compute.
+		bool firstOnCompute = false;
+		// Imported only: released to the compute queue by the last frame, and
+		// read by a compute pass this frame, so released again for the next.
+		bool released = false;
+		bool wantsCompute = false;
+		// Used by a recorded pass yet.
+		bool recorded = false;
+		SyncState state;
+	};
+
+	struct BufferResource {
+		std::string name;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = VK_WHOLE_SIZE;
+		bool imported = false;
+		VkBufferUsageFlags usage = 0;
+		bool used = false;
+		uint32_t firstPass = UINT32_MAX;
+		uint32_t lastPass = 0;
+		// Transient only, as for images, and its bindless slot.
+		uint32_t transient = UINT32_MAX;
+		std::vector<uint32_t> aliases;
+		BindlessBuffer handle;
+		bool concurrent = false;
+		bool onCompute = false;
+		bool firstOnCompute = false;
+		bool released = false;
+		bool wantsCompute = false;
+		bool recorded = false;
+		SyncState state;
+	};
+
+	// An imported resource released to the compute queue at the end of a
+	// frame, in the layout it was left in.
+	struct ComputeRelease {
+		VkImage image = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	// Where a transient lives: heap, and the range within it.
+	struct Placement {
+		uint32_t heap = 0;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+	};
+
+	// Resources and memory for one frame's transients. Kept while frames
+	// with the same transient layout keep coming, and reused once retired.
+	struct TransientSet {
+		uint64_t signature = 0;
+		uint64_t lastSerial = 0;
+		uint64_t lastComputeValue = 0;
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+		std::vector<Placement> imagePlacements;
+		std::vector<VkBuffer> buffers;
+		std::vector<BindlessBuffer> bufferHandles;
+		std::vector<Placement> bufferPlacements;
+		// Images and buffers never share a heap, so buffer-image granularity
+		// never comes into it.
+		std::vector<Allocation> heaps;
+		VkDeviceSize requestedBytes = 0;
+		VkDeviceSize allocatedBytes = 0;
+	};
+
+	// Queries for one frame's pass timestamps, two per timed pass, and
+	// pipeline statistics, one per counted pass.
+	struct TimingFrame {
+		VkQueryPool graphicsQueries = VK_NULL_HANDLE;
+		VkQueryPool computeQueries = VK_NULL_HANDLE;
+		VkQueryPool statisticsQueries = VK_NULL_HANDLE;
+		uint64_t serial = 0;
+		uint64_t computeValue = 0;
+		bool pending = false;
+		// Per timed pass: index into m_passTimings, queue, first query and
+		// statistics query, UINT32_MAX when not counted.
+		struct Query {
+			uint32_t timing;
+			bool compute;
+			uint32_t first;
+			uint32_t statistics;
+		};
+		std::vector<Query> queries;
+		uint32_t graphicsCount = 0;
+		uint32_t computeCount = 0;
+		uint32_t statisticsCount = 0;
+	};
+
+	// A device timestamp and the host clock sampled together.
+	struct Calibration {
+		uint64_t deviceTicks = 0;
+		uint64_t hostTicks = 0;
+		bool valid = false;
+	};
+
+	static constexpr uint32_t kTimingFrames = 6;
+	static constexpr uint32_t kMaxTimedPasses = 64;
+
+	void cull();
+	// Marks the imported resources the last frame released to compute.
+	void adoptReleases();
+	// Decides which passes go to the compute queue.
+	void schedule();
+	uint64_t transientSignature() const;
+	TransientSet& acquireTransients(uint64_t frameSerial);
+	std::unique_ptr<TransientSet> createTransients(uint64_t signature);
+	void destroyTransients(TransientSet& set);
+
+	// Appends whatever barrier moving state to the access needs.
+	void transition(SyncState& state, const RenderGraphAccessInfo& info, bool image, uint32_t index);
+	// First graphics use of a resource the compute queue used last: ownership
+	// transfer when the families differ, and the timeline wait.
+	void handoff(SyncState& state, const RenderGraphAccessInfo& info, bool image, uint32_t index);
+	// First compute use of an imported resource in the frame: after the
+	// previous frame's graphics work, and acquired from graphics if it was
+	// released.
+	void enterCompute(VkCommandBuffer commandBuffer, SyncState& state, const RenderGraphAccessInfo& info, bool image, uint32_t index);
+	// Released resources that no compute pass uses first this frame: the
+	// compute queue acquires them and hands them straight back.
+	void returnUnused(VkCommandBuffer commandBuffer, VkCommandBuffer computeCommandBuffer);
+	// End of the frame, on graphics: releases what next frame wants on compute.
+	void releaseToCompute(VkCommandBuffer commandBuffer);
+	// A queue family ownership transfer barrier for the resource, between
+	// the given families and stages, leaving the layout as it is.
+	void pushOwnershipBarrier(bool image, uint32_t index, VkImageLayout layout, uint32_t srcFamily, uint32_t dstFamily,
+		VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess);
+	void recordPass(VkCommandBuffer commandBuffer, RenderGraphPass& pass, uint32_t passIndex);
+	// Null when the frame can't be timed.
+	TimingFrame* beginTiming(uint64_t frameSerial);
+	// Returns the index of the pass's entry in frame.queries, or UINT32_MAX
+	// if it isn't timed.
+	uint32_t beginTimestamp(VkCommandBuffer commandBuffer, TimingFrame& frame, const RenderGraphPass& pass);
+	void endTimestamp(VkCommandBuffer commandBuffer, TimingFrame& frame, uint32_t query);
+	// Accumulates the results of frames retired on both timelines.
+	void readTimings();
+	// Resamples the calibration when it has gone stale; clocks drift apart.
+	void calibrate();
+	// Profiler ticks for a timestamp from a queue with validBits.
+	uint64_t hostTicks(uint64_t deviceTicks, uint32_t validBits) const;
+	void flushBarriers(VkCommandBuffer commandBuffer);
+	void clear();
+
+	const VulkanContext& m_context;
+	GpuAllocator& m_allocator;
+	AsyncCompute* m_asyncCompute;
+	VkSemaphore m_graphicsTimeline;
+	BindlessTable* m_bindless;
+	bool m_asyncComputeEnabled = true;
+	// Serial of the last frame executed, which compute work that uses
+	// imported resources waits for, and the stages it waits at.
+	uint64_t m_previousSerial = 0;
+	VkPipelineStageFlags2 m_graphicsWaitStages = VK_PIPELINE_STAGE_2_NONE;
+	std::vector<ComputeRelease> m_computeReleases;
+
+	std::vector<ImageResource> m_images;
+	std::vector<BufferResource> m_buffers;
+	std::vector<std::unique_ptr<RenderGraphPass>> m_passes;
+
+	std::vector<VkImageMemoryBarrier2> m_imageBarriers;
+	std::vector<VkBufferMemoryBarrier2> m_bufferBarriers;
+	// Release halves of ownership transfers, recorded at the end of the
+	// compute work.
+	std::vector<VkImageMemoryBarrier2> m_releaseImageBarriers;
+	std::vector<VkBufferMemoryBarrier2> m_releaseBufferBarriers;
+	VkPipelineStageFlags2 m_computeWaitStages = VK_PIPELINE_STAGE_2_NONE;
+	std::vector<VkSemaphoreSubmitInfo> m_waitInfos;
+	std::vector<VkSemaphoreSubmitInfo> m_computeWaits;
+
+	std::vector<std::unique_ptr<TransientSet>> m_transientSets;
+	uint64_t m_lastSignature = 0;
+	uint64_t m_completedSerial = 0;
+	uint64_t m_completedComputeValue = 0;
+
+	TimingFrame m_timingFrames[kTimingFrames];
+	uint32_t m_timingCursor = 0;
+	double m_timestampPeriod = 0.0;
+	std::vector<RenderGraphPassTiming> m_passTimings;
+	bool m_pipelineStatisticsEnabled = false;
+
+	// Null without calibrated timestamps. Zones on a track must not
+	// overlap, so each starts no earlier than the last one ended.
+	ProfileTrack* m_graphicsTrack = nullptr;
+	ProfileTrack* m_computeTrack = nullptr;
+	uint64_t m_graphicsTrackEnd = 0;
+	uint64_t m_computeTrackEnd = 0;
+	Calibration m_calibration;
+
+	RenderGraphStats m_stats;
+};
+
+}
@@ -0,0 +1,134 @@
+#include "RenderThread.h"
+
+#include "Profiler.h"
+
+#include <cstdio>
+
+namespace initium {
+
+void DurationCounter::record(std::chrono::steady_clock::duration duration) {
+	uint64_t nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+	m_lastNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+
+	uint64_t max = m_maxNanoseconds.load(std::memory_order_relaxed);
+	while (nanoseconds > max && !m_maxNanoseconds.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+	}
+}
+
+double DurationCounter::lastMilliseconds() const {
+	return static_cast<double>(m_lastNanoseconds.load(std::memory_order_relaxed)) / 1e6;
+}
+
+double DurationCounter::averageMilliseconds() const {
+	uint64_t count = m_count.load(std::memory_order_relaxed);
+	if (count == 0) {
+		return 0.0;
+	}
+	return static_cast<double>(m_totalNanoseconds.load(std::memory_order_relaxed)) / 1e6 / static_cast<double>(count);
+}
+
+double DurationCounter::maxMilliseconds() const {
+	return static_cast<double>(m_maxNanoseconds.load(std::memory_order_relaxed)) / 1e6;
+}
+
+RenderThread::RenderThread(FrameFunction renderFrame, std::function<void()> frameTaken)
+	: m_renderFrame(std::move(renderFrame)), m_frameTaken(std::move(frameTaken)) {}
+
+RenderThread::~RenderThread() {
+	stop();
+}
+
+void RenderThread::start() {
+	if (m_running.exchange(true)) {
+		return;
+	}
+	m_thread = std::thread(&RenderThread::run, this);
+}
+
+void RenderThread::stop() {
+	if (!m_running.exchange(false)) {
+		return;
+	}
+	m_signal.fetch_add(1, std::memory_order_release);
+	m_signal.notify_one();
+	m_thread.join();
+}
+
+void RenderThread::publish(std::chrono::steady_clock::duration mainThreadTime) {
+	m_timings.mainThread.record(mainThreadTime);
+	m_snapshots.writeSlot().publishedAt = std::chrono::steady_clock::now();
+	m_snapshots.publish();
+	m_signal.fetch_add(1, std::memory_order_release);
+	m_signal.notify_one();
+}
+
+bool RenderThread::pushCommand(Command command) {
+	if (!m_commands.push(std::move(command))) {
+		return false;
+	}
+	m_signal.fetch_add(1, std::memory_order_release);
+	m_signal.notify_one();
+	return true;
+}
+
+void RenderThread::rethrowIfFailed() {
+	if (m_failed.load(std::memory_order_acquire) && m_failure) {
+		std::exception_ptr failure = m_failure;
+		m_failure = nullptr;
+		std::rethrow_exception(failure);
+	}
+}
+
+void RenderThread::reportTimings() const {
+	std::printf("frame timings over %llu frames (avg / max ms):\n", static_cast<unsigned long long>(m_timings.renderThread.count()));
+	std::printf("  main thread   %7.3f / %7.3f\n", m_timings.mainThread.averageMilliseconds(), m_timings.mainThread.maxMilliseconds());
+	std::printf("  handoff       %7.3f / %7.3f\n", m_timings.handoff.averageMilliseconds(), m_timings.handoff.maxMilliseconds());
+	std::printf("  render thread %7.3f / %7.3f\n", m_timings.renderThread.averageMilliseconds(), m_timings.renderThread.maxMilliseconds());
+}
+
+void RenderThread::run() {
+	INITIUM_PROFILE_THREAD("render");
+	try {
+		while (m_running.load(std::memory_order_acquire)) {
+			uint32_t signal = m_signal.load(std::memory_order_acquire);
+
+			drainCommands();
+
+			if (m_snapshots.consume()) {
+				const FrameSnapshot& snapshot = m_snapshots.readSlot();
+				auto start = std::chrono::steady_clock::now();
+				m_timings.handoff.record(start - snapshot.publishedAt);
+				if (m_frameTaken) {
+					m_frameTaken();
+				}
+
+				{
+					INITIUM_PROFILE_ZONE("render frame");
+					m_renderFrame(snapshot);
+				}
+				m_timings.renderThread.record(std::chrono::steady_clock::now() - start);
+				continue;
+			}
+
+			m_signal.wait(signal, std::memory_order_acquire);
+		}
+		drainCommands();
+	} catch (...) {
+		m_failure = std::current_exception();
+		m_failed.store(true, std::memory_order_release);
+		if (m_frameTaken) {
+			m_frameTaken();
+		}
+	}
+}
+
+void RenderThread::drainCommands() {
+	while (std::optional<Command> command = m_commands.pop()) {
+		INITIUM_PROFILE_ZONE("render thread command");
+		(*command)();
+	}
+}
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <thread>
+
+namespace initium {
+
+// Everything the render thread needs to know about a frame, captured on the
+// main thread. Rendering only ever reads the snapshot, never live main
+// thread state, so slow event handling cannot stall submission.
+struct FrameSnapshot {
+	uint64_t frameNumber = 0;
+	double time = 0.0;
+	double deltaTime = 0.0;
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+	std::chrono::steady_clock::time_point publishedAt;
+};
+
+// Lock-free running min/avg/max of a duration, written by one thread and
+// readable from any.
+class DurationCounter {
+public:
+	void record(std::chrono::steady_clock::duration duration);
+
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+	double lastMilliseconds() const;
+	double averageMilliseconds() const;
+	double maxMilliseconds() const;
+
+private:
+	std::atomic<uint64_t> m_count{ 0 };
+	std::atomic<uint64_t> m_totalNanoseconds{ 0 };
+	std::atomic<uint64_t> m_lastNanoseconds{ 0 };
+	std::atomic<uint64_t> m_maxNanoseconds{ 0 };
+};
+
+struct FrameTimings {
+	// Main thread work between being allowed a frame and publishing it.
+	DurationCounter mainThread;
+	// Time the render thread spends in the frame function.
+	DurationCounter renderThread;
+	// Publish to pick-up: how long a snapshot waits for the render thread.
+	DurationCounter handoff;
+};
+
+// Owns queue submission and present on a thread of its own. The main thread
+// keeps GLFW event processing (which GLFW requires there) and hands frames
+// over through a triple buffer, plus a queue for one-off commands that must
+// run on the render thread between frames.
+class RenderThread {
+public:
+	using FrameFunction = std::function<void(const FrameSnapshot&)>;
+	using Command = std::function<void()>;
+
+	// frameTaken runs on the render thread as soon as it picks up a
+	// snapshot, so the main thread can start on the next one.
+	RenderThread(FrameFunction renderFrame, std::function<void()> frameTaken);
+	~RenderThread();
+
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	void start();
+	void stop();
+
+	// Main thread: fill in the slot returned by snapshot(), then publish it.
+	FrameSnapshot& snapshot() { return m_snapshots.writeSlot(); }
+	void publish(std::chrono::steady_clock::duration mainThreadTime);
+
+	// Main thread: queue work to run on the render thread before its next
+	// frame. Returns false if the queue is full.
+	bool pushCommand(Command command);
+
+	// Rethrows on the calling thread if the render thread died.
+	void rethrowIfFailed();
+
+	const FrameTimings& timings() const { return m_timings; }
+	void reportTimings() const;
+
+private:
+	void run();
+	void drainCommands();
+
+	FrameFunction m_renderFrame;
+	std::function<void()> m_frameTaken;
+
+	TripleBuffer<FrameSnapshot> m_snapshots;
+	SpscQueue<Command, 64> m_commands;
+
+	// Bumped on every publish, command and stop; the render thread sleeps on
+	// it with std::atomic::wait when it has nothing to do.
+	std::atomic<uint32_t> m_signal{ 0 };
+	std::atomic<bool> m_running{ false };
+	std::atomic<bool> m_failed{ false };
+	std::exception_ptr m_failure;
+
+	FrameTimings m_timings;
+	std::thread m_thread;
+};
+
+}
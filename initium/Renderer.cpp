@@ -0,0 +1,535 @@
+#include "Renderer.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace initium {
+
+namespace {
+
+constexpr uint32_t kSpriteSize = 64;
+constexpr uint32_t kSpriteShapes = 4;
+
+std::string spriteAssetName(uint32_t shape) {
+	return "sprite/" + std::to_string(shape);
+}
+
+// White with the shape in alpha, antialiased over a pixel, so the sprite
+// colour tints it. Writes kSpriteSize squared RGBA8 texels.
+void rasterizeSprite(uint32_t shape, uint8_t* texel) {
+	constexpr float kSize = static_cast<float>(kSpriteSize);
+	// Distances are in pixels from the centre.
+	auto coverage = [shape](float x, float y) {
+		constexpr float kRadius = kSize * 0.45f;
+		float distance;
+		switch (shape) {
+		case 0: distance = std::hypot(x, y) - kRadius; break;
+		case 1: distance = std::fabs(std::hypot(x, y) - kRadius * 0.75f) - kRadius * 0.2f; break;
+		case 2:
+			distance = std::hypot(std::max(std::fabs(x) - kRadius * 0.6f, 0.0f), std::max(std::fabs(y) - kRadius * 0.6f, 0.0f)) - kRadius * 0.35f;
+			break;
+		default: distance = (std::fabs(x) + std::fabs(y) - kRadius) * 0.7071f; break;
+		}
+		return std::clamp(0.5f - distance, 0.0f, 1.0f);
+	};
+
+	for (uint32_t y = 0; y < kSpriteSize; y++) {
+		for (uint32_t x = 0; x < kSpriteSize; x++) {
+			float alpha = coverage(static_cast<float>(x) + 0.5f - kSize * 0.5f, static_cast<float>(y) + 0.5f - kSize * 0.5f);
+			*texel++ = 255;
+			*texel++ = 255;
+			*texel++ = 255;
+			*texel++ = static_cast<uint8_t>(alpha * 255.0f + 0.5f);
+		}
+	}
+}
+
+}
+
+Renderer::Renderer(const VulkanContext& context, GpuAllocator& allocator, JobSystem& jobs, PipelineCache& pipelineCache, Swapchain& swapchain,
+	const RendererCreateInfo& createInfo)
+	: Renderer(context, allocator, jobs, pipelineCache, &swapchain, nullptr, createInfo) {}
+
+Renderer::Renderer(const VulkanContext& context, GpuAllocator& allocator, JobSystem& jobs, PipelineCache& pipelineCache, OffscreenTarget& offscreen,
+	const RendererCreateInfo& createInfo)
+	: Renderer(context, allocator, jobs, pipelineCache, nullptr, &offscreen, createInfo) {}
+
+Renderer::Renderer(const VulkanContext& context, GpuAllocator& allocator, JobSystem& jobs, PipelineCache& pipelineCache, Swapchain* swapchain,
+	OffscreenTarget* offscreen, const RendererCreateInfo& createInfo)
+	: m_context(context), m_allocator(allocator), m_jobs(jobs), m_swapchain(swapchain), m_offscreen(offscreen), m_recorder(jobs),
+	  m_frames(context, allocator, createInfo.framesInFlight, createInfo.transientBytesPerFrame, m_recorder.slotCount()),
+	  m_compute(context), m_bindless(context), m_graph(context, allocator, &m_compute, m_frames.timeline(), &m_bindless),
+	  m_staging(context, allocator, createInfo.stagingBytes),
+	  m_sprites(context, pipelineCache, m_bindless, swapchain ? swapchain->format() : offscreen->format()),
+	  m_spriteCount(createInfo.spriteCount), m_hud(context, pipelineCache, m_bindless, m_sprites.colorFormat()),
+	  m_hudVisible(createInfo.performanceHud) {
+	m_graph.setAsyncComputeEnabled(createInfo.asyncCompute);
+	m_graph.setPipelineStatisticsEnabled(createInfo.pipelineStatistics);
+	try {
+		createSpriteTextures(createInfo.assets);
+		if (createInfo.instanceCount > 0) {
+			if (context.features().drawIndirectCount) {
+				m_scene.emplace(context, allocator, m_staging, m_bindless, pipelineCache, m_sprites.colorFormat(), createInfo.instanceCount,
+					createInfo.assets);
+				if (createInfo.sceneGeometry) {
+					m_scene->setGeometry(*createInfo.sceneGeometry);
+				}
+				m_scene->setCamera(createInfo.sceneCamera);
+			} else {
+				std::printf("renderer: no indirect count draws on this device, drawing no GPU-driven scene\n");
+			}
+		}
+		if (createInfo.shaderHotReload) {
+			m_shaderReloader.emplace(context, *createInfo.tasks, "shaders", createInfo.shadersReloaded);
+			m_sprites.watchShaders(*m_shaderReloader, pipelineCache);
+			m_hud.watchShaders(*m_shaderReloader, pipelineCache);
+			if (m_scene) {
+				m_scene->watchShaders(*m_shaderReloader, pipelineCache);
+			}
+			m_shaderReloader->start();
+		}
+	} catch (...) {
+		m_shaderReloader.reset();
+		m_staging.waitIdle();
+		destroySpriteTextures();
+		throw;
+	}
+}
+
+Renderer::~Renderer() {
+	if (m_shaderReloader) {
+		m_shaderReloader->stop();
+	}
+	m_frames.waitIdle();
+	m_compute.waitIdle();
+	m_staging.waitIdle();
+	destroySpriteTextures();
+}
+
+void Renderer::setHudVisible(bool visible) {
+	m_hudVisible = visible;
+	// Worker utilisation starts over rather than averaging over the time
+	// the HUD was hidden.
+	m_jobBusySeconds.clear();
+}
+
+void Renderer::renderFrame(const FrameSnapshot& snapshot) {
+	auto frameStart = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration frameInterval{};
+	if (m_lastFrameStart != std::chrono::steady_clock::time_point{}) {
+		frameInterval = frameStart - m_lastFrameStart;
+	}
+	m_lastFrameStart = frameStart;
+
+	FrameContext& frame = m_frames.beginFrame();
+	if (m_swapchain) {
+		m_swapchain->releaseRetired(m_frames.completedValue());
+	} else {
+		m_offscreen->releaseCompleted(m_frames.completedValue());
+	}
+	m_graph.releaseCompleted(m_frames.completedValue());
+	m_bindless.releaseCompleted(m_frames.completedValue());
+	if (m_scene) {
+		m_scene->releaseCompleted(m_frames.completedValue());
+	}
+	if (m_shaderReloader) {
+		m_shaderReloader->releaseCompleted(m_frames.completedValue());
+	}
+	m_allocator.updateBudget();
+
+	VkExtent2D framebufferSize{ static_cast<uint32_t>(snapshot.framebufferWidth), static_cast<uint32_t>(snapshot.framebufferHeight) };
+	uint32_t imageIndex = 0;
+	bool acquired = false;
+	{
+		INITIUM_PROFILE_ZONE("acquire");
+		acquired = m_swapchain ? m_swapchain->acquire(framebufferSize, frame.imageAvailable(), frame.timelineValue(), imageIndex)
+							   : m_offscreen->acquire(framebufferSize, frame.timelineValue(), snapshot.frameNumber, imageIndex);
+	}
+	if (!acquired) {
+		m_frames.cancelFrame();
+		return;
+	}
+
+	// Pipelines are only ever replaced here, between frames and once the
+	// frame is certain to be submitted, so nothing recorded for it sees two
+	// versions and the replaced ones retire with a serial that will signal.
+	if (m_shaderReloader) {
+		m_shaderReloader->applyReloads(frame.timelineValue());
+	}
+
+	VkExtent2D extent = m_swapchain ? m_swapchain->extent() : m_offscreen->extent();
+	if (m_scene) {
+		INITIUM_PROFILE_ZONE("prepare scene");
+		m_scene->prepare(extent);
+	}
+	m_staging.flush();
+	m_bindless.flush();
+	if (m_hudVisible) {
+		INITIUM_PROFILE_ZONE("update hud");
+		m_hud.update(frame, hudFrame(frameInterval));
+	}
+
+	std::vector<VkCommandBuffer> secondaries = recordSprites(frame, extent, snapshot.time, m_spriteCount, 0);
+
+	VkCommandBuffer commandBuffer = frame.allocateCommandBuffer();
+	VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkCheck(vkBeginCommandBuffer(commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+	m_staging.recordAcquires(commandBuffer, m_context.queueFamilies().graphics.family);
+	if (m_swapchain) {
+		RenderGraphImportedImage backbuffer{ m_swapchain->image(imageIndex), m_swapchain->imageView(imageIndex), m_swapchain->format(), extent };
+		recordFrame(commandBuffer, backbuffer, { VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }, snapshot.time, frame.timelineValue(), secondaries);
+	} else {
+		// recordFinish takes the image from COLOR_ATTACHMENT_OPTIMAL when dumping.
+		RenderGraphImportedImage backbuffer{ m_offscreen->image(imageIndex), m_offscreen->imageView(imageIndex), m_offscreen->format(), extent };
+		recordFrame(commandBuffer, backbuffer, { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }, snapshot.time, frame.timelineValue(),
+			secondaries);
+		m_offscreen->recordFinish(commandBuffer, imageIndex);
+	}
+	vkCheck(vkEndCommandBuffer(commandBuffer), "vkEndCommandBuffer");
+
+	// Headless frames have no acquire to wait for and no present to signal.
+	std::vector<VkSemaphoreSubmitInfo> waitInfos = m_graph.waitInfos();
+	waitInfos.push_back(m_staging.waitInfo());
+	VkSemaphoreSubmitInfo signalInfos[2] = { m_frames.signalInfo(), { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO } };
+	uint32_t signalCount = 1;
+	if (m_swapchain) {
+		VkSemaphoreSubmitInfo imageAvailable{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+		imageAvailable.semaphore = frame.imageAvailable();
+		imageAvailable.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		waitInfos.push_back(imageAvailable);
+		signalInfos[1].semaphore = m_swapchain->renderFinished(imageIndex);
+		signalInfos[1].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		signalCount = 2;
+	}
+
+	VkCommandBufferSubmitInfo commandBufferInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+	commandBufferInfo.commandBuffer = commandBuffer;
+
+	VkSubmitInfo2 submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+	submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waitInfos.size());
+	submitInfo.pWaitSemaphoreInfos = waitInfos.data();
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandBufferInfo;
+	submitInfo.signalSemaphoreInfoCount = signalCount;
+	submitInfo.pSignalSemaphoreInfos = signalInfos;
+
+	{
+		INITIUM_PROFILE_ZONE("submit");
+		vkCheck(vkQueueSubmit2(m_context.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE), "vkQueueSubmit2");
+	}
+	m_frames.endFrame();
+
+	if (m_swapchain) {
+		INITIUM_PROFILE_ZONE("present");
+		m_swapchain->present(m_context.graphicsQueue(), imageIndex);
+	}
+	m_lastRenderTime = std::chrono::steady_clock::now() - frameStart;
+}
+
+void Renderer::benchmarkUploads(VkDeviceSize totalBytes) {
+	constexpr VkDeviceSize kChunkBytes = 1ull << 20;
+	totalBytes = (totalBytes + kChunkBytes - 1) / kChunkBytes * kChunkBytes;
+
+	// The scratch buffer stays with the transfer family, so no ownership
+	// transfers are queued for a resource that is about to be destroyed.
+	VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = totalBytes;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	GpuBuffer scratch = m_allocator.createBuffer(bufferInfo, { MemoryUsage::GpuOnly });
+	uint32_t transferFamily = m_context.queueFamilies().transfer.family;
+
+	std::vector<uint8_t> source(kChunkBytes);
+	for (size_t i = 0; i < source.size(); i++) {
+		source[i] = static_cast<uint8_t>(i * 31);
+	}
+
+	m_staging.waitIdle();
+	StagingStats before = m_staging.stats();
+	auto start = std::chrono::steady_clock::now();
+	for (VkDeviceSize offset = 0; offset < totalBytes; offset += kChunkBytes) {
+		m_staging.upload(scratch.buffer, offset, source.data(), kChunkBytes, transferFamily);
+		// Submit in quarter-ring batches so copying overlaps with writing.
+		if ((offset + kChunkBytes) % (m_staging.capacity() / 4) < kChunkBytes) {
+			m_staging.flush();
+		}
+	}
+	m_staging.flush();
+	m_staging.waitIdle();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	m_allocator.destroyBuffer(scratch);
+
+	const StagingStats& after = m_staging.stats();
+	auto rate = [](uint64_t bytes, double time) { return time > 0.0 ? static_cast<double>(bytes) / time / 1e9 : 0.0; };
+	std::printf("upload benchmark: %.0f MiB in %.2f ms, %.2f GB/s end to end (CPU write %.2f GB/s, GPU copy %.2f GB/s, %llu stalls)\n",
+		static_cast<double>(totalBytes) / (1 << 20), seconds * 1000.0, rate(totalBytes, seconds),
+		rate(after.cpuWrittenBytes - before.cpuWrittenBytes, after.cpuWriteSeconds - before.cpuWriteSeconds),
+		rate(after.gpuTimedBytes - before.gpuTimedBytes, after.gpuCopySeconds - before.gpuCopySeconds),
+		static_cast<unsigned long long>(after.stalls - before.stalls));
+}
+
+void Renderer::benchmarkRecording(uint32_t drawCount) {
+	// Recorded into a frame that is then cancelled: the buffers are never
+	// submitted, and the slot's pools are reset when it is next used.
+	constexpr VkExtent2D kExtent{ 1920, 1080 };
+	FrameContext& frame = m_frames.beginFrame();
+	uint32_t slots = frame.recordingSlots();
+
+	std::printf("recording benchmark: %u draws, up to %u threads\n", drawCount, slots);
+	recordSprites(frame, kExtent, 0.0, drawCount, 0);
+	for (uint32_t threads = 1;; threads = std::min(threads * 2, slots)) {
+		std::vector<RecordingThreadStats> before(slots);
+		for (uint32_t i = 0; i < slots; i++) {
+			before[i] = m_recorder.threadStats(i);
+		}
+		auto start = std::chrono::steady_clock::now();
+		std::vector<VkCommandBuffer> secondaries = recordSprites(frame, kExtent, 0.0, drawCount, threads);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// Each thread's rate over its own recording time, averaged over the
+		// threads that got a chunk.
+		uint32_t busyThreads = 0;
+		double perThread = 0.0;
+		for (uint32_t i = 0; i < slots; i++) {
+			RecordingThreadStats delta = m_recorder.threadStats(i);
+			delta.draws -= before[i].draws;
+			delta.seconds -= before[i].seconds;
+			if (delta.draws > 0) {
+				busyThreads++;
+				perThread += delta.drawsPerMillisecond();
+			}
+		}
+		if (busyThreads > 0) {
+			perThread /= busyThreads;
+		}
+		std::printf("  %2u chunks on %2u threads: %8.2f ms, %9.1f draws/ms total, %8.1f draws/ms per thread\n",
+			static_cast<uint32_t>(secondaries.size()), busyThreads, seconds * 1000.0,
+			seconds > 0.0 ? static_cast<double>(drawCount) / (seconds * 1000.0) : 0.0, perThread);
+		if (threads == slots) {
+			break;
+		}
+	}
+	m_frames.cancelFrame();
+}
+
+void Renderer::addAssets(AssetPackWriter& writer, uint32_t instanceCount) {
+	std::vector<uint8_t> texels(kSpriteSize * kSpriteSize * 4);
+	for (uint32_t shape = 0; shape < kSpriteShapes; shape++) {
+		rasterizeSprite(shape, texels.data());
+		writer.addTexture(spriteAssetName(shape), VK_FORMAT_R8G8B8A8_UNORM, kSpriteSize, kSpriteSize, 1, texels.data(), texels.size());
+	}
+	GpuScene::addAssets(writer, instanceCount);
+}
+
+void Renderer::createSpriteTextures(const AssetPack* assets) {
+	VkDevice device = m_context.device();
+	uint32_t graphicsFamily = m_context.queueFamilies().graphics.family;
+
+	for (uint32_t shape = 0; shape < kSpriteShapes; shape++) {
+		VkImageCreateInfo imageInfo{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.extent = { kSpriteSize, kSpriteSize, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		SpriteTexture& texture = m_spriteTextures.emplace_back();
+		texture.image = m_allocator.createImage(imageInfo, { MemoryUsage::GpuOnly });
+
+		VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = texture.image.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = imageInfo.format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCheck(vkCreateImageView(device, &viewInfo, m_context.allocationCallbacks(), &texture.view), "vkCreateImageView");
+
+		// Copied from the pack's mapping straight into the staging ring when
+		// it has the shape in this format, otherwise drawn there.
+		StagingAllocation pixels = m_staging.allocate(kSpriteSize * kSpriteSize * 4);
+		Asset packed = assets ? assets->find(spriteAssetName(shape)) : Asset{};
+		if (packed && packed.entry->type == AssetType::Texture && packed.entry->format == static_cast<uint32_t>(imageInfo.format) && packed.entry->width == kSpriteSize
+			&& packed.entry->height == kSpriteSize && packed.size() == pixels.size) {
+			std::memcpy(pixels.mapped, packed.data, static_cast<size_t>(pixels.size));
+		} else {
+			rasterizeSprite(shape, static_cast<uint8_t*>(pixels.mapped));
+		}
+		// Acquired and waited on by the first frame, like any other upload.
+		m_staging.copyToImage(pixels, texture.image.image, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, imageInfo.extent,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, graphicsFamily);
+		texture.handle = m_bindless.addTexture(texture.view);
+	}
+
+	VkSamplerCreateInfo samplerInfo{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = 0.0f;
+	vkCheck(vkCreateSampler(device, &samplerInfo, m_context.allocationCallbacks(), &m_spriteSampler), "vkCreateSampler");
+	m_spriteSamplerHandle = m_bindless.addSampler(m_spriteSampler);
+}
+
+void Renderer::destroySpriteTextures() {
+	// Only after the GPU is done with them: the slots are not recycled.
+	VkDevice device = m_context.device();
+	vkDestroySampler(device, m_spriteSampler, m_context.allocationCallbacks());
+	m_spriteSampler = VK_NULL_HANDLE;
+	for (SpriteTexture& texture : m_spriteTextures) {
+		vkDestroyImageView(device, texture.view, m_context.allocationCallbacks());
+		m_allocator.destroyImage(texture.image);
+	}
+	m_spriteTextures.clear();
+}
+
+VkCommandBufferInheritanceRenderingInfo Renderer::inheritanceInfo() const {
+	// Points into m_sprites, so the result stays valid as long as it does.
+	VkCommandBufferInheritanceRenderingInfo renderingInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = m_sprites.colorFormatPointer();
+	renderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	return renderingInfo;
+}
+
+std::vector<VkCommandBuffer> Renderer::recordSprites(FrameContext& frame, VkExtent2D extent, double time, uint32_t spriteCount,
+	uint32_t maxThreads) {
+	INITIUM_PROFILE_ZONE("record sprites");
+	VkCommandBufferInheritanceRenderingInfo renderingInfo = inheritanceInfo();
+	return m_recorder.record(frame, renderingInfo, spriteCount, maxThreads,
+		[this, extent, time, spriteCount](VkCommandBuffer commandBuffer, uint32_t begin, uint32_t end) {
+			recordSpriteRange(commandBuffer, extent, time, spriteCount, begin, end);
+		});
+}
+
+void Renderer::recordSpriteRange(VkCommandBuffer commandBuffer, VkExtent2D extent, double time, uint32_t spriteCount, uint32_t begin,
+	uint32_t end) const {
+	INITIUM_PROFILE_ZONE("record sprite range");
+	// A grid of cells covering the screen, one sprite bobbing in each. Pure
+	// function of the index and time so any thread can record any range.
+	uint32_t columns = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(spriteCount)))));
+	uint32_t rows = std::max(1u, (spriteCount + columns - 1) / columns);
+	float cellWidth = 2.0f / static_cast<float>(columns);
+	float cellHeight = 2.0f / static_cast<float>(rows);
+
+	m_sprites.bind(commandBuffer, extent);
+	for (uint32_t i = begin; i < end; i++) {
+		float phase = static_cast<float>(time) * 2.0f + static_cast<float>(i) * 0.37f;
+		uint32_t hash = i * 2654435761u;
+
+		SpriteConstants sprite;
+		sprite.center[0] = -1.0f + (static_cast<float>(i % columns) + 0.5f + 0.25f * std::sin(phase)) * cellWidth;
+		sprite.center[1] = -1.0f + (static_cast<float>(i / columns) + 0.5f + 0.25f * std::cos(phase)) * cellHeight;
+		sprite.halfSize[0] = 0.35f * cellWidth;
+		sprite.halfSize[1] = 0.35f * cellHeight;
+		sprite.color[0] = 0.3f + 0.7f * static_cast<float>((hash >> 8) & 0xFF) / 255.0f;
+		sprite.color[1] = 0.3f + 0.7f * static_cast<float>((hash >> 16) & 0xFF) / 255.0f;
+		sprite.color[2] = 0.3f + 0.7f * static_cast<float>((hash >> 24) & 0xFF) / 255.0f;
+		sprite.color[3] = 0.9f;
+		sprite.texture = m_spriteTextures[(hash >> 4) % m_spriteTextures.size()].handle;
+		sprite.sampler = m_spriteSamplerHandle;
+		m_sprites.draw(commandBuffer, sprite);
+	}
+}
+
+PerformanceHudFrame Renderer::hudFrame(std::chrono::steady_clock::duration frameInterval) {
+	PerformanceHudFrame data;
+	data.frameMilliseconds = std::chrono::duration<double, std::milli>(frameInterval).count();
+	data.cpuMilliseconds = std::chrono::duration<double, std::milli>(m_lastRenderTime).count();
+
+	// Only passes of the newest timed frame: the others no longer run.
+	uint64_t newest = 0;
+	for (const RenderGraphPassTiming& timing : m_graph.passTimings()) {
+		newest = std::max(newest, timing.lastFrame);
+	}
+	for (const RenderGraphPassTiming& timing : m_graph.passTimings()) {
+		if (timing.samples > 0 && timing.lastFrame == newest) {
+			(timing.asyncCompute ? data.computeMilliseconds : data.gpuMilliseconds) += timing.lastMilliseconds;
+		}
+	}
+
+	// Sprites and the HUD are a draw each; the scene's come from its last
+	// readback, counting each cluster as one.
+	data.draws = m_spriteCount + 1;
+	if (m_scene) {
+		const GpuSceneStats& stats = m_scene->stats();
+		data.draws += m_scene->geometry() == SceneGeometry::Meshes ? stats.lastDrawn : stats.lastClustersDrawn;
+		data.dispatches = stats.lastDispatches;
+	}
+
+	std::vector<HeapStats> heaps = m_allocator.heapStats();
+	const VkPhysicalDeviceMemoryProperties& memory = m_context.memoryProperties();
+	for (uint32_t heap = 0; heap < heaps.size(); heap++) {
+		if (memory.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			data.vramUsage += heaps[heap].usage;
+			data.vramBudget += heaps[heap].budget;
+		}
+	}
+
+	// Busy time since the last frame over its length. The first frame after
+	// the HUD appears only takes the baseline.
+	uint32_t workers = m_jobs.workerCount();
+	bool baseline = m_jobBusySeconds.size() != workers;
+	m_jobBusySeconds.resize(workers, 0.0);
+	double seconds = std::chrono::duration<double>(frameInterval).count();
+	for (uint32_t worker = 0; worker < workers; worker++) {
+		double busy = m_jobs.workerStats(worker).busySeconds;
+		bool measured = !baseline && seconds > 0.0;
+		data.jobUtilization.push_back(measured ? static_cast<float>((busy - m_jobBusySeconds[worker]) / seconds) : 0.0f);
+		m_jobBusySeconds[worker] = busy;
+	}
+	return data;
+}
+
+void Renderer::recordFrame(VkCommandBuffer commandBuffer, const RenderGraphImportedImage& backbuffer, const RenderGraphImageState& finalState,
+	double time, uint64_t frameSerial, const std::vector<VkCommandBuffer>& secondaries) {
+	INITIUM_PROFILE_ZONE("record frame");
+	// Whatever the image held is discarded; the acquire semaphore wait
+	// (or the previous frame's timeline wait) is at colour attachment output.
+	RenderGraphImage target = m_graph.importImage("backbuffer", backbuffer,
+		{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE }, finalState);
+
+	// The scene clears the target and the sprites go on top; without it the
+	// sprite pass clears, even when it has nothing to draw.
+	if (m_scene) {
+		m_scene->addPasses(m_graph, target, backbuffer.extent, time, frameSerial);
+	}
+	if (!m_scene || !secondaries.empty()) {
+		RenderGraphPass& sprites = m_graph.addPass("sprites");
+		sprites.colorAttachment(target, m_scene ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR, { { 0.02f, 0.02f, 0.03f, 1.0f } });
+		if (!secondaries.empty()) {
+			sprites.secondaryCommandBuffers();
+			sprites.execute([&secondaries](VkCommandBuffer commandBuffer) {
+				// In draw order, however the chunks were spread over threads.
+				vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+			});
+		}
+	}
+	if (m_hudVisible && m_hud.rectCount() > 0) {
+		VkExtent2D extent = backbuffer.extent;
+		m_graph.addPass("hud").colorAttachment(target, VK_ATTACHMENT_LOAD_OP_LOAD).execute([this, extent](VkCommandBuffer commandBuffer) {
+			m_hud.record(commandBuffer, extent);
+		});
+	}
+
+	// Scene uploads the compute passes read; graphics waits for them in
+	// renderFrame().
+	m_graph.addComputeWait(m_staging.waitInfo());
+	m_graph.execute(commandBuffer, frameSerial);
+}
+
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "AssetPack.h"
+#include "AsyncCompute.h"
+#include "BindlessTable.h"
+#include "FrameRing.h"
+#include "GpuAllocator.h"
+#include "GpuScene.h"
+#include "JobSystem.h"
+#include "OffscreenTarget.h"
+#include "ParallelRecorder.h"
+#include "PerformanceHud.h"
+#include "PipelineCache.h"
+#include "RenderGraph.h"
+#include "RenderThread.h"
+#include "ShaderReloader.h"
+#include "SpritePipeline.h"
+#include "StagingRing.h"
+#include "Swapchain.h"
+#include "TaskRuntime.h"
+#include "VulkanContext.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace initium {
+
+struct RendererCreateInfo {
+	uint32_t framesInFlight = 2;
+	VkDeviceSize transientBytesPerFrame = 4ull << 20;
+	VkDeviceSize stagingBytes = 64ull << 20;
+	// Sprites drawn per frame, each its own draw call.
+	uint32_t spriteCount = 4096;
+	// Instances in the GPU-driven scene, drawn under the sprites; 0 for
+	// none. Ignored on devices without indirect count draws.
+	uint32_t instanceCount = 0;
+	// How the scene is drawn; the best the device has when unset.
+	std::optional<SceneGeometry> sceneGeometry;
+	SceneCamera sceneCamera = SceneCamera::Orbit;
+	// Sprite textures and scene data are read from this pack when it has
+	// them, and built otherwise. Only needs to outlive the constructor.
+	const AssetPack* assets = nullptr;
+	// Run render graph passes marked for it on the compute queue, when the
+	// device has a separate one.
+	bool asyncCompute = true;
+	// Count primitives and shader invocations per graphics pass alongside
+	// the pass timings, where the device can.
+	bool pipelineStatistics = false;
+	// Draw the frame-time graph and counters over the frame.
+	bool performanceHud = false;
+	// Recompile shaders from shaders/ when they change, rebuild their
+	// pipelines as tasks on tasks, which must then be set and outlive the
+	// renderer, and swap them in between frames. shadersReloaded is called
+	// from a worker when they are ready, to get a frame rendered.
+	bool shaderHotReload = false;
+	TaskRuntime* tasks = nullptr;
+	std::function<void()> shadersReloaded;
+};
+
+// Records and submits frames, either to a swapchain or, when headless, to
+// an offscreen target. Lives on the render thread: every call after
+// construction must come from there. Draws are recorded in parallel on the
+// job system.
+class Renderer {
+public:
+	Renderer(const VulkanContext& context, GpuAllocator& allocator, JobSystem& jobs, PipelineCache& pipelineCache, Swapchain& swapchain,
+		const RendererCreateInfo& createInfo);
+	Renderer(const VulkanContext& context, GpuAllocator& allocator, JobSystem& jobs, PipelineCache& pipelineCache, OffscreenTarget& offscreen,
+		const RendererCreateInfo& createInfo);
+	~Renderer();
+
+	Renderer(const Renderer&) = delete;
+	Renderer& operator=(const Renderer&) = delete;
+
+	void renderFrame(const FrameSnapshot& snapshot);
+
+	// More frames in flight overlap CPU and GPU better, fewer cut input
+	// latency. Takes effect from the next frame.
+	void setFramesInFlight(uint32_t count) { m_frames.setFramesInFlight(count); }
+	uint32_t framesInFlight() const { return m_frames.framesInFlight(); }
+
+	void setSpriteCount(uint32_t count) { m_spriteCount = count; }
+	uint32_t spriteCount() const { return m_spriteCount; }
+
+	// Uploads recorded here are flushed and waited on by the next frame.
+	StagingRing& staging() { return m_staging; }
+	const ParallelRecorder& recorder() const { return m_recorder; }
+	RenderGraph& graph() { return m_graph; }
+	const RenderGraph& graph() const { return m_graph; }
+	// Textures, samplers, storage buffers and storage images for every
+	// bindless pipeline.
+	BindlessTable& bindless() { return m_bindless; }
+	// Null when the renderer draws no GPU-driven scene.
+	GpuScene* scene() { return m_scene ? &*m_scene : nullptr; }
+	// Null without shader hot reload.
+	const ShaderReloader* shaderReloader() const { return m_shaderReloader ? &*m_shaderReloader : nullptr; }
+
+	// Takes effect from the next frame.
+	void setHudVisible(bool visible);
+	bool hudVisible() const { return m_hudVisible; }
+
+	// Takes effect from the next frame.
+	void setAsyncCompute(bool enabled) { m_graph.setAsyncComputeEnabled(enabled); }
+	bool asyncCompute() const { return m_graph.asyncComputeEnabled(); }
+	bool asyncComputeAvailable() const { return m_graph.asyncComputeAvailable(); }
+
+	// Streams totalBytes through the staging ring into a scratch buffer and
+	// prints the end-to-end and per-side throughput.
+	void benchmarkUploads(VkDeviceSize totalBytes);
+
+	// Records drawCount sprite draws on 1, 2, 4, ... threads up to every
+	// recording slot, without submitting them, and prints draws per
+	// millisecond overall and per thread.
+	void benchmarkRecording(uint32_t drawCount);
+
+	// Adds everything the renderer would otherwise build at startup to a
+	// pack, with the scene for instanceCount instances.
+	static void addAssets(AssetPackWriter& writer, uint32_t instanceCount);
+
+private:
+	// Exactly one of swapchain and offscreen is set.
+	Renderer(const VulkanContext& context, GpuAllocator& allocator, JobSystem& jobs, PipelineCache& pipelineCache, Swapchain* swapchain,
+		OffscreenTarget* offscreen, const RendererCreateInfo& createInfo);
+
+	// A few procedural shapes for the sprites to pick from, uploaded through
+	// the staging ring and registered in the bindless table.
+	void createSpriteTextures(const AssetPack* assets);
+	void destroySpriteTextures();
+
+	VkCommandBufferInheritanceRenderingInfo inheritanceInfo() const;
+	// Records a grid of spriteCount sprites into secondaries for the frame's
+	// main pass.
+	std::vector<VkCommandBuffer> recordSprites(FrameContext& frame, VkExtent2D extent, double time, uint32_t spriteCount, uint32_t maxThreads);
+	void recordSpriteRange(VkCommandBuffer commandBuffer, VkExtent2D extent, double time, uint32_t spriteCount, uint32_t begin,
+		uint32_t end) const;
+
+	// What the HUD shows this frame, frameInterval after the previous one
+	// started.
+	PerformanceHudFrame hudFrame(std::chrono::steady_clock::duration frameInterval);
+
+	// Builds the frame's render graph around the backbuffer and records it.
+	void recordFrame(VkCommandBuffer commandBuffer, const RenderGraphImportedImage& backbuffer, const RenderGraphImageState& finalState,
+		double time, uint64_t frameSerial, const std::vector<VkCommandBuffer>& secondaries);
+
+	const VulkanContext& m_context;
+	GpuAllocator& m_allocator;
+	JobSystem& m_jobs;
+	Swapchain* m_swapchain;
+	OffscreenTarget* m_offscreen;
+	ParallelRecorder m_recorder;
+	FrameRing m_frames;
+	AsyncCompute m_compute;
+	// Before the graph, which keeps slots for its transient buffers.
+	BindlessTable m_bindless;
+	RenderGraph m_graph;
+	StagingRing m_staging;
+	SpritePipeline m_sprites;
+	uint32_t m_spriteCount;
+	PerformanceHud m_hud;
+	bool m_hudVisible;
+	std::chrono::steady_clock::time_point m_lastFrameStart;
+	std::chrono::steady_clock::duration m_lastRenderTime{};
+	// Each job worker's busy time when the HUD last read it.
+	std::vector<double> m_jobBusySeconds;
+	std::optional<GpuScene> m_scene;
+	// Its build functions use the sprites, the HUD and the scene, so it is stopped
+	// before they are destroyed.
+	std::optional<ShaderReloader> m_shaderReloader;
+
+	struct SpriteTexture {
+		GpuImage image;
+		VkImageView view = VK_NULL_HANDLE;
+		BindlessTexture handle;
+	};
+	std::vector<SpriteTexture> m_spriteTextures;
+	VkSampler m_spriteSampler = VK_NULL_HANDLE;
+	BindlessSampler m_spriteSamplerHandle;
+};
+
+}
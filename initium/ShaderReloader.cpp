@@ -0,0 +1,309 @@
+#include "ShaderReloader.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iterator>
+
+namespace initium {
+
+namespace {
+
+constexpr std::chrono::milliseconds kPollInterval{ 250 };
+
+bool isStageSource(const std::filesystem::path& path) {
+	static const char* const kExtensions[] = { ".vert", ".frag", ".comp", ".task", ".mesh", ".geom", ".tesc", ".tese" };
+	std::string extension = path.extension().string();
+	return std::any_of(std::begin(kExtensions), std::end(kExtensions), [&](const char* known) { return extension == known; });
+}
+
+bool isShaderSource(const std::filesystem::path& path) {
+	return isStageSource(path) || path.extension() == ".glsl";
+}
+
+// Files named by #include "..." lines, relative to the includer.
+std::vector<std::filesystem::path> includesOf(const std::filesystem::path& source) {
+	std::vector<std::filesystem::path> includes;
+	std::ifstream file(source);
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t directive = line.find_first_not_of(" \t");
+		if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) {
+			continue;
+		}
+		size_t open = line.find('"', directive);
+		size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+		if (close != std::string::npos) {
+			includes.push_back((source.parent_path() / line.substr(open + 1, close - open - 1)).lexically_normal());
+		}
+	}
+	return includes;
+}
+
+std::filesystem::path canonicalPath(const std::filesystem::path& path) {
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+	return error ? path.lexically_normal() : canonical;
+}
+
+}
+
+ShaderReloader::ShaderReloader(const VulkanContext& context, TaskRuntime& tasks, std::filesystem::path shaderDirectory,
+	std::function<void()> reloaded)
+	: m_context(context), m_tasks(tasks), m_shaderDirectory(std::move(shaderDirectory)), m_reloaded(std::move(reloaded)) {
+	if (const char* compiler = std::getenv("INITIUM_GLSLC")) {
+		m_compiler = compiler;
+	} else if (const char* sdk = std::getenv("VULKAN_SDK")) {
+#ifdef _WIN32
+		m_compiler = (std::filesystem::path(sdk) / "Bin" / "glslc.exe").string();
+#else
+		m_compiler = (std::filesystem::path(sdk) / "bin" / "glslc").string();
+#endif
+	} else {
+		m_compiler = "glslc";
+	}
+}
+
+ShaderReloader::~ShaderReloader() {
+	stop();
+	// Whoever owns the device has waited for it to go idle.
+	for (const ReadyPipeline& ready : m_ready) {
+		vkDestroyPipeline(m_context.device(), ready.pipeline, m_context.allocationCallbacks());
+	}
+	for (const RetiredPipeline& retired : m_retired) {
+		vkDestroyPipeline(m_context.device(), retired.pipeline, m_context.allocationCallbacks());
+	}
+}
+
+void ShaderReloader::watch(VkPipeline& pipeline, std::vector<std::filesystem::path> shaders, BuildFunction build) {
+	for (std::filesystem::path& shader : shaders) {
+		shader = canonicalPath(shader);
+	}
+	m_watches.push_back({ &pipeline, std::move(shaders), std::move(build) });
+}
+
+void ShaderReloader::start() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_running) {
+		return;
+	}
+	m_running = true;
+	m_thread = std::thread(&ShaderReloader::run, this);
+	std::printf("shader reload: watching %s with %s\n", m_shaderDirectory.string().c_str(), m_compiler.c_str());
+}
+
+void ShaderReloader::stop() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_running) {
+			return;
+		}
+		m_running = false;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+	m_tasks.wait(m_rebuilding);
+}
+
+uint32_t ShaderReloader::applyReloads(uint64_t frameSerial) {
+	std::vector<ReadyPipeline> ready;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ready.swap(m_ready);
+	}
+	// Frames up to the previous one may still use the old pipelines; this
+	// one is recorded with the new.
+	for (const ReadyPipeline& pipeline : ready) {
+		m_retired.push_back({ *pipeline.target, frameSerial });
+		*pipeline.target = pipeline.pipeline;
+	}
+	m_swaps += ready.size();
+	return static_cast<uint32_t>(ready.size());
+}
+
+void ShaderReloader::releaseCompleted(uint64_t completedSerial) {
+	auto done = std::remove_if(m_retired.begin(), m_retired.end(), [&](const RetiredPipeline& retired) {
+		if (retired.serial > completedSerial) {
+			return false;
+		}
+		vkDestroyPipeline(m_context.device(), retired.pipeline, m_context.allocationCallbacks());
+		return true;
+	});
+	m_retired.erase(done, m_retired.end());
+}
+
+void ShaderReloader::reportStats() const {
+	std::printf("shader reload: %llu compiles (%llu failed), %llu pipelines rebuilt (%llu failed), %llu swapped in\n",
+		static_cast<unsigned long long>(m_compiles.load()), static_cast<unsigned long long>(m_compileFailures.load()),
+		static_cast<unsigned long long>(m_rebuilds.load()), static_cast<unsigned long long>(m_rebuildFailures.load()),
+		static_cast<unsigned long long>(m_swaps));
+}
+
+ShaderReloader::SourceTimes ShaderReloader::scan() const {
+	SourceTimes sources;
+	std::error_code error;
+	for (std::filesystem::directory_iterator entry(m_shaderDirectory, error), end; !error && entry != end; entry.increment(error)) {
+		if (!isShaderSource(entry->path())) {
+			continue;
+		}
+		// Editors replace files on save; one that is briefly missing just
+		// shows up as changed on the next scan.
+		std::error_code timeError;
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(entry->path(), timeError);
+		if (!timeError) {
+			sources[entry->path().lexically_normal()] = time;
+		}
+	}
+	return sources;
+}
+
+std::set<std::filesystem::path> ShaderReloader::affectedSources(const SourceTimes& sources, const std::set<std::filesystem::path>& changed) const {
+	std::set<std::filesystem::path> affected;
+	for (const auto& [source, time] : sources) {
+		if (!isStageSource(source)) {
+			continue;
+		}
+		std::vector<std::filesystem::path> pending{ source };
+		std::set<std::filesystem::path> visited;
+		while (!pending.empty()) {
+			std::filesystem::path file = std::move(pending.back());
+			pending.pop_back();
+			if (!visited.insert(file).second) {
+				continue;
+			}
+			if (changed.count(file) != 0) {
+				affected.insert(source);
+				break;
+			}
+			std::vector<std::filesystem::path> includes = includesOf(file);
+			pending.insert(pending.end(), includes.begin(), includes.end());
+		}
+	}
+	return affected;
+}
+
+bool ShaderReloader::compile(const std::filesystem::path& source) {
+	// Into a temporary first, so a pipeline built meanwhile never loads a
+	// half-written module.
+	std::filesystem::path output = source;
+	output += ".spv";
+	std::filesystem::path temporary = source;
+	temporary += ".spv.tmp";
+	std::string command = "\"" + m_compiler + "\" --target-env=vulkan1.3 -O \"" + source.string() + "\" -o \"" + temporary.string() + "\"";
+#ifdef _WIN32
+	// cmd.exe drops the outer quotes of a command line that starts with one.
+	command = "\"" + command + "\"";
+#endif
+
+	INITIUM_PROFILE_ZONE("shader compile");
+	m_compiles.fetch_add(1, std::memory_order_relaxed);
+	auto start = std::chrono::steady_clock::now();
+	int status = std::system(command.c_str());
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::error_code error;
+	if (status == 0) {
+		std::filesystem::rename(temporary, output, error);
+	}
+	if (status != 0 || error) {
+		std::filesystem::remove(temporary, error);
+		m_compileFailures.fetch_add(1, std::memory_order_relaxed);
+		std::printf("shader reload: %s failed to compile, keeping the previous pipelines\n", source.string().c_str());
+		return false;
+	}
+	std::printf("shader reload: compiled %s in %.0f ms\n", source.string().c_str(), milliseconds);
+	return true;
+}
+
+void ShaderReloader::run() {
+	INITIUM_PROFILE_THREAD("shader reload");
+	SourceTimes known = scan();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_running) {
+		m_wake.wait_for(lock, kPollInterval, [this] { return !m_running; });
+		if (!m_running) {
+			break;
+		}
+		if (!m_rebuilding.done()) {
+			continue;
+		}
+		lock.unlock();
+
+		SourceTimes current = scan();
+		std::set<std::filesystem::path> changed;
+		for (const auto& [source, time] : current) {
+			auto previous = known.find(source);
+			if (previous == known.end() || previous->second != time) {
+				changed.insert(source);
+			}
+		}
+		known = std::move(current);
+
+		if (!changed.empty()) {
+			std::set<std::filesystem::path> compiled;
+			for (const std::filesystem::path& source : affectedSources(known, changed)) {
+				if (compile(source)) {
+					std::filesystem::path output = source;
+					output += ".spv";
+					compiled.insert(canonicalPath(output));
+				}
+			}
+			std::vector<const Watch*> stale;
+			for (const Watch& watch : m_watches) {
+				if (std::any_of(watch.shaders.begin(), watch.shaders.end(), [&](const std::filesystem::path& shader) { return compiled.count(shader) != 0; })) {
+					stale.push_back(&watch);
+				}
+			}
+			if (!stale.empty()) {
+				m_tasks.spawn(rebuild(std::move(stale)), &m_rebuilding);
+			}
+		}
+		lock.lock();
+	}
+}
+
+Task<> ShaderReloader::rebuild(std::vector<const Watch*> watches) {
+	std::vector<VkPipeline> pipelines(watches.size(), VK_NULL_HANDLE);
+	for (size_t i = 0; i < watches.size(); i++) {
+		m_tasks.spawn(build(*watches[i], pipelines[i]), &m_building);
+	}
+	co_await m_tasks.after(m_building);
+
+	std::vector<ReadyPipeline> ready;
+	for (size_t i = 0; i < watches.size(); i++) {
+		if (pipelines[i] != VK_NULL_HANDLE) {
+			ready.push_back({ watches[i]->pipeline, pipelines[i] });
+		}
+	}
+	if (ready.empty()) {
+		co_return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_ready.insert(m_ready.end(), ready.begin(), ready.end());
+	}
+	std::printf("shader reload: %zu pipelines ready for the next frame\n", ready.size());
+	// Outside the lock: the callback may well end up in applyReloads(),
+	// which takes it.
+	if (m_reloaded) {
+		m_reloaded();
+	}
+}
+
+Task<> ShaderReloader::build(const Watch& watch, VkPipeline& pipeline) {
+	try {
+		INITIUM_PROFILE_ZONE("pipeline rebuild");
+		pipeline = watch.build();
+		m_rebuilds.fetch_add(1, std::memory_order_relaxed);
+	} catch (const std::exception& exception) {
+		m_rebuildFailures.fetch_add(1, std::memory_order_relaxed);
+		std::printf("shader reload: rebuilding a pipeline failed: %s\n", exception.what());
+	}
+	co_return;
+}
+
+}
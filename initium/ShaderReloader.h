@@ -0,0 +1,123 @@
+#pragma once
+
+#include "TaskRuntime.h"
+#include "VulkanContext.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace initium {
+
+// Rebuilds pipelines while the application runs when the GLSL they were
+// compiled from changes. A thread of its own polls the shader directory and
+// recompiles changed sources, and sources that include them, to SPIR-V with
+// glslc; the pipelines that load them are then rebuilt in parallel by a task
+// on the TaskRuntime. The render thread only ever swaps in finished
+// pipelines between frames, so a slow compile never stalls it; a failed one
+// leaves the old pipeline in place and prints the compiler's errors.
+//
+// SPIR-V is written next to its source as <source>.spv, where the project's
+// shader build puts it. The compiler is $INITIUM_GLSLC, else glslc from
+// $VULKAN_SDK, else glslc on the PATH.
+class ShaderReloader {
+public:
+	using BuildFunction = std::function<VkPipeline()>;
+
+	// reloaded is called from a job system worker whenever rebuilt pipelines
+	// are ready, to wake whatever will render the next frame. tasks must
+	// outlive stop().
+	ShaderReloader(const VulkanContext& context, TaskRuntime& tasks, std::filesystem::path shaderDirectory, std::function<void()> reloaded);
+	~ShaderReloader();
+
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+	// Before start(): whenever the source of one of the SPIR-V files changes,
+	// build() is called on a job system worker and its result replaces
+	// pipeline at the next applyReloads(). build() must be safe to call
+	// there, alongside the other watches' build functions, and its owner
+	// must outlive stop().
+	void watch(VkPipeline& pipeline, std::vector<std::filesystem::path> shaders, BuildFunction build);
+
+	void start();
+	// Joins the watcher thread and waits for rebuilds in flight. Call before
+	// destroying anything a build function uses.
+	void stop();
+
+	// Render thread, at a frame boundary: swaps in the pipelines rebuilt
+	// since the last call. Those they replace are destroyed once frameSerial
+	// has completed. Returns how many were swapped.
+	uint32_t applyReloads(uint64_t frameSerial);
+	void releaseCompleted(uint64_t completedSerial);
+
+	void reportStats() const;
+
+private:
+	struct Watch {
+		VkPipeline* pipeline = nullptr;
+		std::vector<std::filesystem::path> shaders;
+		BuildFunction build;
+	};
+
+	struct ReadyPipeline {
+		VkPipeline* target = nullptr;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+	};
+
+	struct RetiredPipeline {
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		uint64_t serial = 0;
+	};
+
+	void run();
+	// Builds watches in parallel, then hands the pipelines to the render
+	// thread.
+	Task<> rebuild(std::vector<const Watch*> watches);
+	Task<> build(const Watch& watch, VkPipeline& pipeline);
+	using SourceTimes = std::map<std::filesystem::path, std::filesystem::file_time_type>;
+
+	// Modification times of every shader source and include in the directory.
+	SourceTimes scan() const;
+	// Stage sources among sources whose own text or includes, transitively,
+	// are in changed.
+	std::set<std::filesystem::path> affectedSources(const SourceTimes& sources, const std::set<std::filesystem::path>& changed) const;
+	bool compile(const std::filesystem::path& source);
+
+	const VulkanContext& m_context;
+	TaskRuntime& m_tasks;
+	std::filesystem::path m_shaderDirectory;
+	std::function<void()> m_reloaded;
+	std::string m_compiler;
+	std::vector<Watch> m_watches;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_running = false;
+	std::vector<ReadyPipeline> m_ready;
+	std::thread m_thread;
+	// Pending while a rebuild task is, and while its builds are. The watcher
+	// leaves changes for the next scan until the last rebuild has finished,
+	// so an older pipeline never lands after a newer one.
+	JobCounter m_rebuilding;
+	JobCounter m_building;
+
+	// Render thread only.
+	std::vector<RetiredPipeline> m_retired;
+
+	std::atomic<uint64_t> m_compiles{ 0 };
+	std::atomic<uint64_t> m_compileFailures{ 0 };
+	std::atomic<uint64_t> m_rebuilds{ 0 };
+	std::atomic<uint64_t> m_rebuildFailures{ 0 };
+	uint64_t m_swaps = 0;
+};
+
+}
@@ -0,0 +1,155 @@
+#include "SpritePipeline.h"
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace initium {
+
+VkShaderModule loadShaderModule(const VulkanContext& context, const std::filesystem::path& path) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error("cannot open shader " + path.string());
+	}
+	std::streamoff size = file.tellg();
+	if (size <= 0 || size % 4 != 0) {
+		throw std::runtime_error("not a SPIR-V module: " + path.string());
+	}
+	std::vector<uint32_t> code(static_cast<size_t>(size) / 4);
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), size);
+	if (!file || code[0] != 0x07230203) {
+		throw std::runtime_error("not a SPIR-V module: " + path.string());
+	}
+
+	VkShaderModuleCreateInfo moduleInfo{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+	moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+	moduleInfo.pCode = code.data();
+
+	VkShaderModule module;
+	vkCheck(vkCreateShaderModule(context.device(), &moduleInfo, context.allocationCallbacks(), &module), "vkCreateShaderModule");
+	return module;
+}
+
+SpritePipeline::SpritePipeline(const VulkanContext& context, PipelineCache& pipelineCache, const BindlessTable& bindless, VkFormat colorFormat,
+	const std::filesystem::path& shaderDirectory)
+	: m_context(context), m_bindless(bindless), m_colorFormat(colorFormat), m_shaderDirectory(shaderDirectory) {
+	if (sizeof(SpriteConstants) > bindless.pushConstantBytes()) {
+		throw std::runtime_error("sprite push constants exceed the bindless pipeline layout");
+	}
+	m_pipeline = createPipeline(pipelineCache);
+}
+
+SpritePipeline::~SpritePipeline() {
+	vkDestroyPipeline(m_context.device(), m_pipeline, m_context.allocationCallbacks());
+}
+
+void SpritePipeline::watchShaders(ShaderReloader& reloader, PipelineCache& pipelineCache) {
+	reloader.watch(m_pipeline, { m_shaderDirectory / "sprite.vert.spv", m_shaderDirectory / "sprite.frag.spv" },
+		[this, &pipelineCache] { return createPipeline(pipelineCache); });
+}
+
+VkPipeline SpritePipeline::createPipeline(PipelineCache& pipelineCache) const {
+	VkDevice device = m_context.device();
+	VkShaderModule vertexShader = VK_NULL_HANDLE;
+	VkShaderModule fragmentShader = VK_NULL_HANDLE;
+	try {
+		vertexShader = loadShaderModule(m_context, m_shaderDirectory / "sprite.vert.spv");
+		fragmentShader = loadShaderModule(m_context, m_shaderDirectory / "sprite.frag.spv");
+	} catch (...) {
+		vkDestroyShaderModule(device, vertexShader, m_context.allocationCallbacks());
+		throw;
+	}
+
+	VkPipelineShaderStageCreateInfo stages[2] = { { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
+		{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO } };
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vertexShader;
+	stages[0].pName = "main";
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = fragmentShader;
+	stages[1].pName = "main";
+
+	VkPipelineVertexInputStateCreateInfo vertexInput{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{ VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+	VkPipelineViewportStateCreateInfo viewportState{ VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterization{ VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+	rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization.cullMode = VK_CULL_MODE_NONE;
+	rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterization.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample{ VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState blendAttachment{};
+	blendAttachment.blendEnable = VK_TRUE;
+	blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlend{ VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+	colorBlend.attachmentCount = 1;
+	colorBlend.pAttachments = &blendAttachment;
+
+	const VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{ VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineRenderingCreateInfo renderingInfo{ VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &m_colorFormat;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{ VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+	pipelineInfo.pNext = &renderingInfo;
+	pipelineInfo.stageCount = static_cast<uint32_t>(std::size(stages));
+	pipelineInfo.pStages = stages;
+	pipelineInfo.pVertexInputState = &vertexInput;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterization;
+	pipelineInfo.pMultisampleState = &multisample;
+	pipelineInfo.pColorBlendState = &colorBlend;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = m_bindless.pipelineLayout();
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	auto start = std::chrono::steady_clock::now();
+	VkResult result = vkCreateGraphicsPipelines(device, pipelineCache.threadCache(), 1, &pipelineInfo, m_context.allocationCallbacks(), &pipeline);
+	pipelineCache.recordCreation(std::chrono::steady_clock::now() - start);
+
+	vkDestroyShaderModule(device, fragmentShader, m_context.allocationCallbacks());
+	vkDestroyShaderModule(device, vertexShader, m_context.allocationCallbacks());
+	vkCheck(result, "vkCreateGraphicsPipelines");
+	return pipeline;
+}
+
+void SpritePipeline::bind(VkCommandBuffer commandBuffer, VkExtent2D extent) const {
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+	m_bindless.bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+	VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+	VkRect2D scissor{ { 0, 0 }, extent };
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void SpritePipeline::draw(VkCommandBuffer commandBuffer, const SpriteConstants& sprite) const {
+	vkCmdPushConstants(commandBuffer, m_bindless.pipelineLayout(), VK_SHADER_STAGE_ALL, 0, sizeof(SpriteConstants), &sprite);
+	vkCmdDraw(commandBuffer, 4, 1, 0, 0);
+}
+
+}
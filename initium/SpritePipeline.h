@@ -0,0 +1,65 @@
+#pragma once
+
+#include "BindlessTable.h"
+#include "PipelineCache.h"
+#include "ShaderReloader.h"
+#include "VulkanContext.h"
+
+#include <filesystem>
+
+namespace initium {
+
+// Push constants of shaders/sprite.vert and sprite.frag, in clip space.
+// The texture, tinted by color, is looked up in the bindless table.
+struct SpriteConstants {
+	float center[2];
+	float halfSize[2];
+	float color[4];
+	BindlessTexture texture;
+	BindlessSampler sampler;
+};
+
+// Textured quads drawn one per vkCmdDraw with everything in push constants,
+// textures included as bindless handles: the cheapest possible draw, so a
+// frame can issue tens of thousands of them and the cost that shows is
+// recording, not the GPU. Rendered with dynamic rendering into a single
+// colour attachment.
+class SpritePipeline {
+public:
+	SpritePipeline(const VulkanContext& context, PipelineCache& pipelineCache, const BindlessTable& bindless, VkFormat colorFormat,
+		const std::filesystem::path& shaderDirectory = "shaders");
+	~SpritePipeline();
+
+	SpritePipeline(const SpritePipeline&) = delete;
+	SpritePipeline& operator=(const SpritePipeline&) = delete;
+
+	VkPipeline pipeline() const { return m_pipeline; }
+	VkPipelineLayout layout() const { return m_bindless.pipelineLayout(); }
+	VkFormat colorFormat() const { return m_colorFormat; }
+	// For pipeline and inheritance rendering infos, which take an array.
+	const VkFormat* colorFormatPointer() const { return &m_colorFormat; }
+
+	// Binds the pipeline and the bindless table and sets the dynamic viewport
+	// and scissor. Must be repeated in every secondary command buffer: they
+	// inherit none of it.
+	void bind(VkCommandBuffer commandBuffer, VkExtent2D extent) const;
+	void draw(VkCommandBuffer commandBuffer, const SpriteConstants& sprite) const;
+
+	// Rebuilds the pipeline when the sprite shaders change.
+	void watchShaders(ShaderReloader& reloader, PipelineCache& pipelineCache);
+
+private:
+	VkPipeline createPipeline(PipelineCache& pipelineCache) const;
+
+	const VulkanContext& m_context;
+	const BindlessTable& m_bindless;
+	VkFormat m_colorFormat;
+	std::filesystem::path m_shaderDirectory;
+	VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
+
+// Reads a compiled SPIR-V file and creates a shader module from it.
+// Throws std::runtime_error if the file is missing or malformed.
+VkShaderModule loadShaderModule(const VulkanContext& context, const std::filesystem::path& path);
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace initium {
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Capacity must be a power of two; one slot is kept free to tell full from
+// empty, so it holds Capacity - 1 items.
+template <typename T, size_t Capacity>
+class SpscQueue {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+	bool push(T value) {
+		size_t head = m_head.load(std::memory_order_relaxed);
+		size_t next = (head + 1) & (Capacity - 1);
+		if (next == m_tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		m_items[head] = std::move(value);
+		m_head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	std::optional<T> pop() {
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire)) {
+			return std::nullopt;
+		}
+		std::optional<T> value(std::move(m_items[tail]));
+		m_items[tail] = T();
+		m_tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+		return value;
+	}
+
+	bool empty() const {
+		return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+	}
+
+private:
+	T m_items[Capacity] = {};
+	alignas(64) std::atomic<size_t> m_head{ 0 };
+	alignas(64) std::atomic<size_t> m_tail{ 0 };
+};
+
+}
@@ -0,0 +1,410 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace initium {
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+double gigabytesPerSecond(uint64_t bytes, double seconds) {
+	return seconds > 0.0 ? static_cast<double>(bytes) / seconds / 1e9 : 0.0;
+}
+
+}
+
+StagingRing::StagingRing(const VulkanContext& context, GpuAllocator& allocator, VkDeviceSize capacity)
+	: m_context(context), m_allocator(allocator), m_transferFamily(context.queueFamilies().transfer.family), m_capacity(capacity) {
+	VkDevice device = context.device();
+
+	VkBufferCreateInfo bufferInfo{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.size = capacity;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	m_buffer = allocator.createBuffer(bufferInfo, { MemoryUsage::Upload });
+	m_mapped = static_cast<uint8_t*>(m_buffer.allocation.mapped);
+
+	VkCommandPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = m_transferFamily;
+	vkCheck(vkCreateCommandPool(device, &poolInfo, m_context.allocationCallbacks(), &m_commandPool), "vkCreateCommandPool");
+
+	VkCommandBufferAllocateInfo allocateInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	allocateInfo.commandPool = m_commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+	for (Batch& batch : m_batches) {
+		vkCheck(vkAllocateCommandBuffers(device, &allocateInfo, &batch.commandBuffer), "vkAllocateCommandBuffers");
+	}
+
+	VkSemaphoreTypeCreateInfo typeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	semaphoreInfo.pNext = &typeInfo;
+	vkCheck(vkCreateSemaphore(device, &semaphoreInfo, m_context.allocationCallbacks(), &m_timeline), "vkCreateSemaphore");
+
+	// Queries are reset from the host because transfer-only queues can't
+	// run vkCmdResetQueryPool.
+	if (context.features().hostQueryReset && context.queueFamilies().transfer.timestampValidBits > 0) {
+		VkQueryPoolCreateInfo queryInfo{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryInfo.queryCount = kBatchCount * 2;
+		vkCheck(vkCreateQueryPool(device, &queryInfo, m_context.allocationCallbacks(), &m_timestamps), "vkCreateQueryPool");
+		m_timestampPeriod = context.properties().limits.timestampPeriod;
+	}
+}
+
+StagingRing::~StagingRing() {
+	waitIdle();
+
+	VkDevice device = m_context.device();
+	if (m_timestamps) {
+		vkDestroyQueryPool(device, m_timestamps, m_context.allocationCallbacks());
+	}
+	vkDestroySemaphore(device, m_timeline, m_context.allocationCallbacks());
+	vkDestroyCommandPool(device, m_commandPool, m_context.allocationCallbacks());
+	m_allocator.destroyBuffer(m_buffer);
+}
+
+StagingAllocation StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+	if (size == 0) {
+		return {};
+	}
+	if (size > m_capacity) {
+		throw std::runtime_error("staging allocation larger than the ring");
+	}
+	alignment = std::max<VkDeviceSize>(alignment, 1);
+
+	retire(false);
+	if (m_head == m_tail) {
+		// Nothing pending: restart at the front instead of wrapping later.
+		m_head = m_tail = alignUp(m_head, m_capacity);
+	}
+
+	while (true) {
+		uint64_t start = alignUp(m_head, alignment);
+		if (start % m_capacity + size > m_capacity) {
+			start = alignUp(start, m_capacity);
+		}
+		if (start + size - m_tail <= m_capacity) {
+			m_head = start + size;
+			Batch& batch = recordingBatch();
+			batch.ringEnd = m_head;
+			batch.bytes += size;
+
+			VkDeviceSize offset = start % m_capacity;
+			return { m_buffer.buffer, offset, size, m_mapped + offset };
+		}
+
+		// The GPU hasn't caught up with the ring yet.
+		auto stallStart = std::chrono::steady_clock::now();
+		m_stats.stalls++;
+		if (!m_batches[m_oldest].inFlight) {
+			flush();
+		}
+		retire(true);
+		if (m_head == m_tail) {
+			m_head = m_tail = alignUp(m_head, m_capacity);
+		}
+		m_stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stallStart).count();
+	}
+}
+
+void StagingRing::copyToBuffer(const StagingAllocation& source, VkBuffer destination, VkDeviceSize destinationOffset, uint32_t destinationFamily) {
+	Batch& batch = recordingBatch();
+
+	VkBufferCopy2 region{ VK_STRUCTURE_TYPE_BUFFER_COPY_2 };
+	region.srcOffset = source.offset;
+	region.dstOffset = destinationOffset;
+	region.size = source.size;
+
+	VkCopyBufferInfo2 copyInfo{ VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2 };
+	copyInfo.srcBuffer = source.buffer;
+	copyInfo.dstBuffer = destination;
+	copyInfo.regionCount = 1;
+	copyInfo.pRegions = &region;
+	vkCmdCopyBuffer2(batch.commandBuffer, &copyInfo);
+
+	// Within a family the timeline wait alone makes the copy visible.
+	if (needsOwnershipTransfer(destinationFamily)) {
+		PostCopyBarrier release;
+		release.buffer.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		release.buffer.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		release.buffer.srcQueueFamilyIndex = m_transferFamily;
+		release.buffer.dstQueueFamilyIndex = destinationFamily;
+		release.buffer.buffer = destination;
+		release.buffer.offset = destinationOffset;
+		release.buffer.size = source.size;
+		m_postCopyBarriers.push_back(release);
+	}
+}
+
+void StagingRing::copyToImage(const StagingAllocation& source, VkImage destination, const VkImageSubresourceLayers& subresource, VkExtent3D extent,
+	VkImageLayout finalLayout, uint32_t destinationFamily) {
+	Batch& batch = recordingBatch();
+
+	VkImageMemoryBarrier2 toTransfer{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	toTransfer.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	toTransfer.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	toTransfer.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	toTransfer.image = destination;
+	toTransfer.subresourceRange = { subresource.aspectMask, subresource.mipLevel, 1, subresource.baseArrayLayer, subresource.layerCount };
+
+	VkDependencyInfo dependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependency.imageMemoryBarrierCount = 1;
+	dependency.pImageMemoryBarriers = &toTransfer;
+	vkCmdPipelineBarrier2(batch.commandBuffer, &dependency);
+
+	VkBufferImageCopy2 region{ VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2 };
+	region.bufferOffset = source.offset;
+	region.imageSubresource = subresource;
+	region.imageExtent = extent;
+
+	VkCopyBufferToImageInfo2 copyInfo{ VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2 };
+	copyInfo.srcBuffer = source.buffer;
+	copyInfo.dstImage = destination;
+	copyInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	copyInfo.regionCount = 1;
+	copyInfo.pRegions = &region;
+	vkCmdCopyBufferToImage2(batch.commandBuffer, &copyInfo);
+
+	// The final layout transition happens here either way; across families
+	// it doubles as the release.
+	PostCopyBarrier release;
+	release.isImage = true;
+	release.image = toTransfer;
+	release.image.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	release.image.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	release.image.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	release.image.dstAccessMask = VK_ACCESS_2_NONE;
+	release.image.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	release.image.newLayout = finalLayout;
+	if (needsOwnershipTransfer(destinationFamily)) {
+		release.image.srcQueueFamilyIndex = m_transferFamily;
+		release.image.dstQueueFamilyIndex = destinationFamily;
+	}
+	m_postCopyBarriers.push_back(release);
+}
+
+void StagingRing::upload(VkBuffer destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size, uint32_t destinationFamily) {
+	StagingAllocation allocation = allocate(size);
+	if (!allocation) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::memcpy(allocation.mapped, data, size);
+	m_stats.cpuWriteSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_stats.cpuWrittenBytes += size;
+
+	copyToBuffer(allocation, destination, destinationOffset, destinationFamily);
+}
+
+bool StagingRing::flush() {
+	Batch& batch = m_batches[m_current];
+	if (!batch.recording) {
+		return false;
+	}
+
+	if (!m_postCopyBarriers.empty()) {
+		std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+		std::vector<VkImageMemoryBarrier2> imageBarriers;
+		for (const PostCopyBarrier& barrier : m_postCopyBarriers) {
+			if (barrier.isImage) {
+				imageBarriers.push_back(barrier.image);
+			} else {
+				bufferBarriers.push_back(barrier.buffer);
+			}
+			uint32_t releasedTo = barrier.isImage ? barrier.image.dstQueueFamilyIndex : barrier.buffer.dstQueueFamilyIndex;
+			if (releasedTo != VK_QUEUE_FAMILY_IGNORED) {
+				m_pendingAcquires.push_back(barrier);
+			}
+		}
+		m_postCopyBarriers.clear();
+
+		VkDependencyInfo dependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		dependency.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+		dependency.pBufferMemoryBarriers = bufferBarriers.data();
+		dependency.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+		dependency.pImageMemoryBarriers = imageBarriers.data();
+		vkCmdPipelineBarrier2(batch.commandBuffer, &dependency);
+	}
+
+	if (m_timestamps) {
+		vkCmdWriteTimestamp2(batch.commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, m_timestamps, m_current * 2 + 1);
+	}
+	vkCheck(vkEndCommandBuffer(batch.commandBuffer), "vkEndCommandBuffer");
+
+	batch.timelineValue = ++m_submittedValue;
+
+	VkCommandBufferSubmitInfo commandBufferInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+	commandBufferInfo.commandBuffer = batch.commandBuffer;
+
+	VkSemaphoreSubmitInfo signalInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+	signalInfo.semaphore = m_timeline;
+	signalInfo.value = batch.timelineValue;
+	signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo2 submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandBufferInfo;
+	submitInfo.signalSemaphoreInfoCount = 1;
+	submitInfo.pSignalSemaphoreInfos = &signalInfo;
+	vkCheck(vkQueueSubmit2(m_context.transferQueue(), 1, &submitInfo, VK_NULL_HANDLE), "vkQueueSubmit2");
+
+	batch.recording = false;
+	batch.inFlight = true;
+	m_stats.batches++;
+	m_stats.bytes += batch.bytes;
+	m_current = (m_current + 1) % kBatchCount;
+	return true;
+}
+
+VkSemaphoreSubmitInfo StagingRing::waitInfo() const {
+	VkSemaphoreSubmitInfo info{ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+	info.semaphore = m_timeline;
+	info.value = m_submittedValue;
+	info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	return info;
+}
+
+void StagingRing::recordAcquires(VkCommandBuffer commandBuffer, uint32_t family) {
+	std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+	std::vector<VkImageMemoryBarrier2> imageBarriers;
+
+	auto acquired = std::remove_if(m_pendingAcquires.begin(), m_pendingAcquires.end(), [&](const PostCopyBarrier& release) {
+		if (release.isImage) {
+			if (release.image.dstQueueFamilyIndex != family) {
+				return false;
+			}
+			VkImageMemoryBarrier2 acquire = release.image;
+			acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+			acquire.srcAccessMask = VK_ACCESS_2_NONE;
+			acquire.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			acquire.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+			imageBarriers.push_back(acquire);
+		} else {
+			if (release.buffer.dstQueueFamilyIndex != family) {
+				return false;
+			}
+			VkBufferMemoryBarrier2 acquire = release.buffer;
+			acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+			acquire.srcAccessMask = VK_ACCESS_2_NONE;
+			acquire.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			acquire.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+			bufferBarriers.push_back(acquire);
+		}
+		return true;
+	});
+	m_pendingAcquires.erase(acquired, m_pendingAcquires.end());
+
+	if (bufferBarriers.empty() && imageBarriers.empty()) {
+		return;
+	}
+
+	VkDependencyInfo dependency{ VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	dependency.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+	dependency.pBufferMemoryBarriers = bufferBarriers.data();
+	dependency.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+	dependency.pImageMemoryBarriers = imageBarriers.data();
+	vkCmdPipelineBarrier2(commandBuffer, &dependency);
+}
+
+void StagingRing::waitIdle() {
+	while (m_batches[m_oldest].inFlight) {
+		retire(true);
+	}
+}
+
+void StagingRing::reportStats() const {
+	std::printf("staging ring: %.1f MiB uploaded in %llu batches, %llu stalls (%.2f ms)\n",
+		static_cast<double>(m_stats.bytes) / (1 << 20), static_cast<unsigned long long>(m_stats.batches),
+		static_cast<unsigned long long>(m_stats.stalls), m_stats.stallSeconds * 1000.0);
+	if (m_stats.bytes == 0) {
+		return;
+	}
+	std::printf("staging ring: CPU write %.2f GB/s, GPU copy ", gigabytesPerSecond(m_stats.cpuWrittenBytes, m_stats.cpuWriteSeconds));
+	if (m_timestamps) {
+		std::printf("%.2f GB/s\n", gigabytesPerSecond(m_stats.gpuTimedBytes, m_stats.gpuCopySeconds));
+	} else {
+		std::printf("not measured (no transfer-queue timestamps)\n");
+	}
+}
+
+StagingRing::Batch& StagingRing::recordingBatch() {
+	Batch& batch = m_batches[m_current];
+	if (batch.recording) {
+		return batch;
+	}
+	// Batches are reused round-robin, so this one is the oldest in flight.
+	while (batch.inFlight) {
+		retire(true);
+	}
+
+	VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkCheck(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo), "vkBeginCommandBuffer");
+	if (m_timestamps) {
+		vkResetQueryPool(m_context.device(), m_timestamps, m_current * 2, 2);
+		vkCmdWriteTimestamp2(batch.commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, m_timestamps, m_current * 2);
+	}
+
+	batch.recording = true;
+	batch.bytes = 0;
+	batch.ringEnd = m_head;
+	return batch;
+}
+
+void StagingRing::retire(bool block) {
+	VkDevice device = m_context.device();
+	if (block && m_batches[m_oldest].inFlight && m_batches[m_oldest].timelineValue > m_completedValue) {
+		uint64_t value = m_batches[m_oldest].timelineValue;
+		VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &m_timeline;
+		waitInfo.pValues = &value;
+		vkCheck(vkWaitSemaphores(device, &waitInfo, UINT64_MAX), "vkWaitSemaphores");
+	}
+
+	vkCheck(vkGetSemaphoreCounterValue(device, m_timeline, &m_completedValue), "vkGetSemaphoreCounterValue");
+	while (m_batches[m_oldest].inFlight && m_batches[m_oldest].timelineValue <= m_completedValue) {
+		retireBatch(m_oldest);
+		m_oldest = (m_oldest + 1) % kBatchCount;
+	}
+}
+
+void StagingRing::retireBatch(uint32_t index) {
+	Batch& batch = m_batches[index];
+	m_tail = batch.ringEnd;
+	batch.inFlight = false;
+
+	if (m_timestamps) {
+		uint64_t ticks[2] = {};
+		VkResult result = vkGetQueryPoolResults(m_context.device(), m_timestamps, index * 2, 2, sizeof(ticks), ticks, sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+		if (result == VK_SUCCESS) {
+			uint32_t validBits = m_context.queueFamilies().transfer.timestampValidBits;
+			uint64_t mask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+			uint64_t elapsed = (ticks[1] - ticks[0]) & mask;
+			m_stats.gpuCopySeconds += static_cast<double>(elapsed) * m_timestampPeriod * 1e-9;
+			m_stats.gpuTimedBytes += batch.bytes;
+		}
+	}
+}
+
+bool StagingRing::needsOwnershipTransfer(uint32_t destinationFamily) const {
+	return destinationFamily != VK_QUEUE_FAMILY_IGNORED && destinationFamily != m_transferFamily;
+}
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "GpuAllocator.h"
+#include "VulkanContext.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace initium {
+
+struct StagingAllocation {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	// Usually write-combined: fill it sequentially and never read it back.
+	void* mapped = nullptr;
+
+	explicit operator bool() const { return mapped != nullptr; }
+};
+
+struct StagingStats {
+	uint64_t bytes = 0;
+	uint64_t batches = 0;
+	// Bytes and time upload() spent copying into the mapped ring, and the GPU
+	// time of the copies from transfer-queue timestamps (zero when the queue
+	// has no timestamps).
+	uint64_t cpuWrittenBytes = 0;
+	double cpuWriteSeconds = 0.0;
+	double gpuCopySeconds = 0.0;
+	uint64_t gpuTimedBytes = 0;
+	// Times an allocation had to wait for the GPU to free ring space.
+	uint64_t stalls = 0;
+	double stallSeconds = 0.0;
+};
+
+// Upload path for buffer and image data. Source data is bump-allocated from
+// one persistently mapped host-visible buffer used as a ring, and the copies
+// are recorded for the dedicated transfer queue, so uploads neither create
+// Vulkan objects nor stall the graphics queue. Ring space is reclaimed as
+// the transfer timeline passes each batch.
+//
+// When the transfer queue is in another family, ownership of each
+// destination is released on the transfer queue and has to be acquired by
+// its consumer with recordAcquires() in a submission that waits on
+// waitInfo(). Not thread-safe: lives on the render thread with the Renderer.
+class StagingRing {
+public:
+	StagingRing(const VulkanContext& context, GpuAllocator& allocator, VkDeviceSize capacity);
+	~StagingRing();
+
+	StagingRing(const StagingRing&) = delete;
+	StagingRing& operator=(const StagingRing&) = delete;
+
+	// Space for size bytes in the ring. Blocks on the transfer timeline if
+	// the ring is full; throws if size exceeds the capacity. Record the copy
+	// out of an allocation before making the next one: a full ring flushes
+	// the current batch, after which earlier space can be recycled.
+	StagingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+	// Record a copy out of an allocation from this ring. destinationFamily
+	// is the queue family that will use the resource; for images the
+	// subresource ends up in finalLayout.
+	void copyToBuffer(const StagingAllocation& source, VkBuffer destination, VkDeviceSize destinationOffset, uint32_t destinationFamily);
+	void copyToImage(const StagingAllocation& source, VkImage destination, const VkImageSubresourceLayers& subresource, VkExtent3D extent,
+		VkImageLayout finalLayout, uint32_t destinationFamily);
+
+	// allocate() + memcpy + copyToBuffer(), timed for the throughput stats.
+	void upload(VkBuffer destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size, uint32_t destinationFamily);
+
+	// Submits the copies recorded so far to the transfer queue. Returns false
+	// if there was nothing to submit.
+	bool flush();
+
+	// Wait for everything flushed so far; add it to the consuming submit.
+	VkSemaphoreSubmitInfo waitInfo() const;
+	uint64_t submittedValue() const { return m_submittedValue; }
+
+	// Records the acquire half of the ownership transfers flushed so far for
+	// destinations used by family.
+	void recordAcquires(VkCommandBuffer commandBuffer, uint32_t family);
+
+	// Blocks until every flushed batch has completed.
+	void waitIdle();
+
+	VkDeviceSize capacity() const { return m_capacity; }
+	const StagingStats& stats() const { return m_stats; }
+	void reportStats() const;
+
+private:
+	static constexpr uint32_t kBatchCount = 8;
+
+	struct Batch {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint64_t timelineValue = 0;
+		// Monotonic ring position just past the batch's last allocation.
+		uint64_t ringEnd = 0;
+		VkDeviceSize bytes = 0;
+		bool recording = false;
+		bool inFlight = false;
+	};
+
+	// Barrier recorded on the transfer queue after the batch's copies: a
+	// layout transition, an ownership release, or both. Releases are
+	// replayed as acquires on the destination family.
+	struct PostCopyBarrier {
+		bool isImage = false;
+		VkBufferMemoryBarrier2 buffer{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+		VkImageMemoryBarrier2 image{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+	};
+
+	Batch& recordingBatch();
+	void retire(bool block);
+	void retireBatch(uint32_t index);
+	bool needsOwnershipTransfer(uint32_t destinationFamily) const;
+
+	const VulkanContext& m_context;
+	GpuAllocator& m_allocator;
+	uint32_t m_transferFamily;
+
+	GpuBuffer m_buffer;
+	uint8_t* m_mapped = nullptr;
+	VkDeviceSize m_capacity;
+	// Monotonic byte positions; the physical offset is position % capacity.
+	uint64_t m_head = 0;
+	uint64_t m_tail = 0;
+
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	VkSemaphore m_timeline = VK_NULL_HANDLE;
+	uint64_t m_submittedValue = 0;
+	uint64_t m_completedValue = 0;
+
+	Batch m_batches[kBatchCount];
+	uint32_t m_current = 0;
+	// Oldest batch still in flight.
+	uint32_t m_oldest = 0;
+
+	std::vector<PostCopyBarrier> m_postCopyBarriers;
+	std::vector<PostCopyBarrier> m_pendingAcquires;
+
+	VkQueryPool m_timestamps = VK_NULL_HANDLE;
+	double m_timestampPeriod = 0.0;
+
+	StagingStats m_stats;
+};
+
+}
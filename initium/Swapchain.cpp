@@ -0,0 +1,298 @@
+#include "Swapchain.h"
+
+#define GLFW_INCLUDE_VULKAN
+#include "glfw/include/GLFW/glfw3.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace initium {
+
+namespace {
+
+const VkImageUsageFlags kImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+VkSurfaceFormatKHR chooseSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats) {
+	for (const VkSurfaceFormatKHR& format : formats) {
+		if ((format.format == VK_FORMAT_B8G8R8A8_SRGB || format.format == VK_FORMAT_R8G8B8A8_SRGB)
+			&& format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+			return format;
+		}
+	}
+	return formats.front();
+}
+
+// The modes a policy asks for, in the order it tries them; anything else it
+// ends up with is a fallback.
+const char* policyModes(PresentPolicy policy) {
+	switch (policy) {
+	case PresentPolicy::LowLatency: return "MAILBOX or IMMEDIATE";
+	case PresentPolicy::Balanced: return "FIFO_RELAXED";
+	case PresentPolicy::PowerSaving: return "FIFO";
+	}
+	return "FIFO";
+}
+
+bool meetsPolicy(PresentPolicy policy, VkPresentModeKHR mode) {
+	switch (policy) {
+	case PresentPolicy::LowLatency: return mode == VK_PRESENT_MODE_MAILBOX_KHR || mode == VK_PRESENT_MODE_IMMEDIATE_KHR;
+	case PresentPolicy::Balanced: return mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+	case PresentPolicy::PowerSaving: return mode == VK_PRESENT_MODE_FIFO_KHR;
+	}
+	return true;
+}
+
+}
+
+const char* presentModeName(VkPresentModeKHR mode) {
+	switch (mode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+	case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+	default: return "unknown";
+	}
+}
+
+Swapchain::Swapchain(const VulkanContext& context, GLFWwindow* window, PresentPolicy policy)
+	: m_context(context), m_policy(policy) {
+	vkCheck(glfwCreateWindowSurface(context.instance(), window, context.allocationCallbacks(), &m_surface), "glfwCreateWindowSurface");
+
+	VkBool32 supported = VK_FALSE;
+	vkGetPhysicalDeviceSurfaceSupportKHR(context.physicalDevice(), context.queueFamilies().graphics.family, m_surface, &supported);
+	if (!supported) {
+		vkDestroySurfaceKHR(context.instance(), m_surface, context.allocationCallbacks());
+		throw std::runtime_error("the graphics queue cannot present to the window surface");
+	}
+}
+
+Swapchain::~Swapchain() {
+	VkDevice device = m_context.device();
+	for (Retired& retired : m_retired) {
+		destroyRetired(retired);
+	}
+	for (VkImageView view : m_imageViews) {
+		vkDestroyImageView(device, view, m_context.allocationCallbacks());
+	}
+	for (VkSemaphore semaphore : m_renderFinished) {
+		vkDestroySemaphore(device, semaphore, m_context.allocationCallbacks());
+	}
+	if (m_swapchain) {
+		vkDestroySwapchainKHR(device, m_swapchain, m_context.allocationCallbacks());
+	}
+	vkDestroySurfaceKHR(m_context.instance(), m_surface, m_context.allocationCallbacks());
+}
+
+void Swapchain::setPolicy(PresentPolicy policy) {
+	if (policy != m_policy) {
+		m_policy = policy;
+		m_fallbackWarned = false;
+		m_dirty.store(true, std::memory_order_release);
+	}
+}
+
+bool Swapchain::acquire(VkExtent2D framebufferSize, VkSemaphore imageAvailable, uint64_t frameSerial, uint32_t& imageIndex) {
+	if (framebufferSize.width == 0 || framebufferSize.height == 0) {
+		return false;
+	}
+
+	for (int attempt = 0; attempt < 2; attempt++) {
+		if (m_dirty.exchange(false, std::memory_order_acq_rel) || !m_swapchain) {
+			recreate(framebufferSize, frameSerial);
+			if (!m_swapchain) {
+				return false;
+			}
+		}
+
+		VkResult result = vkAcquireNextImageKHR(m_context.device(), m_swapchain, UINT64_MAX, imageAvailable, VK_NULL_HANDLE, &imageIndex);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			m_dirty.store(true, std::memory_order_release);
+			continue;
+		}
+		if (result == VK_SUBOPTIMAL_KHR) {
+			// Still presentable; rebuild at the next opportunity.
+			m_dirty.store(true, std::memory_order_release);
+			return true;
+		}
+		vkCheck(result, "vkAcquireNextImageKHR");
+		return true;
+	}
+	return false;
+}
+
+void Swapchain::present(VkQueue queue, uint32_t imageIndex) {
+	VkPresentInfoKHR presentInfo{ VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &m_renderFinished[imageIndex];
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = &m_swapchain;
+	presentInfo.pImageIndices = &imageIndex;
+
+	VkResult result = vkQueuePresentKHR(queue, &presentInfo);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+		m_dirty.store(true, std::memory_order_release);
+		return;
+	}
+	vkCheck(result, "vkQueuePresentKHR");
+}
+
+void Swapchain::releaseRetired(uint64_t completedSerial) {
+	auto done = std::remove_if(m_retired.begin(), m_retired.end(), [&](Retired& retired) {
+		if (retired.lastSerial > completedSerial) {
+			return false;
+		}
+		destroyRetired(retired);
+		return true;
+	});
+	m_retired.erase(done, m_retired.end());
+}
+
+void Swapchain::recreate(VkExtent2D framebufferSize, uint64_t frameSerial) {
+	VkPhysicalDevice physicalDevice = m_context.physicalDevice();
+	VkDevice device = m_context.device();
+
+	VkSurfaceCapabilitiesKHR capabilities;
+	vkCheck(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, m_surface, &capabilities), "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+
+	VkExtent2D extent = capabilities.currentExtent;
+	if (extent.width == UINT32_MAX) {
+		extent.width = std::clamp(framebufferSize.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+		extent.height = std::clamp(framebufferSize.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+	}
+	if (extent.width == 0 || extent.height == 0) {
+		// Minimised between the resize and now; try again once it has a size.
+		m_dirty.store(true, std::memory_order_release);
+		return;
+	}
+
+	uint32_t formatCount = 0;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, m_surface, &formatCount, nullptr);
+	std::vector<VkSurfaceFormatKHR> formats(formatCount);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, m_surface, &formatCount, formats.data());
+	VkSurfaceFormatKHR surfaceFormat = chooseSurfaceFormat(formats);
+
+	VkPresentModeKHR presentMode = choosePresentMode();
+	// Once per policy rather than on every resize. A benchmark that silently
+	// ends up vsynced measures the display, not the renderer.
+	if (!m_fallbackWarned && !meetsPolicy(m_policy, presentMode)) {
+		std::fprintf(stderr, "swapchain: surface has no %s present mode, falling back to %s\n", policyModes(m_policy),
+			presentModeName(presentMode));
+		m_fallbackWarned = true;
+	}
+
+	// One image more than the minimum so acquire rarely blocks on the
+	// presentation engine; mailbox needs a third to actually replace frames.
+	uint32_t imageCount = capabilities.minImageCount + 1;
+	if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+		imageCount = std::max(imageCount, 3u);
+	}
+	if (capabilities.maxImageCount > 0) {
+		imageCount = std::min(imageCount, capabilities.maxImageCount);
+	}
+
+	VkSwapchainCreateInfoKHR swapchainInfo{ VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR };
+	swapchainInfo.surface = m_surface;
+	swapchainInfo.minImageCount = imageCount;
+	swapchainInfo.imageFormat = surfaceFormat.format;
+	swapchainInfo.imageColorSpace = surfaceFormat.colorSpace;
+	swapchainInfo.imageExtent = extent;
+	swapchainInfo.imageArrayLayers = 1;
+	swapchainInfo.imageUsage = kImageUsage & capabilities.supportedUsageFlags;
+	swapchainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	swapchainInfo.preTransform = capabilities.currentTransform;
+	swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	swapchainInfo.presentMode = presentMode;
+	swapchainInfo.clipped = VK_TRUE;
+	// Handing over the old swapchain lets the driver reuse its resources and
+	// keep presenting already queued frames, so nothing has to be drained.
+	swapchainInfo.oldSwapchain = m_swapchain;
+
+	VkSwapchainKHR swapchain;
+	vkCheck(vkCreateSwapchainKHR(device, &swapchainInfo, m_context.allocationCallbacks(), &swapchain), "vkCreateSwapchainKHR");
+
+	if (m_swapchain) {
+		Retired retired;
+		retired.swapchain = m_swapchain;
+		retired.imageViews = std::move(m_imageViews);
+		retired.renderFinished = std::move(m_renderFinished);
+		retired.lastSerial = frameSerial - 1;
+		m_retired.push_back(std::move(retired));
+		m_imageViews.clear();
+		m_renderFinished.clear();
+	}
+
+	m_swapchain = swapchain;
+	m_format = surfaceFormat.format;
+	m_colorSpace = surfaceFormat.colorSpace;
+	m_extent = extent;
+	m_presentMode = presentMode;
+	m_recreationCount++;
+
+	uint32_t count = 0;
+	vkCheck(vkGetSwapchainImagesKHR(device, m_swapchain, &count, nullptr), "vkGetSwapchainImagesKHR");
+	m_images.resize(count);
+	vkCheck(vkGetSwapchainImagesKHR(device, m_swapchain, &count, m_images.data()), "vkGetSwapchainImagesKHR");
+
+	for (VkImage image : m_images) {
+		VkImageViewCreateInfo viewInfo{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = m_format;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+		VkImageView view;
+		vkCheck(vkCreateImageView(device, &viewInfo, m_context.allocationCallbacks(), &view), "vkCreateImageView");
+		m_imageViews.push_back(view);
+
+		VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		VkSemaphore semaphore;
+		vkCheck(vkCreateSemaphore(device, &semaphoreInfo, m_context.allocationCallbacks(), &semaphore), "vkCreateSemaphore");
+		m_renderFinished.push_back(semaphore);
+	}
+
+	std::printf("swapchain: %ux%u, %u images, %s\n", m_extent.width, m_extent.height, count, presentModeName(m_presentMode));
+}
+
+VkPresentModeKHR Swapchain::choosePresentMode() const {
+	uint32_t count = 0;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(m_context.physicalDevice(), m_surface, &count, nullptr);
+	std::vector<VkPresentModeKHR> modes(count);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(m_context.physicalDevice(), m_surface, &count, modes.data());
+
+	auto supports = [&modes](VkPresentModeKHR mode) {
+		return std::find(modes.begin(), modes.end(), mode) != modes.end();
+	};
+
+	switch (m_policy) {
+	case PresentPolicy::LowLatency:
+		if (supports(VK_PRESENT_MODE_MAILBOX_KHR)) {
+			return VK_PRESENT_MODE_MAILBOX_KHR;
+		}
+		if (supports(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+			return VK_PRESENT_MODE_IMMEDIATE_KHR;
+		}
+		[[fallthrough]];
+	case PresentPolicy::Balanced:
+		if (supports(VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+			return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+		}
+		[[fallthrough]];
+	case PresentPolicy::PowerSaving:
+		break;
+	}
+	// FIFO is the only mode every implementation must support.
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void Swapchain::destroyRetired(Retired& retired) {
+	VkDevice device = m_context.device();
+	for (VkImageView view : retired.imageViews) {
+		vkDestroyImageView(device, view, m_context.allocationCallbacks());
+	}
+	for (VkSemaphore semaphore : retired.renderFinished) {
+		vkDestroySemaphore(device, semaphore, m_context.allocationCallbacks());
+	}
+	vkDestroySwapchainKHR(device, retired.swapchain, m_context.allocationCallbacks());
+}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "VulkanContext.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+struct GLFWwindow;
+
+namespace initium {
+
+// Latency versus power trade-off used to pick a present mode from what the
+// surface supports.
+enum class PresentPolicy {
+	// MAILBOX, then IMMEDIATE: never waits for vblank, may tear on IMMEDIATE.
+	LowLatency,
+	// FIFO_RELAXED: vsynced, but a late frame tears instead of stalling.
+	Balanced,
+	// FIFO: strictly vsynced, the GPU idles between frames.
+	PowerSaving,
+};
+
+const char* presentModeName(VkPresentModeKHR mode);
+
+class Swapchain {
+public:
+	Swapchain(const VulkanContext& context, GLFWwindow* window, PresentPolicy policy);
+	~Swapchain();
+
+	Swapchain(const Swapchain&) = delete;
+	Swapchain& operator=(const Swapchain&) = delete;
+
+	// Thread-safe. Flags the swapchain for recreation before the next acquire.
+	void notifyResized() { m_dirty.store(true, std::memory_order_release); }
+
+	// Render thread only. Takes effect on the next acquire.
+	void setPolicy(PresentPolicy policy);
+	PresentPolicy policy() const { return m_policy; }
+
+	// Acquires the next image, recreating the swapchain first if it was
+	// flagged. Returns false when there is nothing to draw into: the
+	// framebuffer is 0x0 (minimised) or the surface is out of date and has
+	// to be rebuilt at the new size first. frameSerial identifies the frame
+	// about to be submitted, so replaced swapchains can be retired once it
+	// has completed instead of draining the queue.
+	bool acquire(VkExtent2D framebufferSize, VkSemaphore imageAvailable, uint64_t frameSerial, uint32_t& imageIndex);
+
+	// Presents on the given queue after renderFinished(imageIndex) signals.
+	void present(VkQueue queue, uint32_t imageIndex);
+
+	// Destroys swapchains replaced by recreation once every frame that may
+	// still reference them has completed.
+	void releaseRetired(uint64_t completedSerial);
+
+	VkSurfaceKHR surface() const { return m_surface; }
+	VkFormat format() const { return m_format; }
+	VkExtent2D extent() const { return m_extent; }
+	VkPresentModeKHR presentMode() const { return m_presentMode; }
+	uint32_t imageCount() const { return static_cast<uint32_t>(m_images.size()); }
+	VkImage image(uint32_t index) const { return m_images[index]; }
+	VkImageView imageView(uint32_t index) const { return m_imageViews[index]; }
+
+	// Signalled by the frame's submit and waited on by present. One per
+	// image, because a present can still be waiting on it when the same
+	// frame-in-flight slot comes round again.
+	VkSemaphore renderFinished(uint32_t index) const { return m_renderFinished[index]; }
+
+	uint64_t recreationCount() const { return m_recreationCount; }
+
+private:
+	struct Retired {
+		VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+		std::vector<VkImageView> imageViews;
+		std::vector<VkSemaphore> renderFinished;
+		uint64_t lastSerial = 0;
+	};
+
+	void recreate(VkExtent2D framebufferSize, uint64_t frameSerial);
+	VkPresentModeKHR choosePresentMode() const;
+	void destroyRetired(Retired& retired);
+
+	const VulkanContext& m_context;
+	VkSurfaceKHR m_surface = VK_NULL_HANDLE;
+	VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
+
+	PresentPolicy m_policy;
+	// The policy's modes were missing and that has been reported.
+	bool m_fallbackWarned = false;
+	VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	VkFormat m_format = VK_FORMAT_UNDEFINED;
+	VkColorSpaceKHR m_colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	VkExtent2D m_extent{};
+
+	std::vector<VkImage> m_images;
+	std::vector<VkImageView> m_imageViews;
+	std::vector<VkSemaphore> m_renderFinished;
+
+	std::vector<Retired> m_retired;
+	std::atomic<bool> m_dirty{ true };
+	uint64_t m_recreationCount = 0;
+};
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace initium {
+
+template <typename T>
+class Task;
+
+struct TaskPromiseBase {
+	// Coroutine awaiting this task, resumed by symmetric transfer when the
+	// task finishes so a chain of awaits never grows the stack.
+	std::coroutine_handle<> continuation;
+	std::exception_ptr exception;
+
+	struct FinalAwaiter {
+		bool await_ready() const noexcept { return false; }
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept {
+			std::coroutine_handle<> next = handle.promise().continuation;
+			return next ? next : std::noop_coroutine();
+		}
+
+		void await_resume() const noexcept {}
+	};
+
+	// Tasks are lazy: nothing runs until the task is awaited or spawned.
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	FinalAwaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() { exception = std::current_exception(); }
+
+	void rethrowIfFailed() const {
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+	std::optional<T> value;
+
+	Task<T> get_return_object();
+
+	template <typename U>
+	void return_value(U&& result) {
+		value.emplace(std::forward<U>(result));
+	}
+
+	T result() {
+		rethrowIfFailed();
+		return std::move(*value);
+	}
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+	Task<void> get_return_object();
+
+	void return_void() const noexcept {}
+
+	void result() const { rethrowIfFailed(); }
+};
+
+// Coroutine that produces a T. Awaiting a task starts it and resumes the
+// awaiting coroutine on whichever thread the task finishes on; exceptions
+// propagate to the awaiter. Run top-level tasks with TaskRuntime::spawn().
+template <typename T = void>
+class [[nodiscard]] Task {
+public:
+	using promise_type = TaskPromise<T>;
+
+	Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+
+	Task& operator=(Task&& other) noexcept {
+		if (this != &other) {
+			if (m_handle) {
+				m_handle.destroy();
+			}
+			m_handle = std::exchange(other.m_handle, {});
+		}
+		return *this;
+	}
+
+	~Task() {
+		if (m_handle) {
+			m_handle.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept { return false; }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+		m_handle.promise().continuation = awaiting;
+		return m_handle;
+	}
+
+	T await_resume() { return m_handle.promise().result(); }
+
+private:
+	friend struct TaskPromise<T>;
+
+	explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+	return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+	return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+}
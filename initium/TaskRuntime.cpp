@@ -0,0 +1,266 @@
+#include "TaskRuntime.h"
+
+#include "Profiler.h"
+
+#include <cstdio>
+#include <fstream>
+
+namespace initium {
+
+bool TaskRuntime::JobAwaiter::await_ready() const noexcept {
+	if (m_mainThread) {
+		return m_jobs.isMainThread();
+	}
+	return m_counter && m_counter->done();
+}
+
+void TaskRuntime::JobAwaiter::await_suspend(std::coroutine_handle<> handle) const {
+	// The job may resume the coroutine, and so destroy this awaiter, before
+	// submit returns: nothing here may touch members after it.
+	if (m_mainThread) {
+		m_jobs.submitMainThread([handle] { handle.resume(); });
+	} else {
+		m_jobs.submit([handle] { handle.resume(); }, nullptr, m_counter);
+	}
+}
+
+bool TaskRuntime::GpuAwaiter::await_ready() const {
+	uint64_t value = 0;
+	vkCheck(vkGetSemaphoreCounterValue(m_runtime.m_context.device(), m_timeline, &value), "vkGetSemaphoreCounterValue");
+	return value >= m_value;
+}
+
+void TaskRuntime::GpuAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	m_handle = handle;
+	m_runtime.addGpuWait(this);
+}
+
+void TaskRuntime::GpuAwaiter::await_resume() const {
+	vkCheck(m_result, "vkWaitSemaphores");
+}
+
+void TaskRuntime::FileReadAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	m_handle = handle;
+	m_runtime.addFileRead(this);
+}
+
+std::vector<uint8_t> TaskRuntime::FileReadAwaiter::await_resume() {
+	if (!m_error.empty()) {
+		throw std::runtime_error(m_error);
+	}
+	return std::move(m_data);
+}
+
+TaskRuntime::TaskRuntime(const VulkanContext& context, JobSystem& jobs) : m_context(context), m_jobs(jobs) {
+	VkSemaphoreTypeCreateInfo typeInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	semaphoreInfo.pNext = &typeInfo;
+	vkCheck(vkCreateSemaphore(context.device(), &semaphoreInfo, context.allocationCallbacks(), &m_wakeSemaphore), "vkCreateSemaphore");
+
+	m_gpuThread = std::thread(&TaskRuntime::gpuThreadMain, this);
+	m_ioThread = std::thread(&TaskRuntime::ioThreadMain, this);
+}
+
+TaskRuntime::~TaskRuntime() {
+	// Pending I/O still completes; the I/O thread drains its queue first.
+	{
+		std::lock_guard lock(m_ioMutex);
+		m_ioRunning = false;
+	}
+	m_ioCondition.notify_one();
+	m_ioThread.join();
+
+	{
+		std::lock_guard lock(m_gpuMutex);
+		m_gpuRunning = false;
+		VkSemaphoreSignalInfo signalInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO };
+		signalInfo.semaphore = m_wakeSemaphore;
+		signalInfo.value = ++m_wakeValue;
+		vkSignalSemaphore(m_context.device(), &signalInfo);
+	}
+	m_gpuThread.join();
+
+	m_jobs.wait(m_tasks);
+	vkDestroySemaphore(m_context.device(), m_wakeSemaphore, m_context.allocationCallbacks());
+}
+
+void TaskRuntime::spawn(Task<> task, JobCounter* counter) {
+	m_jobs.addPending(m_tasks);
+	if (counter) {
+		m_jobs.addPending(*counter);
+	}
+	m_spawned.fetch_add(1, std::memory_order_relaxed);
+
+	DetachedTask detached = runDetached(std::move(task), counter);
+	m_jobs.submit([handle = detached.handle] { handle.resume(); });
+}
+
+void TaskRuntime::reportStats() const {
+	std::printf("tasks: %llu spawned, %llu failed, %u live, %llu GPU waits, %llu file reads (%.1f MiB)\n",
+		static_cast<unsigned long long>(m_spawned.load(std::memory_order_relaxed)),
+		static_cast<unsigned long long>(m_failed.load(std::memory_order_relaxed)), m_tasks.pending(),
+		static_cast<unsigned long long>(m_gpuWaitCount.load(std::memory_order_relaxed)),
+		static_cast<unsigned long long>(m_fileReads.load(std::memory_order_relaxed)),
+		static_cast<double>(m_fileBytes.load(std::memory_order_relaxed)) / (1 << 20));
+}
+
+TaskRuntime::DetachedTask TaskRuntime::runDetached(Task<> task, JobCounter* counter) {
+	try {
+		co_await std::move(task);
+	} catch (const std::exception& e) {
+		m_failed.fetch_add(1, std::memory_order_relaxed);
+		std::fprintf(stderr, "initium: task failed: %s\n", e.what());
+	}
+	if (counter) {
+		m_jobs.complete(*counter);
+	}
+	// Last: the destructor may be waiting on this.
+	m_jobs.complete(m_tasks);
+}
+
+void TaskRuntime::addGpuWait(GpuAwaiter* awaiter) {
+	m_gpuWaitCount.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard lock(m_gpuMutex);
+		if (m_gpuFailure == VK_SUCCESS && m_gpuRunning) {
+			m_gpuWaits.push_back(awaiter);
+			// Signalled under the lock: timeline values must only go up.
+			VkSemaphoreSignalInfo signalInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO };
+			signalInfo.semaphore = m_wakeSemaphore;
+			signalInfo.value = ++m_wakeValue;
+			vkSignalSemaphore(m_context.device(), &signalInfo);
+			return;
+		}
+		awaiter->m_result = m_gpuFailure != VK_SUCCESS ? m_gpuFailure : VK_ERROR_UNKNOWN;
+	}
+	resume(awaiter->m_handle);
+}
+
+void TaskRuntime::addFileRead(FileReadAwaiter* awaiter) {
+	// Notify under the lock: once it is released the read may complete, the
+	// task finish and the runtime be destroyed.
+	std::lock_guard lock(m_ioMutex);
+	m_ioRequests.push_back(awaiter);
+	m_ioCondition.notify_one();
+}
+
+void TaskRuntime::resume(std::coroutine_handle<> handle) {
+	m_jobs.submit([handle] { handle.resume(); });
+}
+
+void TaskRuntime::gpuThreadMain() {
+	INITIUM_PROFILE_THREAD("task gpu waits");
+	VkDevice device = m_context.device();
+	uint64_t wakeSeen = 0;
+	std::vector<VkSemaphore> semaphores;
+	std::vector<uint64_t> values;
+	std::vector<GpuAwaiter*> ready;
+
+	for (;;) {
+		{
+			std::lock_guard lock(m_gpuMutex);
+			if (!m_gpuRunning) {
+				break;
+			}
+			semaphores.assign(1, m_wakeSemaphore);
+			values.assign(1, wakeSeen + 1);
+			for (const GpuAwaiter* awaiter : m_gpuWaits) {
+				semaphores.push_back(awaiter->m_timeline);
+				values.push_back(awaiter->m_value);
+			}
+		}
+
+		VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+		waitInfo.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+		waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+		waitInfo.pSemaphores = semaphores.data();
+		waitInfo.pValues = values.data();
+		VkResult result = vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+		if (result == VK_SUCCESS) {
+			result = vkGetSemaphoreCounterValue(device, m_wakeSemaphore, &wakeSeen);
+		}
+
+		{
+			std::lock_guard lock(m_gpuMutex);
+			size_t kept = 0;
+			for (GpuAwaiter* awaiter : m_gpuWaits) {
+				uint64_t value = 0;
+				if (result == VK_SUCCESS) {
+					VkResult query = vkGetSemaphoreCounterValue(device, awaiter->m_timeline, &value);
+					if (query != VK_SUCCESS) {
+						awaiter->m_result = query;
+						ready.push_back(awaiter);
+						continue;
+					}
+				}
+				if (result != VK_SUCCESS || value >= awaiter->m_value) {
+					awaiter->m_result = result;
+					ready.push_back(awaiter);
+				} else {
+					m_gpuWaits[kept++] = awaiter;
+				}
+			}
+			m_gpuWaits.resize(kept);
+			if (result != VK_SUCCESS) {
+				// Likely device loss. Fail this and every later wait instead
+				// of spinning on an error.
+				m_gpuFailure = result;
+			}
+		}
+
+		for (GpuAwaiter* awaiter : ready) {
+			resume(awaiter->m_handle);
+		}
+		ready.clear();
+		if (result != VK_SUCCESS) {
+			std::fprintf(stderr, "initium: GPU wait thread stopped: vkWaitSemaphores failed (VkResult %d)\n", static_cast<int>(result));
+			break;
+		}
+	}
+
+	// Shutting down: the device is idle by now, so whatever is still waiting
+	// will never be signalled.
+	std::lock_guard lock(m_gpuMutex);
+	for (GpuAwaiter* awaiter : m_gpuWaits) {
+		awaiter->m_result = VK_ERROR_UNKNOWN;
+		resume(awaiter->m_handle);
+	}
+	m_gpuWaits.clear();
+}
+
+void TaskRuntime::ioThreadMain() {
+	INITIUM_PROFILE_THREAD("task io");
+	for (;;) {
+		FileReadAwaiter* request = nullptr;
+		{
+			std::unique_lock lock(m_ioMutex);
+			m_ioCondition.wait(lock, [this] { return !m_ioRequests.empty() || !m_ioRunning; });
+			if (m_ioRequests.empty()) {
+				break;
+			}
+			request = m_ioRequests.front();
+			m_ioRequests.pop_front();
+		}
+
+		std::ifstream file(request->m_path, std::ios::binary | std::ios::ate);
+		if (file) {
+			std::streamoff size = file.tellg();
+			file.seekg(0);
+			request->m_data.resize(static_cast<size_t>(size));
+			file.read(reinterpret_cast<char*>(request->m_data.data()), size);
+		}
+		if (!file) {
+			request->m_data.clear();
+			request->m_error = "cannot read " + request->m_path.string();
+		} else {
+			m_fileReads.fetch_add(1, std::memory_order_relaxed);
+			m_fileBytes.fetch_add(request->m_data.size(), std::memory_order_relaxed);
+		}
+		resume(request->m_handle);
+	}
+}
+
+}
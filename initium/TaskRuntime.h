@@ -0,0 +1,164 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "Task.h"
+#include "VulkanContext.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace initium {
+
+// Runs Task coroutines on the JobSystem. A task that awaits a job counter,
+// a GPU timeline value or a file read is suspended rather than blocking its
+// worker, and is resumed as a new job once the wait is over. GPU waits are
+// serviced by one thread parked in vkWaitSemaphores on all of them at once,
+// file reads by one I/O thread.
+//
+// Every spawned task must be able to finish: the destructor runs jobs until
+// they all have.
+class TaskRuntime {
+public:
+	// Resumes the awaiting coroutine through the job system: on a worker,
+	// after a counter, or on the main thread.
+	class JobAwaiter {
+	public:
+		bool await_ready() const noexcept;
+		void await_suspend(std::coroutine_handle<> handle) const;
+		void await_resume() const noexcept {}
+
+	private:
+		friend class TaskRuntime;
+
+		JobAwaiter(JobSystem& jobs, JobCounter* counter, bool mainThread) : m_jobs(jobs), m_counter(counter), m_mainThread(mainThread) {}
+
+		JobSystem& m_jobs;
+		JobCounter* m_counter;
+		bool m_mainThread;
+	};
+
+	class GpuAwaiter {
+	public:
+		bool await_ready() const;
+		void await_suspend(std::coroutine_handle<> handle);
+		// Throws VulkanError if the wait failed, e.g. on device loss.
+		void await_resume() const;
+
+	private:
+		friend class TaskRuntime;
+
+		GpuAwaiter(TaskRuntime& runtime, VkSemaphore timeline, uint64_t value) : m_runtime(runtime), m_timeline(timeline), m_value(value) {}
+
+		TaskRuntime& m_runtime;
+		VkSemaphore m_timeline;
+		uint64_t m_value;
+		std::coroutine_handle<> m_handle;
+		VkResult m_result = VK_SUCCESS;
+	};
+
+	class FileReadAwaiter {
+	public:
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle);
+		// Throws std::runtime_error if the file could not be read.
+		std::vector<uint8_t> await_resume();
+
+	private:
+		friend class TaskRuntime;
+
+		FileReadAwaiter(TaskRuntime& runtime, std::filesystem::path path) : m_runtime(runtime), m_path(std::move(path)) {}
+
+		TaskRuntime& m_runtime;
+		std::filesystem::path m_path;
+		std::coroutine_handle<> m_handle;
+		std::vector<uint8_t> m_data;
+		std::string m_error;
+	};
+
+	TaskRuntime(const VulkanContext& context, JobSystem& jobs);
+	~TaskRuntime();
+
+	TaskRuntime(const TaskRuntime&) = delete;
+	TaskRuntime& operator=(const TaskRuntime&) = delete;
+
+	// Starts task on a worker. counter, if given, is pending until the task
+	// has finished. An exception escaping the task is reported and dropped.
+	void spawn(Task<> task, JobCounter* counter = nullptr);
+	// Outside a task: runs jobs until counter, e.g. one given to spawn(), is
+	// zero.
+	void wait(JobCounter& counter) { m_jobs.wait(counter); }
+
+	// co_await schedule(): continue on a worker thread.
+	JobAwaiter schedule() { return JobAwaiter(m_jobs, nullptr, false); }
+	// co_await after(counter): continue on a worker once counter is zero.
+	JobAwaiter after(JobCounter& counter) { return JobAwaiter(m_jobs, &counter, false); }
+	// co_await mainThread(): continue on the main thread, e.g. to call GLFW.
+	JobAwaiter mainThread() { return JobAwaiter(m_jobs, nullptr, true); }
+	// co_await gpu(timeline, value): continue once the semaphore reaches value.
+	GpuAwaiter gpu(VkSemaphore timeline, uint64_t value) { return GpuAwaiter(*this, timeline, value); }
+	// co_await readFile(path): the whole file, read on the I/O thread.
+	FileReadAwaiter readFile(std::filesystem::path path) { return FileReadAwaiter(*this, std::move(path)); }
+
+	uint64_t liveTasks() const { return m_tasks.pending(); }
+	void reportStats() const;
+
+private:
+	// Top-level coroutine wrapping a spawned task; frees itself at the end.
+	struct DetachedTask {
+		struct promise_type {
+			DetachedTask get_return_object() { return { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+			std::suspend_always initial_suspend() const noexcept { return {}; }
+			std::suspend_never final_suspend() const noexcept { return {}; }
+			void return_void() const noexcept {}
+			void unhandled_exception() const noexcept { std::terminate(); }
+		};
+
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	DetachedTask runDetached(Task<> task, JobCounter* counter);
+
+	void addGpuWait(GpuAwaiter* awaiter);
+	void addFileRead(FileReadAwaiter* awaiter);
+	// Resumes a suspended coroutine as a job.
+	void resume(std::coroutine_handle<> handle);
+
+	void gpuThreadMain();
+	void ioThreadMain();
+
+	const VulkanContext& m_context;
+	JobSystem& m_jobs;
+	JobCounter m_tasks;
+
+	// Host-signalled timeline that interrupts the GPU thread's wait when a
+	// new wait is added or the runtime shuts down.
+	VkSemaphore m_wakeSemaphore = VK_NULL_HANDLE;
+	uint64_t m_wakeValue = 0;
+	std::mutex m_gpuMutex;
+	std::vector<GpuAwaiter*> m_gpuWaits;
+	VkResult m_gpuFailure = VK_SUCCESS;
+	bool m_gpuRunning = true;
+	std::thread m_gpuThread;
+
+	std::mutex m_ioMutex;
+	std::condition_variable m_ioCondition;
+	std::deque<FileReadAwaiter*> m_ioRequests;
+	bool m_ioRunning = true;
+	std::thread m_ioThread;
+
+	std::atomic<uint64_t> m_spawned{ 0 };
+	std::atomic<uint64_t> m_failed{ 0 };
+	std::atomic<uint64_t> m_gpuWaitCount{ 0 };
+	std::atomic<uint64_t> m_fileReads{ 0 };
+	std::atomic<uint64_t> m_fileBytes{ 0 };
+};
+
+}
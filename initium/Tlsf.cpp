@@ -0,0 +1,252 @@
+#include "Tlsf.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+namespace initium {
+
+namespace {
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+Tlsf::Tlsf(uint64_t capacity) : m_capacity(capacity / kGranularity * kGranularity), m_freeBytes(m_capacity) {
+	for (auto& firstLevel : m_freeLists) {
+		std::fill(std::begin(firstLevel), std::end(firstLevel), kNull);
+	}
+
+	if (m_capacity > 0) {
+		uint32_t index = newBlock();
+		m_blocks[index].size = m_capacity;
+		insertFree(index);
+	}
+}
+
+uint64_t Tlsf::capacityFor(uint64_t size, uint64_t alignment) {
+	// Mirrors allocate() and findFree(): mapping is monotonic, so a block at
+	// least as large as the rounded request lands in a list that is searched.
+	uint64_t worstCase =
+		alignUp(std::max<uint64_t>(size, 1), kGranularity) + alignUp(std::max<uint64_t>(alignment, 1), kGranularity) - kGranularity;
+	if (worstCase >= (1ull << kFirstLevelShift)) {
+		worstCase += (1ull << (std::bit_width(worstCase) - 1 - kSecondLevelLog2)) - 1;
+	}
+	return alignUp(worstCase, kGranularity);
+}
+
+void Tlsf::mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel) {
+	if (size < (1ull << kFirstLevelShift)) {
+		firstLevel = 0;
+		secondLevel = static_cast<uint32_t>(size / ((1ull << kFirstLevelShift) / kSecondLevelCount));
+		return;
+	}
+	uint32_t log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+	secondLevel = static_cast<uint32_t>(size >> (log2 - kSecondLevelLog2)) ^ kSecondLevelCount;
+	firstLevel = log2 - kFirstLevelShift + 1;
+}
+
+uint32_t Tlsf::newBlock() {
+	if (!m_unusedBlocks.empty()) {
+		uint32_t index = m_unusedBlocks.back();
+		m_unusedBlocks.pop_back();
+		m_blocks[index] = Block{};
+		return index;
+	}
+	m_blocks.emplace_back();
+	return static_cast<uint32_t>(m_blocks.size() - 1);
+}
+
+void Tlsf::releaseBlock(uint32_t index) {
+	m_unusedBlocks.push_back(index);
+}
+
+void Tlsf::insertFree(uint32_t index) {
+	Block& block = m_blocks[index];
+	uint32_t firstLevel, secondLevel;
+	mapping(block.size, firstLevel, secondLevel);
+
+	uint32_t& head = m_freeLists[firstLevel][secondLevel];
+	block.free = true;
+	block.prevFree = kNull;
+	block.nextFree = head;
+	if (head != kNull) {
+		m_blocks[head].prevFree = index;
+	}
+	head = index;
+
+	m_firstLevelBitmap |= 1ull << firstLevel;
+	m_secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void Tlsf::removeFree(uint32_t index) {
+	Block& block = m_blocks[index];
+	uint32_t firstLevel, secondLevel;
+	mapping(block.size, firstLevel, secondLevel);
+
+	if (block.prevFree != kNull) {
+		m_blocks[block.prevFree].nextFree = block.nextFree;
+	} else {
+		m_freeLists[firstLevel][secondLevel] = block.nextFree;
+	}
+	if (block.nextFree != kNull) {
+		m_blocks[block.nextFree].prevFree = block.prevFree;
+	}
+	block.free = false;
+	block.prevFree = kNull;
+	block.nextFree = kNull;
+
+	if (m_freeLists[firstLevel][secondLevel] == kNull) {
+		m_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+		if (m_secondLevelBitmaps[firstLevel] == 0) {
+			m_firstLevelBitmap &= ~(1ull << firstLevel);
+		}
+	}
+}
+
+uint32_t Tlsf::findFree(uint64_t size) {
+	// Round the request up to the next list boundary so that any block in
+	// the list found is guaranteed to fit; no list walking needed.
+	if (size >= (1ull << kFirstLevelShift)) {
+		uint64_t round = (1ull << (std::bit_width(size) - 1 - kSecondLevelLog2)) - 1;
+		size += round;
+	}
+
+	uint32_t firstLevel, secondLevel;
+	mapping(size, firstLevel, secondLevel);
+	if (firstLevel >= kFirstLevelCount) {
+		return kNull;
+	}
+
+	uint32_t secondLevelMap = m_secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+	if (secondLevelMap == 0) {
+		uint64_t firstLevelMap = firstLevel + 1 < 64 ? m_firstLevelBitmap & (~0ull << (firstLevel + 1)) : 0;
+		if (firstLevelMap == 0) {
+			return kNull;
+		}
+		firstLevel = static_cast<uint32_t>(std::countr_zero(firstLevelMap));
+		secondLevelMap = m_secondLevelBitmaps[firstLevel];
+	}
+	secondLevel = static_cast<uint32_t>(std::countr_zero(secondLevelMap));
+	return m_freeLists[firstLevel][secondLevel];
+}
+
+uint32_t Tlsf::split(uint32_t index, uint64_t size) {
+	// Splits off everything past `size` into a new free block and returns it.
+	uint32_t remainder = newBlock();
+	Block& block = m_blocks[index];
+	Block& rest = m_blocks[remainder];
+
+	rest.offset = block.offset + size;
+	rest.size = block.size - size;
+	rest.prevPhysical = index;
+	rest.nextPhysical = block.nextPhysical;
+	if (block.nextPhysical != kNull) {
+		m_blocks[block.nextPhysical].prevPhysical = remainder;
+	}
+	block.size = size;
+	block.nextPhysical = remainder;
+
+	insertFree(remainder);
+	return remainder;
+}
+
+void Tlsf::merge(uint32_t left, uint32_t right) {
+	Block& block = m_blocks[left];
+	Block& absorbed = m_blocks[right];
+	assert(block.offset + block.size == absorbed.offset);
+
+	block.size += absorbed.size;
+	block.nextPhysical = absorbed.nextPhysical;
+	if (absorbed.nextPhysical != kNull) {
+		m_blocks[absorbed.nextPhysical].prevPhysical = left;
+	}
+	releaseBlock(right);
+}
+
+Tlsf::Allocation Tlsf::allocate(uint64_t size, uint64_t alignment) {
+	if (size == 0) {
+		return {};
+	}
+	size = alignUp(size, kGranularity);
+	alignment = alignUp(std::max<uint64_t>(alignment, 1), kGranularity);
+
+	// Blocks start on kGranularity boundaries, so only larger alignments
+	// can need padding in front.
+	uint64_t worstCase = size + (alignment - kGranularity);
+	uint32_t index = findFree(worstCase);
+	if (index == kNull) {
+		return {};
+	}
+	removeFree(index);
+
+	uint64_t padding = alignUp(m_blocks[index].offset, alignment) - m_blocks[index].offset;
+	if (padding > 0) {
+		// Give the padding back as its own free block, merging it into a free
+		// predecessor when there is one.
+		uint32_t aligned = split(index, padding);
+		removeFree(aligned);
+		uint32_t previous = m_blocks[index].prevPhysical;
+		if (previous != kNull && m_blocks[previous].free) {
+			removeFree(previous);
+			merge(previous, index);
+			insertFree(previous);
+		} else {
+			insertFree(index);
+		}
+		index = aligned;
+	}
+
+	if (m_blocks[index].size > size) {
+		split(index, size);
+	}
+
+	m_freeBytes -= m_blocks[index].size;
+	++m_allocationCount;
+	return { m_blocks[index].offset, m_blocks[index].size, index };
+}
+
+void Tlsf::free(uint32_t handle) {
+	assert(handle < m_blocks.size() && !m_blocks[handle].free);
+	m_freeBytes += m_blocks[handle].size;
+	--m_allocationCount;
+
+	uint32_t index = handle;
+	uint32_t next = m_blocks[index].nextPhysical;
+	if (next != kNull && m_blocks[next].free) {
+		removeFree(next);
+		merge(index, next);
+	}
+	uint32_t previous = m_blocks[index].prevPhysical;
+	if (previous != kNull && m_blocks[previous].free) {
+		removeFree(previous);
+		merge(previous, index);
+		index = previous;
+	}
+	insertFree(index);
+}
+
+uint64_t Tlsf::largestFreeBlock() const {
+	if (m_firstLevelBitmap == 0) {
+		return 0;
+	}
+	uint32_t firstLevel = 63 - static_cast<uint32_t>(std::countl_zero(m_firstLevelBitmap));
+	uint32_t secondLevel = 31 - static_cast<uint32_t>(std::countl_zero(m_secondLevelBitmaps[firstLevel]));
+
+	uint64_t largest = 0;
+	for (uint32_t index = m_freeLists[firstLevel][secondLevel]; index != kNull; index = m_blocks[index].nextFree) {
+		largest = std::max(largest, m_blocks[index].size);
+	}
+	return largest;
+}
+
+double Tlsf::fragmentation() const {
+	if (m_freeBytes == 0) {
+		return 0.0;
+	}
+	return 1.0 - static_cast<double>(largestFreeBlock()) / static_cast<double>(m_freeBytes);
+}
+
+}
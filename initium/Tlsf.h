@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace initium {
+
+// Two-level segregated fit allocator over an abstract [0, capacity) range.
+// It only does bookkeeping, so the same code manages offsets into a
+// VkDeviceMemory block or anything else. Allocation and free are O(1):
+// a bitmap lookup finds a free list whose blocks are all large enough, and
+// freed blocks merge with free physical neighbours immediately, which keeps
+// fragmentation low under the mixed-size churn of GPU resources.
+class Tlsf {
+public:
+	static constexpr uint32_t kNull = UINT32_MAX;
+
+	// Offsets and sizes are kept at multiples of this.
+	static constexpr uint64_t kGranularity = 256;
+
+	struct Allocation {
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t handle = kNull;
+
+		explicit operator bool() const { return handle != kNull; }
+	};
+
+	explicit Tlsf(uint64_t capacity);
+
+	// Smallest capacity whose empty range always satisfies
+	// allocate(size, alignment), allowing for granularity rounding and the
+	// free-list lookup rounding the request up.
+	static uint64_t capacityFor(uint64_t size, uint64_t alignment);
+
+	Allocation allocate(uint64_t size, uint64_t alignment);
+	void free(uint32_t handle);
+
+	uint64_t capacity() const { return m_capacity; }
+	uint64_t usedBytes() const { return m_capacity - m_freeBytes; }
+	uint64_t freeBytes() const { return m_freeBytes; }
+	uint64_t largestFreeBlock() const;
+	uint32_t allocationCount() const { return m_allocationCount; }
+	bool empty() const { return m_allocationCount == 0; }
+
+	// 0 when all free space is one block, approaching 1 as it is split
+	// into many small pieces.
+	double fragmentation() const;
+
+private:
+	static constexpr uint32_t kSecondLevelLog2 = 4;
+	static constexpr uint32_t kSecondLevelCount = 1u << kSecondLevelLog2;
+	static constexpr uint32_t kFirstLevelShift = kSecondLevelLog2 + 8; // log2(kGranularity)
+	static constexpr uint32_t kFirstLevelCount = 48;
+
+	struct Block {
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t prevPhysical = kNull;
+		uint32_t nextPhysical = kNull;
+		uint32_t prevFree = kNull;
+		uint32_t nextFree = kNull;
+		bool free = false;
+	};
+
+	static void mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+
+	uint32_t newBlock();
+	void releaseBlock(uint32_t index);
+	void insertFree(uint32_t index);
+	void removeFree(uint32_t index);
+	uint32_t findFree(uint64_t size);
+	uint32_t split(uint32_t index, uint64_t size);
+	void merge(uint32_t left, uint32_t right);
+
+	uint64_t m_capacity;
+	uint64_t m_freeBytes;
+	uint32_t m_allocationCount = 0;
+
+	std::vector<Block> m_blocks;
+	std::vector<uint32_t> m_unusedBlocks;
+
+	uint64_t m_firstLevelBitmap = 0;
+	uint32_t m_secondLevelBitmaps[kFirstLevelCount] = {};
+	uint32_t m_freeLists[kFirstLevelCount][kSecondLevelCount];
+};
+
+}
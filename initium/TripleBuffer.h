@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace initium {
+
+// Single-producer single-consumer "latest value" handoff. The producer fills
+// writeSlot() and publishes it; the consumer picks up the most recently
+// published slot. Neither side ever blocks the other, and a slow consumer
+// simply skips the values it was too late for.
+template <typename T>
+class TripleBuffer {
+public:
+	// Producer side.
+	T& writeSlot() { return m_slots[m_back]; }
+
+	void publish() {
+		uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_back | kFresh), std::memory_order_acq_rel);
+		m_back = previous & kIndexMask;
+	}
+
+	// Consumer side. Returns false if nothing new was published since the
+	// last successful consume(), in which case readSlot() is unchanged.
+	bool consume() {
+		if (!(m_middle.load(std::memory_order_relaxed) & kFresh)) {
+			return false;
+		}
+		uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = previous & kIndexMask;
+		return true;
+	}
+
+	const T& readSlot() const { return m_slots[m_front]; }
+
+	bool hasFresh() const { return (m_middle.load(std::memory_order_acquire) & kFresh) != 0; }
+
+private:
+	static constexpr uint8_t kIndexMask = 0x3;
+	static constexpr uint8_t kFresh = 0x4;
+
+	T m_slots[3] = {};
+	uint8_t m_back = 0;
+	std::atomic<uint8_t> m_middle{ 1 };
+	uint8_t m_front = 2;
+};
+
+}
@@ -0,0 +1,491 @@
+#include "VulkanContext.h"
+
+#define GLFW_INCLUDE_VULKAN
+#include "glfw/include/GLFW/glfw3.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace initium {
+
+namespace {
+
+const char* kValidationLayer = "VK_LAYER_KHRONOS_validation";
+
+VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+	VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT* data, void*) {
+	if (severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+		std::fprintf(stderr, "vulkan: %s\n", data->pMessage);
+	}
+	return VK_FALSE;
+}
+
+bool hasLayer(const char* name) {
+	uint32_t count = 0;
+	vkEnumerateInstanceLayerProperties(&count, nullptr);
+	std::vector<VkLayerProperties> layers(count);
+	vkEnumerateInstanceLayerProperties(&count, layers.data());
+	return std::any_of(layers.begin(), layers.end(), [name](const VkLayerProperties& layer) {
+		return std::strcmp(layer.layerName, name) == 0;
+	});
+}
+
+bool hasInstanceExtension(const char* name) {
+	uint32_t count = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+	std::vector<VkExtensionProperties> extensions(count);
+	vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data());
+	return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& extension) {
+		return std::strcmp(extension.extensionName, name) == 0;
+	});
+}
+
+std::vector<VkExtensionProperties> deviceExtensions(VkPhysicalDevice device) {
+	uint32_t count = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+	std::vector<VkExtensionProperties> extensions(count);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &count, extensions.data());
+	return extensions;
+}
+
+bool hasExtension(const std::vector<VkExtensionProperties>& extensions, const char* name) {
+	return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties& extension) {
+		return std::strcmp(extension.extensionName, name) == 0;
+	});
+}
+
+// Whether the device's timestamps can be sampled together with the host
+// clock CPU zones use.
+bool canCalibrate(VkInstance instance, VkPhysicalDevice device) {
+	auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+		vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+	if (!getTimeDomains) {
+		return false;
+	}
+	uint32_t count = 0;
+	getTimeDomains(device, &count, nullptr);
+	std::vector<VkTimeDomainEXT> domains(count);
+	getTimeDomains(device, &count, domains.data());
+	return std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end()
+		&& std::find(domains.begin(), domains.end(), kHostTimeDomain) != domains.end();
+}
+
+VkDeviceSize largestDeviceLocalHeap(VkPhysicalDevice device) {
+	VkPhysicalDeviceMemoryProperties memory;
+	vkGetPhysicalDeviceMemoryProperties(device, &memory);
+
+	VkDeviceSize largest = 0;
+	for (uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+		if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			largest = std::max(largest, memory.memoryHeaps[i].size);
+		}
+	}
+	return largest;
+}
+
+// The descriptor indexing subset a bindless table needs: one runtime-sized,
+// partially bound array per descriptor type, written while bound.
+bool supportsBindless(const VkPhysicalDeviceVulkan12Features& features) {
+	return features.descriptorIndexing && features.runtimeDescriptorArray && features.descriptorBindingPartiallyBound
+		&& features.descriptorBindingUpdateUnusedWhilePending && features.descriptorBindingSampledImageUpdateAfterBind
+		&& features.descriptorBindingStorageBufferUpdateAfterBind && features.descriptorBindingStorageImageUpdateAfterBind
+		&& features.shaderSampledImageArrayNonUniformIndexing;
+}
+
+int64_t deviceTypeScore(VkPhysicalDeviceType type) {
+	// Type dominates everything else: a discrete GPU with a small heap still
+	// beats an integrated one that reports all of system RAM as device local.
+	switch (type) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 1'000'000;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 100'000;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 10'000;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1'000;
+	default: return 0;
+	}
+}
+
+}
+
+VulkanContext::VulkanContext(const VulkanContextCreateInfo& createInfo) : m_allocationCallbacks(createInfo.allocationCallbacks) {
+	try {
+		createInstance(createInfo);
+		if (createInfo.enableValidation) {
+			createDebugMessenger();
+		}
+		pickPhysicalDevice(createInfo);
+		createDevice();
+	} catch (...) {
+		destroy();
+		throw;
+	}
+}
+
+VulkanContext::~VulkanContext() {
+	destroy();
+}
+
+void VulkanContext::destroy() {
+	if (m_device) {
+		vkDestroyDevice(m_device, m_allocationCallbacks);
+		m_device = VK_NULL_HANDLE;
+	}
+	if (m_debugMessenger) {
+		auto destroyMessenger = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
+			vkGetInstanceProcAddr(m_instance, "vkDestroyDebugUtilsMessengerEXT"));
+		if (destroyMessenger) {
+			destroyMessenger(m_instance, m_debugMessenger, m_allocationCallbacks);
+		}
+		m_debugMessenger = VK_NULL_HANDLE;
+	}
+	if (m_instance) {
+		vkDestroyInstance(m_instance, m_allocationCallbacks);
+		m_instance = VK_NULL_HANDLE;
+	}
+}
+
+bool VulkanContext::isDeviceExtensionEnabled(const char* name) const {
+	return std::find(m_deviceExtensions.begin(), m_deviceExtensions.end(), name) != m_deviceExtensions.end();
+}
+
+uint32_t VulkanContext::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const {
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+		if ((typeBits & (1u << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+	return UINT32_MAX;
+}
+
+void VulkanContext::createInstance(const VulkanContextCreateInfo& createInfo) {
+	std::vector<const char*> extensions;
+	uint32_t glfwExtensionCount = 0;
+	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	if (glfwExtensions) {
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	} else if (createInfo.requirePresentation) {
+		throw std::runtime_error("GLFW reports no Vulkan surface support on this platform");
+	}
+
+	std::vector<const char*> layers;
+	if (createInfo.enableValidation) {
+		if (hasLayer(kValidationLayer)) {
+			layers.push_back(kValidationLayer);
+		} else {
+			std::fprintf(stderr, "vulkan: %s not available, continuing without validation\n", kValidationLayer);
+		}
+		if (hasInstanceExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		}
+	}
+
+	VkApplicationInfo appInfo{ VK_STRUCTURE_TYPE_APPLICATION_INFO };
+	appInfo.pApplicationName = createInfo.applicationName;
+	appInfo.applicationVersion = VK_MAKE_API_VERSION(0, 0, 1, 0);
+	appInfo.pEngineName = "Initium";
+	appInfo.engineVersion = VK_MAKE_API_VERSION(0, 0, 1, 0);
+	appInfo.apiVersion = VK_API_VERSION_1_3;
+
+	VkInstanceCreateInfo instanceInfo{ VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+	instanceInfo.pApplicationInfo = &appInfo;
+	instanceInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	instanceInfo.ppEnabledExtensionNames = extensions.data();
+	instanceInfo.enabledLayerCount = static_cast<uint32_t>(layers.size());
+	instanceInfo.ppEnabledLayerNames = layers.data();
+
+	vkCheck(vkCreateInstance(&instanceInfo, m_allocationCallbacks, &m_instance), "vkCreateInstance");
+}
+
+void VulkanContext::createDebugMessenger() {
+	auto create = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
+		vkGetInstanceProcAddr(m_instance, "vkCreateDebugUtilsMessengerEXT"));
+	if (!create) {
+		return;
+	}
+
+	VkDebugUtilsMessengerCreateInfoEXT messengerInfo{ VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT };
+	messengerInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	messengerInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+		| VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	messengerInfo.pfnUserCallback = debugCallback;
+
+	vkCheck(create(m_instance, &messengerInfo, m_allocationCallbacks, &m_debugMessenger), "vkCreateDebugUtilsMessengerEXT");
+}
+
+void VulkanContext::pickPhysicalDevice(const VulkanContextCreateInfo& createInfo) {
+	uint32_t count = 0;
+	vkCheck(vkEnumeratePhysicalDevices(m_instance, &count, nullptr), "vkEnumeratePhysicalDevices");
+	std::vector<VkPhysicalDevice> devices(count);
+	vkCheck(vkEnumeratePhysicalDevices(m_instance, &count, devices.data()), "vkEnumeratePhysicalDevices");
+
+	// INITIUM_DEVICE=<substring> pins a device by name, for multi-GPU boxes
+	// where the heuristic picks the wrong one or CI wants lavapipe explicitly.
+	const char* forcedName = std::getenv("INITIUM_DEVICE");
+
+	Candidate best;
+	for (VkPhysicalDevice device : devices) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+
+		Candidate candidate = evaluateDevice(device, createInfo.requirePresentation);
+		std::printf("vulkan: found %s (score %lld)\n", properties.deviceName, static_cast<long long>(candidate.score));
+
+		if (forcedName && *forcedName && std::strstr(properties.deviceName, forcedName) == nullptr) {
+			continue;
+		}
+		if (candidate.score > best.score) {
+			best = candidate;
+		}
+	}
+
+	if (best.score < 0) {
+		throw std::runtime_error("no Vulkan 1.3 device with the required features and queues");
+	}
+
+	m_physicalDevice = best.device;
+	m_queueFamilies = best.families;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &m_properties);
+	vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
+
+	std::printf("vulkan: using %s (graphics %u.%u, compute %u.%u, transfer %u.%u)\n", m_properties.deviceName,
+		m_queueFamilies.graphics.family, m_queueFamilies.graphics.index,
+		m_queueFamilies.compute.family, m_queueFamilies.compute.index,
+		m_queueFamilies.transfer.family, m_queueFamilies.transfer.index);
+}
+
+VulkanContext::Candidate VulkanContext::evaluateDevice(VkPhysicalDevice device, bool requirePresentation) const {
+	Candidate candidate;
+	candidate.device = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+	if (properties.apiVersion < VK_API_VERSION_1_3) {
+		return candidate;
+	}
+
+	std::vector<VkExtensionProperties> extensions = deviceExtensions(device);
+	if (requirePresentation && !hasExtension(extensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+		return candidate;
+	}
+
+	VkPhysicalDeviceVulkan13Features features13{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+	VkPhysicalDeviceVulkan12Features features12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	features12.pNext = &features13;
+	VkPhysicalDeviceFeatures2 features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	features.pNext = &features12;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	if (!features12.timelineSemaphore || !features13.synchronization2 || !features13.dynamicRendering) {
+		return candidate;
+	}
+	if (!supportsBindless(features12)) {
+		return candidate;
+	}
+
+	candidate.families = selectQueueFamilies(device, requirePresentation);
+	if (!candidate.families.graphics.valid()) {
+		return candidate;
+	}
+
+	int64_t score = deviceTypeScore(properties.deviceType);
+	score += static_cast<int64_t>(largestDeviceLocalHeap(device) >> 20);
+
+	if (candidate.families.compute.family != candidate.families.graphics.family) {
+		score += 2'000;
+	}
+	if (candidate.families.transfer.family != candidate.families.graphics.family
+		&& candidate.families.transfer.family != candidate.families.compute.family) {
+		score += 2'000;
+	}
+	if (features.features.multiDrawIndirect) {
+		score += 500;
+	}
+	if (features.features.samplerAnisotropy) {
+		score += 500;
+	}
+	if (features12.drawIndirectCount) {
+		score += 500;
+	}
+
+	candidate.score = score;
+	return candidate;
+}
+
+QueueFamilies VulkanContext::selectQueueFamilies(VkPhysicalDevice device, bool requirePresentation) const {
+	uint32_t count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
+	std::vector<VkQueueFamilyProperties> families(count);
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &count, families.data());
+
+	QueueFamilies result;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+			continue;
+		}
+		bool canPresent = glfwGetPhysicalDevicePresentationSupport(m_instance, device, i) == GLFW_TRUE;
+		if (canPresent || (!requirePresentation && !result.graphics.valid())) {
+			result.graphics.family = i;
+			if (canPresent) {
+				break;
+			}
+		}
+	}
+	if (!result.graphics.valid()) {
+		return result;
+	}
+
+	// Prefer a compute family without graphics: that is the async compute
+	// engine on AMD/NVIDIA and runs alongside the graphics queue.
+	for (uint32_t i = 0; i < count; i++) {
+		if ((families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+			result.compute.family = i;
+			break;
+		}
+	}
+	if (!result.compute.valid()) {
+		result.compute.family = result.graphics.family;
+	}
+
+	// Prefer a pure transfer family (the DMA engines), then anything that is
+	// not the graphics family.
+	for (uint32_t i = 0; i < count; i++) {
+		VkQueueFlags flags = families[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			result.transfer.family = i;
+			break;
+		}
+	}
+	if (!result.transfer.valid()) {
+		result.transfer.family = result.compute.family;
+	}
+
+	// Roles that share a family take successive queue indices while the
+	// family has queues left, and alias the last one otherwise.
+	std::vector<uint32_t> used(count, 0);
+	for (QueueSelection* selection : { &result.graphics, &result.compute, &result.transfer }) {
+		uint32_t& next = used[selection->family];
+		selection->index = std::min(next, families[selection->family].queueCount - 1);
+		selection->timestampValidBits = families[selection->family].timestampValidBits;
+		next++;
+	}
+
+	return result;
+}
+
+void VulkanContext::createDevice() {
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &familyCount, nullptr);
+
+	std::vector<uint32_t> queueCounts(familyCount, 0);
+	for (const QueueSelection& selection : { m_queueFamilies.graphics, m_queueFamilies.compute, m_queueFamilies.transfer }) {
+		queueCounts[selection.family] = std::max(queueCounts[selection.family], selection.index + 1);
+	}
+
+	std::vector<float> priorities(3, 1.0f);
+	std::vector<VkDeviceQueueCreateInfo> queueInfos;
+	for (uint32_t family = 0; family < familyCount; family++) {
+		if (queueCounts[family] == 0) {
+			continue;
+		}
+		VkDeviceQueueCreateInfo queueInfo{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+		queueInfo.queueFamilyIndex = family;
+		queueInfo.queueCount = queueCounts[family];
+		queueInfo.pQueuePriorities = priorities.data();
+		queueInfos.push_back(queueInfo);
+	}
+
+	std::vector<VkExtensionProperties> available = deviceExtensions(m_physicalDevice);
+	std::vector<const char*> extensions;
+	if (hasExtension(available, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+		extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
+	if (hasExtension(available, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+	bool meshShaderExtension = hasExtension(available, VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	bool calibratedTimestamps = hasExtension(available, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) && canCalibrate(m_instance, m_physicalDevice);
+	if (calibratedTimestamps) {
+		extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	}
+
+	VkPhysicalDeviceMeshShaderFeaturesEXT supportedMesh{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+	VkPhysicalDeviceVulkan13Features supported13{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+	supported13.pNext = meshShaderExtension ? &supportedMesh : nullptr;
+	VkPhysicalDeviceVulkan12Features supported12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	supported12.pNext = &supported13;
+	VkPhysicalDeviceFeatures2 supported{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	supported.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supported);
+
+	// Task and mesh shaders only; multiview, primitive shading rate and
+	// mesh queries stay off.
+	VkPhysicalDeviceMeshShaderFeaturesEXT featuresMesh{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+	featuresMesh.taskShader = supportedMesh.taskShader;
+	featuresMesh.meshShader = supportedMesh.meshShader;
+	bool meshShader = meshShaderExtension && featuresMesh.taskShader && featuresMesh.meshShader;
+	if (meshShader) {
+		extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	}
+
+	VkPhysicalDeviceVulkan13Features features13{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+	features13.pNext = meshShader ? &featuresMesh : nullptr;
+	features13.synchronization2 = VK_TRUE;
+	features13.dynamicRendering = VK_TRUE;
+
+	VkPhysicalDeviceVulkan12Features features12{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	features12.pNext = &features13;
+	features12.timelineSemaphore = VK_TRUE;
+	features12.hostQueryReset = supported12.hostQueryReset;
+	// Everything BindlessTable relies on; checked by evaluateDevice.
+	features12.descriptorIndexing = VK_TRUE;
+	features12.runtimeDescriptorArray = VK_TRUE;
+	features12.descriptorBindingPartiallyBound = VK_TRUE;
+	features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+	features12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+	features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	features12.shaderStorageBufferArrayNonUniformIndexing = supported12.shaderStorageBufferArrayNonUniformIndexing;
+	features12.drawIndirectCount = supported12.drawIndirectCount;
+
+	VkPhysicalDeviceFeatures2 features{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+	features.pNext = &features12;
+	features.features.multiDrawIndirect = supported.features.multiDrawIndirect;
+	features.features.samplerAnisotropy = supported.features.samplerAnisotropy;
+	features.features.drawIndirectFirstInstance = supported.features.drawIndirectFirstInstance;
+	features.features.pipelineStatisticsQuery = supported.features.pipelineStatisticsQuery;
+
+	VkDeviceCreateInfo deviceInfo{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+	deviceInfo.pNext = &features;
+	deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
+	deviceInfo.pQueueCreateInfos = queueInfos.data();
+	deviceInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	deviceInfo.ppEnabledExtensionNames = extensions.data();
+
+	vkCheck(vkCreateDevice(m_physicalDevice, &deviceInfo, m_allocationCallbacks, &m_device), "vkCreateDevice");
+
+	for (const char* extension : extensions) {
+		m_deviceExtensions.emplace_back(extension);
+	}
+	m_features.hostQueryReset = features12.hostQueryReset;
+	m_features.nonUniformStorageBufferIndexing = features12.shaderStorageBufferArrayNonUniformIndexing;
+	m_features.drawIndirectCount = features12.drawIndirectCount && features.features.multiDrawIndirect
+		&& features.features.drawIndirectFirstInstance;
+	if (meshShader) {
+		m_cmdDrawMeshTasksIndirect = reinterpret_cast<PFN_vkCmdDrawMeshTasksIndirectEXT>(vkGetDeviceProcAddr(m_device, "vkCmdDrawMeshTasksIndirectEXT"));
+		m_features.meshShader = m_cmdDrawMeshTasksIndirect != nullptr;
+	}
+	m_features.pipelineStatisticsQuery = features.features.pipelineStatisticsQuery;
+	if (calibratedTimestamps) {
+		m_getCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(vkGetDeviceProcAddr(m_device, "vkGetCalibratedTimestampsEXT"));
+		m_features.calibratedTimestamps = m_getCalibratedTimestamps != nullptr;
+	}
+
+	vkGetDeviceQueue(m_device, m_queueFamilies.graphics.family, m_queueFamilies.graphics.index, &m_graphicsQueue);
+	vkGetDeviceQueue(m_device, m_queueFamilies.compute.family, m_queueFamilies.compute.index, &m_computeQueue);
+	vkGetDeviceQueue(m_device, m_queueFamilies.transfer.family, m_queueFamilies.transfer.index, &m_transferQueue);
+}
+
+}
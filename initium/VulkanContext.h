@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace initium {
+
+class VulkanError : public std::runtime_error {
+public:
+	VulkanError(const char* what, VkResult result)
+		: std::runtime_error(std::string(what) + " failed (VkResult " + std::to_string(static_cast<int>(result)) + ")"), m_result(result) {}
+
+	VkResult result() const { return m_result; }
+
+private:
+	VkResult m_result;
+};
+
+inline void vkCheck(VkResult result, const char* what) {
+	if (result < VK_SUCCESS) {
+		throw VulkanError(what, result);
+	}
+}
+
+// A queue picked for a role. Several roles may resolve to the same family;
+// when that family exposes more than one queue they get distinct indices so
+// uploads and async work don't serialise behind graphics submissions.
+struct QueueSelection {
+	uint32_t family = VK_QUEUE_FAMILY_IGNORED;
+	uint32_t index = 0;
+	// Zero when the family can't write timestamps.
+	uint32_t timestampValidBits = 0;
+
+	bool valid() const { return family != VK_QUEUE_FAMILY_IGNORED; }
+};
+
+struct QueueFamilies {
+	QueueSelection graphics;
+	QueueSelection compute;
+	QueueSelection transfer;
+};
+
+// Optional features, enabled at device creation whenever supported.
+struct DeviceFeatures {
+	bool hostQueryReset = false;
+	// Storage buffers in the bindless table may be indexed with values that
+	// differ across a draw; otherwise indices must be dynamically uniform.
+	bool nonUniformStorageBufferIndexing = false;
+	// vkCmdDrawIndexedIndirectCount with many draws per call, each free to
+	// set firstInstance: what GPU-driven rendering needs.
+	bool drawIndirectCount = false;
+	// VK_EXT_mesh_shader with task shaders. vkCmdDrawMeshTasksIndirectEXT
+	// is an extension entry point; get it from VulkanContext.
+	bool meshShader = false;
+	// Pipeline statistics queries on the graphics queue.
+	bool pipelineStatisticsQuery = false;
+	// VK_EXT_calibrated_timestamps with both the device and kHostTimeDomain
+	// calibrateable, so GPU timestamps can be placed on the CPU timeline.
+	bool calibratedTimestamps = false;
+};
+
+// The clock glfwGetTimerValue() reads, and so the one CPU profile zones are
+// timed with, in the same units.
+#ifdef _WIN32
+constexpr VkTimeDomainEXT kHostTimeDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+constexpr VkTimeDomainEXT kHostTimeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+struct VulkanContextCreateInfo {
+	const char* applicationName = "Initium";
+#ifdef _DEBUG
+	bool enableValidation = true;
+#else
+	bool enableValidation = false;
+#endif
+	// When false the device is not required to present to a GLFW window,
+	// which is what lets headless runs pick a software device like lavapipe.
+	bool requirePresentation = true;
+	// Host allocator for the instance, device and every object created from
+	// them. Must outlive the context.
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+};
+
+class VulkanContext {
+public:
+	explicit VulkanContext(const VulkanContextCreateInfo& createInfo);
+	~VulkanContext();
+
+	VulkanContext(const VulkanContext&) = delete;
+	VulkanContext& operator=(const VulkanContext&) = delete;
+
+	VkInstance instance() const { return m_instance; }
+	VkPhysicalDevice physicalDevice() const { return m_physicalDevice; }
+	VkDevice device() const { return m_device; }
+
+	// Pass to every vkCreate*/vkDestroy* call on this context's objects.
+	const VkAllocationCallbacks* allocationCallbacks() const { return m_allocationCallbacks; }
+
+	const VkPhysicalDeviceProperties& properties() const { return m_properties; }
+	const VkPhysicalDeviceMemoryProperties& memoryProperties() const { return m_memoryProperties; }
+	const QueueFamilies& queueFamilies() const { return m_queueFamilies; }
+	const DeviceFeatures& features() const { return m_features; }
+
+	VkQueue graphicsQueue() const { return m_graphicsQueue; }
+	VkQueue computeQueue() const { return m_computeQueue; }
+	VkQueue transferQueue() const { return m_transferQueue; }
+
+	// True when the role has its own VkQueue rather than aliasing graphics.
+	bool hasDedicatedCompute() const { return m_computeQueue != m_graphicsQueue; }
+	bool hasDedicatedTransfer() const { return m_transferQueue != m_graphicsQueue && m_transferQueue != m_computeQueue; }
+
+	bool isDeviceExtensionEnabled(const char* name) const;
+
+	// Null unless features().meshShader.
+	PFN_vkCmdDrawMeshTasksIndirectEXT cmdDrawMeshTasksIndirect() const { return m_cmdDrawMeshTasksIndirect; }
+	// Null unless features().calibratedTimestamps.
+	PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps() const { return m_getCalibratedTimestamps; }
+
+	// Returns the first memory type allowed by typeBits that has all of the
+	// requested property flags, or UINT32_MAX if there is none.
+	uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+
+private:
+	struct Candidate {
+		VkPhysicalDevice device = VK_NULL_HANDLE;
+		QueueFamilies families;
+		int64_t score = -1;
+	};
+
+	void createInstance(const VulkanContextCreateInfo& createInfo);
+	void createDebugMessenger();
+	void pickPhysicalDevice(const VulkanContextCreateInfo& createInfo);
+	void createDevice();
+	void destroy();
+
+	Candidate evaluateDevice(VkPhysicalDevice device, bool requirePresentation) const;
+	QueueFamilies selectQueueFamilies(VkPhysicalDevice device, bool requirePresentation) const;
+
+	const VkAllocationCallbacks* m_allocationCallbacks = nullptr;
+	VkInstance m_instance = VK_NULL_HANDLE;
+	VkDebugUtilsMessengerEXT m_debugMessenger = VK_NULL_HANDLE;
+	VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+	VkDevice m_device = VK_NULL_HANDLE;
+
+	VkPhysicalDeviceProperties m_properties{};
+	VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+	QueueFamilies m_queueFamilies;
+	DeviceFeatures m_features;
+
+	VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+	VkQueue m_computeQueue = VK_NULL_HANDLE;
+	VkQueue m_transferQueue = VK_NULL_HANDLE;
+
+	PFN_vkCmdDrawMeshTasksIndirectEXT m_cmdDrawMeshTasksIndirect = nullptr;
+	PFN_vkGetCalibratedTimestampsEXT m_getCalibratedTimestamps = nullptr;
+
+	std::vector<std::string> m_deviceExtensions;
+};
+
+}
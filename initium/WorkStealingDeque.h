@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace initium {
+
+// Bounded Chase-Lev deque of pointers. The owning thread pushes and pops at
+// the bottom (LIFO, cache-warm); any other thread steals from the top
+// (FIFO, the oldest and usually largest work). Capacity must be a power of
+// two.
+template <typename T, size_t Capacity>
+class WorkStealingDeque {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+	// Owner only. Returns false when full.
+	bool push(T* item) {
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		int64_t top = m_top.load(std::memory_order_acquire);
+		if (bottom - top >= static_cast<int64_t>(Capacity)) {
+			return false;
+		}
+		m_items[bottom & kMask].store(item, std::memory_order_relaxed);
+		// Publishes the item (and what it points to) to thieves.
+		m_bottom.store(bottom + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Owner only.
+	T* pop() {
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom) {
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		T* item = m_items[bottom & kMask].load(std::memory_order_relaxed);
+		if (top == bottom) {
+			// Last item: race the thieves for it.
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				item = nullptr;
+			}
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+		return item;
+	}
+
+	// Any thread. Returns nullptr when empty or when it lost a race.
+	T* steal() {
+		int64_t top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t bottom = m_bottom.load(std::memory_order_acquire);
+		if (top >= bottom) {
+			return nullptr;
+		}
+		T* item = m_items[top & kMask].load(std::memory_order_relaxed);
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr;
+		}
+		return item;
+	}
+
+	// Approximate outside the owner.
+	bool empty() const {
+		return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+	}
+
+private:
+	static constexpr int64_t kMask = static_cast<int64_t>(Capacity) - 1;
+
+	alignas(64) std::atomic<int64_t> m_top{ 0 };
+	alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+	std::atomic<T*> m_items[Capacity] = {};
+};
+
+}
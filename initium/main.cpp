@@ -3,18 +3,494 @@
 #define GLFW_INCLUDE_VULKAN
 #include "glfw/include/GLFW/glfw3.h"
 
-int main() {
-	glfwInit();
+#include "AssetPack.h"
+#include "Benchmark.h"
+#include "FrameScheduler.h"
+#include "GpuAllocator.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+#include "OffscreenTarget.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "RenderThread.h"
+#include "Renderer.h"
+#include "Swapchain.h"
+#include "TaskRuntime.h"
+#include "VulkanContext.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <optional>
+
+namespace {
+
+struct Options {
+	// Render offscreen on GLFW's null platform: no display, no swapchain, no
+	// vsync. Runs on software devices such as lavapipe.
+	bool headless = false;
+	// Frames to render before exiting; 0 runs until the window is closed.
+	uint64_t frameLimit = 0;
+	// Headless only: where to write frames as PPMs, and how often.
+	std::filesystem::path dumpDirectory;
+	uint32_t dumpInterval = 1;
+	// Sprites drawn per frame, one draw call each.
+	uint32_t spriteCount = initium::RendererCreateInfo{}.spriteCount;
+	// Instances in the GPU-driven scene. Unless --sprites is given too, a
+	// scene replaces the sprites.
+	uint32_t instanceCount = 0;
+	std::optional<initium::SceneGeometry> sceneGeometry;
+	bool asyncCompute = true;
+	bool pipelineStatistics = false;
+	bool hotReload = false;
+	// Start with the performance overlay shown; F10 toggles it.
+	bool hud = false;
+	// Render a fixed run of frames along a scripted camera path with a fixed
+	// timestep and no vsync, and write frame time statistics to
+	// benchmarkOutput.
+	bool benchmark = false;
+	std::filesystem::path benchmarkOutput = "benchmark.json";
+	// Where to write the CPU profile at exit, and on F9. Perfetto protobuf
+	// for .pftrace, Chrome trace JSON otherwise.
+	std::filesystem::path tracePath;
+	// Read sprite textures and scene data from this pack instead of building
+	// them at startup.
+	std::filesystem::path assetPack;
+	// Write everything the renderer builds at startup, with the scene for
+	// instanceCount, to this pack and exit.
+	std::filesystem::path writeAssetPack;
+};
+
+constexpr const char* kDefaultTracePath = "initium_trace.json";
+
+constexpr uint64_t kDefaultHeadlessFrames = 300;
+// One loop of the flythrough at the benchmark's timestep, measured after the
+// warm-up frames.
+constexpr uint64_t kDefaultBenchmarkFrames = 1200;
+constexpr uint32_t kBenchmarkWarmupFrames = 60;
+
+void printUsage() {
+	std::fprintf(stderr,
+		"usage: initium [--headless] [--frames N] [--dump-frames DIR] [--dump-interval N] [--sprites N] [--instances N]\n"
+		"               [--scene-geometry meshes|clusters|mesh-shaders] [--no-async-compute] [--hot-reload]\n"
+		"               [--gpu-statistics] [--hud] [--trace FILE] [--benchmark] [--benchmark-output FILE]\n"
+		"               [--asset-pack FILE] [--write-asset-pack FILE]\n"
+		"  --headless         render offscreen without a window or display\n"
+		"  --frames N         exit after N frames (headless default %llu, benchmark default %llu after warm-up)\n"
+		"  --dump-frames DIR  headless: write frames to DIR as PPM images\n"
+		"  --dump-interval N  headless: dump every Nth frame (default 1)\n"
+		"  --sprites N        sprites drawn per frame, one draw each (default %u)\n"
+		"  --instances N      GPU-driven scene of N instances, culled on the GPU\n"
+		"  --scene-geometry G draw the scene as whole meshes or culled clusters (default: the best available)\n"
+		"  --no-async-compute run every pass on the graphics queue\n"
+		"  --gpu-statistics   count primitives and shader invocations per graphics pass\n"
+		"  --hot-reload       recompile shaders when their source changes and swap in the new pipelines\n"
+		"  --hud              show the frame-time graph and counters over the frame (F10 toggles)\n"
+		"  --trace FILE       write the CPU and GPU profile to FILE at exit and on F9 (default for F9: %s);\n"
+		"                     Perfetto protobuf if FILE ends in .pftrace, else Chrome trace JSON\n"
+		"  --benchmark        fly a scripted camera path at a fixed timestep without vsync and report frame times\n"
+		"  --benchmark-output FILE\n"
+		"                     where --benchmark writes its JSON results (default benchmark.json)\n"
+		"  --asset-pack FILE  load sprite textures and scene data from FILE, building whatever it lacks\n"
+		"  --write-asset-pack FILE\n"
+		"                     write sprite textures and scene data for --instances to FILE and exit\n",
+		static_cast<unsigned long long>(kDefaultHeadlessFrames), static_cast<unsigned long long>(kDefaultBenchmarkFrames),
+		initium::RendererCreateInfo{}.spriteCount, kDefaultTracePath);
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+	bool framesGiven = false;
+	bool spritesGiven = false;
+	for (int i = 1; i < argc; i++) {
+		const char* argument = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (std::strcmp(argument, "--headless") == 0) {
+			options.headless = true;
+		} else if (std::strcmp(argument, "--frames") == 0 && value) {
+			options.frameLimit = std::strtoull(value, nullptr, 10);
+			framesGiven = true;
+			i++;
+		} else if (std::strcmp(argument, "--dump-frames") == 0 && value) {
+			options.dumpDirectory = value;
+			i++;
+		} else if (std::strcmp(argument, "--dump-interval") == 0 && value) {
+			options.dumpInterval = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+			i++;
+		} else if (std::strcmp(argument, "--sprites") == 0 && value) {
+			options.spriteCount = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+			spritesGiven = true;
+			i++;
+		} else if (std::strcmp(argument, "--instances") == 0 && value) {
+			options.instanceCount = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+			i++;
+		} else if (std::strcmp(argument, "--scene-geometry") == 0 && value) {
+			if (std::strcmp(value, "meshes") == 0) {
+				options.sceneGeometry = initium::SceneGeometry::Meshes;
+			} else if (std::strcmp(value, "clusters") == 0) {
+				options.sceneGeometry = initium::SceneGeometry::ClustersCompute;
+			} else if (std::strcmp(value, "mesh-shaders") == 0) {
+				options.sceneGeometry = initium::SceneGeometry::ClustersMeshShader;
+			} else {
+				return false;
+			}
+			i++;
+		} else if (std::strcmp(argument, "--no-async-compute") == 0) {
+			options.asyncCompute = false;
+		} else if (std::strcmp(argument, "--gpu-statistics") == 0) {
+			options.pipelineStatistics = true;
+		} else if (std::strcmp(argument, "--hot-reload") == 0) {
+			options.hotReload = true;
+		} else if (std::strcmp(argument, "--hud") == 0) {
+			options.hud = true;
+		} else if (std::strcmp(argument, "--benchmark") == 0) {
+			options.benchmark = true;
+		} else if (std::strcmp(argument, "--benchmark-output") == 0 && value) {
+			options.benchmarkOutput = value;
+			i++;
+		} else if (std::strcmp(argument, "--trace") == 0 && value) {
+			options.tracePath = value;
+			i++;
+		} else if (std::strcmp(argument, "--asset-pack") == 0 && value) {
+			options.assetPack = value;
+			i++;
+		} else if (std::strcmp(argument, "--write-asset-pack") == 0 && value) {
+			options.writeAssetPack = value;
+			i++;
+		} else {
+			return false;
+		}
+	}
+	if (!options.dumpDirectory.empty() && !options.headless) {
+		std::fprintf(stderr, "initium: --dump-frames needs --headless\n");
+		return false;
+	}
+	if (options.instanceCount > 0 && !spritesGiven) {
+		options.spriteCount = 0;
+	}
+	if (options.benchmark) {
+		options.frameLimit = (framesGiven && options.frameLimit > 0 ? options.frameLimit : kDefaultBenchmarkFrames) + kBenchmarkWarmupFrames;
+	} else if (options.headless && !framesGiven) {
+		options.frameLimit = kDefaultHeadlessFrames;
+	}
+	return true;
+}
+
+// Everything the GLFW callbacks need to reach, stored as the window user pointer.
+struct WindowState {
+	initium::FrameScheduler* scheduler = nullptr;
+	initium::Swapchain* swapchain = nullptr;
+	// Publishes a frame to the render thread. Also called from the refresh
+	// callback, which is the only code that runs while Windows holds the
+	// main thread in its modal move/resize loop.
+	std::function<void()> publishFrame;
+	std::function<void(int key)> keyPressed;
+};
+
+WindowState& windowState(GLFWwindow* window) {
+	return *static_cast<WindowState*>(glfwGetWindowUserPointer(window));
+}
+
+void installCallbacks(GLFWwindow* window) {
+	glfwSetWindowRefreshCallback(window, [](GLFWwindow* window) {
+		WindowState& state = windowState(window);
+		state.scheduler->onRefresh();
+		if (state.scheduler->isVisible() && !state.scheduler->isAwaitingRenderer()) {
+			state.publishFrame();
+		}
+	});
+	glfwSetWindowIconifyCallback(window, [](GLFWwindow* window, int iconified) {
+		windowState(window).scheduler->onIconify(iconified == GLFW_TRUE);
+	});
+	glfwSetFramebufferSizeCallback(window, [](GLFWwindow* window, int width, int height) {
+		WindowState& state = windowState(window);
+		state.scheduler->onFramebufferSize(width, height);
+		if (state.swapchain) {
+			state.swapchain->notifyResized();
+		}
+	});
+	glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int, int action, int) {
+		WindowState& state = windowState(window);
+		state.scheduler->onInput();
+		if (action == GLFW_PRESS && state.keyPressed) {
+			state.keyPressed(key);
+		}
+	});
+	glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int, int, int) {
+		windowState(window).scheduler->onInput();
+	});
+	glfwSetCursorPosCallback(window, [](GLFWwindow* window, double, double) {
+		windowState(window).scheduler->onInput();
+	});
+	glfwSetScrollCallback(window, [](GLFWwindow* window, double, double) {
+		windowState(window).scheduler->onInput();
+	});
+}
+
+}
+
+int main(int argc, char** argv) {
+	auto processStart = std::chrono::steady_clock::now();
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		printUsage();
+		return 2;
+	}
+	if (!options.writeAssetPack.empty()) {
+		initium::AssetPackWriter writer;
+		initium::Renderer::addAssets(writer, options.instanceCount);
+		if (!writer.write(options.writeAssetPack)) {
+			std::fprintf(stderr, "initium: cannot write %s\n", options.writeAssetPack.string().c_str());
+			return 1;
+		}
+		std::printf("initium: wrote %zu assets to %s\n", writer.assetCount(), options.writeAssetPack.string().c_str());
+		return 0;
+	}
+
+	INITIUM_PROFILE_THREAD("main");
+	initium::HostAllocator hostAllocator;
+	glfwInitAllocator(hostAllocator.glfwAllocator());
+	if (options.headless) {
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	}
+	if (!glfwInit()) {
+		std::fprintf(stderr, "initium: glfwInit failed\n");
+		return 1;
+	}
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	GLFWwindow* window = glfwCreateWindow(600, 400, "Initium", NULL, NULL);
 
-	while (!glfwWindowShouldClose(window)) {
-		glfwPollEvents();
+	int exitCode = 0;
+	std::optional<initium::PipelineCacheBlob> pipelineCacheBlob;
+	try {
+		// Mapped first, so the OS reads it in while the device is created.
+		std::optional<initium::AssetPack> assets;
+		if (!options.assetPack.empty()) {
+			assets.emplace(options.assetPack);
+		}
+		initium::VulkanContextCreateInfo contextInfo;
+		contextInfo.allocationCallbacks = hostAllocator.vulkanCallbacks();
+		contextInfo.requirePresentation = !options.headless;
+		initium::VulkanContext context(contextInfo);
+		initium::PipelineCache pipelineCache(context, "pipeline_cache.bin");
+		initium::GpuAllocator allocator(context);
+		initium::FrameScheduler scheduler(window);
+		initium::JobSystem jobs(0, [&scheduler] { scheduler.wake(); });
+		initium::TaskRuntime tasks(context, jobs);
+
+		std::optional<initium::Swapchain> swapchain;
+		std::optional<initium::OffscreenTarget> offscreen;
+		if (options.headless) {
+			offscreen.emplace(context, allocator);
+			offscreen->setDumpDirectory(options.dumpDirectory, options.dumpInterval);
+			scheduler.setHeadless(true);
+		} else {
+			// Benchmarks measure the renderer, not the display's refresh rate.
+			swapchain.emplace(context, window, options.benchmark ? initium::PresentPolicy::LowLatency : initium::PresentPolicy::Balanced);
+		}
+		// Moving sprites, the orbiting scene camera and the HUD's graphs
+		// change every frame; only a static picture can wait for input.
+		bool hudVisible = options.hud;
+		auto updateMode = [&] {
+			bool animating = options.headless || options.benchmark || options.spriteCount > 0 || options.instanceCount > 0 || hudVisible;
+			scheduler.setMode(animating ? initium::FrameScheduler::Mode::Continuous : initium::FrameScheduler::Mode::OnDemand);
+		};
+		updateMode();
+		initium::RendererCreateInfo rendererInfo;
+		rendererInfo.spriteCount = options.spriteCount;
+		rendererInfo.instanceCount = options.instanceCount;
+		rendererInfo.sceneGeometry = options.sceneGeometry;
+		rendererInfo.sceneCamera = options.benchmark ? initium::SceneCamera::Flythrough : initium::SceneCamera::Orbit;
+		rendererInfo.asyncCompute = options.asyncCompute;
+		rendererInfo.pipelineStatistics = options.pipelineStatistics;
+		rendererInfo.performanceHud = options.hud;
+		rendererInfo.assets = assets ? &*assets : nullptr;
+		rendererInfo.shaderHotReload = options.hotReload;
+		rendererInfo.tasks = &tasks;
+		// Wakes the loop with glfwPostEmptyEvent and asks for a frame, which
+		// swaps the rebuilt pipelines in.
+		rendererInfo.shadersReloaded = [&scheduler] { scheduler.wake(); };
+		initium::Renderer renderer = offscreen ? initium::Renderer(context, allocator, jobs, pipelineCache, *offscreen, rendererInfo)
+											   : initium::Renderer(context, allocator, jobs, pipelineCache, *swapchain, rendererInfo);
+
+		std::optional<initium::Benchmark> benchmark;
+		if (options.benchmark) {
+			benchmark.emplace(kBenchmarkWarmupFrames, options.benchmarkOutput);
+		}
+		initium::RenderThread renderThread(
+			[&renderer, &benchmark, processStart, firstFrame = true](const initium::FrameSnapshot& snapshot) mutable {
+				auto start = std::chrono::steady_clock::now();
+				renderer.renderFrame(snapshot);
+				if (firstFrame) {
+					firstFrame = false;
+					std::printf("initium: first frame submitted %.1f ms after start\n",
+						std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processStart).count());
+				}
+				if (benchmark) {
+					benchmark->frameRendered(renderer, snapshot, std::chrono::steady_clock::now() - start);
+				}
+			},
+			[&scheduler] { scheduler.frameTaken(); });
+
+		uint64_t frameNumber = 0;
+		double lastFrameTime = options.benchmark ? 0.0 : glfwGetTime();
+		auto publishFrame = [&] {
+			INITIUM_PROFILE_ZONE("publish frame");
+			auto frameStart = std::chrono::steady_clock::now();
+
+			initium::FrameSnapshot& snapshot = renderThread.snapshot();
+			snapshot.frameNumber = frameNumber++;
+			// Benchmarks step time by a fixed amount, so every run renders
+			// the same frames however fast it goes.
+			snapshot.time = options.benchmark ? static_cast<double>(snapshot.frameNumber) * initium::Benchmark::kTimestep : glfwGetTime();
+			snapshot.deltaTime = snapshot.time - lastFrameTime;
+			lastFrameTime = snapshot.time;
+			glfwGetFramebufferSize(window, &snapshot.framebufferWidth, &snapshot.framebufferHeight);
+
+			scheduler.framePublished();
+			renderThread.publish(std::chrono::steady_clock::now() - frameStart);
+		};
+
+		WindowState state;
+		state.scheduler = &scheduler;
+		state.swapchain = swapchain ? &*swapchain : nullptr;
+		state.publishFrame = publishFrame;
+		state.keyPressed = [&](int key) {
+			if (key == GLFW_KEY_F2) {
+				// Cycle 1..4 frames in flight to compare latency and throughput.
+				renderThread.pushCommand([&renderer] {
+					uint32_t count = renderer.framesInFlight() % initium::FrameRing::kMaxFramesInFlight + 1;
+					renderer.setFramesInFlight(count);
+					std::printf("renderer: %u frames in flight\n", count);
+				});
+			} else if (key == GLFW_KEY_F3) {
+				renderThread.pushCommand([&renderer] { renderer.benchmarkUploads(256ull << 20); });
+			} else if (key == GLFW_KEY_F4) {
+				renderThread.pushCommand([&renderer] { renderer.benchmarkRecording(100000); });
+			} else if (key == GLFW_KEY_F5) {
+				// Compare frame and per-pass times with and without overlap.
+				renderThread.pushCommand([&renderer] {
+					if (!renderer.asyncComputeAvailable()) {
+						std::printf("renderer: no separate compute queue\n");
+						return;
+					}
+					renderer.setAsyncCompute(!renderer.asyncCompute());
+					std::printf("renderer: async compute %s\n", renderer.asyncCompute() ? "on" : "off");
+				});
+			} else if (key == GLFW_KEY_F6) {
+				// Same draw path either way, so the difference is what culling saves.
+				renderThread.pushCommand([&renderer] {
+					if (initium::GpuScene* scene = renderer.scene()) {
+						scene->setCullingEnabled(!scene->cullingEnabled());
+						std::printf("renderer: scene culling %s\n", scene->cullingEnabled() ? "on" : "off");
+					}
+				});
+			} else if (key == GLFW_KEY_F7) {
+				// Frustum culling alone against frustum and depth pyramid.
+				renderThread.pushCommand([&renderer] {
+					if (initium::GpuScene* scene = renderer.scene()) {
+						scene->setOcclusionCullingEnabled(!scene->occlusionCullingEnabled());
+						std::printf("renderer: scene occlusion culling %s\n", scene->occlusionCullingEnabled() ? "on" : "off");
+					}
+				});
+			} else if (key == GLFW_KEY_F8) {
+				// Whole meshes, then clusters culled by compute, then by task
+				// shaders where the device has them.
+				renderThread.pushCommand([&renderer] {
+					if (initium::GpuScene* scene = renderer.scene()) {
+						auto next = static_cast<initium::SceneGeometry>((static_cast<int>(scene->geometry()) + 1) % 3);
+						if (next == initium::SceneGeometry::ClustersMeshShader && !scene->meshShadersAvailable()) {
+							next = initium::SceneGeometry::Meshes;
+						}
+						scene->setGeometry(next);
+						std::printf("renderer: scene geometry %s\n", initium::sceneGeometryName(scene->geometry()));
+					}
+				});
+			} else if (key == GLFW_KEY_F9) {
+				// Whatever the rings hold: the last few seconds of every thread.
+				initium::Profiler::writeTrace(options.tracePath.empty() ? kDefaultTracePath : options.tracePath);
+			} else if (key == GLFW_KEY_F10) {
+				hudVisible = !hudVisible;
+				updateMode();
+				renderThread.pushCommand([&renderer, visible = hudVisible] { renderer.setHudVisible(visible); });
+			}
+		};
+		glfwSetWindowUserPointer(window, &state);
+		installCallbacks(window);
+
+		// Frame recording submits jobs from the render thread every frame.
+		renderThread.pushCommand([&jobs] { jobs.registerExternalThread(); });
+		renderThread.start();
+		auto runStart = std::chrono::steady_clock::now();
+		while (!glfwWindowShouldClose(window) && (options.frameLimit == 0 || frameNumber < options.frameLimit)) {
+			renderThread.rethrowIfFailed();
+			bool frameDue = scheduler.pumpEvents();
+			{
+				INITIUM_PROFILE_ZONE("main thread jobs");
+				jobs.runMainThreadJobs();
+			}
+			if (frameDue) {
+				publishFrame();
+			}
+		}
+		if (options.headless || options.benchmark) {
+			// Let the render thread pick up the last frame before stopping it.
+			scheduler.pumpEvents();
+		}
+
+		renderThread.stop();
+		renderThread.rethrowIfFailed();
+		if (options.headless) {
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+			uint64_t frames = renderThread.timings().renderThread.count();
+			std::printf("headless: %llu frames in %.2f s, %.1f frames/s\n", static_cast<unsigned long long>(frames), seconds,
+				seconds > 0.0 ? static_cast<double>(frames) / seconds : 0.0);
+		}
+		glfwSetWindowUserPointer(window, NULL);
+		if (benchmark && !benchmark->finish(context, renderer, swapchain ? &*swapchain : nullptr)) {
+			exitCode = 1;
+		}
+		renderThread.reportTimings();
+		pipelineCache.reportStats();
+		if (assets) {
+			assets->reportStats();
+		}
+		renderer.staging().reportStats();
+		renderer.recorder().reportStats();
+		renderer.graph().reportStats();
+		renderer.bindless().reportStats();
+		if (const initium::ShaderReloader* reloader = renderer.shaderReloader()) {
+			reloader->reportStats();
+		}
+		if (renderer.scene()) {
+			renderer.scene()->reportStats();
+		}
+		allocator.reportStats();
+		jobs.reportStats();
+		tasks.reportStats();
+		initium::Profiler::reportStats();
+		// Before glfwTerminate(), which the timer frequency needs.
+		if (!options.tracePath.empty()) {
+			initium::Profiler::writeTrace(options.tracePath);
+		}
+		pipelineCacheBlob = pipelineCache.serialize();
+	} catch (const std::exception& e) {
+		std::fprintf(stderr, "initium: %s\n", e.what());
+		exitCode = 1;
 	}
 
 	glfwDestroyWindow(window);
 	glfwTerminate();
+	hostAllocator.reportStats();
+
+	if (pipelineCacheBlob && !pipelineCacheBlob->write()) {
+		std::fprintf(stderr, "initium: failed to write %s\n", pipelineCacheBlob->path.string().c_str());
+	}
 
-	return 0;
-}
\ No newline at end of file
+	return exitCode;
+}
@@ -0,0 +1,21 @@
+#version 450
+
+// One rectangle per instance, drawn as a 4-vertex strip, so the whole
+// overlay is a single instanced draw. Rectangles are in pixels from the top
+// left and come from a per-instance vertex buffer laid out like HudRect;
+// the block must match HudConstants.
+layout(push_constant) uniform Hud {
+	vec2 pixelToClip;
+} hud;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inSize;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	vec2 corner = vec2((gl_VertexIndex & 1) != 0 ? 1.0 : 0.0, (gl_VertexIndex & 2) != 0 ? 1.0 : 0.0);
+	gl_Position = vec4((inPosition + corner * inSize) * hud.pixelToClip - 1.0, 0.0, 1.0);
+	outColor = inColor;
+}
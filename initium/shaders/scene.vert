@@ -0,0 +1,23 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : require
+
+// Draws whole meshes or clusters through indexed draws. The vertex comes
+// from gl_VertexIndex, which already includes the mesh's vertexOffset, and
+// the instance from gl_InstanceIndex, which the cull passes set to the
+// instance index through firstInstance. The block must match
+// DrawConstants in GpuScene.cpp.
+#include "scene_common.glsl"
+
+layout(push_constant) uniform Scene {
+	uint viewBuffer;
+	uint instanceBuffer;
+	uint vertexBuffer;
+} scene;
+
+layout(location = 0) out vec3 outColor;
+
+void main() {
+	Instance instance = instanceBuffers[scene.instanceBuffer].instances[gl_InstanceIndex];
+	shadeVertex(scene.viewBuffer, scene.vertexBuffer, instance, uint(gl_VertexIndex), gl_Position, outColor);
+}
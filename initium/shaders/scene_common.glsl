@@ -0,0 +1,203 @@
+// Declarations shared by the scene shaders. Structs and the view buffer
+// must match GpuScene.h, Meshlets.h and ViewData in GpuScene.cpp; the
+// includer enables GL_EXT_nonuniform_qualifier.
+
+struct Instance {
+	vec3 position;
+	float scale;
+	vec4 color;
+	uint mesh;
+	float spinSpeed;
+	float spinPhase;
+	uint padding;
+};
+
+struct Mesh {
+	uint indexCount;
+	uint firstIndex;
+	int vertexOffset;
+	float radius;
+	uint meshletOffset;
+	uint meshletCount;
+	uint padding[2];
+};
+
+struct Meshlet {
+	vec3 center;
+	float radius;
+	vec3 coneAxis;
+	float coneCutoff;
+	uint vertexOffset;
+	uint triangleOffset;
+	uint vertexCount;
+	uint triangleCount;
+};
+
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+// Meshlets one task shader workgroup culls, and so how many clusters of
+// one instance a cluster group covers. Groups are launched as rows of
+// kClusterGroupsPerRow, within the smallest dispatch limit.
+const uint kClusterGroupSize = 32;
+const uint kClusterGroupsPerRow = 65535;
+
+// Views of the bindless table (BindlessTable.h).
+layout(set = 0, binding = 0) uniform texture2D textures[];
+layout(set = 0, binding = 1) uniform sampler samplers[];
+layout(set = 0, binding = 2) readonly buffer Instances { Instance instances[]; } instanceBuffers[];
+layout(set = 0, binding = 2) readonly buffer Meshes { Mesh meshes[]; } meshBuffers[];
+layout(set = 0, binding = 2) readonly buffer Meshlets { Meshlet meshlets[]; } meshletBuffers[];
+layout(set = 0, binding = 2) readonly buffer Words { uint words[]; } wordBuffers[];
+layout(set = 0, binding = 2) readonly buffer Floats { float floats[]; } floatBuffers[];
+layout(set = 0, binding = 2) readonly buffer Views {
+	mat4 viewProjection;
+	mat4 view;
+	vec4 frustumPlanes[6];
+	// P[0][0], P[1][1], near and far.
+	vec4 projection;
+	vec2 pyramidSize;
+	uint pyramidLevels;
+	float time;
+	vec4 lightDirection;
+	vec4 eye;
+} viewBuffers[];
+// Clusters to cull in each phase: the instance cull appends groups of up
+// to kClusterGroupSize meshlets of one instance, (instance, first meshlet),
+// and scene_cluster_args.comp turns their count into an indirect dispatch.
+layout(set = 0, binding = 2) buffer Clusters {
+	uint groupCount[2];
+	uint drawCount[2];
+	uint frustumCulled;
+	uint backfaceCulled;
+	uint occlusionCulled;
+	uint padding;
+	uvec4 dispatch[2];
+	uvec2 groups[];
+} clusterBuffers[];
+
+// Objects spin about their Y axis; the bounding sphere about the origin
+// doesn't change, cluster bounds do.
+mat2 spin(Instance instance, float time) {
+	float angle = time * instance.spinSpeed + instance.spinPhase;
+	return mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+}
+
+bool sphereInFrustum(uint viewBuffer, vec3 center, float radius) {
+	for (int i = 0; i < 6; i++) {
+		vec4 plane = viewBuffers[viewBuffer].frustumPlanes[i];
+		if (dot(plane.xyz, center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Screen-space bounds of a sphere in view space, looking down +z, as
+// (min u, min v, max u, max v). From "2D Polyhedral Bounds of a Clipped,
+// Perspective-Projected 3D Sphere" (Mara and McGuire, 2013). False when
+// the sphere crosses the near plane.
+bool projectSphere(vec3 center, float radius, float near, float p00, float p11, out vec4 bounds) {
+	if (center.z < radius + near) {
+		return false;
+	}
+
+	vec2 cx = -center.xz;
+	vec2 vx = vec2(sqrt(dot(cx, cx) - radius * radius), radius);
+	vec2 minX = mat2(vx.x, vx.y, -vx.y, vx.x) * cx;
+	vec2 maxX = mat2(vx.x, -vx.y, vx.y, vx.x) * cx;
+
+	vec2 cy = -center.yz;
+	vec2 vy = vec2(sqrt(dot(cy, cy) - radius * radius), radius);
+	vec2 minY = mat2(vy.x, vy.y, -vy.y, vy.x) * cy;
+	vec2 maxY = mat2(vy.x, -vy.y, vy.y, vy.x) * cy;
+
+	bounds = vec4(minX.x / minX.y * p00, minY.x / minY.y * p11, maxX.x / maxX.y * p00, maxY.x / maxY.y * p11);
+	// Clip space to texture coordinates, whose v runs down.
+	bounds = bounds.xwzy * vec4(0.5, -0.5, 0.5, -0.5) + vec4(0.5);
+	return true;
+}
+
+// Whether a world-space sphere is behind everything in the depth pyramid
+// over its screen bounds.
+bool sphereOccluded(uint viewBuffer, uint pyramidTexture, uint samplerIndex, vec3 position, float radius) {
+	vec4 projection = viewBuffers[viewBuffer].projection;
+	vec3 center = (viewBuffers[viewBuffer].view * vec4(position, 1.0)).xyz;
+	center.z = -center.z;
+
+	vec4 bounds;
+	if (!projectSphere(center, radius, projection.z, projection.x, projection.y, bounds)) {
+		return false;
+	}
+
+	// The level where the bounds span at most two texels each way, so four
+	// fetches cover them.
+	vec2 pyramidSize = viewBuffers[viewBuffer].pyramidSize;
+	vec2 size = (bounds.zw - bounds.xy) * pyramidSize;
+	int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, int(viewBuffers[viewBuffer].pyramidLevels) - 1);
+	ivec2 levelSize = max(ivec2(pyramidSize) >> level, ivec2(1));
+	ivec2 first = clamp(ivec2(floor(bounds.xy * vec2(levelSize))), ivec2(0), levelSize - 1);
+	ivec2 last = min(first + 1, levelSize - 1);
+
+	float farthest = 1.0;
+	for (int i = 0; i < 4; i++) {
+		ivec2 texel = ivec2((i & 1) != 0 ? last.x : first.x, (i & 2) != 0 ? last.y : first.y);
+		farthest = min(farthest, texelFetch(sampler2D(textures[pyramidTexture], samplers[samplerIndex]), texel, level).r);
+	}
+
+	// Reverse-Z depth of the sphere's nearest point; occluded when that is
+	// farther than everything already drawn over its bounds.
+	float near = projection.z;
+	float far = projection.w;
+	float nearest = center.z - radius;
+	float sphereDepth = near * (far - nearest) / ((far - near) * nearest);
+	return sphereDepth < farthest;
+}
+
+// 0 when the meshlet is drawn, otherwise which test culled it: 1 frustum,
+// 2 backface, 3 occlusion. The pyramid is only consulted when
+// pyramidTexture is valid.
+uint cullMeshlet(uint viewBuffer, uint pyramidTexture, uint samplerIndex, Instance instance, Meshlet meshlet) {
+	mat2 rotation = spin(instance, viewBuffers[viewBuffer].time);
+	vec3 center = meshlet.center;
+	center.xz = rotation * center.xz;
+	center = instance.position + center * instance.scale;
+	float radius = meshlet.radius * instance.scale;
+	vec3 axis = meshlet.coneAxis;
+	axis.xz = rotation * axis.xz;
+
+	if (!sphereInFrustum(viewBuffer, center, radius)) {
+		return 1;
+	}
+	vec3 toCenter = center - viewBuffers[viewBuffer].eye.xyz;
+	if (dot(toCenter, axis) >= meshlet.coneCutoff * length(toCenter) + radius) {
+		return 2;
+	}
+	if (pyramidTexture != 0xFFFFFFFF && sphereOccluded(viewBuffer, pyramidTexture, samplerIndex, center, radius)) {
+		return 3;
+	}
+	return 0;
+}
+
+// Vertex pulling: position and normal, six floats a vertex, placed and lit
+// for the instance.
+void shadeVertex(uint viewBuffer, uint vertexBuffer, Instance instance, uint vertex, out vec4 position, out vec3 color) {
+	uint base = vertex * 6;
+	vec3 local = vec3(floatBuffers[vertexBuffer].floats[base], floatBuffers[vertexBuffer].floats[base + 1],
+		floatBuffers[vertexBuffer].floats[base + 2]);
+	vec3 normal = vec3(floatBuffers[vertexBuffer].floats[base + 3], floatBuffers[vertexBuffer].floats[base + 4],
+		floatBuffers[vertexBuffer].floats[base + 5]);
+
+	mat2 rotation = spin(instance, viewBuffers[viewBuffer].time);
+	local.xz = rotation * local.xz;
+	normal.xz = rotation * normal.xz;
+
+	position = viewBuffers[viewBuffer].viewProjection * vec4(instance.position + local * instance.scale, 1.0);
+	float diffuse = max(dot(normal, -viewBuffers[viewBuffer].lightDirection.xyz), 0.0);
+	color = instance.color.rgb * (0.25 + 0.75 * diffuse);
+}
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// The bindless table (BindlessTable.h). The handles come from push
+// constants, so they are uniform across the draw.
+layout(set = 0, binding = 0) uniform texture2D textures[];
+layout(set = 0, binding = 1) uniform sampler samplers[];
+
+layout(push_constant) uniform Sprite {
+	vec2 center;
+	vec2 halfSize;
+	vec4 color;
+	uint textureIndex;
+	uint samplerIndex;
+} sprite;
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec2 inUv;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	outColor = inColor * texture(sampler2D(textures[sprite.textureIndex], samplers[sprite.samplerIndex]), inUv);
+}
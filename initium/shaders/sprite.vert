@@ -0,0 +1,23 @@
+#version 450
+
+// One quad per draw, drawn as a 4-vertex strip. Corners come from
+// gl_VertexIndex and placement from push constants, so a draw needs no
+// vertex buffers or per-draw descriptors: recording one costs a push and a
+// draw. The block must match sprite.frag and SpriteConstants.
+layout(push_constant) uniform Sprite {
+	vec2 center;
+	vec2 halfSize;
+	vec4 color;
+	uint textureIndex;
+	uint samplerIndex;
+} sprite;
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec2 outUv;
+
+void main() {
+	vec2 corner = vec2((gl_VertexIndex & 1) != 0 ? 1.0 : -1.0, (gl_VertexIndex & 2) != 0 ? 1.0 : -1.0);
+	gl_Position = vec4(sprite.center + corner * sprite.halfSize, 0.0, 1.0);
+	outColor = sprite.color;
+	outUv = corner * 0.5 + 0.5;
+}